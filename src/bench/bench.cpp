@@ -35,12 +35,15 @@ void benchmark::ConsolePrinter::result(const State& state)
         size_t mid = results.size() / 2;
         median = results[mid];
         if (0 == results.size() % 2) {
-            median = (results[mid] + results[mid + 1]) / 2;
+            median = (results[mid - 1] + results[mid]) / 2;
         }
     }
 
     std::cout << std::setprecision(6);
     std::cout << state.m_name << ", " << state.m_num_evals << ", " << state.m_num_iters << ", " << total << ", " << front << ", " << back << ", " << median << std::endl;
+    for (const auto& counter : state.counters) {
+        std::cout << "# " << state.m_name << " " << counter.first << ": " << counter.second << std::endl;
+    }
 }
 
 void benchmark::ConsolePrinter::footer() {}
@@ -89,12 +92,12 @@ benchmark::BenchRunner::BenchmarkMap& benchmark::BenchRunner::benchmarks()
     return benchmarks_map;
 }
 
-benchmark::BenchRunner::BenchRunner(std::string name, benchmark::BenchFunction func, uint64_t num_iters_for_one_second)
+benchmark::BenchRunner::BenchRunner(std::string name, benchmark::BenchFunction func, uint64_t num_iters_for_one_second, bool large_memory)
 {
-    benchmarks().insert(std::make_pair(name, Bench{func, num_iters_for_one_second}));
+    benchmarks().insert(std::make_pair(name, Bench{func, num_iters_for_one_second, large_memory}));
 }
 
-void benchmark::BenchRunner::RunAll(Printer& printer, uint64_t num_evals, double scaling, const std::string& filter, bool is_list_only)
+void benchmark::BenchRunner::RunAll(Printer& printer, uint64_t num_evals, double scaling, const std::string& filter, bool is_list_only, bool run_large_memory)
 {
     perf_init();
     if (!std::ratio_less_equal<benchmark::clock::period, std::micro>::value) {
@@ -113,6 +116,9 @@ void benchmark::BenchRunner::RunAll(Printer& printer, uint64_t num_evals, double
         if (!std::regex_match(p.first, baseMatch, reFilter)) {
             continue;
         }
+        if (p.second.large_memory && !run_large_memory) {
+            continue;
+        }
 
         uint64_t num_iters = static_cast<uint64_t>(p.second.num_iters_for_one_second * scaling);
         if (0 == num_iters) {
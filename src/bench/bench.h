@@ -60,6 +60,8 @@ public:
     const uint64_t m_num_evals;
     std::vector<double> m_elapsed_results;
     time_point m_start_time;
+    /** Extra named results, printed after the timings. */
+    std::map<std::string, double> counters;
 
     bool UpdateTimer(time_point finish_time);
 
@@ -87,14 +89,15 @@ class BenchRunner
     struct Bench {
         BenchFunction func;
         uint64_t num_iters_for_one_second;
+        bool large_memory;
     };
     typedef std::map<std::string, Bench> BenchmarkMap;
     static BenchmarkMap& benchmarks();
 
 public:
-    BenchRunner(std::string name, BenchFunction func, uint64_t num_iters_for_one_second);
+    BenchRunner(std::string name, BenchFunction func, uint64_t num_iters_for_one_second, bool large_memory = false);
 
-    static void RunAll(Printer& printer, uint64_t num_evals, double scaling, const std::string& filter, bool is_list_only);
+    static void RunAll(Printer& printer, uint64_t num_evals, double scaling, const std::string& filter, bool is_list_only, bool run_large_memory);
 };
 
 // interface to output benchmark results.
@@ -139,4 +142,8 @@ private:
 #define BENCHMARK(n, num_iters_for_one_second) \
     benchmark::BenchRunner BOOST_PP_CAT(bench_, BOOST_PP_CAT(__LINE__, n))(BOOST_PP_STRINGIZE(n), n, (num_iters_for_one_second));
 
+// BENCHMARK_LARGE_MEMORY is for benchmarks which need gigabytes of memory, they only run with -largemem.
+#define BENCHMARK_LARGE_MEMORY(n, num_iters_for_one_second) \
+    benchmark::BenchRunner BOOST_PP_CAT(bench_, BOOST_PP_CAT(__LINE__, n))(BOOST_PP_STRINGIZE(n), n, (num_iters_for_one_second), true);
+
 #endif // GENESIS_BENCH_BENCH_H
@@ -4,8 +4,10 @@
 
 #include <bench/bench.h>
 
+#include <crypto/equihash/leafhash.h>
 #include <crypto/sha256.h>
 #include <key.h>
+#include <pow.h>
 #include <validation.h>
 #include <util.h>
 #include <random.h>
@@ -33,6 +35,7 @@ main(int argc, char** argv)
                   << HelpMessageOpt("-list", _("List benchmarks without executing them. Can be combined with -scaling and -filter"))
                   << HelpMessageOpt("-evals=<n>", strprintf(_("Number of measurement evaluations to perform. (default: %u)"), DEFAULT_BENCH_EVALUATIONS))
                   << HelpMessageOpt("-filter=<regex>", strprintf(_("Regular expression filter to select benchmark by name (default: %s)"), DEFAULT_BENCH_FILTER))
+                  << HelpMessageOpt("-largemem", _("Also run the benchmarks which need several GB of memory, such as the tromp (192,7) solver"))
                   << HelpMessageOpt("-scaling=<n>", strprintf(_("Scaling factor for benchmark's runtime (default: %u)"), DEFAULT_BENCH_SCALING))
                   << HelpMessageOpt("-printer=(console|plot)", strprintf(_("Choose printer format. console: print data to console. plot: Print results as HTML graph (default: %s)"), DEFAULT_BENCH_PRINTER))
                   << HelpMessageOpt("-plot-plotlyurl=<uri>", strprintf(_("URL to use for plotly.js (default: %s)"), DEFAULT_PLOT_PLOTLYURL))
@@ -43,15 +46,18 @@ main(int argc, char** argv)
     }
 
     SHA256AutoDetect();
+    EhLeafHashAutoDetect();
     RandomInit();
     ECC_Start();
     SetupEnvironment();
     fPrintToDebugLog = false; // don't want to write to debug.log file
+    InitEquihashCache();
 
     int64_t evaluations = gArgs.GetArg("-evals", DEFAULT_BENCH_EVALUATIONS);
     std::string regex_filter = gArgs.GetArg("-filter", DEFAULT_BENCH_FILTER);
     std::string scaling_str = gArgs.GetArg("-scaling", DEFAULT_BENCH_SCALING);
     bool is_list_only = gArgs.GetBoolArg("-list", false);
+    bool run_large_memory = gArgs.GetBoolArg("-largemem", false);
 
     double scaling_factor = boost::lexical_cast<double>(scaling_str);
 
@@ -65,7 +71,7 @@ main(int argc, char** argv)
             gArgs.GetArg("-plot-height", DEFAULT_PLOT_HEIGHT)));
     }
 
-    benchmark::BenchRunner::RunAll(*printer, evaluations, scaling_factor, regex_filter, is_list_only);
+    benchmark::BenchRunner::RunAll(*printer, evaluations, scaling_factor, regex_filter, is_list_only, run_large_memory);
 
     ECC_Stop();
 }
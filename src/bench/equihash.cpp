@@ -0,0 +1,241 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <crypto/equihash/equihash.h>
+#include <pow/tromp/solver.h>
+#include <utilstrencodings.h>
+
+#include <blake2.h>
+
+#include <chrono>
+#include <fstream>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * A (192,7) solution for I = {0x00, 0x01, ..., 0x6b} and an all-zero 32-byte
+ * nonce, using the GENX_PoW personalization.
+ */
+static const char* EQUIHASH_192_7_SOLUTION =
+    "01ab4646dfd3666e31d603b8e1068edb4f3ed932b05dc6f1e41bb87a69a0491a29a49c772486c6922d690a4defaa7d9cf585"
+    "031bebe0947fcd514cfdd1d7345ead472642453e321921611304239a55414354b10f1f562125700e8c035e5ab20d17f5a262"
+    "0da1e04226bfc6650c2883f2e278a69a654c267cbd41c693302ae6dbba79539b1e2e5ead9efab7441e34d5ef66dd81f7b92a"
+    "201e8aae486ee1fa08fa001b936aaaad643121d17c9381735d5a4dacd27177323028dbe1eef9e969952771a290a04fcc97dd"
+    "0a0e029ef051989475bdb59381bfba9252cdf3560387d6ba393d95ba6e5e0f5210389f9f3ef466bb9791d97f19d689e75963"
+    "212f5b36c7dd14b910be904423bc1f85634bb5304ea954eded44ec2deffe9de17ca69dc167255dad1dc8bbd2bfa08b82c47a"
+    "0cf3a6d77c5ebee9caffdfc8246e31c52980ea6c6ed3f836972eda23debc63cccfe46ad437e322fdc34a10f60316a381ab52"
+    "260a94386b7899ee8a9ab466b3732f0abce324efae8ed1a8d333a456624b8e8e9908f72b9674250a57daca76567f59871935";
+
+/** The same header solved with the legacy SafeCash personalization. */
+static const char* EQUIHASH_192_7_SOLUTION_LEGACY =
+    "048329aa5958b0db1b7fb6b9c408a4a56bdd1db3059f5934ec1b30754549fe939e9ed994d7720b1e2ee325029875c17f39ce"
+    "0cc3806a953b033f5da47cca73121ffe1669526eebedcb73670e0c98b588621f6668b47dbdb1c507f27d45fca7ff772277f9"
+    "12f166d6826edfc277b41e3debb26b1e0524c70846c38a3a403b0c65bfec3f995fa5fb7edcb6c8772e21415edf094b78d155"
+    "14d98769cfac5553235b18a51252f379364696e2b8a79624f714f9048c4d3e0675de8f4eb0d28d4b639f4c24aa7f4481699c"
+    "05002643f86b5860ca9ea07203ce3c7da3e5c148154b8be9251d33485ef52f5818a79c00ae53839606b5c178f66380afb272"
+    "099210dd5b96918f010d94b1e1038ab220442d25dddea4041a1091ebd58abe8e51bf0f74df65e8c7761f342b4ea5c5c8c745"
+    "083394c8ed4d82c558be69a16abbb2c6f37baaea9d079aea5c0d58deeaf30589112fe7a90d847fbf6bc7a2b186b3a5c441c8"
+    "1c9eeae116bf97701ddeacd4028f58e4a824ba27c4653657451d58da770303950fc2be89abe2e040273d7e19627490d878ff";
+
+/** Number of distinct nonces the solver benchmarks cycle through. */
+static const unsigned char SOLVE_BENCH_NONCES = 8;
+
+static void InitialiseBenchState(blake2b_state& state, unsigned int n, unsigned int k, const char* personalization, unsigned char nonce = 0)
+{
+    EhInitialiseState(n, k, state, personalization);
+    unsigned char I[108];
+    for (size_t i = 0; i < sizeof(I); i++)
+        I[i] = i;
+    blake2b_update(&state, I, sizeof(I));
+    unsigned char V[32] = {};
+    V[0] = nonce;
+    blake2b_update(&state, V, sizeof(V));
+}
+
+/**
+ * Peak resident memory of the process while a benchmark runs. Linux lets us
+ * reset the high-water mark through /proc/self/clear_refs; elsewhere nothing
+ * is reported.
+ */
+class PeakMemoryTracker
+{
+private:
+    int64_t m_base_kb;
+
+    static int64_t ReadStatusKB(const std::string& field)
+    {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.compare(0, field.size(), field) == 0 && line.size() > field.size() && line[field.size()] == ':') {
+                return atoi64(line.substr(field.size() + 1));
+            }
+        }
+        return -1;
+    }
+
+public:
+    PeakMemoryTracker() : m_base_kb(-1)
+    {
+#if defined(__GLIBC__)
+        // Hand memory freed by earlier benchmarks back so it is not in the base.
+        malloc_trim(0);
+#endif
+#if defined(__linux__)
+        std::ofstream clear_refs("/proc/self/clear_refs");
+        clear_refs << "5";
+        clear_refs.close();
+        if (clear_refs.good()) {
+            m_base_kb = ReadStatusKB("VmRSS");
+        }
+#endif
+    }
+
+    /** Record the growth of the high-water mark, in MiB, on the state. */
+    void Report(benchmark::State& state) const
+    {
+        int64_t peak_kb = ReadStatusKB("VmHWM");
+        if (m_base_kb >= 0 && peak_kb >= m_base_kb) {
+            state.counters["peak_rss_mib"] = (peak_kb - m_base_kb) / 1024.0;
+        }
+    }
+};
+
+/** Solve fixed headers until the benchmark is done and report solutions per second. */
+static void RunSolveBench(benchmark::State& state, unsigned int n, unsigned int k, const std::function<size_t(const blake2b_state&)>& solve)
+{
+    std::vector<blake2b_state> headers(SOLVE_BENCH_NONCES);
+    for (unsigned char nonce = 0; nonce < SOLVE_BENCH_NONCES; nonce++) {
+        InitialiseBenchState(headers[nonce], n, k, "GENX_PoW", nonce);
+    }
+
+    uint64_t nSolves = 0;
+    uint64_t nSolutions = 0;
+    const auto start = benchmark::clock::now();
+    while (state.KeepRunning()) {
+        nSolutions += solve(headers[nSolves++ % headers.size()]);
+    }
+    const std::chrono::duration<double> elapsed = benchmark::clock::now() - start;
+    state.counters["solutions_per_second"] = nSolutions / elapsed.count();
+}
+
+static void EquihashVerifyGeneric(benchmark::State& state)
+{
+    blake2b_state eh_state;
+    InitialiseBenchState(eh_state, 192, 7, "GENX_PoW");
+    const std::vector<unsigned char> soln = ParseHex(EQUIHASH_192_7_SOLUTION);
+    while (state.KeepRunning()) {
+        bool isValid = Eh192_7.IsValidSolution(eh_state, soln);
+        assert(isValid);
+    }
+}
+
+static void EquihashVerifyFixed(benchmark::State& state)
+{
+    blake2b_state eh_state;
+    InitialiseBenchState(eh_state, 192, 7, "GENX_PoW");
+    const std::vector<unsigned char> soln = ParseHex(EQUIHASH_192_7_SOLUTION);
+    while (state.KeepRunning()) {
+        bool isValid;
+        EhIsValidSolution(192, 7, eh_state, soln, isValid);
+        assert(isValid);
+    }
+}
+
+static void EquihashVerifyFixedLegacy(benchmark::State& state)
+{
+    blake2b_state eh_state;
+    InitialiseBenchState(eh_state, 192, 7, "SafeCash");
+    const std::vector<unsigned char> soln = ParseHex(EQUIHASH_192_7_SOLUTION_LEGACY);
+    while (state.KeepRunning()) {
+        bool isValid;
+        EhIsValidSolution(192, 7, eh_state, soln, isValid);
+        assert(isValid);
+    }
+}
+
+// A header whose personalization was guessed wrong: rejected under GENX_PoW,
+// then accepted under SafeCash, as CheckBlockEquihashSolution does on a miss.
+static void EquihashVerifyBothPersonalizations(benchmark::State& state)
+{
+    blake2b_state genx_state;
+    blake2b_state legacy_state;
+    InitialiseBenchState(genx_state, 192, 7, "GENX_PoW");
+    InitialiseBenchState(legacy_state, 192, 7, "SafeCash");
+    const std::vector<unsigned char> soln = ParseHex(EQUIHASH_192_7_SOLUTION_LEGACY);
+    while (state.KeepRunning()) {
+        bool isValid;
+        EhIsValidSolution(192, 7, genx_state, soln, isValid);
+        assert(!isValid);
+        EhIsValidSolution(192, 7, legacy_state, soln, isValid);
+        assert(isValid);
+    }
+}
+
+// The list-based solvers need far more memory than we have for (192,7), so
+// they run on the smaller (96,5) instance.
+static void EquihashBasicSolve(benchmark::State& state)
+{
+    PeakMemoryTracker memory;
+    RunSolveBench(state, 96, 5, [](const blake2b_state& base) {
+        size_t nSolutions = 0;
+        EhBasicSolveUncancellable(96, 5, base, [&nSolutions](std::vector<unsigned char> soln) {
+            nSolutions++;
+            return false;
+        });
+        return nSolutions;
+    });
+    memory.Report(state);
+}
+
+static void EquihashOptimisedSolve(benchmark::State& state)
+{
+    PeakMemoryTracker memory;
+    RunSolveBench(state, 96, 5, [](const blake2b_state& base) {
+        size_t nSolutions = 0;
+        EhOptimisedSolveUncancellable(96, 5, base, [&nSolutions](std::vector<unsigned char> soln) {
+            nSolutions++;
+            return false;
+        });
+        return nSolutions;
+    });
+    memory.Report(state);
+}
+
+// The tromp solver allocates about 3.3GB of heaps for (192,7), so these
+// benchmarks only run with -largemem.
+static void TrompSolveBench(benchmark::State& state, unsigned int nThreads)
+{
+    PeakMemoryTracker memory;
+    CTrompSolver solver(nThreads);
+    RunSolveBench(state, 192, 7, [&solver](const blake2b_state& base) {
+        return solver.Solve(base, [](std::vector<unsigned char> soln) { return false; });
+    });
+    memory.Report(state);
+    state.counters["allocated_mib"] = solver.DynamicMemoryUsage() / (1024.0 * 1024.0);
+}
+
+static void EquihashTrompSolve(benchmark::State& state)
+{
+    TrompSolveBench(state, 1);
+}
+
+static void EquihashTrompSolveTwoThreads(benchmark::State& state)
+{
+    TrompSolveBench(state, 2);
+}
+
+BENCHMARK(EquihashVerifyGeneric, 10 * 1000);
+BENCHMARK(EquihashVerifyFixed, 18 * 1000);
+BENCHMARK(EquihashVerifyFixedLegacy, 18 * 1000);
+BENCHMARK(EquihashVerifyBothPersonalizations, 9 * 1000);
+BENCHMARK(EquihashBasicSolve, 8);
+BENCHMARK(EquihashOptimisedSolve, 8);
+BENCHMARK_LARGE_MEMORY(EquihashTrompSolve, 1);
+BENCHMARK_LARGE_MEMORY(EquihashTrompSolveTwoThreads, 1);
@@ -4,6 +4,21 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <chain.h>
+#include <txdb.h>
+#include <validation.h>
+
+#include <stdexcept>
+
+std::vector<unsigned char> CBlockIndex::GetSolution() const
+{
+    if (!fSolutionTrimmed)
+        return nSolution;
+
+    std::vector<unsigned char> solution;
+    if (!pblocktree || !pblocktree->ReadBlockSolution(GetBlockHash(), solution))
+        throw std::runtime_error(strprintf("%s: failed to read solution of block %s", __func__, GetBlockHash().ToString()));
+    return solution;
+}
 
 /**
  * CChain implementation
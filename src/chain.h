@@ -213,14 +213,28 @@ public:
     uint32_t nTime;
     uint32_t nBits;
     uint256 nNonce;
+
+    //! Equihash solution. Only held in memory until the entry has been written
+    //! to the block tree database; use GetSolution() to read it.
     std::vector<unsigned char> nSolution;
 
+    //! (memory only) Whether nSolution has been released and must be read back from disk.
+    bool fSolutionTrimmed;
+
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     int32_t nSequenceId;
 
     //! (memory only) Maximum nTime in the chain up to and including this block.
     unsigned int nTimeMax;
 
+    //! (memory only) LWMA prefix sums over the chain up to and including this
+    //! block, maintained by LwmaUpdateAccumulators(). Unsigned so that they
+    //! wrap; only differences between two blocks are meaningful.
+    uint64_t nLwmaSolvetimeSum;
+    uint64_t nLwmaWeightedSolvetimeSum;
+    arith_uint256 nLwmaTargetSum;
+    bool fHaveLwmaSums;
+
     void SetNull()
     {
         phashBlock = nullptr;
@@ -236,6 +250,10 @@ public:
         nStatus = 0;
         nSequenceId = 0;
         nTimeMax = 0;
+        nLwmaSolvetimeSum = 0;
+        nLwmaWeightedSolvetimeSum = 0;
+        nLwmaTargetSum = arith_uint256();
+        fHaveLwmaSums = false;
 
         nVersion       = 0;
         hashMerkleRoot = uint256();
@@ -244,6 +262,7 @@ public:
         nBits          = 0;
         nNonce         = uint256();
         nSolution.clear();
+        fSolutionTrimmed = false;
     }
 
     CBlockIndex()
@@ -295,10 +314,22 @@ public:
         block.nTime          = nTime;
         block.nBits          = nBits;
         block.nNonce         = nNonce;
-        block.nSolution      = nSolution;
+        block.nSolution      = GetSolution();
         return block;
     }
 
+    //! Return the Equihash solution, reading it from the block tree database
+    //! if it is no longer held in memory. Requires cs_main.
+    std::vector<unsigned char> GetSolution() const;
+
+    //! Release the in-memory solution once the entry is stored in the block
+    //! tree database. Requires cs_main.
+    void TrimSolution()
+    {
+        std::vector<unsigned char>().swap(nSolution);
+        fSolutionTrimmed = true;
+    }
+
     uint256 GetBlockHash() const
     {
         return *phashBlock;
@@ -388,6 +419,10 @@ public:
 
     explicit CDiskBlockIndex(const CBlockIndex* pindex) : CBlockIndex(*pindex) {
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256());
+        if (fSolutionTrimmed) {
+            nSolution = pindex->GetSolution();
+            fSolutionTrimmed = false;
+        }
     }
 
     ADD_SERIALIZE_METHODS;
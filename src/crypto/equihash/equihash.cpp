@@ -17,6 +17,7 @@
 #endif
 
 #include "crypto/equihash/equihash.h"
+#include "crypto/equihash/leafhash.h"
 
 #ifndef NO_UTIL_LOG
 #include "util.h"
@@ -782,6 +783,89 @@ bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<
     return X[0].IsZero(hashLen);
 }
 
+template<unsigned int N, unsigned int K>
+bool EquihashFixedVerifier<N,K>::IsValidSolution(const eh_HashState& base_state, const unsigned char* soln, size_t solnLen)
+{
+    if (solnLen != SolutionWidth) {
+        return false;
+    }
+
+    // Expand the minimal representation into its IndexBitLength-bit big-endian indices.
+    eh_index indices[ProofSize];
+    uint64_t acc_value = 0;
+    size_t acc_bits = 0;
+    size_t j = 0;
+    for (size_t i = 0; i < SolutionWidth; i++) {
+        acc_value = (acc_value << 8) | soln[i];
+        acc_bits += 8;
+        if (acc_bits >= IndexBitLength) {
+            acc_bits -= IndexBitLength;
+            indices[j++] = (acc_value >> acc_bits) & (((eh_index)1 << IndexBitLength) - 1);
+        }
+    }
+    assert(j == ProofSize);
+
+    // The index tree must be ordered: at every level the leftmost index of the
+    // left subtree is smaller than the leftmost index of the right subtree.
+    // Ties are duplicates, which are rejected below.
+    for (size_t width = 1; width < ProofSize; width *= 2) {
+        for (size_t i = 0; i < ProofSize; i += 2*width) {
+            if (indices[i+width] < indices[i]) {
+                return false;
+            }
+        }
+    }
+
+    // All indices must be distinct, which is equivalent to the subtrees being
+    // disjoint at every level.
+    eh_index sorted[ProofSize];
+    std::copy(indices, indices+ProofSize, sorted);
+    std::sort(sorted, sorted+ProofSize);
+    if (std::adjacent_find(sorted, sorted+ProofSize) != sorted+ProofSize) {
+        return false;
+    }
+
+    // The collision length is byte aligned, so each row is just the slice of
+    // the BLAKE2b output belonging to its index.
+    // All leaves are hashed in one batch so they can share SIMD lanes.
+    eh_index blocks[ProofSize];
+    for (size_t i = 0; i < ProofSize; i++) {
+        blocks[i] = indices[i] / IndicesPerHashOutput;
+    }
+    unsigned char hashes[ProofSize][HashOutput];
+    CEhLeafHasher(base_state, HashOutput).Hash(blocks, ProofSize, hashes[0]);
+
+    unsigned char rows[ProofSize][HashLength];
+    for (size_t i = 0; i < ProofSize; i++) {
+        memcpy(rows[i], hashes[i]+((indices[i] % IndicesPerHashOutput) * N/8), HashLength);
+    }
+
+    // Collide pairs in place. After round r, row p holds the XOR of subtree p
+    // and bytes [0, (r+1)*CollisionByteLength) are no longer looked at.
+    size_t count = ProofSize;
+    for (size_t r = 0; r < K; r++) {
+        const size_t pos = r*CollisionByteLength;
+        for (size_t p = 0; p < count/2; p++) {
+            const unsigned char* a = rows[2*p];
+            const unsigned char* b = rows[2*p+1];
+            if (memcmp(a+pos, b+pos, CollisionByteLength) != 0) {
+                return false;
+            }
+            for (size_t x = pos+CollisionByteLength; x < HashLength; x++) {
+                rows[p][x] = a[x] ^ b[x];
+            }
+        }
+        count /= 2;
+    }
+
+    for (size_t x = K*CollisionByteLength; x < HashLength; x++) {
+        if (rows[0][x] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
 // Explicit instantiations for Equihash<96,3>
 template int Equihash<96,3>::InitialiseState(eh_HashState& base_state, const std::string personalizationString);
 template bool Equihash<96,3>::BasicSolve(const eh_HashState& base_state,
@@ -830,3 +914,7 @@ template bool Equihash<192,7>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 template bool Equihash<192,7>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+
+// Explicit instantiations for EquihashFixedVerifier
+template class EquihashFixedVerifier<96,5>;
+template class EquihashFixedVerifier<192,7>;
@@ -194,6 +194,34 @@ public:
 
 #include "equihash.tcc"
 
+/**
+ * Verifier for Equihash parameters whose collision length is a whole number of
+ * bytes, such as our (192,7). Expands the minimal solution into fixed-size
+ * stack arrays and does the ordering, duplicate and XOR checks in place, so a
+ * verification never touches the heap. Accepts exactly the same solutions as
+ * Equihash<N,K>::IsValidSolution.
+ */
+template<unsigned int N, unsigned int K>
+class EquihashFixedVerifier
+{
+private:
+    BOOST_STATIC_ASSERT(K < N);
+    BOOST_STATIC_ASSERT((N/(K+1)) % 8 == 0);
+    BOOST_STATIC_ASSERT((N/(K+1)) + 1 < 8*sizeof(eh_index));
+
+public:
+    enum : size_t { IndicesPerHashOutput=512/N };
+    enum : size_t { HashOutput=IndicesPerHashOutput*N/8 };
+    enum : size_t { CollisionBitLength=N/(K+1) };
+    enum : size_t { CollisionByteLength=CollisionBitLength/8 };
+    enum : size_t { HashLength=(K+1)*CollisionByteLength };
+    enum : size_t { IndexBitLength=CollisionBitLength+1 };
+    enum : size_t { ProofSize=(size_t)1 << K };
+    enum : size_t { SolutionWidth=ProofSize*IndexBitLength/8 };
+
+    static bool IsValidSolution(const eh_HashState& base_state, const unsigned char* soln, size_t solnLen);
+};
+
 static Equihash<96,3> Eh96_3;
 static Equihash<200,9> Eh200_9;
 static Equihash<96,5> Eh96_5;
@@ -276,8 +304,8 @@ inline bool EhOptimisedSolveUncancellable(unsigned int n, unsigned int k, const
         ret = Eh96_5.IsValidSolution(base_state, soln);  \
     } else if (n == 48 && k == 5) {                      \
         ret = Eh48_5.IsValidSolution(base_state, soln);  \
-    } else if (n == 192 && k == 7) {                      \
-        ret = Eh192_7.IsValidSolution(base_state, soln);  \
+    } else if (n == 192 && k == 7) {                     \
+        ret = EquihashFixedVerifier<192,7>::IsValidSolution(base_state, (soln).data(), (soln).size()); \
     } else {                                             \
         throw std::invalid_argument("Unsupported Equihash parameters"); \
     }
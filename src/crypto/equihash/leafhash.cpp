@@ -0,0 +1,278 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/equihash/leafhash.h"
+#include "crypto/common.h"
+
+#include <assert.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__amd64__)
+#if defined(ENABLE_SSE41) || defined(ENABLE_AVX2)
+#include <cpuid.h>
+#endif
+#if defined(ENABLE_SSE41)
+namespace eh_leafhash_sse41
+{
+void Finish_2way(const CEhLeafHasher& hasher, const uint32_t* indices, unsigned char* out);
+}
+#endif
+#if defined(ENABLE_AVX2)
+namespace eh_leafhash_avx2
+{
+void Finish_4way(const CEhLeafHasher& hasher, const uint32_t* indices, unsigned char* out);
+}
+#endif
+#endif
+
+// Internal implementation code.
+namespace
+{
+/// Internal BLAKE2b compression, matching libb2 bit for bit.
+namespace eh_leafhash
+{
+const uint64_t IV[8] = {
+    0x6a09e667f3bcc908ull, 0xbb67ae8584caa73bull, 0x3c6ef372fe94f82bull, 0xa54ff53a5f1d36f1ull,
+    0x510e527fade682d1ull, 0x9b05688c2b3e6c1full, 0x1f83d9abfb41bd6bull, 0x5be0cd19137e2179ull
+};
+
+const unsigned char SIGMA[12][16] = {
+    { 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15},
+    {14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3},
+    {11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4},
+    { 7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8},
+    { 9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13},
+    { 2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9},
+    {12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11},
+    {13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10},
+    { 6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5},
+    {10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0},
+    { 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15},
+    {14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3}
+};
+
+uint64_t inline Rotr(uint64_t x, int n) { return (x >> n) | (x << (64 - n)); }
+
+void inline G(uint64_t& a, uint64_t& b, uint64_t& c, uint64_t& d, uint64_t x, uint64_t y)
+{
+    a = a + b + x;
+    d = Rotr(d ^ a, 32);
+    c = c + d;
+    b = Rotr(b ^ c, 24);
+    a = a + b + y;
+    d = Rotr(d ^ a, 16);
+    c = c + d;
+    b = Rotr(b ^ c, 63);
+}
+
+/** Compress one block; t is the message length up to and including it. */
+void Compress(uint64_t* h, const uint64_t* m, uint64_t t, bool last)
+{
+    uint64_t v[16];
+    for (int i = 0; i < 8; i++) {
+        v[i] = h[i];
+        v[i + 8] = IV[i];
+    }
+    v[12] ^= t;
+    if (last) v[14] = ~v[14];
+
+    for (int r = 0; r < 12; r++) {
+        const unsigned char* s = SIGMA[r];
+        G(v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]);
+        G(v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]);
+        G(v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]);
+        G(v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]);
+        G(v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]);
+        G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+        G(v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]);
+        G(v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        h[i] ^= v[i] ^ v[i + 8];
+    }
+}
+
+void Finish_1way(const CEhLeafHasher& hasher, const uint32_t* indices, unsigned char* out)
+{
+    uint64_t m[16];
+    memcpy(m, hasher.Block(), sizeof(m));
+    m[hasher.IndexWord()] |= (uint64_t)indices[0] << hasher.IndexShift();
+    uint64_t s[8];
+    memcpy(s, hasher.ChainingValue(), sizeof(s));
+    Compress(s, m, hasher.Length(), true);
+
+    unsigned char digest[BLAKE2B_OUTBYTES];
+    for (int i = 0; i < 8; i++) {
+        WriteLE64(digest + 8 * i, s[i]);
+    }
+    memcpy(out, digest, hasher.OutputLength());
+}
+
+} // namespace eh_leafhash
+
+typedef void (*FinishType)(const CEhLeafHasher&, const uint32_t*, unsigned char*);
+
+FinishType Finish = eh_leafhash::Finish_1way;
+size_t FinishLanes = 1;
+
+bool SelfTest(FinishType finish, size_t lanes)
+{
+    // BLAKE2b-384 of the bytes 0..11 followed by a zero index.
+    static const unsigned char out0[48] = {
+        0x3e, 0x4b, 0xad, 0xcc, 0xfd, 0x7e, 0xea, 0x0b, 0x4e, 0x66, 0x7c, 0xac, 0xd7, 0x4c, 0x62, 0x5f,
+        0x6b, 0x4e, 0x18, 0xac, 0x77, 0xc2, 0xef, 0xca, 0x3c, 0x9b, 0xe4, 0x34, 0xed, 0x39, 0xb3, 0x1c,
+        0x5e, 0x60, 0xbf, 0x08, 0xa5, 0xcd, 0xf8, 0x9c, 0x81, 0x3b, 0x90, 0xbb, 0x15, 0xba, 0x81, 0xda
+    };
+    static const uint32_t indices[CEhLeafHasher::MAX_LANES] = {0, 1, 0x01ffffff, 0xffffffff};
+
+    blake2b_state state;
+    memset(&state, 0, sizeof(state));
+    memcpy(state.h, eh_leafhash::IV, sizeof(state.h));
+    state.h[0] ^= 0x01010000 ^ sizeof(out0);
+    for (int i = 0; i < 12; i++) {
+        state.buf[i] = i;
+    }
+    state.buflen = 12;
+    CEhLeafHasher hasher(state, sizeof(out0));
+
+    unsigned char expected[CEhLeafHasher::MAX_LANES][48];
+    for (size_t i = 0; i < CEhLeafHasher::MAX_LANES; i++) {
+        eh_leafhash::Finish_1way(hasher, indices + i, expected[i]);
+    }
+    if (memcmp(expected[0], out0, sizeof(out0))) return false;
+
+    unsigned char result[CEhLeafHasher::MAX_LANES][48];
+    for (size_t i = 0; i + lanes <= CEhLeafHasher::MAX_LANES; i += lanes) {
+        finish(hasher, indices + i, result[i]);
+        if (memcmp(result[i], expected[i], lanes * sizeof(out0))) return false;
+    }
+    return true;
+}
+
+#if defined(__x86_64__) || defined(__amd64__)
+#if defined(ENABLE_SSE41) || defined(ENABLE_AVX2)
+/** Check that the operating system saves the YMM registers. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+#endif
+
+} // namespace
+
+CEhLeafHasher::CEhLeafHasher(const blake2b_state& base_state, size_t outlenIn) :
+    t(0), indexWord(0), indexShift(0), outlen(outlenIn), fFallback(true), base(base_state)
+{
+    assert(outlen > 0 && outlen <= BLAKE2B_OUTBYTES);
+    if (base_state.f[0] || base_state.t[1] || base_state.last_node) {
+        return;
+    }
+
+    // libb2 keeps between zero and two blocks of input buffered depending on
+    // the version, but h and t always describe everything before buf.
+    memcpy(h, base_state.h, sizeof(h));
+    uint64_t counter = base_state.t[0];
+    const unsigned char* data = base_state.buf;
+    size_t pending = base_state.buflen;
+    while (pending >= BLAKE2B_BLOCKBYTES) {
+        uint64_t block[16];
+        for (int i = 0; i < 16; i++) {
+            block[i] = ReadLE64(data + 8 * i);
+        }
+        counter += BLAKE2B_BLOCKBYTES;
+        eh_leafhash::Compress(h, block, counter, false);
+        data += BLAKE2B_BLOCKBYTES;
+        pending -= BLAKE2B_BLOCKBYTES;
+    }
+
+    // The index must land in one message word of the final block.
+    if (pending + sizeof(uint32_t) > BLAKE2B_BLOCKBYTES || pending % 8 > 4) {
+        return;
+    }
+    unsigned char last[BLAKE2B_BLOCKBYTES] = {};
+    memcpy(last, data, pending);
+    for (int i = 0; i < 16; i++) {
+        m[i] = ReadLE64(last + 8 * i);
+    }
+    t = counter + pending + sizeof(uint32_t);
+    indexWord = pending / 8;
+    indexShift = (pending % 8) * 8;
+    fFallback = false;
+}
+
+void CEhLeafHasher::Hash(const uint32_t* indices, size_t count, unsigned char* out) const
+{
+    if (fFallback) {
+        for (size_t i = 0; i < count; i++) {
+            blake2b_state state = base;
+            unsigned char lei[4];
+            WriteLE32(lei, indices[i]);
+            blake2b_update(&state, lei, sizeof(lei));
+            blake2b_final(&state, out + i * outlen, outlen);
+        }
+        return;
+    }
+
+    size_t i = 0;
+    if (FinishLanes > 1) {
+        for (; i + FinishLanes <= count; i += FinishLanes) {
+            Finish(*this, indices + i, out + i * outlen);
+        }
+    }
+    for (; i < count; i++) {
+        eh_leafhash::Finish_1way(*this, indices + i, out + i * outlen);
+    }
+}
+
+std::string EhLeafHashAutoDetect()
+{
+    assert(SelfTest(eh_leafhash::Finish_1way, 1));
+
+#if defined(__x86_64__) || defined(__amd64__)
+#if defined(ENABLE_SSE41) || defined(ENABLE_AVX2)
+    bool have_sse4 = false;
+    bool have_avx2 = false;
+    bool enabled_avx = false;
+    uint32_t eax, ebx, ecx, edx;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        have_sse4 = (ecx >> 19) & 1;
+        bool have_xsave = (ecx >> 27) & 1;
+        bool have_avx = (ecx >> 28) & 1;
+        if (have_xsave && have_avx) {
+            enabled_avx = AVXEnabled();
+        }
+        if (__get_cpuid_max(0, nullptr) >= 7) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            have_avx2 = (ebx >> 5) & 1;
+        }
+    }
+    (void)have_sse4;
+    (void)have_avx2;
+    (void)enabled_avx;
+
+#if defined(ENABLE_AVX2)
+    if (have_avx2 && enabled_avx) {
+        Finish = eh_leafhash_avx2::Finish_4way;
+        FinishLanes = 4;
+        assert(SelfTest(Finish, FinishLanes));
+        return "avx2(4way)";
+    }
+#endif
+#if defined(ENABLE_SSE41)
+    if (have_sse4) {
+        Finish = eh_leafhash_sse41::Finish_2way;
+        FinishLanes = 2;
+        assert(SelfTest(Finish, FinishLanes));
+        return "sse41(2way)";
+    }
+#endif
+#endif
+#endif
+
+    return "standard";
+}
@@ -0,0 +1,66 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef GENESIS_CRYPTO_EQUIHASH_LEAFHASH_H
+#define GENESIS_CRYPTO_EQUIHASH_LEAFHASH_H
+
+#include "blake2.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/** Batched generation of Equihash leaf hashes.
+ *
+ *  Every leaf is BLAKE2b(header || le32(index)) with the same personalised
+ *  parameter block, so everything up to the block holding the index is shared.
+ *  CEhLeafHasher compresses the shared prefix once and then finishes many
+ *  indices at a time, one per 64-bit SIMD lane when the CPU allows it.
+ */
+class CEhLeafHasher
+{
+private:
+    /** Chaining value after every index-independent block. */
+    uint64_t h[8];
+    /** Message words of the final block, with the index bits cleared. */
+    uint64_t m[16];
+    /** Total message length, including the index. */
+    uint64_t t;
+    /** Position of the little-endian index inside m. */
+    unsigned int indexWord;
+    unsigned int indexShift;
+    /** Digest length in bytes. */
+    size_t outlen;
+    /** Unsupported state layout; every leaf goes through libb2 instead. */
+    bool fFallback;
+    blake2b_state base;
+
+public:
+    /** Largest number of leaves a single kernel call finishes. */
+    static const size_t MAX_LANES = 4;
+
+    /** Capture base_state, which must not have been finalised. outlen is the
+     *  digest length the state was initialised with. */
+    CEhLeafHasher(const blake2b_state& base_state, size_t outlen);
+
+    /** Write the outlen-byte digest of each of the count indices to
+     *  out + i * outlen. */
+    void Hash(const uint32_t* indices, size_t count, unsigned char* out) const;
+
+    size_t OutputLength() const { return outlen; }
+
+    /** Kernels see the raw fields; they all share this layout. */
+    const uint64_t* ChainingValue() const { return h; }
+    const uint64_t* Block() const { return m; }
+    uint64_t Length() const { return t; }
+    unsigned int IndexWord() const { return indexWord; }
+    unsigned int IndexShift() const { return indexShift; }
+};
+
+/** Autodetect the best available leaf hashing kernel.
+ *  Returns the name of the implementation.
+ */
+std::string EhLeafHashAutoDetect();
+
+#endif // GENESIS_CRYPTO_EQUIHASH_LEAFHASH_H
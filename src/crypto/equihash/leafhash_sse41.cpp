@@ -0,0 +1,112 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// This is a translation to SSE4.1 intrinsics of the BLAKE2b compression in
+// leafhash.cpp, with one leaf per 64-bit lane.
+
+#ifdef ENABLE_SSE41
+
+#include "crypto/equihash/leafhash.h"
+#include "crypto/common.h"
+
+#include <smmintrin.h>
+#include <string.h>
+
+namespace eh_leafhash_sse41 {
+namespace {
+
+const unsigned char SIGMA[12][16] = {
+    { 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15},
+    {14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3},
+    {11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4},
+    { 7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8},
+    { 9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13},
+    { 2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9},
+    {12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11},
+    {13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10},
+    { 6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5},
+    {10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0},
+    { 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15},
+    {14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3}
+};
+
+const uint64_t IV[8] = {
+    0x6a09e667f3bcc908ull, 0xbb67ae8584caa73bull, 0x3c6ef372fe94f82bull, 0xa54ff53a5f1d36f1ull,
+    0x510e527fade682d1ull, 0x9b05688c2b3e6c1full, 0x1f83d9abfb41bd6bull, 0x5be0cd19137e2179ull
+};
+
+__m128i inline K(uint64_t x) { return _mm_set1_epi64x(x); }
+__m128i inline Add(__m128i x, __m128i y) { return _mm_add_epi64(x, y); }
+__m128i inline Xor(__m128i x, __m128i y) { return _mm_xor_si128(x, y); }
+
+__m128i inline Rotr32(__m128i x) { return _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)); }
+__m128i inline Rotr24(__m128i x) { return _mm_shuffle_epi8(x, _mm_setr_epi8(3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10)); }
+__m128i inline Rotr16(__m128i x) { return _mm_shuffle_epi8(x, _mm_setr_epi8(2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9)); }
+__m128i inline Rotr63(__m128i x) { return _mm_or_si128(_mm_srli_epi64(x, 63), _mm_add_epi64(x, x)); }
+
+void inline G(__m128i& a, __m128i& b, __m128i& c, __m128i& d, __m128i x, __m128i y)
+{
+    a = Add(Add(a, b), x);
+    d = Rotr32(Xor(d, a));
+    c = Add(c, d);
+    b = Rotr24(Xor(b, c));
+    a = Add(Add(a, b), y);
+    d = Rotr16(Xor(d, a));
+    c = Add(c, d);
+    b = Rotr63(Xor(b, c));
+}
+
+} // namespace
+
+void Finish_2way(const CEhLeafHasher& hasher, const uint32_t* indices, unsigned char* out)
+{
+    const uint64_t* h = hasher.ChainingValue();
+    const uint64_t* block = hasher.Block();
+    const unsigned int word = hasher.IndexWord();
+    const unsigned int shift = hasher.IndexShift();
+
+    __m128i m[16];
+    for (int i = 0; i < 16; i++) {
+        m[i] = K(block[i]);
+    }
+    m[word] = _mm_set_epi64x(block[word] | (uint64_t)indices[1] << shift, block[word] | (uint64_t)indices[0] << shift);
+
+    __m128i v[16];
+    for (int i = 0; i < 8; i++) {
+        v[i] = K(h[i]);
+        v[i + 8] = K(IV[i]);
+    }
+    v[12] = K(IV[4] ^ hasher.Length());
+    v[14] = K(~IV[6]);
+
+    for (int r = 0; r < 12; r++) {
+        const unsigned char* s = SIGMA[r];
+        G(v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]);
+        G(v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]);
+        G(v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]);
+        G(v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]);
+        G(v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]);
+        G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+        G(v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]);
+        G(v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]);
+    }
+
+    alignas(16) uint64_t lanes[8][2];
+    for (int i = 0; i < 8; i++) {
+        _mm_store_si128((__m128i*)lanes[i], Xor(K(h[i]), Xor(v[i], v[i + 8])));
+    }
+
+    const size_t outlen = hasher.OutputLength();
+    for (int l = 0; l < 2; l++) {
+        unsigned char digest[BLAKE2B_OUTBYTES];
+        for (int i = 0; i < 8; i++) {
+            WriteLE64(digest + 8 * i, lanes[i][l]);
+        }
+        memcpy(out + l * outlen, digest, outlen);
+    }
+}
+
+} // namespace eh_leafhash_sse41
+
+#endif
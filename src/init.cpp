@@ -17,6 +17,7 @@
 #include <checkpoints.h>
 #include <compat/sanity.h>
 #include <consensus/validation.h>
+#include <crypto/equihash/leafhash.h>
 #include <fs.h>
 #include <httpserver.h>
 #include <httprpc.h>
@@ -30,6 +31,7 @@
 #include <policy/feerate.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
+#include <pow.h>
 #include <rpc/server.h>
 #include <rpc/register.h>
 #include <rpc/safemode.h>
@@ -37,6 +39,7 @@
 #include <script/standard.h>
 #include <script/sigcache.h>
 #include <scheduler.h>
+#include <stratum.h>
 #include <timedata.h>
 #include <txdb.h>
 #include <txmempool.h>
@@ -57,6 +60,7 @@
 #include <masternodes/masternode-sync.h>
 #include <masternodes/masternodeman.h>
 #include <masternodes/masternodeconfig.h>
+#include <masternodes/messagequeue.h>
 #include <masternodes/messagesigner.h>
 
 #include <stdint.h>
@@ -177,6 +181,8 @@ void Interrupt()
     InterruptRPC();
     InterruptREST();
     InterruptTorControl();
+    InterruptStratumServer();
+    mnmessagequeue.Interrupt();
     if (g_connman)
         g_connman->Interrupt();
 }
@@ -200,6 +206,7 @@ void Shutdown()
     StopREST();
     StopRPC();
     StopHTTPServer();
+    StopStratumServer();
 #ifdef ENABLE_WALLET
     FlushWallets();
 #endif
@@ -208,15 +215,15 @@ void Shutdown()
     // Because these depend on each-other, we make sure that neither can be
     // using the other before destroying them.
     if (peerLogic) UnregisterValidationInterface(peerLogic.get());
+    mnmessagequeue.Stop();
     if (g_connman) g_connman->Stop();
     peerLogic.reset();
     g_connman.reset();
   
     // STORE DATA CACHES INTO SERIALIZED DAT FILES
     if (!fLiteMode) {
-        // #2b*: Disable writing to the mncache file... because it is broken in ways I can't track down... yet 
-        // CFlatDB<CMasternodeMan> flatdb1("mncache.dat", "magicMasternodeCache");
-        // flatdb1.Dump(mnodeman);
+        CFlatDB<CMasternodeMan> flatdb1("mncache.dat", "magicMasternodeCache");
+        flatdb1.Dump(mnodeman);
         CFlatDB<CMasternodePayments> flatdb2("mnpayments.dat", "magicMasternodePaymentsCache");
         flatdb2.Dump(mnpayments);
         CFlatDB<CGovernanceManager> flatdb3("governance.dat", "magicGovernanceCache");
@@ -379,6 +386,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     if (showDebug) {
         strUsage += HelpMessageOpt("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize));
+        strUsage += HelpMessageOpt("-trustblockindexhashes", strprintf("Take header hashes from the block index database keys at startup instead of rehashing every header (default: %u)", DEFAULT_TRUST_BLOCK_INDEX_HASHES));
     }
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
     if (showDebug)
@@ -393,7 +401,7 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Whether to save the mempool on shutdown and load on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
     strUsage += HelpMessageOpt("-blockreconstructionextratxn=<n>", strprintf(_("Extra transactions to keep in memory for compact block reconstructions (default: %u)"), DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN));
-    strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
+    strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script and header verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), GENESIS_PID_FILENAME));
@@ -468,6 +476,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), DEFAULT_CHECKLEVEL));
         strUsage += HelpMessageOpt("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. Also sets -checkmempool (default: %u)", defaultChainParams->DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", defaultChainParams->DefaultConsistencyChecks()));
+        strUsage += HelpMessageOpt("-checkmasternodes", strprintf("Check the masternode list counters against a full scan after every list check (default: %u)", defaultChainParams->DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkpoints", strprintf("Disable expensive verification for known chain history (default: %u)", DEFAULT_CHECKPOINTS_ENABLED));
         strUsage += HelpMessageOpt("-disablesafemode", strprintf("Disable safemode, override a real safe mode event (default: %u)", DEFAULT_DISABLE_SAFEMODE));
         strUsage += HelpMessageOpt("-deprecatedrpc=<method>", "Allows deprecated RPC method(s) to be used");
@@ -495,6 +504,8 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-logtimemicros", strprintf("Add microsecond precision to debug timestamps (default: %u)", DEFAULT_LOGTIMEMICROS));
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
         strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit sum of signature cache and script execution cache sizes to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-maxequihashcachesize=<n>", strprintf("Limit the verified Equihash solution cache to <n> MiB (default: %u)", DEFAULT_MAX_EQUIHASH_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-maxmnsigcachesize=<n>", strprintf("Limit the verified masternode and governance signature cache to <n> MiB (default: %u)", DEFAULT_MAX_MASTERNODE_SIG_CACHE_SIZE));
         strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     }
     strUsage += HelpMessageOpt("-maxtxfee=<amt>", strprintf(_("Maximum total fees (in %s) to use in a single wallet transaction or raw transaction; setting this too low may abort large transactions (default: %s)"),
@@ -514,6 +525,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-mnconf=<file>", strprintf(_("Specify masternode configuration file (default: %s)"), "masternode.conf"));
     strUsage += HelpMessageOpt("-mnconflock=<n>", strprintf(_("Lock masternodes from masternode configuration file (default: %u)"), 1));
     strUsage += HelpMessageOpt("-masternodeprivkey=<n>", _("Set the masternode private key"));
+    strUsage += HelpMessageOpt("-mnsigthreads=<n>", strprintf(_("Check masternode and governance message signatures on <n> threads, 0 = on the message handler thread (0 to %d, default: %d)"), MAX_MASTERNODE_SIG_THREADS, DEFAULT_MASTERNODE_SIG_THREADS));
 
     strUsage += HelpMessageGroup(_("Node relay options:"));
     if (showDebug) {
@@ -538,6 +550,12 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-blockmintxfee=<amt>", strprintf(_("Set lowest fee rate (in %s/kB) for transactions to be included in block creation. (default: %s)"), CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_MIN_TX_FEE)));
     if (showDebug)
         strUsage += HelpMessageOpt("-blockversion=<n>", "Override block version to test forking scenarios");
+    strUsage += HelpMessageOpt("-equihashsolverthreads=<n>", strprintf(_("Split each tromp Equihash solve across <n> threads. Every mining thread keeps its own solver heaps (about 3.3GB), so fewer mining threads with more solver threads use less memory (1 to %d, default: %d)"), MAX_EQUIHASH_SOLVER_THREADS, DEFAULT_EQUIHASH_SOLVER_THREADS));
+
+    strUsage += HelpMessageOpt("-stratum", strprintf(_("Serve Equihash work to local miners over Stratum, paying to -mineraddress (default: %u)"), DEFAULT_STRATUM_ENABLE));
+    strUsage += HelpMessageOpt("-stratumbind=<addr>", strprintf(_("Bind the Stratum server to given address (default: %s)"), DEFAULT_STRATUM_BIND));
+    strUsage += HelpMessageOpt("-stratumport=<port>", strprintf(_("Listen for Stratum connections on <port> (default: %u)"), DEFAULT_STRATUM_PORT));
+    strUsage += HelpMessageOpt("-stratumdifficulty=<n>", strprintf(_("Accept Stratum shares at 1/<n> of the minimum block difficulty target (default: %u)"), DEFAULT_STRATUM_DIFFICULTY));
 
     strUsage += HelpMessageGroup(_("RPC server options:"));
     strUsage += HelpMessageOpt("-server", _("Accept command line and JSON-RPC commands"));
@@ -1076,6 +1094,7 @@ bool AppInitParameterInteraction()
         mempool.setSanityCheck(1.0 / ratio);
     }
     fCheckBlockIndex = gArgs.GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
+    mnodeman.SetSanityCheck(gArgs.GetBoolArg("-checkmasternodes", chainparams.DefaultConsistencyChecks()));
     fCheckpointsEnabled = gArgs.GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
 
     hashAssumeValid = uint256S(gArgs.GetArg("-assumevalid", chainparams.GetConsensus().defaultAssumeValid.GetHex()));
@@ -1266,6 +1285,8 @@ bool AppInitSanityChecks()
     // Initialize elliptic curve code
     std::string sha256_algo = SHA256AutoDetect();
     LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+    std::string leafhash_algo = EhLeafHashAutoDetect();
+    LogPrintf("Using the '%s' Equihash leaf hash implementation\n", leafhash_algo);
     RandomInit();
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1329,11 +1350,15 @@ bool AppInitMain()
 
     InitSignatureCache();
     InitScriptExecutionCache();
+    InitEquihashCache();
+    InitMasternodeSigCache();
 
-    LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
+    LogPrintf("Using %u threads for script and header verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadHeaderCheck);
     }
 
     // Start the lightweight task scheduler thread
@@ -1637,6 +1662,11 @@ bool AppInitMain()
                         strLoadError = _("Corrupted block database detected");
                         break;
                     }
+
+                    if (!gArgs.GetBoolArg("-litemode", false) && !BuildMasternodePaymentIndex(chainparams)) {
+                        strLoadError = _("Error building the masternode payment index");
+                        break;
+                    }
                 }
             } catch (const std::exception& e) {
                 LogPrintf("%s\n", e.what());
@@ -1788,6 +1818,11 @@ bool AppInitMain()
 
     LogPrintf("fLiteMode %d\n", fLiteMode);
 
+    // lite mode nodes keep no masternode list to serve
+    if (!fLiteMode) {
+        nLocalServices = ServiceFlags(nLocalServices | NODE_MNLIST);
+    }
+
     if (gArgs.IsArgSet("-blocknotify"))
         uiInterface.NotifyBlockTip.connect(BlockNotifyCallback);
 
@@ -1818,14 +1853,15 @@ bool AppInitMain()
         fs::path pathDB = GetDataDir();
         std::string strDBName;
 
-        // mncache file disabled, because it pissed me off.
-        // strDBName = "mncache.dat";
-        // uiInterface.InitMessage(_("Loading masternode cache..."));
-        // CFlatDB<CMasternodeMan> flatdb1(strDBName, "magicMasternodeCache");
-        // if (!flatdb1.Load(mnodeman)) {
-        //     return InitError(_("Failed to load masternode cache from") + "\n" + (pathDB / strDBName).string());
-        // }
-        
+        // Collaterals of the cached masternodes are looked up in the UTXO set by the first
+        // CMasternodeMan::Check(), spent ones are dropped by the next CheckAndRemove()
+        strDBName = "mncache.dat";
+        uiInterface.InitMessage(_("Loading masternode cache..."));
+        CFlatDB<CMasternodeMan> flatdb1(strDBName, "magicMasternodeCache");
+        if (!flatdb1.Load(mnodeman)) {
+            return InitError(_("Failed to load masternode cache from") + "\n" + (pathDB / strDBName).string());
+        }
+
         if (mnodeman.size()) {
             strDBName = "mnpayments.dat";
             uiInterface.InitMessage(_("Loading masternode payment cache..."));
@@ -1868,6 +1904,12 @@ bool AppInitMain()
 
     threadGroup.create_thread(boost::bind(&ThreadCheckMasternode, boost::ref(*g_connman)));
 
+    if (!fLiteMode) {
+        int nMasternodeSigThreads = std::max(0, std::min(MAX_MASTERNODE_SIG_THREADS, (int)gArgs.GetArg("-mnsigthreads", DEFAULT_MASTERNODE_SIG_THREADS)));
+        LogPrintf("Using %u threads for masternode message signatures\n", nMasternodeSigThreads);
+        mnmessagequeue.Start(nMasternodeSigThreads, *g_connman);
+    }
+
     // ********************************************************* Step 11: start node
 
     int chain_active_height;
@@ -1945,6 +1987,10 @@ bool AppInitMain()
         return false;
     }
 
+    if (gArgs.GetBoolArg("-stratum", DEFAULT_STRATUM_ENABLE) && !StartStratumServer()) {
+        return InitError(_("Unable to start Stratum server. See debug log for details."));
+    }
+
     // ********************************************************* Step 12: finished
 
     SetRPCWarmupFinished();
@@ -1977,6 +2023,9 @@ void ThreadCheckMasternode(CConnman& connman)
         // try to sync from all available nodes, one step at a time
         masternodeSync.ProcessTick(connman);
 
+        // hand the changes of the last second to RPC and UI readers
+        mnodeman.PublishListSnapshot();
+
         if (masternodeSync.IsBlockchainSynced() && !ShutdownRequested()) {
 
             nTick++;
@@ -2006,6 +2055,12 @@ void ThreadCheckMasternode(CConnman& connman)
             if (nTick % (60 * 5) == 0) {
                 governance.DoMaintenance(connman);
             }
+
+            // snapshot the list every 15 minutes, so that a restart does not have to wait for a full resync
+            if (nTick % (60 * 15) == 0 && masternodeSync.IsMasternodeListSynced()) {
+                CFlatDB<CMasternodeMan> flatdb1("mncache.dat", "magicMasternodeCache");
+                flatdb1.Dump(mnodeman, false);
+            }
         }
     }
 }
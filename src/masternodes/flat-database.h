@@ -12,6 +12,8 @@
 #include <streams.h>
 #include <util.h>
 
+#include <mutex>
+
 // TODO replace using fs.cpp
 #include <boost/filesystem.hpp>
 
@@ -39,6 +41,13 @@ private:
     std::string strFilename;
     std::string strMagicMessage;
 
+    /// Dumps of the same type go to the same file through the same ".new" file, one at a time
+    static std::mutex& GetDumpMutex()
+    {
+        static std::mutex mutexDump;
+        return mutexDump;
+    }
+
     bool Write(const T& objToSave)
     {
         // LOCK(objToSave.cs);
@@ -53,11 +62,13 @@ private:
         uint256 hash = Hash(ssObj.begin(), ssObj.end());
         ssObj << hash;
 
-        // open output file, and associate with CAutoFile
-        FILE *file = fopen(pathDB.string().c_str(), "wb");
+        // open a temporary output file, and associate with CAutoFile
+        boost::filesystem::path pathTmp = pathDB;
+        pathTmp += ".new";
+        FILE *file = fopen(pathTmp.string().c_str(), "wb");
         CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
         if (fileout.IsNull())
-            return error("%s: Failed to open file %s", __func__, pathDB.string());
+            return error("%s: Failed to open file %s", __func__, pathTmp.string());
 
         // Write and commit header, data
         try {
@@ -66,8 +77,13 @@ private:
         catch (std::exception &e) {
             return error("%s: Serialize or I/O error - %s", __func__, e.what());
         }
+        FileCommit(fileout.Get());
         fileout.fclose();
 
+        // replace the existing file, so that a crash never leaves a partial one behind
+        if (!RenameOver(pathTmp, pathDB))
+            return error("%s: Rename-into-place failed", __func__);
+
         LogPrintf("Written info to %s  %dms\n", strFilename, GetTimeMillis() - nStart);
         LogPrintf("     %s\n", objToSave.ToString());
 
@@ -195,13 +211,19 @@ public:
         return true;
     }
 
-    bool Dump(T& objToSave)
+    /** Write objToSave. Unless fVerify is false, first make sure that an existing
+     *  file is one of ours, so that we never overwrite something we can't read. */
+    bool Dump(T& objToSave, bool fVerify = true)
     {
+        std::lock_guard<std::mutex> lock(GetDumpMutex());
         int64_t nStart = GetTimeMillis();
 
-        LogPrintf("Verifying %s format...\n", strFilename);
-        T tmpObjToLoad;
-        ReadResult readResult = Read(tmpObjToLoad, true);
+        ReadResult readResult = Ok;
+        if (fVerify) {
+            LogPrintf("Verifying %s format...\n", strFilename);
+            T tmpObjToLoad;
+            readResult = Read(tmpObjToLoad, true);
+        }
 
         // there was an error and it was not an error on file opening => do not proceed
         if (readResult == FileError)
@@ -219,7 +241,8 @@ public:
         }
 
         LogPrintf("Writing info to %s...\n", strFilename);
-        Write(objToSave);
+        if (!Write(objToSave))
+            return false;
         LogPrintf("%s dump finished  %dms\n", strFilename, GetTimeMillis() - nStart);
 
         return true;
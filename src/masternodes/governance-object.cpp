@@ -37,7 +37,7 @@ CGovernanceObject::CGovernanceObject():
     fDirtyCache(true),
     fExpired(false),
     fUnparsable(false),
-    mapCurrentMNVotes(),
+    storeCurrentMNVotes(),
     cmmapOrphanVotes(),
     fileVotes()
 {
@@ -65,7 +65,7 @@ CGovernanceObject::CGovernanceObject(const uint256& nHashParentIn, int nRevision
     fDirtyCache(true),
     fExpired(false),
     fUnparsable(false),
-    mapCurrentMNVotes(),
+    storeCurrentMNVotes(),
     cmmapOrphanVotes(),
     fileVotes()
 {
@@ -93,7 +93,7 @@ CGovernanceObject::CGovernanceObject(const CGovernanceObject& other):
     fDirtyCache(other.fDirtyCache),
     fExpired(other.fExpired),
     fUnparsable(other.fUnparsable),
-    mapCurrentMNVotes(other.mapCurrentMNVotes),
+    storeCurrentMNVotes(other.storeCurrentMNVotes),
     cmmapOrphanVotes(other.cmmapOrphanVotes),
     fileVotes(other.fileVotes)
 {}
@@ -131,8 +131,6 @@ bool CGovernanceObject::ProcessVote(CNode* pfrom,
         return false;
     }
 
-    vote_m_it it = mapCurrentMNVotes.emplace(vote_m_t::value_type(vote.GetMasternodeOutpoint(), vote_rec_t())).first;
-    vote_rec_t& voteRecordRef = it->second;
     vote_signal_enum_t eSignal = vote.GetSignal();
     if (eSignal == VOTE_SIGNAL_NONE) {
         std::ostringstream ostr;
@@ -148,11 +146,10 @@ bool CGovernanceObject::ProcessVote(CNode* pfrom,
         exception = CGovernanceException(ostr.str(), GOVERNANCE_EXCEPTION_PERMANENT_ERROR, 20);
         return false;
     }
-    vote_instance_m_it it2 = voteRecordRef.mapInstances.emplace(vote_instance_m_t::value_type(int(eSignal), vote_instance_t())).first;
-    vote_instance_t& voteInstanceRef = it2->second;
+    vote_instance_t voteInstance = storeCurrentMNVotes.Get(vote.GetMasternodeOutpoint(), eSignal);
 
     // Reject obsolete votes
-    if (vote.GetTimestamp() < voteInstanceRef.nCreationTime) {
+    if (vote.GetTimestamp() < voteInstance.nCreationTime) {
         std::ostringstream ostr;
         ostr << "CGovernanceObject::ProcessVote -- Obsolete vote";
         LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::GOV, "[Governance] %s\n", ostr.str());
@@ -161,9 +158,9 @@ bool CGovernanceObject::ProcessVote(CNode* pfrom,
     }
 
     int64_t nNow = GetAdjustedTime();
-    int64_t nVoteTimeUpdate = voteInstanceRef.nTime;
+    int64_t nVoteTimeUpdate = voteInstance.nTime;
     if (governance.AreRateChecksEnabled()) {
-        int64_t nTimeDelta = nNow - voteInstanceRef.nTime;
+        int64_t nTimeDelta = nNow - voteInstance.nTime;
         if (nTimeDelta < GOVERNANCE_UPDATE_MIN) {
             std::ostringstream ostr;
             ostr << "CGovernanceObject::ProcessVote -- Masternode voting too often"
@@ -198,7 +195,7 @@ bool CGovernanceObject::ProcessVote(CNode* pfrom,
         exception = CGovernanceException(ostr.str(), GOVERNANCE_EXCEPTION_PERMANENT_ERROR);
         return false;
     }
-    voteInstanceRef = vote_instance_t(vote.GetOutcome(), nVoteTimeUpdate, vote.GetTimestamp());
+    storeCurrentMNVotes.Set(vote.GetMasternodeOutpoint(), eSignal, vote_instance_t(vote.GetOutcome(), nVoteTimeUpdate, vote.GetTimestamp()));
     fileVotes.AddVote(vote);
     fDirtyCache = true;
     return true;
@@ -208,14 +205,12 @@ void CGovernanceObject::ClearMasternodeVotes()
 {
     LOCK(cs);
 
-    vote_m_it it = mapCurrentMNVotes.begin();
-    while(it != mapCurrentMNVotes.end()) {
-        if (!mnodeman.Has(it->first)) {
-            fileVotes.RemoveVotesFromMasternode(it->first);
-            mapCurrentMNVotes.erase(it++);
-        }
-        else {
-            ++it;
+    // copied, removing a masternode reorders the rows
+    std::vector<COutPoint> vecVoters = storeCurrentMNVotes.GetMasternodes();
+    for (const auto& outpoint : vecVoters) {
+        if (!mnodeman.Has(outpoint)) {
+            fileVotes.RemoveVotesFromMasternode(outpoint);
+            storeCurrentMNVotes.Remove(outpoint);
         }
     }
 }
@@ -612,16 +607,7 @@ bool CGovernanceObject::IsCollateralValid(std::string& strError, bool& fMissingC
 int CGovernanceObject::CountMatchingVotes(vote_signal_enum_t eVoteSignalIn, vote_outcome_enum_t eVoteOutcomeIn) const
 {
     LOCK(cs);
-
-    int nCount = 0;
-    for (const auto& votepair : mapCurrentMNVotes) {
-        const vote_rec_t& recVote = votepair.second;
-        vote_instance_m_cit it2 = recVote.mapInstances.find(eVoteSignalIn);
-        if (it2 != recVote.mapInstances.end() && it2->second.eOutcome == eVoteOutcomeIn) {
-            ++nCount;
-        }
-    }
-    return nCount;
+    return storeCurrentMNVotes.Count(eVoteSignalIn, eVoteOutcomeIn);
 }
 
 /**
@@ -657,12 +643,13 @@ bool CGovernanceObject::GetCurrentMNVotes(const COutPoint& mnCollateralOutpoint,
 {
     LOCK(cs);
     
-    vote_m_cit it = mapCurrentMNVotes.find(mnCollateralOutpoint);
-    if (it == mapCurrentMNVotes.end()) {
-        return false;
-    }
-    voteRecord = it->second;
-    return  true;
+    return storeCurrentMNVotes.GetRecord(mnCollateralOutpoint, voteRecord);
+}
+
+std::vector<COutPoint> CGovernanceObject::GetVotingMasternodes() const
+{
+    LOCK(cs);
+    return storeCurrentMNVotes.GetMasternodes();
 }
 
 void CGovernanceObject::Relay(CConnman& connman)
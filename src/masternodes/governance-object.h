@@ -56,51 +56,6 @@ inline bool operator<(const vote_time_pair_t& p1, const vote_time_pair_t& p2)
     return (p1.first < p2.first);
 }
 
-struct vote_instance_t {
-
-    vote_outcome_enum_t eOutcome;
-    int64_t nTime;
-    int64_t nCreationTime;
-
-    vote_instance_t(vote_outcome_enum_t eOutcomeIn = VOTE_OUTCOME_NONE, int64_t nTimeIn = 0, int64_t nCreationTimeIn = 0)
-        : eOutcome(eOutcomeIn),
-          nTime(nTimeIn),
-          nCreationTime(nCreationTimeIn)
-    {}
-
-    ADD_SERIALIZE_METHODS;
-
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action)
-    {
-        int nOutcome = int(eOutcome);
-        READWRITE(nOutcome);
-        READWRITE(nTime);
-        READWRITE(nCreationTime);
-        if (ser_action.ForRead()) {
-            eOutcome = vote_outcome_enum_t(nOutcome);
-        }
-    }
-};
-
-typedef std::map<int,vote_instance_t> vote_instance_m_t;
-
-typedef vote_instance_m_t::iterator vote_instance_m_it;
-
-typedef vote_instance_m_t::const_iterator vote_instance_m_cit;
-
-struct vote_rec_t {
-    vote_instance_m_t mapInstances;
-
-    ADD_SERIALIZE_METHODS;
-
-     template <typename Stream, typename Operation>
-     inline void SerializationOp(Stream& s, Operation ser_action)
-     {
-         READWRITE(mapInstances);
-     }
-};
-
 /**
 * Governance Object
 *
@@ -113,12 +68,6 @@ class CGovernanceObject
     friend class CGovernanceBlock;
 
 public: // Types
-    typedef std::map<COutPoint, vote_rec_t> vote_m_t;
-
-    typedef vote_m_t::iterator vote_m_it;
-
-    typedef vote_m_t::const_iterator vote_m_cit;
-
     typedef CacheMultiMap<COutPoint, vote_time_pair_t> vote_cmm_t;
 
 private:
@@ -179,7 +128,8 @@ private:
     /// Failed to parse object data
     bool fUnparsable;
 
-    vote_m_t mapCurrentMNVotes;
+    /// Current vote of each masternode on each signal, with the tallies
+    CGovernanceVoteStore storeCurrentMNVotes;
 
     /// Limited map of votes orphaned by MN
     vote_cmm_t cmmapOrphanVotes;
@@ -291,6 +241,9 @@ public:
 
     bool GetCurrentMNVotes(const COutPoint& mnCollateralOutpoint, vote_rec_t& voteRecord) const;
 
+    /// Masternodes with a current vote on this object
+    std::vector<COutPoint> GetVotingMasternodes() const;
+
     // FUNCTIONS FOR DEALING WITH DATA STRING
 
     std::string GetDataAsHexString() const;
@@ -353,7 +306,7 @@ public:
             LogPrintG(BCLogLevel::LOG_INFO, BCLog::GOV, "[Governance] CGovernanceObject::SerializationOp Reading/writing votes from/to disk\n");
             READWRITE(nDeletionTime);
             READWRITE(fExpired);
-            READWRITE(mapCurrentMNVotes);
+            READWRITE(storeCurrentMNVotes);
             READWRITE(fileVotes);
             LogPrintG(BCLogLevel::LOG_INFO, BCLog::GOV, "[Governance] CGovernanceObject::SerializationOp hash = %s, vote count = %d\n", GetHash().ToString(), fileVotes.GetVoteCount());
         }
@@ -5,6 +5,125 @@
 
 #include <masternodes/governance-votedb.h>
 
+#include <algorithm>
+
+const uint8_t CGovernanceVoteStore::NO_VOTE;
+
+CGovernanceVoteStore::CGovernanceVoteStore()
+    : mapRows(),
+      vecOutpoints(),
+      vecOutcomes(),
+      vecTimes(),
+      vecCreationTimes()
+{
+    Clear();
+}
+
+void CGovernanceVoteStore::UpdateTally(uint8_t nOutcome, int nSignal, int nDelta)
+{
+    if (nOutcome < OUTCOMES) {
+        nTally[nSignal - 1][nOutcome] += nDelta;
+    }
+}
+
+vote_instance_t CGovernanceVoteStore::Get(const COutPoint& outpointMasternode, vote_signal_enum_t eSignal) const
+{
+    auto it = mapRows.find(outpointMasternode);
+    if (it == mapRows.end() || !IsSupportedSignal(eSignal)) {
+        return vote_instance_t();
+    }
+    size_t nCell = it->second * SIGNALS + eSignal - 1;
+    if (vecOutcomes[nCell] == NO_VOTE) {
+        return vote_instance_t();
+    }
+    return vote_instance_t(vote_outcome_enum_t(vecOutcomes[nCell]), vecTimes[nCell], vecCreationTimes[nCell]);
+}
+
+void CGovernanceVoteStore::Set(const COutPoint& outpointMasternode, vote_signal_enum_t eSignal, const vote_instance_t& voteInstance)
+{
+    if (!IsSupportedSignal(eSignal)) return;
+
+    auto it = mapRows.find(outpointMasternode);
+    if (it == mapRows.end()) {
+        it = mapRows.emplace(outpointMasternode, vecOutpoints.size()).first;
+        vecOutpoints.push_back(outpointMasternode);
+        vecOutcomes.resize(vecOutcomes.size() + SIGNALS, NO_VOTE);
+        vecTimes.resize(vecTimes.size() + SIGNALS, 0);
+        vecCreationTimes.resize(vecCreationTimes.size() + SIGNALS, 0);
+    }
+    size_t nCell = it->second * SIGNALS + eSignal - 1;
+    UpdateTally(vecOutcomes[nCell], eSignal, -1);
+    vecOutcomes[nCell] = uint8_t(voteInstance.eOutcome);
+    vecTimes[nCell] = voteInstance.nTime;
+    vecCreationTimes[nCell] = voteInstance.nCreationTime;
+    UpdateTally(vecOutcomes[nCell], eSignal, 1);
+}
+
+void CGovernanceVoteStore::GetRecord(uint32_t nRow, vote_rec_t& recordRet) const
+{
+    recordRet.mapInstances.clear();
+    for (int nSignal = 1; nSignal <= SIGNALS; nSignal++) {
+        size_t nCell = nRow * SIGNALS + nSignal - 1;
+        if (vecOutcomes[nCell] == NO_VOTE) continue;
+        recordRet.mapInstances.emplace(nSignal, vote_instance_t(vote_outcome_enum_t(vecOutcomes[nCell]), vecTimes[nCell], vecCreationTimes[nCell]));
+    }
+}
+
+bool CGovernanceVoteStore::GetRecord(const COutPoint& outpointMasternode, vote_rec_t& recordRet) const
+{
+    auto it = mapRows.find(outpointMasternode);
+    if (it == mapRows.end()) {
+        return false;
+    }
+    GetRecord(it->second, recordRet);
+    return true;
+}
+
+void CGovernanceVoteStore::Remove(const COutPoint& outpointMasternode)
+{
+    auto it = mapRows.find(outpointMasternode);
+    if (it == mapRows.end()) return;
+
+    uint32_t nRow = it->second;
+    uint32_t nLast = vecOutpoints.size() - 1;
+    mapRows.erase(it);
+    for (int nSignal = 1; nSignal <= SIGNALS; nSignal++) {
+        UpdateTally(vecOutcomes[nRow * SIGNALS + nSignal - 1], nSignal, -1);
+    }
+    // the last row takes the place of the removed one
+    if (nRow != nLast) {
+        vecOutpoints[nRow] = vecOutpoints[nLast];
+        mapRows[vecOutpoints[nRow]] = nRow;
+        std::copy(vecOutcomes.begin() + nLast * SIGNALS, vecOutcomes.end(), vecOutcomes.begin() + nRow * SIGNALS);
+        std::copy(vecTimes.begin() + nLast * SIGNALS, vecTimes.end(), vecTimes.begin() + nRow * SIGNALS);
+        std::copy(vecCreationTimes.begin() + nLast * SIGNALS, vecCreationTimes.end(), vecCreationTimes.begin() + nRow * SIGNALS);
+    }
+    vecOutpoints.pop_back();
+    vecOutcomes.resize(nLast * SIGNALS);
+    vecTimes.resize(nLast * SIGNALS);
+    vecCreationTimes.resize(nLast * SIGNALS);
+}
+
+int CGovernanceVoteStore::Count(vote_signal_enum_t eSignal, vote_outcome_enum_t eOutcome) const
+{
+    if (!IsSupportedSignal(eSignal) || eOutcome < 0 || eOutcome >= OUTCOMES) {
+        return 0;
+    }
+    return nTally[eSignal - 1][eOutcome];
+}
+
+void CGovernanceVoteStore::Clear()
+{
+    mapRows.clear();
+    vecOutpoints.clear();
+    vecOutcomes.clear();
+    vecTimes.clear();
+    vecCreationTimes.clear();
+    for (auto& tally : nTally) {
+        std::fill(std::begin(tally), std::end(tally), 0);
+    }
+}
+
 CGovernanceObjectVoteFile::CGovernanceObjectVoteFile()
     : nMemoryVotes(0),
       listVotes(),
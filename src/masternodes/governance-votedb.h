@@ -8,12 +8,130 @@
 
 #include <list>
 #include <map>
+#include <vector>
 
 #include <masternodes/governance-vote.h>
 #include <serialize.h>
 #include <streams.h>
 #include <uint256.h>
 
+struct vote_instance_t {
+
+    vote_outcome_enum_t eOutcome;
+    int64_t nTime;
+    int64_t nCreationTime;
+
+    vote_instance_t(vote_outcome_enum_t eOutcomeIn = VOTE_OUTCOME_NONE, int64_t nTimeIn = 0, int64_t nCreationTimeIn = 0)
+        : eOutcome(eOutcomeIn),
+          nTime(nTimeIn),
+          nCreationTime(nCreationTimeIn)
+    {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        int nOutcome = int(eOutcome);
+        READWRITE(nOutcome);
+        READWRITE(nTime);
+        READWRITE(nCreationTime);
+        if (ser_action.ForRead()) {
+            eOutcome = vote_outcome_enum_t(nOutcome);
+        }
+    }
+};
+
+typedef std::map<int,vote_instance_t> vote_instance_m_t;
+
+typedef vote_instance_m_t::iterator vote_instance_m_it;
+
+typedef vote_instance_m_t::const_iterator vote_instance_m_cit;
+
+struct vote_rec_t {
+    vote_instance_m_t mapInstances;
+
+    ADD_SERIALIZE_METHODS;
+
+     template <typename Stream, typename Operation>
+     inline void SerializationOp(Stream& s, Operation ser_action)
+     {
+         READWRITE(mapInstances);
+     }
+};
+
+/**
+ * The current vote of each masternode on each signal of a CGovernanceObject
+ *
+ * Votes are kept in columns, one row per masternode and one cell per signal, and
+ * the number of votes for each signal and outcome is updated as cells change, so
+ * counting the votes of an object doesn't visit them. Stored in the format of the
+ * std::map<COutPoint, vote_rec_t> it replaced.
+ */
+class CGovernanceVoteStore
+{
+private:
+    static const int SIGNALS = MAX_SUPPORTED_VOTE_SIGNAL;
+    static const int OUTCOMES = VOTE_OUTCOME_ABSTAIN + 1;
+    /// Outcome of a cell nobody voted on
+    static const uint8_t NO_VOTE = 0xff;
+
+    std::map<COutPoint, uint32_t> mapRows;
+    std::vector<COutPoint> vecOutpoints;
+    // cells of row r are at r * SIGNALS + signal - 1
+    std::vector<uint8_t> vecOutcomes;
+    std::vector<int64_t> vecTimes;
+    std::vector<int64_t> vecCreationTimes;
+    int nTally[SIGNALS][OUTCOMES];
+
+    static bool IsSupportedSignal(int nSignal) { return nSignal > VOTE_SIGNAL_NONE && nSignal <= SIGNALS; }
+    void UpdateTally(uint8_t nOutcome, int nSignal, int nDelta);
+    void GetRecord(uint32_t nRow, vote_rec_t& recordRet) const;
+
+public:
+    CGovernanceVoteStore();
+
+    /// The vote of a masternode on a signal, a default instance if there is none
+    vote_instance_t Get(const COutPoint& outpointMasternode, vote_signal_enum_t eSignal) const;
+    void Set(const COutPoint& outpointMasternode, vote_signal_enum_t eSignal, const vote_instance_t& voteInstance);
+
+    bool GetRecord(const COutPoint& outpointMasternode, vote_rec_t& recordRet) const;
+    bool Has(const COutPoint& outpointMasternode) const { return mapRows.count(outpointMasternode) != 0; }
+    void Remove(const COutPoint& outpointMasternode);
+
+    /// Number of masternodes whose vote on the signal has this outcome
+    int Count(vote_signal_enum_t eSignal, vote_outcome_enum_t eOutcome) const;
+
+    const std::vector<COutPoint>& GetMasternodes() const { return vecOutpoints; }
+    size_t size() const { return vecOutpoints.size(); }
+    void Clear();
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        WriteCompactSize(s, vecOutpoints.size());
+        for (uint32_t nRow = 0; nRow < vecOutpoints.size(); nRow++) {
+            vote_rec_t record;
+            GetRecord(nRow, record);
+            s << vecOutpoints[nRow] << record;
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        std::map<COutPoint, vote_rec_t> mapRecords;
+        s >> mapRecords;
+        Clear();
+        for (const auto& recordpair : mapRecords) {
+            for (const auto& instancepair : recordpair.second.mapInstances) {
+                if (!IsSupportedSignal(instancepair.first)) continue;
+                Set(recordpair.first, vote_signal_enum_t(instancepair.first), instancepair.second);
+            }
+        }
+    }
+};
+
 /**
  * Represents the collection of votes associated with a given CGovernanceObject
  * Recently received votes are held in memory until a maximum size is reached after
@@ -164,7 +164,7 @@ void CGovernanceManager::ProcessMessage(CNode* pfrom, const std::string& strComm
         LOCK2(cs_main, cs);
 
         if (mapObjects.count(nHash) || mapPostponedObjects.count(nHash) ||
-           mapErasedGovernanceObjects.count(nHash) || mapMasternodeOrphanObjects.count(nHash)) {
+           mapErasedGovernanceObjects.Has(nHash) || mapMasternodeOrphanObjects.count(nHash)) {
             // TODO - print error code? what if it's GOVOBJ_ERROR_IMMATURE?
             LogPrintG(BCLogLevel::LOG_WARNING, BCLog::GOV, "[Governance] MNGOVERNANCEOBJECT -- Received already seen object: %s\n", strHash);
             return;
@@ -255,7 +255,7 @@ void CGovernanceManager::ProcessMessage(CNode* pfrom, const std::string& strComm
         CGovernanceException exception;
         if (ProcessVote(pfrom, vote, exception, connman)) {
             LogPrintG(BCLogLevel::LOG_WARNING, BCLog::GOV, "[Governance] MNGOVERNANCEOBJECTVOTE -- %s new\n", strHash);
-            masternodeSync.BumpAssetLastTime("MNGOVERNANCEOBJECTVOTE");
+            masternodeSync.BumpAssetLastTime("MNGOVERNANCEOBJECTVOTE", MASTERNODE_SYNC_GOVERNANCE, pfrom);
             vote.Relay(connman);
         }
         else {
@@ -347,7 +347,7 @@ void CGovernanceManager::AddGovernanceObject(CGovernanceObject& govobj, CConnman
     // Update the rate buffer
     MasternodeRateUpdate(govobj);
 
-    masternodeSync.BumpAssetLastTime("CGovernanceManager::AddGovernanceObject");
+    masternodeSync.BumpAssetLastTime("CGovernanceManager::AddGovernanceObject", MASTERNODE_SYNC_GOVERNANCE, pfrom);
 
     // WE MIGHT HAVE PENDING/ORPHAN VOTES FOR THIS OBJECT
 
@@ -438,7 +438,9 @@ void CGovernanceManager::UpdateCachesAndClean()
                 nTimeExpired = pObj->GetCreationTime() + 2 * nGovernanceBlockOffsetSeconds + GOVERNANCE_DELETION_DELAY;
             }
 
-            mapErasedGovernanceObjects.insert(std::make_pair(nHash, nTimeExpired));
+            if (!mapErasedGovernanceObjects.Has(nHash)) {
+                mapErasedGovernanceObjects.Set(nHash, nTimeExpired);
+            }
             mapObjects.erase(it++);
         } else {
             // NOTE: triggers are handled via triggerman
@@ -457,13 +459,7 @@ void CGovernanceManager::UpdateCachesAndClean()
     }
 
     // forget about expired deleted objects
-    hash_time_m_it s_it = mapErasedGovernanceObjects.begin();
-    while(s_it != mapErasedGovernanceObjects.end()) {
-        if (s_it->second < nNow)
-            mapErasedGovernanceObjects.erase(s_it++);
-        else
-            ++s_it;
-    }
+    mapErasedGovernanceObjects.Expire(nNow);
 
     LogPrintG(BCLogLevel::LOG_INFO, BCLog::GOV, "[Governance] CGovernanceManager::UpdateCachesAndClean -- %s\n", ToString());
 }
@@ -501,27 +497,30 @@ std::vector<CGovernanceVote> CGovernanceManager::GetCurrentVotes(const uint256&
     if (it == mapObjects.end()) return vecResult;
     const CGovernanceObject& govobj = it->second;
 
-    CMasternode mn;
-    std::map<COutPoint, CMasternode> mapMasternodes;
+    // only the masternodes which voted on the object are visited, votes from masternodes no longer in the list are skipped
+    std::vector<COutPoint> vecVoters;
+    CMasternodeMan::list_snapshot_t listSnapshot;
     if (mnCollateralOutpointFilter.IsNull()) {
-        mapMasternodes = mnodeman.GetFullMasternodeMap();
-    } else if (mnodeman.Get(mnCollateralOutpointFilter, mn)) {
-        mapMasternodes[mnCollateralOutpointFilter] = mn;
+        vecVoters = govobj.GetVotingMasternodes();
+        listSnapshot = mnodeman.GetListSnapshot();
+    } else if (mnodeman.Has(mnCollateralOutpointFilter)) {
+        vecVoters.push_back(mnCollateralOutpointFilter);
     }
 
-    // Loop thru each MN collateral outpoint and get the votes for the `nParentHash` governance object
-    for (const auto& mnpair : mapMasternodes)
+    for (const auto& outpoint : vecVoters)
     {
+        if (listSnapshot && !listSnapshot->count(outpoint)) continue;
+
         // get a vote_rec_t from the govobj
         vote_rec_t voteRecord;
-        if (!govobj.GetCurrentMNVotes(mnpair.first, voteRecord)) continue;
+        if (!govobj.GetCurrentMNVotes(outpoint, voteRecord)) continue;
 
         for (vote_instance_m_it it3 = voteRecord.mapInstances.begin(); it3 != voteRecord.mapInstances.end(); ++it3) {
             int signal = (it3->first);
             int outcome = ((it3->second).eOutcome);
             int64_t nCreationTime = ((it3->second).nCreationTime);
 
-            CGovernanceVote vote = CGovernanceVote(mnpair.first, nParentHash, (vote_signal_enum_t)signal, (vote_outcome_enum_t)outcome);
+            CGovernanceVote vote = CGovernanceVote(outpoint, nParentHash, (vote_signal_enum_t)signal, (vote_outcome_enum_t)outcome);
             vote.SetTime(nCreationTime);
 
             vecResult.push_back(vote);
@@ -588,8 +587,8 @@ void CGovernanceManager::DoMaintenance(CConnman& connman)
 
 bool CGovernanceManager::ConfirmInventoryRequest(const CInv& inv)
 {
-    // do not request objects until it's time to sync
-    if (!masternodeSync.IsWinnersListSynced()) return false;
+    // do not request objects until it's time to sync, which is right after the masternode list
+    if (!masternodeSync.IsMasternodeListSynced()) return false;
 
     LOCK(cs);
 
@@ -13,7 +13,9 @@
 #include <masternodes/governance-exceptions.h>
 #include <masternodes/governance-object.h>
 #include <masternodes/governance-vote.h>
+#include <masternodes/timerwheel.h>
 #include <net.h>
+#include <saltedhasher.h>
 #include <sync.h>
 #include <timedata.h>
 #include <util.h>
@@ -210,11 +212,7 @@ public: // Types
 
     typedef object_info_m_t::const_iterator object_info_m_cit;
 
-    typedef std::map<uint256, int64_t> hash_time_m_t;
-
-    typedef hash_time_m_t::iterator hash_time_m_it;
-
-    typedef hash_time_m_t::const_iterator hash_time_m_cit;
+    typedef CTimerWheel<uint256, SaltedTxidHasher> hash_time_m_t;
 
 private:
     static const int MAX_CACHE_SIZE = 1000000;
@@ -317,7 +315,7 @@ public:
 
         LogPrintG(BCLogLevel::LOG_INFO, BCLog::GOV, "[Governance] Governance object manager was cleared\n");
         mapObjects.clear();
-        mapErasedGovernanceObjects.clear();
+        mapErasedGovernanceObjects.Clear();
         cmapVoteToObject.Clear();
         cmapInvalidVotes.Clear();
         cmmapOrphanVotes.Clear();
@@ -173,12 +173,168 @@ bool EnforceMasternodePayments(int nHeight)
     return (pcheckpoint && nHeight > pcheckpoint->nHeight + MN_PAYMENTS_UPDATE_THRESHOLD);
 }
 
+void CMasternodePaymentRing::ClearSlot(CMasternodePaymentSlot& slot)
+{
+    for (const auto& pair : slot.mapVotes) {
+        mapVoteHeights.erase(pair.first);
+    }
+    if (slot.HasPayees()) {
+        nBlockCount--;
+    }
+    slot = CMasternodePaymentSlot();
+}
+
+void CMasternodePaymentRing::Reserve(int nCapacity)
+{
+    if (nCapacity <= (int)vecSlots.size()) return;
+
+    std::vector<CMasternodePaymentSlot> vecOldSlots;
+    vecOldSlots.swap(vecSlots);
+    vecSlots.resize(nCapacity);
+
+    for (auto& slot : vecOldSlots) {
+        if (!slot.IsUsed()) continue;
+        CMasternodePaymentSlot& slotNew = vecSlots[GetSlotIndex(slot.nBlockHeight)];
+        if (slotNew.IsUsed()) {
+            // only heights which are out of the window anyway can meet here, keep the newer one
+            if (slotNew.nBlockHeight > slot.nBlockHeight) {
+                ClearSlot(slot);
+                continue;
+            }
+            ClearSlot(slotNew);
+        }
+        slotNew = std::move(slot);
+    }
+}
+
+const CMasternodePaymentSlot* CMasternodePaymentRing::Find(int nBlockHeight) const
+{
+    if (vecSlots.empty() || nBlockHeight < 0) return nullptr;
+
+    const CMasternodePaymentSlot& slot = vecSlots[GetSlotIndex(nBlockHeight)];
+    return slot.nBlockHeight == nBlockHeight ? &slot : nullptr;
+}
+
+CMasternodePaymentSlot* CMasternodePaymentRing::Get(int nBlockHeight)
+{
+    if (vecSlots.empty() || nBlockHeight < 0) return nullptr;
+
+    CMasternodePaymentSlot& slot = vecSlots[GetSlotIndex(nBlockHeight)];
+    if (slot.nBlockHeight == nBlockHeight) return &slot;
+    if (slot.nBlockHeight > nBlockHeight) return nullptr;
+
+    ClearSlot(slot);
+    slot.nBlockHeight = nBlockHeight;
+    slot.payees.nBlockHeight = nBlockHeight;
+    nLowestHeight = std::min(nLowestHeight, nBlockHeight);
+    return &slot;
+}
+
+const CMasternodePaymentVote* CMasternodePaymentRing::FindVote(const uint256& hash) const
+{
+    const auto it = mapVoteHeights.find(hash);
+    if (it == mapVoteHeights.end()) return nullptr;
+
+    const CMasternodePaymentSlot* slot = Find(it->second);
+    if (!slot) return nullptr;
+
+    const auto itVote = slot->mapVotes.find(hash);
+    return itVote == slot->mapVotes.end() ? nullptr : &itVote->second;
+}
+
+bool CMasternodePaymentRing::AddVote(const uint256& hash, const CMasternodePaymentVote& vote, bool fAddPayee)
+{
+    CMasternodePaymentSlot* slot = Get(vote.nBlockHeight);
+    if (!slot) return false;
+
+    auto res = slot->mapVotes.emplace(hash, vote);
+    if (res.second) {
+        mapVoteHeights.emplace(hash, vote.nBlockHeight);
+    } else {
+        res.first->second = vote;
+    }
+
+    if (fAddPayee) {
+        if (!slot->HasPayees()) {
+            nBlockCount++;
+        }
+        slot->payees.AddPayee(vote);
+    }
+    return true;
+}
+
+int CMasternodePaymentRing::RemoveBelow(int nMinHeight)
+{
+    if (nMinHeight <= nLowestHeight) return 0;
+
+    int nRemoved = 0;
+    if (nMinHeight - nLowestHeight > (int)vecSlots.size()) {
+        // a long way behind, every slot has to be looked at anyway
+        for (auto& slot : vecSlots) {
+            if (slot.IsUsed() && slot.nBlockHeight < nMinHeight) {
+                ClearSlot(slot);
+                nRemoved++;
+            }
+        }
+    } else {
+        for (int h = nLowestHeight; h < nMinHeight; h++) {
+            CMasternodePaymentSlot& slot = vecSlots[GetSlotIndex(h)];
+            if (slot.nBlockHeight == h) {
+                ClearSlot(slot);
+                nRemoved++;
+            }
+        }
+    }
+    nLowestHeight = nMinHeight;
+    return nRemoved;
+}
+
+void CMasternodePaymentRing::Clear()
+{
+    for (auto& slot : vecSlots) {
+        slot = CMasternodePaymentSlot();
+    }
+    mapVoteHeights.clear();
+    nBlockCount = 0;
+    nLowestHeight = std::numeric_limits<int>::max();
+}
+
+void CMasternodePaymentRing::ToMaps(std::map<uint256, CMasternodePaymentVote>& mapVotesRet, std::map<int, CMasternodeBlockPayees>& mapBlocksRet) const
+{
+    mapVotesRet.clear();
+    mapBlocksRet.clear();
+    for (const auto& slot : vecSlots) {
+        if (!slot.IsUsed()) continue;
+        mapVotesRet.insert(slot.mapVotes.begin(), slot.mapVotes.end());
+        if (slot.HasPayees()) {
+            mapBlocksRet.emplace(slot.nBlockHeight, slot.payees);
+        }
+    }
+}
+
+void CMasternodePaymentRing::FromMaps(const std::map<uint256, CMasternodePaymentVote>& mapVotes, const std::map<int, CMasternodeBlockPayees>& mapBlocks)
+{
+    Clear();
+    for (const auto& pair : mapBlocks) {
+        if (pair.second.vecPayees.empty()) continue;
+        CMasternodePaymentSlot* slot = Get(pair.first);
+        if (!slot) continue;
+        if (!slot->HasPayees()) {
+            nBlockCount++;
+        }
+        slot->payees = pair.second;
+        slot->payees.nBlockHeight = pair.first;
+    }
+    for (const auto& pair : mapVotes) {
+        AddVote(pair.first, pair.second, false);
+    }
+}
+
 void CMasternodePayments::Clear()
 {
     LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePaymentVotes);
-    mapMasternodeBlocksPrimary.clear();
+    ringPrimary.Clear();
     mapMasternodeBlocksSecondary.clear();
-    mapMasternodePaymentVotesPrimary.clear();
     mapMasternodePaymentVotesSecondary.clear();
 }
 
@@ -228,7 +384,7 @@ void CMasternodePayments::FillBlockPayees(CMutableTransaction& txNew, int nBlock
         }
 
         // fill payee with locally calculated winner and hope for the best
-        payee = GetScriptForDestination(CScriptID(GetScriptForDestination(WitnessV0KeyHash(mnInfo.pubKeyCollateralAddress.GetID()))));
+        payee = mnInfo.payee;
         // Calculate the primaryPayeeActivationHeight for this locally calculated winner...
         if (mnInfo.activationBlockHeight != 0)
         {
@@ -270,7 +426,7 @@ void CMasternodePayments::FillBlockPayees(CMutableTransaction& txNew, int nBlock
     {
         for(int i=0; i< (int)secondaryMnInfoRet.size(); ++i)
         {
-            secondaryPayees.push_back(GetScriptForDestination(CScriptID(GetScriptForDestination(WitnessV0KeyHash(secondaryMnInfoRet[i].pubKeyCollateralAddress.GetID())))));
+            secondaryPayees.push_back(secondaryMnInfoRet[i].payee);
         }
         // Now, calculate how much each secondary will get
         int secondariesCount = (int)secondaryPayees.size();
@@ -362,12 +518,21 @@ void CMasternodePayments::ProcessMessage(CNode* pfrom, const std::string& strCom
         // Ignore any payments messages until masternode list is synced
         if (!masternodeSync.IsMasternodeListSynced()) return;
 
+        // Votes out of range have no slot to be remembered in, drop them first
+        int nFirstBlock = nCachedBlockHeight - GetStorageLimit();
+        if (vote.nBlockHeight < nFirstBlock || vote.nBlockHeight > nCachedBlockHeight + MNPAYMENTS_FUTURE_VOTES_LIMIT) {
+            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] MASTERNODEPAYMENTVOTEPRIMARY -- vote out of range: nFirstBlock=%d, nBlockHeight=%d, nHeight=%d\n", nFirstBlock, vote.nBlockHeight, nCachedBlockHeight);
+            return;
+        }
+
+        int nCapacity = GetRingCapacity();
         {
-            LOCK(cs_mapMasternodePaymentVotes);
-            auto res = mapMasternodePaymentVotesPrimary.emplace(nHash, vote);
+            LOCK(cs_mapMasternodeBlocks);
+            ringPrimary.Reserve(nCapacity);
+            const CMasternodePaymentVote* pvote = ringPrimary.FindVote(nHash);
 
             // Avoid processing same vote multiple times if it was already verified earlier
-            if (!res.second && res.first->second.IsVerified()) {
+            if (pvote && pvote->IsVerified()) {
                 // LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] MASTERNODEPAYMENTVOTEPRIMARY -- hash=%s, nBlockHeight=%d/%d seen\n",
                 //     nHash.ToString(), vote.nBlockHeight, nCachedBlockHeight);
                 return;
@@ -375,13 +540,11 @@ void CMasternodePayments::ProcessMessage(CNode* pfrom, const std::string& strCom
 
             // Mark vote as non-verified when it's seen for the first time,
             // AddOrUpdatePaymentVote() below should take care of it if vote is actually ok
-            res.first->second.MarkAsNotVerified();
-        }
-
-        int nFirstBlock = nCachedBlockHeight - GetStorageLimit();
-        if (vote.nBlockHeight < nFirstBlock || vote.nBlockHeight > nCachedBlockHeight + 20) {
-            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] MASTERNODEPAYMENTVOTEPRIMARY -- vote out of range: nFirstBlock=%d, nBlockHeight=%d, nHeight=%d\n", nFirstBlock, vote.nBlockHeight, nCachedBlockHeight);
-            return;
+            if (!pvote) {
+                CMasternodePaymentVote voteNotVerified(vote);
+                voteNotVerified.MarkAsNotVerified();
+                ringPrimary.AddVote(nHash, voteNotVerified, false);
+            }
         }
 
         std::string strError = "";
@@ -430,7 +593,7 @@ void CMasternodePayments::ProcessMessage(CNode* pfrom, const std::string& strCom
 
         if (AddOrUpdatePaymentVote(vote)){
             vote.Relay(connman);
-            masternodeSync.BumpAssetLastTime("MASTERNODEPAYMENTVOTEPRIMARY");
+            masternodeSync.BumpAssetLastTime("MASTERNODEPAYMENTVOTEPRIMARY", MASTERNODE_SYNC_MNW, pfrom);
         }
     }
     else if (strCommand == NetMsgType::MASTERNODEPAYMENTVOTESECONDARY){
@@ -493,8 +656,8 @@ bool CMasternodePayments::GetBlockPayees(int nBlockHeight, CScript& payeeRet, in
 {
     LOCK(cs_mapMasternodeBlocks);
 
-    auto it = mapMasternodeBlocksPrimary.find(nBlockHeight);
-    return it != mapMasternodeBlocksPrimary.end() && it->second.GetBestPayee(payeeRet, activationHeightRet);
+    const CMasternodePaymentSlot* slot = ringPrimary.Find(nBlockHeight);
+    return slot && slot->HasPayees() && slot->payees.GetBestPayee(payeeRet, activationHeightRet);
 }
 
 // Is this masternode scheduled to get paid soon?
@@ -505,9 +668,8 @@ bool CMasternodePayments::IsScheduled(const masternode_info_t& mnInfo, int nNotB
 
     if (!masternodeSync.IsMasternodeListSynced()) return false;
 
-    CScript mnpayee;
+    const CScript& mnpayee = mnInfo.payee.empty() ? GetMasternodePayeeScript(mnInfo.pubKeyCollateralAddress) : mnInfo.payee;
     int activationBlockHeight;
-    mnpayee = GetScriptForDestination(CScriptID(GetScriptForDestination(WitnessV0KeyHash(mnInfo.pubKeyCollateralAddress.GetID()))));
 
     CScript payee;
     for(int64_t h = nCachedBlockHeight; h <= nCachedBlockHeight + 8; h++){
@@ -520,32 +682,100 @@ bool CMasternodePayments::IsScheduled(const masternode_info_t& mnInfo, int nNotB
     return false;
 }
 
+void CMasternodePayments::GetScheduledPayees(int nNotBlockHeight, std::set<CScript>& setPayeesRet) const
+{
+    LOCK(cs_mapMasternodeBlocks);
+
+    setPayeesRet.clear();
+    if (!masternodeSync.IsMasternodeListSynced()) return;
+
+    int activationBlockHeight;
+    CScript payee;
+    for(int64_t h = nCachedBlockHeight; h <= nCachedBlockHeight + 8; h++){
+        if (h == nNotBlockHeight) continue;
+        if (GetBlockPayees(h, payee, activationBlockHeight)) {
+            setPayeesRet.insert(payee);
+        }
+    }
+}
+
 bool CMasternodePayments::AddOrUpdatePaymentVote(const CMasternodePaymentVote& vote)
 {
     uint256 blockHash = uint256();
     if (!GetBlockHash(blockHash, vote.nBlockHeight - 101)) return false;
 
     uint256 nVoteHash = vote.GetHash();
+    int nCapacity = GetRingCapacity();
 
-    if (HasVerifiedPaymentVote(nVoteHash)) return false;
-
-    LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePaymentVotes);
+    LOCK(cs_mapMasternodeBlocks);
 
-    mapMasternodePaymentVotesPrimary[nVoteHash] = vote;
+    if (HasVerifiedPaymentVote(nVoteHash)) return false;
 
-    auto it = mapMasternodeBlocksPrimary.emplace(vote.nBlockHeight, CMasternodeBlockPayees(vote.nBlockHeight)).first;
-    it->second.AddPayee(vote);
+    ringPrimary.Reserve(nCapacity);
+    if (!ringPrimary.AddVote(nVoteHash, vote, true)) {
+        LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodePayments::AddOrUpdatePaymentVote -- no slot for nBlockHeight=%d, hash=%s\n", vote.nBlockHeight, nVoteHash.ToString());
+        return false;
+    }
 
     LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodePayments::AddOrUpdatePaymentVote -- added, hash=%s\n", nVoteHash.ToString());
 
     return true;
 }
 
+bool CMasternodePayments::HasPaymentVote(const uint256& hashIn) const
+{
+    LOCK(cs_mapMasternodeBlocks);
+    return ringPrimary.FindVote(hashIn) != nullptr;
+}
+
 bool CMasternodePayments::HasVerifiedPaymentVote(const uint256& hashIn) const
 {
-    LOCK(cs_mapMasternodePaymentVotes);
-    const auto it = mapMasternodePaymentVotesPrimary.find(hashIn);
-    return it != mapMasternodePaymentVotesPrimary.end() && it->second.IsVerified();
+    LOCK(cs_mapMasternodeBlocks);
+    const CMasternodePaymentVote* pvote = ringPrimary.FindVote(hashIn);
+    return pvote && pvote->IsVerified();
+}
+
+bool CMasternodePayments::GetVerifiedPaymentVote(const uint256& hashIn, CMasternodePaymentVote& voteRet) const
+{
+    LOCK(cs_mapMasternodeBlocks);
+    const CMasternodePaymentVote* pvote = ringPrimary.FindVote(hashIn);
+    if (!pvote || !pvote->IsVerified()) return false;
+    voteRet = *pvote;
+    return true;
+}
+
+bool CMasternodePayments::HasBlockPayees(int nBlockHeight) const
+{
+    LOCK(cs_mapMasternodeBlocks);
+    const CMasternodePaymentSlot* slot = ringPrimary.Find(nBlockHeight);
+    return slot && slot->HasPayees();
+}
+
+bool CMasternodePayments::GetBlockPaymentVotes(int nBlockHeight, std::vector<CMasternodePaymentVote>& vecVotesRet) const
+{
+    LOCK(cs_mapMasternodeBlocks);
+
+    vecVotesRet.clear();
+    const CMasternodePaymentSlot* slot = ringPrimary.Find(nBlockHeight);
+    if (!slot || !slot->HasPayees()) return false;
+
+    for (const auto& payee : slot->payees.vecPayees) {
+        for (const auto& hash : payee.GetVoteHashes()) {
+            const auto it = slot->mapVotes.find(hash);
+            if (it != slot->mapVotes.end() && it->second.IsVerified()) {
+                vecVotesRet.push_back(it->second);
+            }
+        }
+    }
+    return true;
+}
+
+void CMasternodeBlockPayees::RebuildIndex()
+{
+    mapPayeeIndex.clear();
+    for (size_t i = 0; i < vecPayees.size(); i++) {
+        mapPayeeIndex.emplace(vecPayees[i].GetPayee(), i);
+    }
 }
 
 void CMasternodeBlockPayees::AddPayee(const CMasternodePaymentVote& vote)
@@ -553,12 +783,11 @@ void CMasternodeBlockPayees::AddPayee(const CMasternodePaymentVote& vote)
     LOCK(cs_vecPayees);
 
     uint256 nVoteHash = vote.GetHash();
-    
-    for (auto& payee : vecPayees) {
-        if (payee.GetPayee() == vote.payee) {
-            payee.AddVoteHash(nVoteHash);
-            return;
-        }
+
+    auto res = mapPayeeIndex.emplace(vote.payee, vecPayees.size());
+    if (!res.second) {
+        vecPayees[res.first->second].AddVoteHash(nVoteHash);
+        return;
     }
     CMasternodePayee payeeNew(vote.payee, nVoteHash);
     vecPayees.push_back(payeeNew);
@@ -573,15 +802,6 @@ bool CMasternodeBlockPayees::GetBestPayee(CScript& payeeRet, int& activationBloc
         return false;
     }
 
-    // Work with a local list of masternodes to avoid deadlocks :(
-    std::map<COutPoint, CMasternode> localMasternodeList = mnodeman.GetFullMasternodeMap();
-    // Pre create a map, so we're not doing CPU expensive magic for each item in the list
-    std::map<std::string, CMasternode> nodeMap;
-    for (const auto& mnpair : localMasternodeList) {
-        std::string strCompare = EncodeDestination(CScriptID(GetScriptForDestination(WitnessV0KeyHash(mnpair.second.pubKeyCollateralAddress.GetID()))));
-        nodeMap[strCompare] = mnpair.second;
-    }
-
     // internal state
     int nVotes = -1;
     int activationHeight = 0;
@@ -595,26 +815,10 @@ bool CMasternodeBlockPayees::GetBestPayee(CScript& payeeRet, int& activationBloc
         int voteCount = payee.GetVoteCount();
         CScript currentPayee = payee.GetPayee();
         // Try to look up the masternode
-        bool gotNode = false;
+        // NOTE: CMasternodeMan never calls back into the payments code while holding its lock
         masternode_info_t mNode;
+        bool gotNode = mnodeman.GetMasternodeInfoFromCollateral(currentPayee, mNode);
 
-        CTxDestination payeeDestinationAddress;
-        ExtractDestination(payee.GetPayee(), payeeDestinationAddress);
-        std::string strAddress = EncodeDestination(payeeDestinationAddress);
-
-        // This should be ok, as vecPayees comes from the masternode list
-        mNode = nodeMap.find(strAddress)->second.GetInfo();
-        gotNode = true;
-
-        // Copied from masternodeman, to avoid having to deal with dealocks
-        // for (const auto& mnpair : localMasternodeList) {
-        //     // Not optimal, but makes it easier to debug
-        //     std::string strCompare = EncodeDestination(CScriptID(GetScriptForDestination(WitnessV0KeyHash(mnpair.second.pubKeyCollateralAddress.GetID()))));
-        //     if (strCompare == strAddress) {
-        //         mNode = mnpair.second.GetInfo();
-        //         gotNode = true;
-        //     } 
-        // }
         // Check for (and try to fix) wonkiness...
         int payeeActivationHeight = 0;
         if (gotNode && mNode.activationBlockHeight != 0)
@@ -668,10 +872,9 @@ bool CMasternodeBlockPayees::HasPayeeWithVotes(const CScript& payeeIn, int nVote
 {
     LOCK(cs_vecPayees);
 
-    for (const auto& payee : vecPayees) {
-        if (payee.GetVoteCount() >= nVotesReq &&  payee.GetPayee() == payeeIn) {
-            return true;
-        }
+    const auto it = mapPayeeIndex.find(payeeIn);
+    if (it != mapPayeeIndex.end() && vecPayees[it->second].GetVoteCount() >= nVotesReq) {
+        return true;
     }
 
     LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeBlockPayees::HasPayeeWithVotes -- ERROR: couldn't find any payee with %d+ votes\n", nVotesReq);
@@ -711,26 +914,29 @@ bool CMasternodeBlockPayees::IsTransactionValid(const CTransactionRef& txNew, in
     // if we don't have at least MNPAYMENTS_SIGNATURES_REQUIRED signatures on a payee, approve whichever is the longest chain
     if (nMaxSignatures < MNPAYMENTS_SIGNATURES_REQUIRED) return true;
 
+    // look the outputs up by payee instead of matching every payee against every output
+    for (const auto& txout : txNew->vout) {
+        const auto it = mapPayeeIndex.find(txout.scriptPubKey);
+        if (it == mapPayeeIndex.end()) continue;
+
+        CAmount actualAmount = txout.nValue;
+        CAmount maxPaymentallowed = nMaxMasternodeAmount;
+        bool checkVoteCount = vecPayees[it->second].GetVoteCount() >= MNPAYMENTS_SIGNATURES_REQUIRED;
+        bool checkGreaterThan = actualAmount >= nMinMasternodeAmount;
+        bool checkLessThan = actualAmount <= maxPaymentallowed;
+
+        if (checkVoteCount
+            && checkGreaterThan
+            && checkLessThan
+            ) {
+            LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeBlockPayees::IsTransactionValid -- Found required payment\n");
+            return true;
+        }
+    }
+
     for (const auto& payee : vecPayees) {
         int payeeVoteCount = payee.GetVoteCount();
         if (payeeVoteCount >= MNPAYMENTS_SIGNATURES_REQUIRED) {
-            for (const auto& txout : txNew->vout) {
-                CAmount actualAmount = txout.nValue;
-                CAmount maxPaymentallowed = nMaxMasternodeAmount;
-                bool checkPayeeMatch = payee.GetPayee() == txout.scriptPubKey;
-                bool checkGreaterThan = actualAmount >= nMinMasternodeAmount;
-                bool checkLessThan = actualAmount <= maxPaymentallowed;
-
-
-                if (checkPayeeMatch 
-                    && checkGreaterThan
-                    && checkLessThan
-                    ) {
-                    LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeBlockPayees::IsTransactionValid -- Found required payment\n");
-                    return true;
-                }
-            }
-            
             CTxDestination address;
             ExtractDestination(payee.GetPayee(), address);
 
@@ -772,37 +978,31 @@ std::string CMasternodePayments::GetRequiredPaymentsString(int nBlockHeight) con
 {
     LOCK(cs_mapMasternodeBlocks);
 
-    const auto it = mapMasternodeBlocksPrimary.find(nBlockHeight);
-    return it == mapMasternodeBlocksPrimary.end() ? "Unknown" : it->second.GetRequiredPaymentsString();
+    const CMasternodePaymentSlot* slot = ringPrimary.Find(nBlockHeight);
+    return slot && slot->HasPayees() ? slot->payees.GetRequiredPaymentsString() : "Unknown";
 }
 
 bool CMasternodePayments::IsTransactionValid(const CTransactionRef& txNew, int nBlockHeight, CAmount blockReward) const
 {
     LOCK(cs_mapMasternodeBlocks);
 
-    const auto it = mapMasternodeBlocksPrimary.find(nBlockHeight);
-    return it == mapMasternodeBlocksPrimary.end() ? true : it->second.IsTransactionValid(txNew, nBlockHeight, blockReward);
+    const CMasternodePaymentSlot* slot = ringPrimary.Find(nBlockHeight);
+    return slot && slot->HasPayees() ? slot->payees.IsTransactionValid(txNew, nBlockHeight, blockReward) : true;
 }
 
 void CMasternodePayments::CheckAndRemove()
 {
     if (!masternodeSync.IsBlockchainSynced()) return;
 
-    LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePaymentVotes);
-
     int nLimit = GetStorageLimit();
+    int nCapacity = GetRingCapacity();
 
-    std::map<uint256, CMasternodePaymentVote>::iterator it = mapMasternodePaymentVotesPrimary.begin();
-    while(it != mapMasternodePaymentVotesPrimary.end()) {
-        CMasternodePaymentVote vote = (*it).second;
+    LOCK(cs_mapMasternodeBlocks);
 
-        if (nCachedBlockHeight - vote.nBlockHeight > nLimit) {
-            LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodePayments::CheckAndRemove -- Removing old Masternode payment: nBlockHeight=%d\n", vote.nBlockHeight);
-            mapMasternodePaymentVotesPrimary.erase(it++);
-            mapMasternodeBlocksPrimary.erase(vote.nBlockHeight);
-        } else {
-            ++it;
-        }
+    ringPrimary.Reserve(nCapacity);
+    int nRemoved = ringPrimary.RemoveBelow(nCachedBlockHeight - nLimit);
+    if (nRemoved) {
+        LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodePayments::CheckAndRemove -- Removed %d old Masternode payment blocks below nBlockHeight=%d\n", nRemoved, nCachedBlockHeight - nLimit);
     }
     LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodePayments::CheckAndRemove -- %s\n", ToString());
 }
@@ -904,7 +1104,7 @@ bool CMasternodePayments::ProcessBlock(int nBlockHeight, CConnman& connman)
 
     LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodePayments::ProcessBlock -- Masternode found by GetNextMasternodesInQueueForPayment(): %s\n", mnInfo.outpoint.ToStringShort());
 
-    CScript payee = GetScriptForDestination(CScriptID(GetScriptForDestination(WitnessV0KeyHash(mnInfo.pubKeyCollateralAddress.GetID()))));
+    CScript payee = mnInfo.payee;
 
     CMasternodePaymentVote voteNew(activeMasternode.outpoint, nBlockHeight, payee, activeMasternode.activationBlockHeight);
 
@@ -944,17 +1144,18 @@ void CMasternodePayments::CheckBlockVotes(int nBlockHeight)
 
     LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePaymentVotes);
 
+    const CMasternodePaymentSlot* slot = ringPrimary.Find(nBlockHeight);
+
     int i{0};
     for (const auto& mn : mns) {
         CScript payee;
         bool found = false;
 
-        const auto it = mapMasternodeBlocksPrimary.find(nBlockHeight);
-        if (it != mapMasternodeBlocksPrimary.end()) {
-            for (const auto& p : it->second.vecPayees) {
+        if (slot) {
+            for (const auto& p : slot->payees.vecPayees) {
                 for (const auto& voteHash : p.GetVoteHashes()) {
-                    const auto itVote = mapMasternodePaymentVotesPrimary.find(voteHash);
-                    if (itVote == mapMasternodePaymentVotesPrimary.end()) {
+                    const auto itVote = slot->mapVotes.find(voteHash);
+                    if (itVote == slot->mapVotes.end()) {
                         debugStr += strprintf("    - could not find vote %s\n",
                                               voteHash.ToString());
                         continue;
@@ -1078,16 +1279,15 @@ void CMasternodePayments::Sync(CNode* pnode, CConnman& connman) const
 
     int nInvCount = 0;
 
-    for(int h = nCachedBlockHeight; h < nCachedBlockHeight + 20; h++) {
-        const auto it = mapMasternodeBlocksPrimary.find(h);
-        if (it != mapMasternodeBlocksPrimary.end()) {
-            for (const auto& payee : it->second.vecPayees) {
-                std::vector<uint256> vecVoteHashes = payee.GetVoteHashes();
-                for (const auto& hash : vecVoteHashes) {
-                    if (!HasVerifiedPaymentVote(hash)) continue;
-                    pnode->PushInventory(CInv(MSG_MASTERNODE_PAYMENT_VOTE_PRIMARY, hash));
-                    nInvCount++;
-                }
+    for(int h = nCachedBlockHeight; h < nCachedBlockHeight + MNPAYMENTS_FUTURE_VOTES_LIMIT; h++) {
+        const CMasternodePaymentSlot* slot = ringPrimary.Find(h);
+        if (!slot) continue;
+        for (const auto& payee : slot->payees.vecPayees) {
+            for (const auto& hash : payee.GetVoteHashes()) {
+                const auto itVote = slot->mapVotes.find(hash);
+                if (itVote == slot->mapVotes.end() || !itVote->second.IsVerified()) continue;
+                pnode->PushInventory(CInv(MSG_MASTERNODE_PAYMENT_VOTE_PRIMARY, hash));
+                nInvCount++;
             }
         }
     }
@@ -1111,47 +1311,29 @@ void CMasternodePayments::RequestLowDataPaymentBlocks(CNode* pnode, CConnman& co
 
     const CBlockIndex *pindex = chainActive.Tip();
 
+    // Only the heights of the storage window can be stored, so walking the chain
+    // back through it finds both the unknown and the low data blocks
     while(nCachedBlockHeight - pindex->nHeight < nLimit) {
-        const auto it = mapMasternodeBlocksPrimary.find(pindex->nHeight);
-        if (it == mapMasternodeBlocksPrimary.end()) {
+        const CMasternodePaymentSlot* slot = ringPrimary.Find(pindex->nHeight);
+        if (!slot || !slot->HasPayees()) {
             // We have no idea about this block height, let's ask
             vToFetch.push_back(CInv(MSG_MASTERNODE_PAYMENT_BLOCK_PRIMARY, pindex->GetBlockHash()));
-            // We should not violate GETDATA rules
-            if (vToFetch.size() == MAX_INV_SZ) {
-                LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodePayments::RequestLowDataPaymentBlocks -- asking peer=%d for %d blocks\n", pnode->GetId(), MAX_INV_SZ);
-                connman.PushMessage(pnode, msgMaker.Make(NetMsgType::GETDATA, vToFetch));
-                // connman.PushMessage(pnode, NetMsgType::GETDATA, vToFetch);
-                // Start filling new batch
-                vToFetch.clear();
+        } else {
+            int nTotalVotes = 0;
+            bool fFound = false;
+            for (const auto& payee : slot->payees.vecPayees) {
+                if (payee.GetVoteCount() >= MNPAYMENTS_SIGNATURES_REQUIRED) {
+                    fFound = true;
+                    break;
+                }
+                nTotalVotes += payee.GetVoteCount();
             }
-        }
-        if (!pindex->pprev) break;
-        pindex = pindex->pprev;
-    }
-
-    auto it = mapMasternodeBlocksPrimary.begin();
-
-    while(it != mapMasternodeBlocksPrimary.end()) {
-        int nTotalVotes = 0;
-        bool fFound = false;
-        for (const auto& payee : it->second.vecPayees) {
-            if (payee.GetVoteCount() >= MNPAYMENTS_SIGNATURES_REQUIRED) {
-                fFound = true;
-                break;
+            // No clear winner (MNPAYMENTS_SIGNATURES_REQUIRED+ votes) was found
+            // and there are less than avg number of votes either
+            if (!fFound && nTotalVotes < (MNPAYMENTS_SIGNATURES_TOTAL + MNPAYMENTS_SIGNATURES_REQUIRED)/2) {
+                // Low data block found, let's try to sync it
+                vToFetch.push_back(CInv(MSG_MASTERNODE_PAYMENT_BLOCK_PRIMARY, pindex->GetBlockHash()));
             }
-            nTotalVotes += payee.GetVoteCount();
-        }
-        // A clear winner (MNPAYMENTS_SIGNATURES_REQUIRED+ votes) was found
-        // or no clear winner was found but there are at least avg number of votes
-        if (fFound || nTotalVotes >= (MNPAYMENTS_SIGNATURES_TOTAL + MNPAYMENTS_SIGNATURES_REQUIRED)/2) {
-            // so just move to the next block
-            ++it;
-            continue;
-        }
-        // Low data block found, let's try to sync it
-        uint256 hash;
-        if (GetBlockHash(hash, it->first)) {
-            vToFetch.push_back(CInv(MSG_MASTERNODE_PAYMENT_BLOCK_PRIMARY, hash));
         }
         // We should not violate GETDATA rules
         if (vToFetch.size() == MAX_INV_SZ) {
@@ -1161,7 +1343,8 @@ void CMasternodePayments::RequestLowDataPaymentBlocks(CNode* pnode, CConnman& co
             // Start filling new batch
             vToFetch.clear();
         }
-        ++it;
+        if (!pindex->pprev) break;
+        pindex = pindex->pprev;
     }
     // Ask for the rest of it
     if (!vToFetch.empty()) {
@@ -1175,8 +1358,8 @@ std::string CMasternodePayments::ToString() const
 {
     std::ostringstream info;
 
-    info << "Votes: " << (int)mapMasternodePaymentVotesPrimary.size() <<
-            ", Blocks: " << (int)mapMasternodeBlocksPrimary.size();
+    info << "Votes: " << GetVoteCount() <<
+            ", Blocks: " << GetBlockCount();
 
     return info.str();
 }
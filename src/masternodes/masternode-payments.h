@@ -11,8 +11,12 @@
 #include <key.h>
 #include <masternodes/masternode.h>
 #include <net_processing.h>
+#include <saltedhasher.h>
 #include <utilstrencodings.h>
 
+#include <limits>
+#include <unordered_map>
+
 class CMasternodePayments;
 class CMasternodePaymentVote;
 class CMasternodeBlockPayees;
@@ -21,6 +25,8 @@ class CChainParams;
 static const int MNPAYMENTS_SIGNATURES_REQUIRED         = 6;
 static const int MNPAYMENTS_SIGNATURES_TOTAL            = 10;
 static const int MN_PAYMENTS_UPDATE_THRESHOLD           = 4000;
+// votes are accepted for up to this many blocks past the tip
+static const int MNPAYMENTS_FUTURE_VOTES_LIMIT          = 20;
 
 //! minimum peer version that can receive and send masternode payment messages,
 //  vote for masternode and be elected as a payment winner
@@ -84,15 +90,23 @@ public:
 // Keep track of votes for payees from masternodes
 class CMasternodeBlockPayees
 {
+private:
+    // position of each payee in vecPayees
+    std::map<CScript, size_t> mapPayeeIndex;
+
+    void RebuildIndex();
+
 public:
     int nBlockHeight;
     std::vector<CMasternodePayee> vecPayees;
 
     CMasternodeBlockPayees() :
+        mapPayeeIndex(),
         nBlockHeight(0),
         vecPayees()
         {}
     CMasternodeBlockPayees(int nBlockHeightIn) :
+        mapPayeeIndex(),
         nBlockHeight(nBlockHeightIn),
         vecPayees()
         {}
@@ -103,6 +117,9 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action) {
         READWRITE(nBlockHeight);
         READWRITE(vecPayees);
+        if (ser_action.ForRead()) {
+            RebuildIndex();
+        }
     }
 
     void AddPayee(const CMasternodePaymentVote& vote);
@@ -203,6 +220,82 @@ public:
 };
 
 
+// Payment votes and payees of a single block height
+class CMasternodePaymentSlot
+{
+public:
+    // -1 while the slot is unused
+    int nBlockHeight;
+    // votes for this height by hash, including the ones which are not verified yet
+    std::map<uint256, CMasternodePaymentVote> mapVotes;
+    CMasternodeBlockPayees payees;
+
+    CMasternodePaymentSlot() :
+        nBlockHeight(-1),
+        mapVotes(),
+        payees()
+        {}
+
+    bool IsUsed() const { return nBlockHeight >= 0; }
+    bool HasPayees() const { return !payees.vecPayees.empty(); }
+};
+
+/** Payment votes and block payees of the storage window, in a ring indexed by block height
+ *
+ *  Height h lives in slot h % capacity. The capacity covers every height votes
+ *  are accepted for, so a slot holding some other height holds one which fell
+ *  out of the window: pruning drops whole slots and a block's payees and votes
+ *  are found without a search. Not thread safe, CMasternodePayments guards it
+ *  with cs_mapMasternodeBlocks.
+ */
+class CMasternodePaymentRing
+{
+private:
+    std::vector<CMasternodePaymentSlot> vecSlots;
+    // height of every stored vote
+    std::unordered_map<uint256, int, SaltedTxidHasher> mapVoteHeights;
+    // number of slots with payees
+    int nBlockCount;
+    // no slot holds a lower height
+    int nLowestHeight;
+
+    size_t GetSlotIndex(int nBlockHeight) const { return nBlockHeight % vecSlots.size(); }
+    void ClearSlot(CMasternodePaymentSlot& slot);
+
+public:
+    CMasternodePaymentRing() :
+        vecSlots(),
+        mapVoteHeights(),
+        nBlockCount(0),
+        nLowestHeight(std::numeric_limits<int>::max())
+        {}
+
+    /// Make room for nCapacity heights, the ring never shrinks
+    void Reserve(int nCapacity);
+    size_t GetCapacity() const { return vecSlots.size(); }
+
+    /// The slot holding nBlockHeight, nullptr if there is none
+    const CMasternodePaymentSlot* Find(int nBlockHeight) const;
+    /// The slot for nBlockHeight, the older height it held is dropped. nullptr if it holds a newer one.
+    CMasternodePaymentSlot* Get(int nBlockHeight);
+
+    const CMasternodePaymentVote* FindVote(const uint256& hash) const;
+    /// Store a vote and, if fAddPayee is set, count it for its payee
+    bool AddVote(const uint256& hash, const CMasternodePaymentVote& vote, bool fAddPayee);
+
+    /// Drop every height below nMinHeight, returns the number of dropped slots
+    int RemoveBelow(int nMinHeight);
+    void Clear();
+
+    int GetBlockCount() const { return nBlockCount; }
+    int GetVoteCount() const { return mapVoteHeights.size(); }
+
+    /// Copy the contents to the maps which are stored on disk
+    void ToMaps(std::map<uint256, CMasternodePaymentVote>& mapVotesRet, std::map<int, CMasternodeBlockPayees>& mapBlocksRet) const;
+    /// Refill from the maps which are stored on disk, Reserve() first
+    void FromMaps(const std::map<uint256, CMasternodePaymentVote>& mapVotes, const std::map<int, CMasternodeBlockPayees>& mapBlocks);
+};
+
 //
 // Masternode Payments Class
 // Keeps track of who should get paid for which blocks
@@ -219,30 +312,52 @@ private:
     // Keep track of current block height
     int nCachedBlockHeight;
 
+    // primary payment votes and block payees, guarded by cs_mapMasternodeBlocks
+    CMasternodePaymentRing ringPrimary;
+
+    // heights the ring has to hold: the storage window and the future blocks votes are accepted for
+    int GetRingCapacity() const { return GetStorageLimit() + MNPAYMENTS_FUTURE_VOTES_LIMIT + 1; }
+
 public:
-    std::map<uint256, CMasternodePaymentVote> mapMasternodePaymentVotesPrimary;
     std::map<uint256, CMasternodePaymentVotes> mapMasternodePaymentVotesSecondary;
-    std::map<int, CMasternodeBlockPayees> mapMasternodeBlocksPrimary;
     std::map<int, CMasternodeBlockPayees> mapMasternodeBlocksSecondary;
     std::map<COutPoint, int> mapMasternodesLastVote;
     std::map<COutPoint, int> mapMasternodesDidNotVote;
 
-    CMasternodePayments() : nStorageCoeff(1.25), nMinBlocksToStore(6000) {}
+    CMasternodePayments() : nStorageCoeff(1.25), nMinBlocksToStore(6000), nCachedBlockHeight(0) {}
 
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action) {
-        READWRITE(mapMasternodePaymentVotesPrimary);
+        // stored as plain maps, the ring depends on the size of the masternode list
+        std::map<uint256, CMasternodePaymentVote> mapVotesPrimary;
+        std::map<int, CMasternodeBlockPayees> mapBlocksPrimary;
+        int nCapacity = GetRingCapacity();
+
+        LOCK(cs_mapMasternodeBlocks);
+        if (!ser_action.ForRead()) {
+            ringPrimary.ToMaps(mapVotesPrimary, mapBlocksPrimary);
+        }
+        READWRITE(mapVotesPrimary);
         READWRITE(mapMasternodePaymentVotesSecondary);
-        READWRITE(mapMasternodeBlocksPrimary);
+        READWRITE(mapBlocksPrimary);
         READWRITE(mapMasternodeBlocksSecondary);
+        if (ser_action.ForRead()) {
+            ringPrimary.Reserve(nCapacity);
+            ringPrimary.FromMaps(mapVotesPrimary, mapBlocksPrimary);
+        }
     }
 
     void Clear();
 
     bool AddOrUpdatePaymentVote(const CMasternodePaymentVote& vote);
+    bool HasPaymentVote(const uint256& hashIn) const;
     bool HasVerifiedPaymentVote(const uint256& hashIn) const;
+    bool GetVerifiedPaymentVote(const uint256& hashIn, CMasternodePaymentVote& voteRet) const;
+    bool HasBlockPayees(int nBlockHeight) const;
+    /// Verified votes for the payees of a block
+    bool GetBlockPaymentVotes(int nBlockHeight, std::vector<CMasternodePaymentVote>& vecVotesRet) const;
     bool ProcessBlock(int nBlockHeight, CConnman& connman);
     void CheckBlockVotes(int nBlockHeight);
 
@@ -253,6 +368,8 @@ public:
     bool GetBlockPayees(int nBlockHeight, CScript& payeeRet, int& activationHeightRet) const;
     bool IsTransactionValid(const CTransactionRef& txNew, int nBlockHeight, CAmount blockReward) const;
     bool IsScheduled(const masternode_info_t& mnInfo, int nNotBlockHeight) const;
+    /// Collect the payees of the blocks IsScheduled() looks at
+    void GetScheduledPayees(int nNotBlockHeight, std::set<CScript>& setPayeesRet) const;
 
     bool UpdateLastVote(const CMasternodePaymentVote& vote);
 
@@ -262,8 +379,8 @@ public:
     void FillBlockPayees(CMutableTransaction& txNew, int nBlockHeight, CAmount blockReward, std::vector<CTxOut>& vtxoutMasternodeRet) const;
     std::string ToString() const;
 
-    int GetBlockCount() const { return mapMasternodeBlocksPrimary.size(); }
-    int GetVoteCount() const { return mapMasternodePaymentVotesPrimary.size(); }
+    int GetBlockCount() const { return ringPrimary.GetBlockCount(); }
+    int GetVoteCount() const { return ringPrimary.GetVoteCount(); }
 
     bool IsEnoughData() const;
     int GetStorageLimit() const;
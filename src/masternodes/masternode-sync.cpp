@@ -16,34 +16,107 @@
 #include <ui_interface.h>
 #include <util.h>
 
+#include <limits>
+#include <set>
+
 class CMasternodeSync;
 CMasternodeSync masternodeSync;
 
+int CMasternodeSyncAsset::CountActivePeers(int64_t nNow) const
+{
+    int nCount = 0;
+    for (const auto& peerpair : mapPeers) {
+        if (peerpair.second.IsActive(nNow)) nCount++;
+    }
+    return nCount;
+}
+
+int CMasternodeSyncAsset::CountCompletePeers() const
+{
+    int nCount = 0;
+    for (const auto& peerpair : mapPeers) {
+        if (peerpair.second.fComplete) nCount++;
+    }
+    return nCount;
+}
+
+int CMasternodeSyncAsset::GetExpectedItems() const
+{
+    int nExpected = 0;
+    for (const auto& peerpair : mapPeers) {
+        nExpected = std::max(nExpected, peerpair.second.nExpectedItems);
+    }
+    return nExpected;
+}
+
+double CMasternodeSyncAsset::GetProgress() const
+{
+    if (IsFinished()) return 1;
+    int nExpected = GetExpectedItems();
+    if (!IsStarted() || nExpected == 0) return 0;
+    // peers may announce items we already have, only finishing the asset completes it
+    return std::min(0.99, double(nItems) / nExpected);
+}
+
 void CMasternodeSync::Fail()
 {
+    LOCK(cs);
     nTimeLastFailure = GetTime();
     nRequestedMasternodeAssets = MASTERNODE_SYNC_FAILED;
 }
 
-void CMasternodeSync::Reset()
+void CMasternodeSync::ResetState()
 {
     nRequestedMasternodeAssets = MASTERNODE_SYNC_INITIAL;
     nRequestedMasternodeAttempt = 0;
     nTimeAssetSyncStarted = GetTime();
     nTimeLastBumped = GetTime();
     nTimeLastFailure = 0;
+    mapAssets.clear();
+    mapAssets[MASTERNODE_SYNC_LIST];
+    mapAssets[MASTERNODE_SYNC_MNW];
+    mapAssets[MASTERNODE_SYNC_GOVERNANCE];
+}
+
+void CMasternodeSync::Reset()
+{
+    LOCK(cs);
+    ResetState();
 }
 
 void CMasternodeSync::BumpAssetLastTime(const std::string& strFuncName)
 {
     if (IsSynced() || IsFailed()) return;
+    LOCK(cs);
     nTimeLastBumped = GetTime();
     LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeSync::BumpAssetLastTime -- %s\n", strFuncName);
 }
 
-std::string CMasternodeSync::GetAssetName()
+void CMasternodeSync::BumpAssetLastTime(const std::string& strFuncName, int nAsset, const CNode* pfrom)
+{
+    if (IsSynced() || IsFailed()) return;
+    LOCK(cs);
+    auto it = mapAssets.find(nAsset);
+    if (it == mapAssets.end() || !it->second.IsRunning()) return;
+
+    int64_t nNow = GetTime();
+    CMasternodeSyncAsset& asset = it->second;
+    asset.nTimeLastBumped = nNow;
+    nTimeLastBumped = nNow;
+    if (pfrom) {
+        asset.nItems++;
+        auto itPeer = asset.mapPeers.find(pfrom->GetId());
+        if (itPeer != asset.mapPeers.end()) {
+            itPeer->second.nItems++;
+            itPeer->second.nTimeLastItem = nNow;
+        }
+    }
+    LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeSync::BumpAssetLastTime -- %s %s peer=%d\n", GetAssetName(nAsset), strFuncName, pfrom ? pfrom->GetId() : -1);
+}
+
+std::string CMasternodeSync::GetAssetName(int nAsset)
 {
-    switch(nRequestedMasternodeAssets)
+    switch(nAsset)
     {
         case(MASTERNODE_SYNC_INITIAL):      return "MASTERNODE_SYNC_INITIAL";
         case(MASTERNODE_SYNC_WAITING):      return "MASTERNODE_SYNC_WAITING";
@@ -56,58 +129,107 @@ std::string CMasternodeSync::GetAssetName()
     }
 }
 
-void CMasternodeSync::SwitchToNextAsset(CConnman& connman)
+void CMasternodeSync::StartAsset(int nAsset)
 {
-    switch(nRequestedMasternodeAssets)
-    {
-        case(MASTERNODE_SYNC_FAILED):
-            throw std::runtime_error("Can't switch to next asset from failed, should use Reset() first!");
-            break;
-        case(MASTERNODE_SYNC_INITIAL):
-            nRequestedMasternodeAssets = MASTERNODE_SYNC_WAITING;
-            LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeSync::SwitchToNextAsset -- Starting %s\n", GetAssetName());
-            break;
-        case(MASTERNODE_SYNC_WAITING):
-            LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeSync::SwitchToNextAsset -- Completed %s in %llds\n", GetAssetName(), GetTime() - nTimeAssetSyncStarted);
-            nRequestedMasternodeAssets = MASTERNODE_SYNC_LIST;
-            LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeSync::SwitchToNextAsset -- Starting %s\n", GetAssetName());
-            break;
-        case(MASTERNODE_SYNC_LIST):
-            LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeSync::SwitchToNextAsset -- Completed %s in %llds\n", GetAssetName(), GetTime() - nTimeAssetSyncStarted);
-            nRequestedMasternodeAssets = MASTERNODE_SYNC_MNW;
-            LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeSync::SwitchToNextAsset -- Starting %s\n", GetAssetName());
-            break;
-        case(MASTERNODE_SYNC_MNW):
-            LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeSync::SwitchToNextAsset -- Completed %s in %llds\n", GetAssetName(), GetTime() - nTimeAssetSyncStarted);
-            nRequestedMasternodeAssets = MASTERNODE_SYNC_GOVERNANCE;
-            LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeSync::SwitchToNextAsset -- Starting %s\n", GetAssetName());
-            break;
-        case(MASTERNODE_SYNC_GOVERNANCE):
-            LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeSync::SwitchToNextAsset -- Completed %s in %llds\n", GetAssetName(), GetTime() - nTimeAssetSyncStarted);
-            nRequestedMasternodeAssets = MASTERNODE_SYNC_FINISHED;
-            uiInterface.NotifyAdditionalDataSyncProgressChanged(1);
-            //try to activate our masternode if possible
-            activeMasternode.ManageState(connman);
+    AssertLockHeld(cs);
 
-            connman.ForEachNode(CConnman::AllNodes, [](CNode* pnode) {
-                netfulfilledman.AddFulfilledRequest(pnode->addr, "full-sync");
-            });
-            LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeSync::SwitchToNextAsset -- Sync has finished\n");
+    CMasternodeSyncAsset& asset = mapAssets[nAsset];
+    asset = CMasternodeSyncAsset();
+    asset.nTimeStarted = GetTime();
+    asset.nTimeLastBumped = asset.nTimeStarted;
+    LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeSync::StartAsset -- Starting %s\n", GetAssetName(nAsset));
+}
+
+bool CMasternodeSync::FinishAsset(int nAsset)
+{
+    AssertLockHeld(cs);
+
+    CMasternodeSyncAsset& asset = mapAssets[nAsset];
+    if (!asset.IsRunning()) return false;
+
+    asset.nTimeFinished = GetTime();
+    LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeSync::FinishAsset -- Completed %s in %llds\n", GetAssetName(nAsset), asset.nTimeFinished - asset.nTimeStarted);
 
+    if (nAsset == MASTERNODE_SYNC_LIST) {
+        // payment votes and governance objects only need the list, not each other
+        StartAsset(MASTERNODE_SYNC_MNW);
+        StartAsset(MASTERNODE_SYNC_GOVERNANCE);
+    }
+
+    int nAssetNew = MASTERNODE_SYNC_FINISHED;
+    for (int nAssetNext : {MASTERNODE_SYNC_LIST, MASTERNODE_SYNC_MNW, MASTERNODE_SYNC_GOVERNANCE}) {
+        if (!mapAssets[nAssetNext].IsFinished()) {
+            nAssetNew = nAssetNext;
             break;
+        }
+    }
+    if (nAssetNew != nRequestedMasternodeAssets) {
+        nRequestedMasternodeAssets = nAssetNew;
+        nRequestedMasternodeAttempt = nAssetNew == MASTERNODE_SYNC_FINISHED ? 0 : mapAssets[nAssetNew].mapPeers.size();
+        nTimeAssetSyncStarted = nAssetNew == MASTERNODE_SYNC_FINISHED ? GetTime() : mapAssets[nAssetNew].nTimeStarted;
+    }
+    return nAssetNew == MASTERNODE_SYNC_FINISHED;
+}
+
+void CMasternodeSync::FinishSync(CConnman& connman)
+{
+    uiInterface.NotifyAdditionalDataSyncProgressChanged(1);
+    //try to activate our masternode if possible
+    activeMasternode.ManageState(connman);
+
+    connman.ForEachNode(CConnman::AllNodes, [](CNode* pnode) {
+        netfulfilledman.AddFulfilledRequest(pnode->addr, "full-sync");
+    });
+    LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeSync::FinishSync -- Sync has finished\n");
+}
+
+void CMasternodeSync::SwitchToNextAsset(CConnman& connman)
+{
+    bool fSyncFinished = false;
+    {
+        LOCK(cs);
+        switch(nRequestedMasternodeAssets)
+        {
+            case(MASTERNODE_SYNC_FAILED):
+                throw std::runtime_error("Can't switch to next asset from failed, should use Reset() first!");
+                break;
+            case(MASTERNODE_SYNC_INITIAL):
+                nRequestedMasternodeAssets = MASTERNODE_SYNC_WAITING;
+                nRequestedMasternodeAttempt = 0;
+                nTimeAssetSyncStarted = GetTime();
+                LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeSync::SwitchToNextAsset -- Starting %s\n", GetAssetName());
+                break;
+            case(MASTERNODE_SYNC_WAITING):
+                LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeSync::SwitchToNextAsset -- Completed %s in %llds\n", GetAssetName(), GetTime() - nTimeAssetSyncStarted);
+                nRequestedMasternodeAssets = MASTERNODE_SYNC_LIST;
+                nRequestedMasternodeAttempt = 0;
+                nTimeAssetSyncStarted = GetTime();
+                StartAsset(MASTERNODE_SYNC_LIST);
+                break;
+            case(MASTERNODE_SYNC_LIST):
+            case(MASTERNODE_SYNC_MNW):
+            case(MASTERNODE_SYNC_GOVERNANCE):
+                // payment votes and governance run side by side, this finishes the lower one
+                fSyncFinished = FinishAsset(nRequestedMasternodeAssets);
+                break;
+        }
+        BumpAssetLastTime("CMasternodeSync::SwitchToNextAsset");
+    }
+    if (fSyncFinished) {
+        FinishSync(connman);
     }
-    nRequestedMasternodeAttempt = 0;
-    nTimeAssetSyncStarted = GetTime();
-    BumpAssetLastTime("CMasternodeSync::SwitchToNextAsset");
 }
 
 std::string CMasternodeSync::GetSyncStatus()
 {
-    switch (masternodeSync.nRequestedMasternodeAssets) {
+    LOCK(cs);
+    switch (nRequestedMasternodeAssets) {
         case MASTERNODE_SYNC_INITIAL:       return _("Synchroning blockchain...");
         case MASTERNODE_SYNC_WAITING:       return _("Synchronization pending...");
         case MASTERNODE_SYNC_LIST:          return _("Synchronizing masternodes...");
-        case MASTERNODE_SYNC_MNW:           return _("Synchronizing masternode payments...");
+        case MASTERNODE_SYNC_MNW:
+            if (mapAssets[MASTERNODE_SYNC_GOVERNANCE].IsFinished()) return _("Synchronizing masternode payments...");
+            return _("Synchronizing masternode payments and governance objects...");
         case MASTERNODE_SYNC_GOVERNANCE:    return _("Synchronizing governance objects...");
         case MASTERNODE_SYNC_FAILED:        return _("Synchronization failed");
         case MASTERNODE_SYNC_FINISHED:      return _("Synchronization finished");
@@ -115,6 +237,60 @@ std::string CMasternodeSync::GetSyncStatus()
     }
 }
 
+double CMasternodeSync::GetSyncProgress()
+{
+    if (IsSynced()) return 1;
+    if (!IsBlockchainSynced()) return 0;
+
+    LOCK(cs);
+    // the blockchain counts as the first quarter
+    return (1 + mapAssets[MASTERNODE_SYNC_LIST].GetProgress() + mapAssets[MASTERNODE_SYNC_MNW].GetProgress() + mapAssets[MASTERNODE_SYNC_GOVERNANCE].GetProgress()) / 4;
+}
+
+UniValue CMasternodeSync::GetAssetsStatus()
+{
+    LOCK(cs);
+
+    int64_t nNow = GetTime();
+    UniValue objAssets(UniValue::VOBJ);
+    for (const auto& assetpair : mapAssets) {
+        const CMasternodeSyncAsset& asset = assetpair.second;
+        UniValue arrPeers(UniValue::VARR);
+        for (const auto& peerpair : asset.mapPeers) {
+            const CMasternodeSyncPeer& peer = peerpair.second;
+            UniValue objPeer(UniValue::VOBJ);
+            objPeer.push_back(Pair("Peer", peerpair.first));
+            objPeer.push_back(Pair("RequestTime", peer.nTimeRequested));
+            objPeer.push_back(Pair("Items", peer.nItems));
+            objPeer.push_back(Pair("ExpectedItems", peer.nExpectedItems));
+            objPeer.push_back(Pair("Throughput", peer.GetThroughput()));
+            objPeer.push_back(Pair("IsAnswered", peer.fAnswered));
+            objPeer.push_back(Pair("IsStalled", peer.IsStalled(nNow)));
+            arrPeers.push_back(objPeer);
+        }
+        UniValue objAsset(UniValue::VOBJ);
+        objAsset.push_back(Pair("Status", asset.IsFinished() ? "finished" : asset.IsStarted() ? "syncing" : "waiting"));
+        objAsset.push_back(Pair("StartTime", asset.nTimeStarted));
+        objAsset.push_back(Pair("FinishTime", asset.nTimeFinished));
+        objAsset.push_back(Pair("Items", asset.nItems));
+        objAsset.push_back(Pair("ExpectedItems", asset.GetExpectedItems()));
+        objAsset.push_back(Pair("Progress", asset.GetProgress()));
+        objAsset.push_back(Pair("Peers", arrPeers));
+        objAssets.push_back(Pair(GetAssetName(assetpair.first), objAsset));
+    }
+    return objAssets;
+}
+
+void CMasternodeSync::NotifyMasternodeListReceived(const CNode* pfrom)
+{
+    LOCK(cs);
+    auto& mapPeers = mapAssets[MASTERNODE_SYNC_LIST].mapPeers;
+    auto it = mapPeers.find(pfrom->GetId());
+    if (it == mapPeers.end()) return;
+    it->second.fAnswered = true;
+    it->second.fComplete = true;
+}
+
 void CMasternodeSync::ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv)
 {
     if (strCommand == NetMsgType::SYNCSTATUSCOUNT) { //Sync status count
@@ -127,6 +303,18 @@ void CMasternodeSync::ProcessMessage(CNode* pfrom, const std::string& strCommand
         vRecv >> nItemID >> nCount;
 
         LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] SYNCSTATUSCOUNT -- got inventory count: nItemID=%d  nCount=%d  peer=%d\n", nItemID, nCount, pfrom->GetId());
+
+        // objects and votes both count for governance
+        int nAsset = (nItemID == MASTERNODE_SYNC_GOVOBJ || nItemID == MASTERNODE_SYNC_GOVOBJ_VOTE) ? MASTERNODE_SYNC_GOVERNANCE : nItemID;
+
+        LOCK(cs);
+        auto it = mapAssets.find(nAsset);
+        if (it == mapAssets.end()) return;
+        auto itPeer = it->second.mapPeers.find(pfrom->GetId());
+        if (itPeer == it->second.mapPeers.end()) return;
+        CMasternodeSyncPeer& peer = itPeer->second;
+        peer.nExpectedItems = (int)std::min<int64_t>(int64_t(peer.nExpectedItems) + std::max(nCount, 0), std::numeric_limits<int>::max());
+        peer.fAnswered = true;
     }
 }
 
@@ -165,11 +353,12 @@ void CMasternodeSync::ProcessTick(CConnman& connman)
     }
 
     // Calculate "progress" for LOG reporting / GUI notification
-    double nSyncProgress = double(nRequestedMasternodeAttempt + (nRequestedMasternodeAssets - 1) * 8) / (8*4);
-    LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeSync::ProcessTick -- nTick %d nRequestedMasternodeAssets %d nRequestedMasternodeAttempt %d nSyncProgress %f\n", nTick, nRequestedMasternodeAssets, nRequestedMasternodeAttempt, nSyncProgress);
+    double nSyncProgress = GetSyncProgress();
+    LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeSync::ProcessTick -- nTick %d nRequestedMasternodeAssets %d nRequestedMasternodeAttempt %d nSyncProgress %f\n", nTick, nRequestedMasternodeAssets.load(), nRequestedMasternodeAttempt.load(), nSyncProgress);
     uiInterface.NotifyAdditionalDataSyncProgressChanged(nSyncProgress);
 
     std::vector<CNode*> vNodesCopy = connman.CopyNodeVector(CConnman::FullyConnectedOnly);
+    std::vector<CNode*> vNodes;
 
     for (auto& pnode : vNodesCopy)
     {
@@ -178,24 +367,18 @@ void CMasternodeSync::ProcessTick(CConnman& connman)
         // Inbound connection this early is most likely a "masternode" connection
         // initiated from another node, so skip it too.
         if (pnode->fMasternode || (fMasternodeMode && pnode->fInbound)) continue;
-        
-        const CNetMsgMaker msgMaker(pnode->GetSendVersion());
-        
+
         // QUICK MODE (REGTEST ONLY!)
         if (Params().NetworkIDString() == CBaseChainParams::REGTEST)
         {
+            const CNetMsgMaker msgMaker(pnode->GetSendVersion());
             if (nRequestedMasternodeAttempt <= 2) {
                 mnodeman.DsegUpdate(pnode, connman);
             } else if (nRequestedMasternodeAttempt < 4) {
-                //sync payment votes
-                // if (pnode->nVersion == 70018) {
-                //     connman.PushMessage(pnode, msgMaker.Make(NetMsgType::MASTERNODEPAYMENTSYNC, mnpayments.GetStorageLimit())); //sync payment votes
-                // } else {
-                //     connman.PushMessage(pnode, msgMaker.Make(NetMsgType::MASTERNODEPAYMENTSYNC)); //sync payment votes
-                // }
                 connman.PushMessage(pnode, msgMaker.Make(NetMsgType::MASTERNODEPAYMENTSYNC)); //sync payment votes
                 SendGovernanceSyncRequest(pnode, connman);
             } else {
+                LOCK(cs);
                 nRequestedMasternodeAssets = MASTERNODE_SYNC_FINISHED;
             }
             nRequestedMasternodeAttempt++;
@@ -203,194 +386,224 @@ void CMasternodeSync::ProcessTick(CConnman& connman)
             return;
         }
 
-        // NORMAL NETWORK MODE - TESTNET/MAINNET
-        {
-            if (netfulfilledman.HasFulfilledRequest(pnode->addr, "full-sync")) {
-                // We already fully synced from this node recently,
-                // disconnect to free this connection slot for another peer.
-                pnode->fDisconnect = true;
-                LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeSync::ProcessTick -- disconnecting from recently synced peer=%d\n", pnode->GetId());
-                continue;
-            }
+        if (netfulfilledman.HasFulfilledRequest(pnode->addr, "full-sync")) {
+            // We already fully synced from this node recently,
+            // disconnect to free this connection slot for another peer.
+            pnode->fDisconnect = true;
+            LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeSync::ProcessTick -- disconnecting from recently synced peer=%d\n", pnode->GetId());
+            continue;
+        }
 
-            // INITIAL TIMEOUT
-
-            if (nRequestedMasternodeAssets == MASTERNODE_SYNC_WAITING) {
-                if (GetTime() - nTimeLastBumped > MASTERNODE_SYNC_TIMEOUT_SECONDS) {
-                    // At this point we know that:
-                    // a) there are peers (because we are looping on at least one of them);
-                    // b) we waited for at least MASTERNODE_SYNC_TIMEOUT_SECONDS since we reached
-                    //    the headers tip the last time (i.e. since we switched from
-                    //     MASTERNODE_SYNC_INITIAL to MASTERNODE_SYNC_WAITING and bumped time);
-                    // c) there were no blocks (UpdatedBlockTip, NotifyHeaderTip) or headers (AcceptedBlockHeader)
-                    //    for at least MASTERNODE_SYNC_TIMEOUT_SECONDS.
-                    // We must be at the tip already, let's move to the next asset.
-                    SwitchToNextAsset(connman);
-                }
-            }
+        vNodes.push_back(pnode);
+    }
 
-            // MNLIST : SYNC MASTERNODE LIST FROM OTHER CONNECTED CLIENTS
-
-            if (nRequestedMasternodeAssets == MASTERNODE_SYNC_LIST) {
-                LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeSync::ProcessTick -- nTick %d nRequestedMasternodeAssets %d nTimeLastBumped %lld GetTime() %lld diff %lld\n", nTick, nRequestedMasternodeAssets, nTimeLastBumped, GetTime(), GetTime() - nTimeLastBumped);
-                // check for timeout first
-                if (GetTime() - nTimeLastBumped > MASTERNODE_SYNC_TIMEOUT_SECONDS) {
-                    LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeSync::ProcessTick -- nTick %d nRequestedMasternodeAssets %d -- timeout\n", nTick, nRequestedMasternodeAssets);
-                    if (nRequestedMasternodeAttempt == 0) {
-                        LogPrintG(BCLogLevel::LOG_ERROR, BCLog::MN, "[Masternodes] CMasternodeSync::ProcessTick -- ERROR: failed to sync %s\n", GetAssetName());
-                        // there is no way we can continue without masternode list, fail here and try later
-                        Fail();
-                        connman.ReleaseNodeVector(vNodesCopy);
-                        return;
-                    }
-                    SwitchToNextAsset(connman);
-                    connman.ReleaseNodeVector(vNodesCopy);
-                    return;
-                }
-                
-                // request from three peers max
-                if (nRequestedMasternodeAttempt > 2) {
-                    connman.ReleaseNodeVector(vNodesCopy);
-                    return;
-                }
+    // NORMAL NETWORK MODE - TESTNET/MAINNET
 
-                // only request once from each peer
-                if (netfulfilledman.HasFulfilledRequest(pnode->addr, "masternode-list-sync")) continue;
-                netfulfilledman.AddFulfilledRequest(pnode->addr, "masternode-list-sync");
+    if (vNodes.empty()) {
+        connman.ReleaseNodeVector(vNodesCopy);
+        return;
+    }
 
-                if (pnode->nVersion < mnpayments.GetMinMasternodePaymentsProto()) continue;
-                nRequestedMasternodeAttempt++;
+    // INITIAL TIMEOUT
 
-                mnodeman.DsegUpdate(pnode, connman);
+    if (nRequestedMasternodeAssets == MASTERNODE_SYNC_WAITING && GetTime() - nTimeLastBumped > MASTERNODE_SYNC_TIMEOUT_SECONDS) {
+        // At this point we know that:
+        // a) there are peers;
+        // b) we waited for at least MASTERNODE_SYNC_TIMEOUT_SECONDS since we reached
+        //    the headers tip the last time (i.e. since we switched from
+        //     MASTERNODE_SYNC_INITIAL to MASTERNODE_SYNC_WAITING and bumped time);
+        // c) there were no blocks (UpdatedBlockTip, NotifyHeaderTip) or headers (AcceptedBlockHeader)
+        //    for at least MASTERNODE_SYNC_TIMEOUT_SECONDS.
+        // We must be at the tip already, let's move to the next asset.
+        SwitchToNextAsset(connman);
+    }
 
-                connman.ReleaseNodeVector(vNodesCopy);
-                return; //this will cause each peer to get one request each six seconds for the various assets we need
-            }
+    if (!IsBlockchainSynced()) {
+        connman.ReleaseNodeVector(vNodesCopy);
+        return;
+    }
 
-            // MNW : SYNC MASTERNODE PAYMENT VOTES FROM OTHER CONNECTED CLIENTS
-
-            if (nRequestedMasternodeAssets == MASTERNODE_SYNC_MNW) {
-                LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeSync::ProcessTick -- nTick %d nRequestedMasternodeAssets %d nTimeLastBumped %lld GetTime() %lld diff %lld\n", nTick, nRequestedMasternodeAssets, nTimeLastBumped, GetTime(), GetTime() - nTimeLastBumped);
-                // check for timeout first
-                // This might take a lot longer than MASTERNODE_SYNC_TIMEOUT_SECONDS due to new blocks,
-                // but that should be OK and it should timeout eventually.
-                if (GetTime() - nTimeLastBumped > MASTERNODE_SYNC_TIMEOUT_SECONDS) {
-                    LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeSync::ProcessTick -- nTick %d nRequestedMasternodeAssets %d -- timeout\n", nTick, nRequestedMasternodeAssets);
-                    if (nRequestedMasternodeAttempt == 0) {
-                        LogPrintG(BCLogLevel::LOG_ERROR, BCLog::MN, "[Masternodes] CMasternodeSync::ProcessTick -- ERROR: failed to sync %s\n", GetAssetName());
-                        // probably not a good idea to proceed without winner list
-                        Fail();
-                        connman.ReleaseNodeVector(vNodesCopy);
-                        return;
-                    }
-                    SwitchToNextAsset(connman);
-                    connman.ReleaseNodeVector(vNodesCopy);
-                    return;
-                }
+    // the managers call BumpAssetLastTime with their own locks held, so ask them before taking cs
+    bool fEnoughPaymentData = mnpayments.IsEnoughData();
+    int nVoteCount = governance.GetVoteCount();
 
-                // check for data
-                // if mnpayments already has enough blocks and votes, switch to the next asset
-                // try to fetch data from at least two peers though
-                if (nRequestedMasternodeAttempt > 1 && mnpayments.IsEnoughData()) {
-                    LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeSync::ProcessTick -- nTick %d nRequestedMasternodeAssets %d -- found enough data\n", nTick, nRequestedMasternodeAssets);
-                    SwitchToNextAsset(connman);
-                    connman.ReleaseNodeVector(vNodesCopy);
-                    return;
-                }
-                
-                // request from three peers max
-                if (nRequestedMasternodeAttempt > 2) {
-                    connman.ReleaseNodeVector(vNodesCopy);
-                    return;
-                }
+    std::vector<std::pair<int, CNode*> > vRequests;
+    std::vector<CNode*> vVotePeers;
+    bool fFail = false;
+    bool fSyncFinished = ScheduleRequests(vNodes, fEnoughPaymentData, nVoteCount, vRequests, vVotePeers, fFail);
 
-                // only request once from each peer
-                if (netfulfilledman.HasFulfilledRequest(pnode->addr, "masternode-payment-sync")) continue;
-                netfulfilledman.AddFulfilledRequest(pnode->addr, "masternode-payment-sync");
-
-                if (pnode->nVersion < mnpayments.GetMinMasternodePaymentsProto()) continue;
-                nRequestedMasternodeAttempt++;
-
-                // ask node for all payment votes it has (new nodes will only return votes for future payments)
-                //sync payment votes
-                // if (pnode->nVersion == 70018) {
-                //     connman.PushMessage(pnode, msgMaker.Make(NetMsgType::MASTERNODEPAYMENTSYNC, mnpayments.GetStorageLimit()));
-                // } else {
-                //     connman.PushMessage(pnode, msgMaker.Make(NetMsgType::MASTERNODEPAYMENTSYNC));
-                // }
-                connman.PushMessage(pnode, msgMaker.Make(NetMsgType::MASTERNODEPAYMENTSYNC));
-                // connman.PushMessage(pnode, NetMsgType::MASTERNODEPAYMENTSYNC, mnpayments.GetStorageLimit());
-                // ask node for missing pieces only (old nodes will not be asked)
-                mnpayments.RequestLowDataPaymentBlocks(pnode, connman);
-
-                connman.ReleaseNodeVector(vNodesCopy);
-                return; //this will cause each peer to get one request each six seconds for the various assets we need
-            }
+    if (fFail) {
+        Fail();
+        connman.ReleaseNodeVector(vNodesCopy);
+        return;
+    }
+    if (fSyncFinished) {
+        FinishSync(connman);
+        connman.ReleaseNodeVector(vNodesCopy);
+        return;
+    }
 
-            // GOVOBJ : SYNC GOVERNANCE ITEMS FROM OUR PEERS
-
-            if (nRequestedMasternodeAssets == MASTERNODE_SYNC_GOVERNANCE) {
-                LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::GOV, "[Governance] CMasternodeSync::ProcessTick -- nTick %d nRequestedMasternodeAssets %d nTimeLastBumped %lld GetTime() %lld diff %lld\n", nTick, nRequestedMasternodeAssets, nTimeLastBumped, GetTime(), GetTime() - nTimeLastBumped);
-
-                // check for timeout first
-                if (GetTime() - nTimeLastBumped > MASTERNODE_SYNC_TIMEOUT_SECONDS) {
-                    LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeSync::ProcessTick -- nTick %d nRequestedMasternodeAssets %d -- timeout\n", nTick, nRequestedMasternodeAssets);
-                    if (nRequestedMasternodeAttempt == 0) {
-                        LogPrintG(BCLogLevel::LOG_WARNING, BCLog::MN, "[Masternodes] CMasternodeSync::ProcessTick -- WARNING: failed to sync %s\n", GetAssetName());
-                        // it's kind of ok to skip this for now, hopefully we'll catch up later?
-                    }
-                    SwitchToNextAsset(connman);
-                    connman.ReleaseNodeVector(vNodesCopy);
-                    return;
-                }
+    for (const auto& request : vRequests) {
+        SendRequest(request.first, request.second, connman);
+    }
 
-                // only request obj sync once from each peer, then request votes on per-obj basis
-                if (netfulfilledman.HasFulfilledRequest(pnode->addr, "governance-sync")) {
-                    int nObjsLeftToAsk = governance.RequestGovernanceObjectVotes(pnode, connman);
-                    static int64_t nTimeNoObjectsLeft = 0;
-                    // check for data
-                    if (nObjsLeftToAsk == 0) {
-                        static int nLastTick = 0;
-                        static int nLastVotes = 0;
-                        if (nTimeNoObjectsLeft == 0) {
-                            // asked all objects for votes for the first time
-                            nTimeNoObjectsLeft = GetTime();
-                        }
-                        // make sure the condition below is checked only once per tick
-                        if (nLastTick == nTick) continue;
-                        if (GetTime() - nTimeNoObjectsLeft > MASTERNODE_SYNC_TIMEOUT_SECONDS &&
-                            governance.GetVoteCount() - nLastVotes < std::max(int(0.0001 * nLastVotes), MASTERNODE_SYNC_TICK_SECONDS)
-                        ) {
-                            // We already asked for all objects, waited for MASTERNODE_SYNC_TIMEOUT_SECONDS
-                            // after that and less then 0.01% or MASTERNODE_SYNC_TICK_SECONDS
-                            // (i.e. 1 per second) votes were recieved during the last tick.
-                            // We can be pretty sure that we are done syncing.
-                            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeSync::ProcessTick -- nTick %d nRequestedMasternodeAssets %d -- asked for all objects, nothing to do\n", nTick, nRequestedMasternodeAssets);
-                            // reset nTimeNoObjectsLeft to be able to use the same condition on resync
-                            nTimeNoObjectsLeft = 0;
-                            SwitchToNextAsset(connman);
-                            connman.ReleaseNodeVector(vNodesCopy);
-                            return;
-                        }
-                        nLastTick = nTick;
-                        nLastVotes = governance.GetVoteCount();
-                    }
-                    continue;
+    // governance peers which sent their objects are asked for votes per object
+    bool fNoObjectsLeft = false;
+    for (CNode* pnode : vVotePeers) {
+        if (governance.RequestGovernanceObjectVotes(pnode, connman) == 0) {
+            fNoObjectsLeft = true;
+        }
+    }
+    if (fNoObjectsLeft) {
+        LOCK(cs);
+        CMasternodeSyncAsset& asset = mapAssets[MASTERNODE_SYNC_GOVERNANCE];
+        if (asset.IsRunning() && asset.nTimeNoObjectsLeft == 0) {
+            // asked all objects for votes for the first time
+            asset.nTimeNoObjectsLeft = GetTime();
+        }
+    }
+
+    connman.ReleaseNodeVector(vNodesCopy);
+}
+
+bool CMasternodeSync::ScheduleRequests(const std::vector<CNode*>& vNodes, bool fEnoughPaymentData, int nVoteCount,
+                                       std::vector<std::pair<int, CNode*> >& vRequestsRet, std::vector<CNode*>& vVotePeersRet, bool& fFailRet)
+{
+    LOCK(cs);
+
+    int64_t nNow = GetTime();
+
+    // spread the requests, the peer with the least running requests and then the fastest one goes first
+    std::map<NodeId, int> mapLoad;
+    std::map<NodeId, double> mapThroughput;
+    for (const auto& assetpair : mapAssets) {
+        for (const auto& peerpair : assetpair.second.mapPeers) {
+            if (assetpair.second.IsRunning() && peerpair.second.IsActive(nNow)) {
+                mapLoad[peerpair.first]++;
+            }
+            double& nThroughput = mapThroughput[peerpair.first];
+            nThroughput = std::max(nThroughput, peerpair.second.GetThroughput());
+        }
+    }
+
+    std::vector<CNode*> vCandidates(vNodes);
+
+    for (int nAsset : {MASTERNODE_SYNC_LIST, MASTERNODE_SYNC_MNW, MASTERNODE_SYNC_GOVERNANCE}) {
+        CMasternodeSyncAsset& asset = mapAssets[nAsset];
+        if (!asset.IsRunning()) continue;
+
+        LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeSync::ScheduleRequests -- %s nTimeLastBumped %lld GetTime() %lld diff %lld\n", GetAssetName(nAsset), asset.nTimeLastBumped, nNow, nNow - asset.nTimeLastBumped);
+
+        // check for timeout first
+        // payment votes might take a lot longer than MASTERNODE_SYNC_TIMEOUT_SECONDS due to new blocks,
+        // but that should be OK and it should timeout eventually.
+        if (nNow - asset.nTimeLastBumped > MASTERNODE_SYNC_TIMEOUT_SECONDS) {
+            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeSync::ScheduleRequests -- %s -- timeout\n", GetAssetName(nAsset));
+            if (asset.mapPeers.empty()) {
+                if (nAsset != MASTERNODE_SYNC_GOVERNANCE) {
+                    LogPrintG(BCLogLevel::LOG_ERROR, BCLog::MN, "[Masternodes] CMasternodeSync::ScheduleRequests -- ERROR: failed to sync %s\n", GetAssetName(nAsset));
+                    // there is no way we can continue without masternode list and winners, fail here and try later
+                    fFailRet = true;
+                    return false;
                 }
-                netfulfilledman.AddFulfilledRequest(pnode->addr, "governance-sync");
+                // it's kind of ok to skip governance for now, hopefully we'll catch up later?
+                LogPrintG(BCLogLevel::LOG_WARNING, BCLog::MN, "[Masternodes] CMasternodeSync::ScheduleRequests -- WARNING: failed to sync %s\n", GetAssetName(nAsset));
+            }
+            if (FinishAsset(nAsset)) return true;
+            continue;
+        }
 
-                if (pnode->nVersion < MIN_GOVERNANCE_PEER_PROTO_VERSION) continue;
-                nRequestedMasternodeAttempt++;
+        // check for data
+        bool fDone = false;
+        if (nAsset == MASTERNODE_SYNC_LIST) {
+            // every peer we asked sent its whole list diff, or one did and nobody else is sending anything
+            int nComplete = asset.CountCompletePeers();
+            fDone = nComplete >= MASTERNODE_SYNC_PEERS_PER_ASSET || (nComplete > 0 && asset.CountActivePeers(nNow) == 0);
+        } else if (nAsset == MASTERNODE_SYNC_MNW) {
+            // if mnpayments already has enough blocks and votes, we are done
+            // try to fetch data from at least two peers though
+            fDone = asset.mapPeers.size() > 1 && fEnoughPaymentData;
+        } else {
+            // We already asked for all objects, waited for MASTERNODE_SYNC_TIMEOUT_SECONDS
+            // after that and less then 0.01% or MASTERNODE_SYNC_TICK_SECONDS
+            // (i.e. 1 per second) votes were recieved during the last tick.
+            // We can be pretty sure that we are done syncing.
+            fDone = asset.nTimeNoObjectsLeft != 0 && nNow - asset.nTimeNoObjectsLeft > MASTERNODE_SYNC_TIMEOUT_SECONDS &&
+                    nVoteCount - asset.nLastVotes < std::max(int(0.0001 * asset.nLastVotes), MASTERNODE_SYNC_TICK_SECONDS);
+            asset.nLastVotes = nVoteCount;
+        }
+        if (fDone) {
+            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeSync::ScheduleRequests -- %s -- found enough data\n", GetAssetName(nAsset));
+            if (FinishAsset(nAsset)) return true;
+            continue;
+        }
 
-                SendGovernanceSyncRequest(pnode, connman);
+        std::stable_sort(vCandidates.begin(), vCandidates.end(), [&mapLoad, &mapThroughput](const CNode* a, const CNode* b) {
+            int nLoadA = mapLoad.count(a->GetId()) ? mapLoad.at(a->GetId()) : 0;
+            int nLoadB = mapLoad.count(b->GetId()) ? mapLoad.at(b->GetId()) : 0;
+            if (nLoadA != nLoadB) return nLoadA < nLoadB;
+            double nThroughputA = mapThroughput.count(a->GetId()) ? mapThroughput.at(a->GetId()) : 0;
+            double nThroughputB = mapThroughput.count(b->GetId()) ? mapThroughput.at(b->GetId()) : 0;
+            return nThroughputA > nThroughputB;
+        });
+
+        // keep MASTERNODE_SYNC_PEERS_PER_ASSET peers busy, a stalled peer frees its slot for the next one
+        const std::string strRequest = nAsset == MASTERNODE_SYNC_LIST ? "masternode-list-sync" :
+                                       nAsset == MASTERNODE_SYNC_MNW ? "masternode-payment-sync" : "governance-sync";
+        int nMinProto = nAsset == MASTERNODE_SYNC_GOVERNANCE ? MIN_GOVERNANCE_PEER_PROTO_VERSION : mnpayments.GetMinMasternodePaymentsProto();
+        int nActive = asset.CountActivePeers(nNow);
+        std::set<NodeId> setRequested;
+        for (CNode* pnode : vCandidates) {
+            if (nActive >= MASTERNODE_SYNC_PEERS_PER_ASSET || (int)asset.mapPeers.size() >= MASTERNODE_SYNC_MAX_ATTEMPTS) break;
+            if (asset.mapPeers.count(pnode->GetId())) continue;
+
+            // only request once from each peer
+            if (netfulfilledman.HasFulfilledRequest(pnode->addr, strRequest)) continue;
+            netfulfilledman.AddFulfilledRequest(pnode->addr, strRequest);
+
+            if (pnode->nVersion < nMinProto) continue;
+
+            asset.mapPeers.emplace(pnode->GetId(), CMasternodeSyncPeer(nNow));
+            mapLoad[pnode->GetId()]++;
+            setRequested.insert(pnode->GetId());
+            nActive++;
+            if (nAsset == nRequestedMasternodeAssets) nRequestedMasternodeAttempt++;
+            vRequestsRet.emplace_back(nAsset, pnode);
+            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeSync::ScheduleRequests -- asking peer=%d for %s, %d peers active\n", pnode->GetId(), GetAssetName(nAsset), nActive);
+        }
 
-                connman.ReleaseNodeVector(vNodesCopy);
-                return; //this will cause each peer to get one request each six seconds for the various assets we need
+        // only request obj sync once from each peer, then request votes on per-obj basis
+        if (nAsset == MASTERNODE_SYNC_GOVERNANCE) {
+            for (CNode* pnode : vNodes) {
+                if (asset.mapPeers.count(pnode->GetId()) && !setRequested.count(pnode->GetId())) {
+                    vVotePeersRet.push_back(pnode);
+                }
             }
         }
     }
-    // looped through all nodes, release them
-    connman.ReleaseNodeVector(vNodesCopy);
+
+    return false;
+}
+
+void CMasternodeSync::SendRequest(int nAsset, CNode* pnode, CConnman& connman)
+{
+    const CNetMsgMaker msgMaker(pnode->GetSendVersion());
+
+    switch (nAsset)
+    {
+        case MASTERNODE_SYNC_LIST:
+            mnodeman.DsegUpdate(pnode, connman);
+            break;
+        case MASTERNODE_SYNC_MNW:
+            // ask node for all payment votes it has (new nodes will only return votes for future payments)
+            connman.PushMessage(pnode, msgMaker.Make(NetMsgType::MASTERNODEPAYMENTSYNC));
+            // ask node for missing pieces only (old nodes will not be asked)
+            mnpayments.RequestLowDataPaymentBlocks(pnode, connman);
+            break;
+        case MASTERNODE_SYNC_GOVERNANCE:
+            SendGovernanceSyncRequest(pnode, connman);
+            break;
+    }
 }
 
 void CMasternodeSync::SendGovernanceSyncRequest(CNode* pnode, CConnman& connman)
@@ -475,6 +688,7 @@ void CMasternodeSync::UpdatedBlockTip(const CBlockIndex *pindexNew, bool fInitia
     if (!IsBlockchainSynced() && fReachedBestHeader) {
         if (fLiteMode) {
             // nothing to do in lite mode, just finish the process immediately
+            LOCK(cs);
             nRequestedMasternodeAssets = MASTERNODE_SYNC_FINISHED;
             return;
         }
@@ -7,9 +7,14 @@
 
 #include <chain.h>
 #include <net.h>
+#include <sync.h>
 
 #include <univalue.h>
 
+#include <algorithm>
+#include <atomic>
+#include <map>
+
 class CMasternodeSync;
 
 static const int MASTERNODE_SYNC_FAILED          = -1;
@@ -24,22 +29,96 @@ static const int MASTERNODE_SYNC_FINISHED        = 999;
 
 static const int MASTERNODE_SYNC_TICK_SECONDS    = 6;
 static const int MASTERNODE_SYNC_TIMEOUT_SECONDS = 30; // our blocks are 2.5 minutes so 30 seconds should be fine
+static const int MASTERNODE_SYNC_STALL_SECONDS   = 2 * MASTERNODE_SYNC_TICK_SECONDS; // a peer quiet for this long frees its slot
 
 static const int MASTERNODE_SYNC_ENOUGH_PEERS    = 6;
+static const int MASTERNODE_SYNC_PEERS_PER_ASSET = 3; // peers syncing the same asset at a time
+static const int MASTERNODE_SYNC_MAX_ATTEMPTS    = 6; // peers asked for the same asset, stalled ones included
 
 extern CMasternodeSync masternodeSync;
 
+/** One peer we asked for an asset */
+class CMasternodeSyncPeer
+{
+public:
+    int64_t nTimeRequested;
+    // when the last new item from this peer arrived
+    int64_t nTimeLastItem;
+    int nItems;
+    // items the peer announced with SYNCSTATUSCOUNT
+    int nExpectedItems;
+    bool fAnswered;
+    // the peer sent the last batch of its list
+    bool fComplete;
+
+    CMasternodeSyncPeer(int64_t nTimeRequestedIn = 0) :
+        nTimeRequested(nTimeRequestedIn),
+        nTimeLastItem(0),
+        nItems(0),
+        nExpectedItems(0),
+        fAnswered(false),
+        fComplete(false)
+        {}
+
+    int64_t GetTimeLastActive() const { return std::max(nTimeRequested, nTimeLastItem); }
+    /// Asked recently or still sending, otherwise the peer either finished or stalled
+    bool IsActive(int64_t nNow) const { return nNow - GetTimeLastActive() <= MASTERNODE_SYNC_STALL_SECONDS; }
+    bool IsStalled(int64_t nNow) const { return !fAnswered && !IsActive(nNow); }
+    /// New items per second since the request
+    double GetThroughput() const { return double(nItems) / std::max<int64_t>(1, GetTimeLastActive() - nTimeRequested); }
+};
+
+/** Progress of an asset which is synced from several peers at once */
+class CMasternodeSyncAsset
+{
+public:
+    int64_t nTimeStarted;
+    int64_t nTimeLastBumped;
+    int64_t nTimeFinished;
+    int nItems;
+    std::map<NodeId, CMasternodeSyncPeer> mapPeers;
+    // governance: when every object was asked for votes and the vote count back then
+    int64_t nTimeNoObjectsLeft;
+    int nLastVotes;
+
+    CMasternodeSyncAsset() :
+        nTimeStarted(0),
+        nTimeLastBumped(0),
+        nTimeFinished(0),
+        nItems(0),
+        mapPeers(),
+        nTimeNoObjectsLeft(0),
+        nLastVotes(0)
+        {}
+
+    bool IsStarted() const { return nTimeStarted != 0; }
+    bool IsRunning() const { return IsStarted() && nTimeFinished == 0; }
+    bool IsFinished() const { return nTimeFinished != 0; }
+
+    int CountActivePeers(int64_t nNow) const;
+    int CountCompletePeers() const;
+    /// The most items any peer announced, peers mostly send the same set
+    int GetExpectedItems() const;
+    double GetProgress() const;
+};
+
 //
-// CMasternodeSync : Sync masternode assets in stages
+// CMasternodeSync : Sync masternode assets from several peers at once
+//
+// The masternode list comes first, payment votes and governance objects both
+// depend on it but not on each other, so they are synced side by side.
+// nRequestedMasternodeAssets is the lowest asset which isn't finished yet.
 //
 
 class CMasternodeSync
 {
 private:
-    // Keep track of current asset
-    int nRequestedMasternodeAssets;
-    // Count peers we've requested the asset from
-    int nRequestedMasternodeAttempt;
+    mutable CCriticalSection cs;
+
+    // Keep track of current asset, changed under cs but read by the Is*Synced getters from any thread
+    std::atomic<int> nRequestedMasternodeAssets;
+    // Count peers we've requested the current asset from
+    std::atomic<int> nRequestedMasternodeAttempt;
 
     // Time when current masternode asset sync started
     int64_t nTimeAssetSyncStarted;
@@ -48,10 +127,24 @@ private:
     // ... or failed
     int64_t nTimeLastFailure;
 
+    // LIST, MNW and GOVERNANCE
+    std::map<int, CMasternodeSyncAsset> mapAssets;
+
     void Fail();
+    /// Reset without taking cs, the constructor runs before the lock order checks are set up
+    void ResetState();
+
+    void StartAsset(int nAsset);
+    /// Mark an asset done and start the ones which only waited for it, returns true once everything is done
+    bool FinishAsset(int nAsset);
+    void FinishSync(CConnman& connman);
+    /// Finish the running assets which are done and pick the peers to ask next, returns true once everything is done
+    bool ScheduleRequests(const std::vector<CNode*>& vNodes, bool fEnoughPaymentData, int nVoteCount,
+                          std::vector<std::pair<int, CNode*> >& vRequestsRet, std::vector<CNode*>& vVotePeersRet, bool& fFailRet);
+    void SendRequest(int nAsset, CNode* pnode, CConnman& connman);
 
 public:
-    CMasternodeSync() { Reset(); }
+    CMasternodeSync() { ResetState(); }
 
 
     void SendGovernanceSyncRequest(CNode* pnode, CConnman& connman);
@@ -65,12 +158,21 @@ public:
     int GetAssetID() { return nRequestedMasternodeAssets; }
     int GetAttempt() { return nRequestedMasternodeAttempt; }
     void BumpAssetLastTime(const std::string& strFuncName);
+    /// Postpone the timeout of an asset, pfrom is the peer which sent a new item or null if nothing new arrived
+    void BumpAssetLastTime(const std::string& strFuncName, int nAsset, const CNode* pfrom);
     int64_t GetAssetStartTime() { return nTimeAssetSyncStarted; }
-    std::string GetAssetName();
+    static std::string GetAssetName(int nAsset);
+    std::string GetAssetName() { return GetAssetName(nRequestedMasternodeAssets); }
     std::string GetSyncStatus();
+    /// Overall progress for the GUI
+    double GetSyncProgress();
+    /// Progress and peers of each asset for mnsync status
+    UniValue GetAssetsStatus();
 
     void Reset();
     void SwitchToNextAsset(CConnman& connman);
+    /// A peer sent the last batch of its reply to our MNLISTDIGEST
+    void NotifyMasternodeListReceived(const CNode* pfrom);
 
     void ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv);
     void ProcessTick(CConnman& connman);
@@ -14,6 +14,7 @@
 #include <masternodes/masternodeman.h>
 #include <masternodes/messagesigner.h>
 #include <script/standard.h>
+#include <txdb.h>
 #include <util.h>
 #include <wallet/wallet.h>
 
@@ -21,6 +22,11 @@
 #include <boost/lexical_cast.hpp>
 
 
+CScript GetMasternodePayeeScript(const CPubKey& pubKeyCollateralAddress)
+{
+    return GetScriptForDestination(CScriptID(GetScriptForDestination(WitnessV0KeyHash(pubKeyCollateralAddress.GetID()))));
+}
+
 CMasternode::CMasternode() :
     masternode_info_t{ MASTERNODE_ENABLED, PROTOCOL_VERSION, GetAdjustedTime()}
 {}
@@ -39,7 +45,8 @@ CMasternode::CMasternode(const CMasternode& other) :
     nBlockLastPaidSecondary(other.nBlockLastPaidSecondary),
     nPoSeBanScore(other.nPoSeBanScore),
     nPoSeBanHeight(other.nPoSeBanHeight),
-    fUnitTest(other.fUnitTest)
+    fUnitTest(other.fUnitTest),
+    fCollateralTracked(other.fCollateralTracked)
 {}
 
 CMasternode::CMasternode(const CMasternodeBroadcast& mnb) :
@@ -56,11 +63,11 @@ bool CMasternode::UpdateFromNewBroadcast(CMasternodeBroadcast& mnb, CConnman& co
 {
     if (mnb.sigTime <= sigTime && !mnb.fRecovery) return false;
 
-    pubKeyMasternode = mnb.pubKeyMasternode;
+    // set before re-keying, which also drops the cached score tables filtered by protocol version
+    nProtocolVersion = mnb.nProtocolVersion;
+    mnodeman.UpdateIndexedKeys(*this, mnb.addr, mnb.pubKeyMasternode);
     sigTime = mnb.sigTime;
     vchSig = mnb.vchSig;
-    nProtocolVersion = mnb.nProtocolVersion;
-    addr = mnb.addr;
     nPoSeBanScore = 0;
     nPoSeBanHeight = 0;
     nTimeLastChecked = 0;
@@ -117,7 +124,7 @@ CMasternode::CollateralStatus CMasternode::CheckCollateral(const COutPoint& outp
         return COLLATERAL_INVALID_AMOUNT;
     }
 
-    if (pubkey == CPubKey() || coin.out.scriptPubKey != GetScriptForDestination(CScriptID(GetScriptForDestination(WitnessV0KeyHash(pubkey.GetID()))))) {
+    if (pubkey == CPubKey() || coin.out.scriptPubKey != GetMasternodePayeeScript(pubkey)) {
         return COLLATERAL_INVALID_PUBKEY;
     }
 
@@ -130,11 +137,46 @@ bool CMasternode::IsPoSeVerified() const
     return nPoSeBanScore <= -Params().GetConsensus().nMasternodePoseBanMaxScore; 
 }
 
-void CMasternode::Check(bool fForce)
+void CMasternode::UpdateCollateralFromUTXO()
 {
     AssertLockHeld(cs_main);
     LOCK(cs);
 
+    Coin coin;
+    if (!GetUTXOCoin(outpoint, coin)) {
+        nActiveState = MASTERNODE_OUTPOINT_SPENT;
+        LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternode::UpdateCollateralFromUTXO -- Failed to find Masternode UTXO, masternode=%s\n", outpoint.ToStringShort());
+    } else {
+        activationBlockHeight = coin.nHeight;
+    }
+    fCollateralTracked = true;
+}
+
+void CMasternode::SetCollateralSpent()
+{
+    LOCK(cs);
+    if (IsOutpointSpent()) return;
+    nActiveState = MASTERNODE_OUTPOINT_SPENT;
+    LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternode::SetCollateralSpent -- Masternode %s collateral is spent\n", outpoint.ToStringShort());
+}
+
+void CMasternode::SetCollateralUnspent(int nHeight)
+{
+    LOCK(cs);
+    if (nHeight >= 0) {
+        activationBlockHeight = nHeight;
+    }
+    if (!IsOutpointSpent()) return;
+    // let the next Check() work out the real state from the last ping
+    nActiveState = MASTERNODE_PRE_ENABLED;
+    nTimeLastChecked = 0;
+    LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternode::SetCollateralUnspent -- Masternode %s collateral is unspent again\n", outpoint.ToStringShort());
+}
+
+void CMasternode::Check(bool fForce)
+{
+    LOCK(cs);
+
     if (ShutdownRequested()) return;
 
     if (!fForce && (GetTime() - nTimeLastChecked < Params().GetConsensus().nMasternodeCheckSeconds)) return;
@@ -142,25 +184,15 @@ void CMasternode::Check(bool fForce)
 
     LogPrintG(BCLogLevel::LOG_INFO, BCLog::MN, "[Masternodes] CMasternode::Check -- Masternode %s is in %s state\n", outpoint.ToStringShort(), GetStateString());
 
+    // Spends of a tracked collateral are applied by CMasternodeMan::BlockConnected,
+    // only entries that never went through the list need a UTXO lookup here
+    if (!fUnitTest && !fCollateralTracked) {
+        UpdateCollateralFromUTXO();
+    }
+
     //once spent, stop doing the checks
     if (IsOutpointSpent()) return;
 
-    // int nHeight = 0;
-    if (!fUnitTest) {
-        Coin coin;
-        if (!GetUTXOCoin(outpoint, coin)) {
-            nActiveState = MASTERNODE_OUTPOINT_SPENT;
-            LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternode::Check -- Failed to find Masternode UTXO, masternode=%s\n", outpoint.ToStringShort());
-            return;
-        }
-        else
-        {
-            activationBlockHeight = coin.nHeight;
-        }       
-
-        // nHeight = chainActive.Height();
-    }
-
     if (IsPoSeBanned()) {
         // Re-enable pose_banned masternodes
         //if (nHeight < nPoSeBanHeight) return; // too early?
@@ -343,175 +375,22 @@ std::string CMasternode::GetStatus() const
     return GetStateString();
 }
 
-void CMasternode::UpdateLastPaid(const CBlockIndex *pindex, int nMaxBlocksToScanBack)
+void CMasternode::UpdateLastPaid(const CBlockIndex *pindex)
 {
     if (!pindex) return;
-    
-    const CBlockIndex *pindexActive = chainActive.Tip();
-    assert(pindexActive);
-
-    CDiskBlockPos blockPos = pindexActive->GetBlockPos();
-
-    CScript mnpayee = GetScriptForDestination(CScriptID(GetScriptForDestination(WitnessV0KeyHash(pubKeyCollateralAddress.GetID()))));
-    //LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternode::UpdateLastPaidBlock -- searching for block with payment to %s\n", outpoint.ToStringShort());
-
-    LOCK(cs_mapMasternodeBlocks);
 
-    int scanBack = 0;
-    if (nBlockLastPaidPrimary > nBlockLastPaidSecondary)
-    {
-        scanBack = nBlockLastPaidSecondary;
-    }
-    else
-    {
-        scanBack = nBlockLastPaidPrimary;
+    // The payment index only knows the coinbase positions, the amounts are not checked (yet)
+    const CBlockIndex* pindexPaid = nullptr;
+    if (pblocktree->ReadLastMasternodePayment(payee, true, pindex, pindexPaid)) {
+        nBlockLastPaidPrimary = pindexPaid->nHeight;
+        nTimeLastPaidPrimary = pindexPaid->nTime;
     }
-
-    // keep track of what is found 
-    bool foundPrimary = false;
-    bool foundSecondary = false;
-
-    for (int i = 0; pindexActive->nHeight > scanBack && i < nMaxBlocksToScanBack; i++) {
-        size_t checkitOut = mnpayments.mapMasternodeBlocksPrimary.count(pindexActive->nHeight);
-        //bool hazIt = mnpayments.mapMasternodeBlocksPrimary[pindexActive->nHeight].HasPayeeWithVotes(mnpayee, 2);
-        int mnCount = mnodeman.CountMasternodes(-1);
-
-        // if ((mnCount > 2 && checkitOut && hazIt) || (mnCount <= 2))
-        if ((mnCount > 2 && checkitOut) || (mnCount <= 2))
-        {
-            if (blockPos.IsNull() == true) {
-                return;
-            }
-
-            CBlock block;
-            if (!ReadBlockFromDisk(block, blockPos, Params().GetConsensus()))
-            {
-                continue;
-            }
-            
-            // Adding this as a sanity check... as we specify the order of the payments:
-            // This can be calculated dynamically, but a fixed value is sufficient for now, 
-            // as this method is called a lot.
-            // 0 = Miner
-            // 1-5 = Founders
-            // 6 = Primary Masternode
-            // 7 = First Secondary Masternode Payment (may receive more than the other secondaries)
-            // 8+ = The remainder of the secondaries payments and pool deductions etc.
-            int primaryMnPaymentPosition = 6; // starting from 0
-
-            CAmount nMasternodePaymentPrimary = GetMasternodePayments(pindexActive->nHeight, activationBlockHeight, block.vtx[0]->GetValueOut());
-            double readableMnPayValue = nMasternodePaymentPrimary / COIN;
-
-            int positionTracker = 0;
-            for (const auto& txout : block.vtx[0]->vout)
-            {
-                CAmount txValue = txout.nValue;
-                bool payeeMatch = mnpayee == txout.scriptPubKey;
-                bool valueMatch = nMasternodePaymentPrimary == txValue;
-                double readableTxValue = txValue / COIN;
-                if (payeeMatch)
-                {
-                    // make debugging easier
-                    std::string mnPayeeAddressString = EncodeDestination(CScriptID(GetScriptForDestination(WitnessV0KeyHash(pubKeyCollateralAddress.GetID()))));
-                    if (valueMatch)
-                    {
-                        nBlockLastPaidPrimary = pindexActive->nHeight;
-                        nTimeLastPaidPrimary = pindexActive->nTime;
-                        LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternode::UpdateLastPaidBlock -- searching for block with primary payment to %s -- found new %d\n", outpoint.ToStringShort(), nBlockLastPaidPrimary);
-                        foundPrimary = true;
-                        if (foundSecondary)
-                        {
-                            // I've found both values
-                            return;
-                        }
-                        else
-                        {
-                            // still looking for the other one...
-                            break;
-                        }
-                    }
-                    // Check that we have not missed something...
-                    else if (positionTracker == primaryMnPaymentPosition)
-                    {
-                        // Living the dream... masternode was paid as a primary too recently
-                        if (pindexActive->nHeight - nBlockLastPaidPrimary < mnCount)
-                        {
-                            LogPrintG(BCLogLevel::LOG_INFO, BCLog::MN, "[Masternodes] CMasternode::UpdateLastPaidBlock -- Bad value in masternode payment. %s -- in block %d was paid in block %d when there are %d masternodes\n", outpoint.ToStringShort(), pindexActive->nHeight, nBlockLastPaidPrimary, mnCount);
-                        }
-                        // Still mark it as primary paid, even if the value is off :S
-                        nBlockLastPaidPrimary = pindexActive->nHeight;
-                        nTimeLastPaidPrimary = pindexActive->nTime;
-                        // this is badong... let someone know (If you don't know what badong is, watch https://www.youtube.com/watch?v=O6_P_ZWwJ3Q)
-                        LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternode::UpdateLastPaidBlock -- Bad value in masternode payment. %s -- in block %d pays %f instead of %f\n", outpoint.ToStringShort(), pindexActive->nHeight, readableTxValue, readableMnPayValue);
-                        foundPrimary = true;
-                        if (foundSecondary)
-                        {
-                            // I've found both values
-                            return;
-                        }
-                        else
-                        {
-                            // still looking for the other one...
-                            break;
-                        }
-                    }
-                    else if (positionTracker > primaryMnPaymentPosition)
-                    {
-                        // This is a bit fuzzy for my liking, but the logic:
-                        // * This is the coinbase transaction
-                        // * I am a masternode
-                        // * I am being paid in the coinbase tx, as a mn, but it is not as the primary
-                        // Should suffice to substantiate the claim that this is a secondary masternode payment to me
-                        nBlockLastPaidSecondary = pindexActive->nHeight;
-                        nTimeLastPaidSecondary = pindexActive->nTime;
-                        LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternode::UpdateLastPaidBlock -- searching for block with secondary payment to %s -- found new %d\n", outpoint.ToStringShort(), nBlockLastPaidSecondary);
-                        foundSecondary = true;
-                        if (foundPrimary)
-                        {
-                            // I've found both values
-                            return;
-                        }
-                        else
-                        {
-                            // still looking for the other one...
-                            break;
-                        }
-                    }
-                    else
-                    {
-                        // Reaching this code means that:
-                        // There is a payment in the coinbase, to a masternode address that is:
-                        // either a miner address
-                        // which is interesting, but not useful (other than for debugging)
-                        bool isMasternodeMiner = positionTracker == 0;
-                        // or it could be among the founder's payments... which means the block payments are really really broken
-                        bool isMasternodePaymentAmongFounders = positionTracker > 0 && positionTracker < primaryMnPaymentPosition;
-
-                        if (isMasternodeMiner)
-                        {
-                            // Miner and masternode address...
-                            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternode::UpdateLastPaidBlock -- %s is mining to their masternode address\n", outpoint.ToStringShort());
-                        }
-                        else if (isMasternodePaymentAmongFounders)
-                        {
-                            // Barring time travel this is not possible
-                            LogPrintG(BCLogLevel::LOG_ERROR, BCLog::MN, "[Masternodes] CMasternode::UpdateLastPaidBlock -- %s is a founder address masternode address\n", outpoint.ToStringShort());
-                            // kill it with fire....
-                            //assert(!isMasternodePaymentAmongFounders);
-                        }
-                    }
-                }    
-                positionTracker++;            
-            }
-        }
-
-        if (pindexActive->pprev == nullptr) { assert(pindexActive); break; }
-        pindexActive = pindexActive->pprev;
+    if (pblocktree->ReadLastMasternodePayment(payee, false, pindex, pindexPaid)) {
+        nBlockLastPaidSecondary = pindexPaid->nHeight;
+        nTimeLastPaidSecondary = pindexPaid->nTime;
     }
 
-    // Last payment for this masternode wasn't found in latest mnpayments blocks
-    // or it was found in mnpayments blocks but wasn't found in the blockchain.
-    LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternode::UpdateLastPaidBlock -- searching for block with payment to %s -- keeping old %d\n", outpoint.ToStringShort(), nBlockLastPaidPrimary);
+    LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternode::UpdateLastPaid -- %s last paid in block %d (primary) and %d (secondary)\n", outpoint.ToStringShort(), nBlockLastPaidPrimary, nBlockLastPaidSecondary);
 }
 
 //#ifdef ENABLE_WALLET
@@ -699,7 +578,7 @@ bool CMasternodeBroadcast::Update(CMasternode* pmn, int& nDos, CConnman& connman
             pmn->Check();
             Relay(connman);
         }
-        masternodeSync.BumpAssetLastTime("CMasternodeBroadcast::Update");
+        masternodeSync.BumpAssetLastTime("CMasternodeBroadcast::Update", MASTERNODE_SYNC_LIST, nullptr);
     }
 
     return true;
@@ -1062,7 +941,7 @@ bool CMasternodePing::CheckAndUpdate(CMasternode* pmn, bool fFromNewBroadcast, i
     if (!masternodeSync.IsMasternodeListSynced() && !pmn->IsPingedWithin(Params().GetConsensus().nMasternodeExpirationSeconds/2)) {
         // let's bump sync timeout
         LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodePing::CheckAndUpdate -- bumping sync timeout, masternode=%s\n", masternodeOutpoint.ToStringShort());
-        masternodeSync.BumpAssetLastTime("CMasternodePing::CheckAndUpdate");
+        masternodeSync.BumpAssetLastTime("CMasternodePing::CheckAndUpdate", MASTERNODE_SYNC_LIST, nullptr);
     }
 
     // let's store this ping as the last one
@@ -130,6 +130,9 @@ inline CMasternodePing::operator bool() const
     return *this != CMasternodePing();
 }
 
+/** Script that masternode payments for pubKeyCollateralAddress are made to */
+CScript GetMasternodePayeeScript(const CPubKey& pubKeyCollateralAddress);
+
 struct masternode_info_t
 {
     // Note: all these constructors can be removed once C++14 is enabled.
@@ -145,7 +148,8 @@ struct masternode_info_t
                       CPubKey const& pkCollAddr, CPubKey const& pkMN) :
         nActiveState{activeState}, nProtocolVersion{protoVer}, sigTime{sTime},
         outpoint{outpnt}, addr{addr},
-        pubKeyCollateralAddress{pkCollAddr}, pubKeyMasternode{pkMN} {}
+        pubKeyCollateralAddress{pkCollAddr}, pubKeyMasternode{pkMN},
+        payee{GetMasternodePayeeScript(pkCollAddr)} {}
 
     int nActiveState = 0;
     int nProtocolVersion = 0;
@@ -155,6 +159,7 @@ struct masternode_info_t
     CService addr{};
     CPubKey pubKeyCollateralAddress{};
     CPubKey pubKeyMasternode{};
+    CScript payee{}; //* derived from pubKeyCollateralAddress, not serialized
     int activationBlockHeight{};
 
     int64_t nLastDsq = 0; //the dsq count from the last dsq broadcast of this node
@@ -204,6 +209,8 @@ public:
     int nPoSeBanScore{};
     int nPoSeBanHeight{};
     bool fUnitTest = false;
+    // Memory only: the collateral was looked up once and is kept current from block notifications since
+    bool fCollateralTracked = false;
 
     // KEEP TRACK OF GOVERNANCE ITEMS EACH MASTERNODE HAS VOTE UPON FOR RECALCULATION
     std::map<uint256, int> mapGovernanceObjectsVotedOn;
@@ -256,6 +263,9 @@ public:
         READWRITE(nPoSeBanHeight);
         READWRITE(fUnitTest);
         READWRITE(mapGovernanceObjectsVotedOn);
+        if (ser_action.ForRead()) {
+            payee = GetMasternodePayeeScript(pubKeyCollateralAddress);
+        }
     }
 
     // CALCULATE A RANK AGAINST OF GIVEN BLOCK
@@ -267,6 +277,14 @@ public:
     static CollateralStatus CheckCollateral(const COutPoint& outpoint, const CPubKey& pubkey, int& nHeightRet);
     void Check(bool fForce = false);
 
+    /// Look the collateral up in the UTXO set and start tracking it, requires cs_main
+    void UpdateCollateralFromUTXO();
+    /// Collateral was spent or its transaction was disconnected
+    void SetCollateralSpent();
+    /// Collateral is unspent again after a reorg, nHeight is its height or -1 if unchanged
+    void SetCollateralUnspent(int nHeight = -1);
+    bool IsCollateralTracked() const { return fCollateralTracked; }
+
     bool IsBroadcastedWithin(int nSeconds) { return GetAdjustedTime() - sigTime < nSeconds; }
 
     bool IsPingedWithin(int nSeconds, int64_t nTimeToCheckAt = -1)
@@ -328,7 +346,8 @@ public:
     int GetLastPaidTimeSecondary() const { return nTimeLastPaidSecondary; }
     int GetLastPaidBlockPrimary() const { return nBlockLastPaidPrimary; }
     int GetLastPaidBlockSecondary() const { return nBlockLastPaidSecondary; }
-    void UpdateLastPaid(const CBlockIndex *pindex, int nMaxBlocksToScanBack);
+    /// Look up the last primary and secondary payments in the chain ending at pindex
+    void UpdateLastPaid(const CBlockIndex *pindex);
 
     // KEEP TRACK OF EACH GOVERNANCE ITEM INCASE THIS NODE GOES OFFLINE, SO WE CAN RECALC THEIR STATUS
     void AddGovernanceVote(uint256 nGovernanceObjectHash);
@@ -348,6 +367,7 @@ public:
         nPoSeBanScore = from.nPoSeBanScore;
         nPoSeBanHeight = from.nPoSeBanHeight;
         fUnitTest = from.fUnitTest;
+        fCollateralTracked = from.fCollateralTracked;
         mapGovernanceObjectsVotedOn = from.mapGovernanceObjectsVotedOn;
         return *this;
     }
@@ -411,6 +431,9 @@ public:
         if (!(s.GetType() & SER_GETHASH)) {
             READWRITE(lastPing);
         }
+        if (ser_action.ForRead()) {
+            payee = GetMasternodePayeeScript(pubKeyCollateralAddress);
+        }
     }
 
     uint256 GetHash() const;
@@ -12,45 +12,24 @@
 #include <masternodes/masternode-sync.h>
 #include <masternodes/masternodeman.h>
 #include <masternodes/messagesigner.h>
+#include <hash.h>
 #include <netmessagemaker.h>
+#include <primitives/block.h>
 #include <masternodes/netfulfilledman.h>
 #include <script/standard.h>
 #include <ui_interface.h>
 #include <util.h>
 #include <warnings.h>
 
+#include <limits>
+#include <unordered_set>
+
 /** Masternode manager */
 CMasternodeMan mnodeman;
 
-const std::string CMasternodeMan::SERIALIZATION_VERSION_STRING = CLIENT_NAME + "-CMasternodeMan-Version-1";
+const std::string CMasternodeMan::SERIALIZATION_VERSION_STRING = CLIENT_NAME + "-CMasternodeMan-Version-2";
 const int CMasternodeMan::LAST_PAID_SCAN_BLOCKS = 100;
 
-struct CompareLastPaidBlock
-{
-    bool operator()(const std::pair<int, const CMasternode*>& t1,
-                    const std::pair<int, const CMasternode*>& t2) const
-    {
-        if (t1.first != t2.first)
-        {
-            return t1.first < t2.first;
-        }
-        else
-        {
-            if (t1.second->activationBlockHeight != t2.second->activationBlockHeight)
-            {
-                return t1.second->activationBlockHeight < t2.second->activationBlockHeight;
-            }
-            else
-            {
-                return t1.second->outpoint < t2.second->outpoint;
-            }            
-        }
-        
-        return (t1.first != t2.first) ? (t1.first < t2.first) : (t1.second->outpoint < t2.second->outpoint);
-    }
-};
-
-
 struct CompareScoreMN
 {
     bool operator()(const std::pair<arith_uint256, const CMasternode*>& t1,
@@ -70,9 +49,44 @@ struct CompareByAddr
     }
 };
 
+SaltedMasternodeKeyHasher::SaltedMasternodeKeyHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+size_t SaltedMasternodeKeyHasher::operator()(const CScript& script) const
+{
+    return CSipHasher(k0, k1).Write(script.data(), script.size()).Finalize();
+}
+
+size_t SaltedMasternodeKeyHasher::operator()(const CKeyID& keyID) const
+{
+    return CSipHasher(k0, k1).Write(keyID.begin(), keyID.size()).Finalize();
+}
+
+size_t SaltedMasternodeKeyHasher::operator()(const CService& addr) const
+{
+    std::vector<unsigned char> vchKey = addr.GetKey();
+    return CSipHasher(k0, k1).Write(vchKey.data(), vchKey.size()).Finalize();
+}
+
+size_t SaltedMasternodeKeyHasher::operator()(const std::pair<COutPoint, CService>& entry) const
+{
+    std::vector<unsigned char> vchKey = entry.second.GetKey();
+    return CSipHasher(k0, k1).Write(entry.first.hash.begin(), entry.first.hash.size()).Write(entry.first.n).Write(vchKey.data(), vchKey.size()).Finalize();
+}
+
+uint64_t CMasternodeListDigest::GetShortId(const CMasternodeBroadcast& mnb) const
+{
+    uint256 hashMnb = mnb.GetHash();
+    uint256 hashPing = mnb.lastPing.GetHash();
+    return CSipHasher(nSalt0, nSalt1).Write(hashMnb.begin(), hashMnb.size()).Write(hashPing.begin(), hashPing.size()).Finalize();
+}
+
 CMasternodeMan::CMasternodeMan():
     cs(),
     mapMasternodes(),
+    mapPayeeIndex(),
+    mapCollateralKeyIndex(),
+    mapMasternodeKeyIndex(),
+    mapAddrIndex(),
     mAskedUsForMasternodeList(),
     mWeAskedForMasternodeList(),
     mWeAskedForMasternodeListEntry(),
@@ -84,6 +98,7 @@ CMasternodeMan::CMasternodeMan():
     fMasternodesRemoved(false),
     vecDirtyGovernanceObjectHashes(),
     nLastSentinelPingTime(0),
+    fSanityCheck(false),
     mapSeenMasternodeBroadcast(),
     mapSeenMasternodePing()
 {}
@@ -99,18 +114,162 @@ bool CMasternodeMan::Add(CMasternode &mn)
     } 
 
     LogPrintG(BCLogLevel::LOG_INFO, BCLog::MN, "[Masternodes] CMasternodeMan::Add -- Adding new Masternode: addr=%s, %i now\n", mn.addr.ToString(), size() + 1);
-    if (mn.activationBlockHeight == 0)
-    {
-        Coin coin;
-        if (GetUTXOCoin(mn.outpoint, coin)) {
-            mn.activationBlockHeight = coin.nHeight;
-        }        
+    // from here on BlockConnected/BlockDisconnected keep the collateral state current
+    if (!mn.fUnitTest) {
+        mn.UpdateCollateralFromUTXO();
     }
-    mapMasternodes[mn.outpoint] = mn;
+    CMasternode& mnNew = mapMasternodes[mn.outpoint];
+    mnNew = mn;
+    AddToIndexes(mnNew);
     fMasternodesAdded = true;
     return true;
 }
 
+template <typename Index>
+static void EraseFromIndex(Index& index, const typename Index::key_type& key, const COutPoint& outpoint)
+{
+    auto range = index.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == outpoint) {
+            index.erase(it);
+            return;
+        }
+    }
+}
+
+/// Move outpoint to key in a payment queue, or take it out if it should not be queued
+template <typename Key>
+static void UpdatePaymentQueue(std::set<Key>& setQueue, std::map<COutPoint, Key>& mapKeys, const COutPoint& outpoint, bool fQueued, const Key& key)
+{
+    auto it = mapKeys.find(outpoint);
+    if (it != mapKeys.end()) {
+        if (fQueued && it->second == key) return;
+        setQueue.erase(it->second);
+        mapKeys.erase(it);
+    }
+    if (fQueued) {
+        setQueue.insert(key);
+        mapKeys.emplace(outpoint, key);
+    }
+}
+
+void CMasternodeMan::AddToIndexes(const CMasternode& mn)
+{
+    AssertLockHeld(cs);
+    mapPayeeIndex.emplace(mn.payee, mn.outpoint);
+    mapCollateralKeyIndex.emplace(mn.pubKeyCollateralAddress.GetID(), mn.outpoint);
+    mapMasternodeKeyIndex.emplace(mn.pubKeyMasternode.GetID(), mn.outpoint);
+    mapAddrIndex.emplace(mn.addr, mn.outpoint);
+    RefreshPaymentQueues(mn);
+    listScoreCache.clear();
+}
+
+void CMasternodeMan::RemoveFromIndexes(const CMasternode& mn)
+{
+    AssertLockHeld(cs);
+    EraseFromIndex(mapPayeeIndex, mn.payee, mn.outpoint);
+    EraseFromIndex(mapCollateralKeyIndex, mn.pubKeyCollateralAddress.GetID(), mn.outpoint);
+    EraseFromIndex(mapMasternodeKeyIndex, mn.pubKeyMasternode.GetID(), mn.outpoint);
+    EraseFromIndex(mapAddrIndex, mn.addr, mn.outpoint);
+    fListSnapshotDirty = true;
+    UpdatePaymentQueue(setPrimaryQueue, mapPrimaryQueueKeys, mn.outpoint, false, payment_queue_key_t());
+    UpdatePaymentQueue(setSecondaryQueue, mapSecondaryQueueKeys, mn.outpoint, false, payment_queue_key_t());
+    UpdateCounters(mn.outpoint, nullptr);
+    listScoreCache.clear();
+}
+
+void CMasternodeMan::RefreshPaymentQueues(const CMasternode& mn)
+{
+    AssertLockHeld(cs);
+    fListSnapshotDirty = true;
+    bool fPayable = mn.IsValidForPayment() && mn.nProtocolVersion >= mnpayments.GetMinMasternodePaymentsProto();
+    UpdatePaymentQueue(setPrimaryQueue, mapPrimaryQueueKeys, mn.outpoint, fPayable && mn.activationBlockHeight > 0,
+            payment_queue_key_t(mn.GetLastPaidBlockPrimary(), mn.activationBlockHeight, mn.outpoint));
+    UpdatePaymentQueue(setSecondaryQueue, mapSecondaryQueueKeys, mn.outpoint, fPayable,
+            payment_queue_key_t(mn.GetLastPaidBlockSecondary(), mn.activationBlockHeight, mn.outpoint));
+    UpdateCounters(mn.outpoint, &mn);
+}
+
+static void AdjustCount(std::map<int, int>& mapCounts, int nKey, int nDelta)
+{
+    int& nCount = mapCounts[nKey];
+    nCount += nDelta;
+    if (nCount == 0) {
+        mapCounts.erase(nKey);
+    }
+}
+
+void CMasternodeMan::UpdateCounters(const COutPoint& outpoint, const CMasternode* pmn)
+{
+    AssertLockHeld(cs);
+    for (int nDelta : {-1, 1}) {
+        count_key_t key;
+        if (nDelta < 0) {
+            auto it = mapCountKeys.find(outpoint);
+            if (it == mapCountKeys.end()) continue;
+            key = it->second;
+            mapCountKeys.erase(it);
+        } else {
+            if (!pmn) continue;
+            key = count_key_t(pmn->nActiveState, pmn->nProtocolVersion, pmn->activationBlockHeight);
+            mapCountKeys.emplace(outpoint, key);
+        }
+        bool fEnabled = std::get<0>(key) == CMasternode::MASTERNODE_ENABLED;
+        AdjustCount(mapStateCounts, std::get<0>(key), nDelta);
+        AdjustCount(mapProtocolCounts, std::get<1>(key), nDelta);
+        AdjustCount(mapActivationHeightCounts, std::get<2>(key), nDelta);
+        if (fEnabled) {
+            AdjustCount(mapEnabledProtocolCounts, std::get<1>(key), nDelta);
+            AdjustCount(mapEnabledActivationHeightCounts, std::get<2>(key), nDelta);
+        }
+    }
+}
+
+void CMasternodeMan::ClearCounters()
+{
+    AssertLockHeld(cs);
+    mapCountKeys.clear();
+    mapStateCounts.clear();
+    mapProtocolCounts.clear();
+    mapEnabledProtocolCounts.clear();
+    mapActivationHeightCounts.clear();
+    mapEnabledActivationHeightCounts.clear();
+}
+
+bool CMasternodeMan::IsCountStale(const CMasternode& mn) const
+{
+    AssertLockHeld(cs);
+    auto it = mapCountKeys.find(mn.outpoint);
+    return it == mapCountKeys.end() || it->second != count_key_t(mn.nActiveState, mn.nProtocolVersion, mn.activationBlockHeight);
+}
+
+void CMasternodeMan::UpdateIndexedKeys(CMasternode& mn, const CService& addrNew, const CPubKey& pubKeyMasternodeNew)
+{
+    LOCK(cs);
+    RemoveFromIndexes(mn);
+    mn.addr = addrNew;
+    mn.pubKeyMasternode = pubKeyMasternodeNew;
+    AddToIndexes(mn);
+}
+
+void CMasternodeMan::RebuildIndexes()
+{
+    AssertLockHeld(cs);
+    mapPayeeIndex.clear();
+    mapCollateralKeyIndex.clear();
+    mapMasternodeKeyIndex.clear();
+    mapAddrIndex.clear();
+    setPrimaryQueue.clear();
+    setSecondaryQueue.clear();
+    mapPrimaryQueueKeys.clear();
+    mapSecondaryQueueKeys.clear();
+    ClearCounters();
+    listScoreCache.clear();
+    for (const auto& mnpair : mapMasternodes) {
+        AddToIndexes(mnpair.second);
+    }
+}
+
 void CMasternodeMan::AskForMN(CNode* pnode, const COutPoint& outpoint, CConnman& connman)
 {
     if (!pnode)
@@ -123,26 +282,21 @@ void CMasternodeMan::AskForMN(CNode* pnode, const COutPoint& outpoint, CConnman&
     LOCK(cs);
 
     CService addrSquashed = CService(pnode->addr, 0);
-    auto it1 = mWeAskedForMasternodeListEntry.find(outpoint);
-    if (it1 != mWeAskedForMasternodeListEntry.end()) {
-        auto it2 = it1->second.find(addrSquashed);
-        if (it2 != it1->second.end()) {
-            if (GetTime() < it2->second) {
-                LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::AskForMN -- Skip (Last Request Too Recent): %s %s\n", addrSquashed.ToString(), outpoint.ToStringShort());
-                // we've asked recently, should not repeat too often or we could get banned
-                return;
-            }
-            // we asked this node for this outpoint but it's ok to ask again already
-            LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeMan::AskForMN -- Asking same peer %s for missing masternode entry again: %s\n", addrSquashed.ToString(), outpoint.ToStringShort());
-        } else {
-            // we already asked for this outpoint but not this node
-            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::AskForMN -- Asking new peer %s for missing masternode entry: %s\n", addrSquashed.ToString(), outpoint.ToStringShort());
+    auto entry = std::make_pair(outpoint, addrSquashed);
+    int64_t nAskAgain;
+    if (mWeAskedForMasternodeListEntry.GetExpiry(entry, nAskAgain)) {
+        if (GetTime() < nAskAgain) {
+            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::AskForMN -- Skip (Last Request Too Recent): %s %s\n", addrSquashed.ToString(), outpoint.ToStringShort());
+            // we've asked recently, should not repeat too often or we could get banned
+            return;
         }
+        // we asked this node for this outpoint but it's ok to ask again already
+        LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeMan::AskForMN -- Asking same peer %s for missing masternode entry again: %s\n", addrSquashed.ToString(), outpoint.ToStringShort());
     } else {
-        // we never asked any node for this outpoint
-        LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::AskForMN -- Asking peer %s for missing masternode entry for the first time: %s\n", addrSquashed.ToString(), outpoint.ToStringShort());
+        // we didn't ask this node for this outpoint yet
+        LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::AskForMN -- Asking peer %s for missing masternode entry: %s\n", addrSquashed.ToString(), outpoint.ToStringShort());
     }
-    mWeAskedForMasternodeListEntry[outpoint][addrSquashed] = GetTime() + DSEG_UPDATE_SECONDS;
+    mWeAskedForMasternodeListEntry.Set(entry, GetTime() + DSEG_UPDATE_SECONDS);
 
     const CNetMsgMaker msgMaker(pnode->GetSendVersion());
     // if (pnode->GetSendVersion() == 70021) {
@@ -162,21 +316,75 @@ bool CMasternodeMan::PoSeBan(const COutPoint &outpoint)
         return false;
     }
     pmn->PoSeBan();
+    fListSnapshotDirty = true;
 
     return true;
 }
 
 void CMasternodeMan::Check()
 {
-    LOCK2(cs_main, cs);
+    // Collateral spends are applied as blocks connect, so cs_main is only
+    // needed for entries whose collateral has never been looked up
+    std::vector<COutPoint> vecUntracked;
+    {
+        LOCK(cs);
+        for (const auto& mnpair : mapMasternodes) {
+            if (!mnpair.second.fUnitTest && !mnpair.second.IsCollateralTracked()) {
+                vecUntracked.push_back(mnpair.first);
+            }
+        }
+    }
+    if (!vecUntracked.empty()) {
+        LOCK2(cs_main, cs);
+        for (const auto& outpoint : vecUntracked) {
+            CMasternode* pmn = Find(outpoint);
+            if (pmn) {
+                pmn->UpdateCollateralFromUTXO();
+            }
+        }
+    }
+
+    LOCK(cs);
 
     LogPrintG(BCLogLevel::LOG_INFO, BCLog::MN, "[Masternodes] CMasternodeMan::Check -- nLastSentinelPingTime=%d, IsSentinelPingActive()=%d\n", nLastSentinelPingTime, IsSentinelPingActive());
 
     for (auto& mnpair : mapMasternodes) {
-        // NOTE: internally it checks only every Params().GetConsensus().nMasternodeCheckSeconds seconds
-        // since the last time, so expect some MNs to skip this
-        mnpair.second.Check();
+        // added while cs was released, picked up on the next pass
+        if (mnpair.second.fUnitTest || mnpair.second.IsCollateralTracked()) {
+            // NOTE: internally it checks only every Params().GetConsensus().nMasternodeCheckSeconds seconds
+            // since the last time, so expect some MNs to skip this
+            mnpair.second.Check();
+        }
+        // also picks up changes made by CMasternode::Check calls outside this loop
+        if (IsCountStale(mnpair.second)) {
+            RefreshPaymentQueues(mnpair.second);
+        }
+    }
+
+    CheckCounters();
+}
+
+CMasternodeMan::list_snapshot_t CMasternodeMan::GetListSnapshot()
+{
+    list_snapshot_t snapshot = std::atomic_load(&listSnapshot);
+    if (!snapshot) {
+        // nothing published yet
+        PublishListSnapshot();
+        snapshot = std::atomic_load(&listSnapshot);
+    }
+    return snapshot;
+}
+
+void CMasternodeMan::PublishListSnapshot()
+{
+    if (!fListSnapshotDirty.exchange(false) && std::atomic_load(&listSnapshot)) return;
+
+    list_snapshot_t snapshot;
+    {
+        LOCK(cs);
+        snapshot = std::make_shared<const std::map<COutPoint, CMasternode> >(mapMasternodes);
     }
+    std::atomic_store(&listSnapshot, snapshot);
 }
 
 void CMasternodeMan::CheckAndRemove(CConnman& connman)
@@ -187,87 +395,107 @@ void CMasternodeMan::CheckAndRemove(CConnman& connman)
         return;
     } 
 
-    {
-        // Need LOCK2 here to ensure consistent locking order because code below locks cs_main
-        // in CheckMnbAndUpdateMasternodeList()
-        LOCK2(cs_main, cs);
+    Check();
 
-        Check();
+    // masternodes which need a new broadcast and whose recovery we may ask other masternodes for
+    std::vector<std::pair<COutPoint, uint256> > vecRecoveryCandidates;
+    {
+        LOCK(cs);
 
-        // Remove spent masternodes, prepare structures and make requests to reasure the state of inactive ones
-        rank_pair_vec_t vecMasternodeRanks;
-        // ask for up to MNB_RECOVERY_MAX_ASK_ENTRIES masternode entries at a time
-        int nAskForMnbRecovery = MNB_RECOVERY_MAX_ASK_ENTRIES;
+        // Remove spent masternodes
         std::map<COutPoint, CMasternode>::iterator it = mapMasternodes.begin();
         while (it != mapMasternodes.end()) {
-            CMasternodeBroadcast mnb = CMasternodeBroadcast(it->second);
-            uint256 hash = mnb.GetHash();
             // If collateral was spent ...
             if (it->second.IsOutpointSpent()) {
                 LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeMan::CheckAndRemove -- Removing Masternode: %s  addr=%s  %i now\n", it->second.GetStateString(), it->second.addr.ToString(), size() - 1);
 
                 // erase all of the broadcasts we've seen from this txin, ...
-                mapSeenMasternodeBroadcast.erase(hash);
-                mWeAskedForMasternodeListEntry.erase(it->first);
+                mapSeenMasternodeBroadcast.erase(CMasternodeBroadcast(it->second).GetHash());
+                // ... and the peers we asked for it, so it can be asked for again if it comes back
+                std::vector<std::pair<COutPoint, CService> > vecAskedFor;
+                mWeAskedForMasternodeListEntry.ForEach([&](const std::pair<COutPoint, CService>& entry, int64_t, bool) {
+                    if (entry.first == it->first) vecAskedFor.push_back(entry);
+                });
+                for (const auto& entry : vecAskedFor) {
+                    mWeAskedForMasternodeListEntry.Erase(entry);
+                }
 
                 // and finally remove it from the list
                 it->second.FlagGovernanceItemsAsDirty();
+                RemoveFromIndexes(it->second);
                 mapMasternodes.erase(it++);
                 fMasternodesRemoved = true;
             } else {
-                bool fAsk = (nAskForMnbRecovery > 0) &&
-                            masternodeSync.IsSynced() &&
-                            it->second.IsNewStartRequired() &&
-                            !IsMnbRecoveryRequested(hash) &&
-                            !gArgs.IsArgSet("-connect");
-                
-                if (fAsk) {
-                    // this mn is in a non-recoverable state and we haven't asked other nodes yet
-                    std::set<CService> setRequested;
-                    // calulate only once and only when it's needed
-                    if (vecMasternodeRanks.empty()) {
-                        int nRandomBlockHeight = GetRandInt(nCachedBlockHeight);
-                        GetMasternodeRanks(vecMasternodeRanks, nRandomBlockHeight);
-                    }
-                    bool fAskedForMnbRecovery = false;
-                    // ask first MNB_RECOVERY_QUORUM_TOTAL masternodes we can connect to and we haven't asked recently
-                    for(int i = 0; setRequested.size() < MNB_RECOVERY_QUORUM_TOTAL && i < (int)vecMasternodeRanks.size(); i++) {
-                        // avoid banning
-                        if (mWeAskedForMasternodeListEntry.count(it->first) && mWeAskedForMasternodeListEntry[it->first].count(vecMasternodeRanks[i].second.addr))
-                        { 
-                            LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeMan::CheckAndRemove -- Avoiding banning, masternode=%s\n", it->first.ToStringShort());
-                            continue; 
-                        }
-                        // didn't ask recently, ok to ask now
-                        CService addr = vecMasternodeRanks[i].second.addr;
-                        setRequested.insert(addr);
-                        listScheduledMnbRequestConnections.push_back(std::make_pair(addr, hash));
-                        fAskedForMnbRecovery = true;
+                if (it->second.IsNewStartRequired()) {
+                    uint256 hash = CMasternodeBroadcast(it->second).GetHash();
+                    if (!IsMnbRecoveryRequested(hash)) {
+                        vecRecoveryCandidates.push_back(std::make_pair(it->first, hash));
                     }
-                    if (fAskedForMnbRecovery) {
-                        LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeMan::CheckAndRemove -- Recovery initiated, masternode=%s\n", it->first.ToStringShort());
-                        nAskForMnbRecovery--;
-                    }
-                    // wait for mnb recovery replies for MNB_RECOVERY_WAIT_SECONDS seconds
-                    mMnbRecoveryRequests[hash] = std::make_pair(GetTime() + MNB_RECOVERY_WAIT_SECONDS, setRequested);
                 }
                 ++it;
             }
         }
+    }
+
+    // Prepare structures and make requests to reasure the state of inactive ones
+    if (!vecRecoveryCandidates.empty() && masternodeSync.IsSynced() && !gArgs.IsArgSet("-connect")) {
+        rank_pair_vec_t vecMasternodeRanks;
+        // GetBlockHash() locks cs_main, so the ranks have to be calculated before cs is taken
+        int nRandomBlockHeight = GetRandInt(nCachedBlockHeight);
+        GetMasternodeRanks(vecMasternodeRanks, nRandomBlockHeight);
+
+        LOCK(cs);
+        // ask for up to MNB_RECOVERY_MAX_ASK_ENTRIES masternode entries at a time
+        int nAskForMnbRecovery = MNB_RECOVERY_MAX_ASK_ENTRIES;
+        for (const auto& candidate : vecRecoveryCandidates) {
+            if (nAskForMnbRecovery <= 0) break;
+            const COutPoint& outpoint = candidate.first;
+            const uint256& hash = candidate.second;
+            // this mn is in a non-recoverable state and we haven't asked other nodes yet
+            std::set<CService> setRequested;
+            bool fAskedForMnbRecovery = false;
+            // ask first MNB_RECOVERY_QUORUM_TOTAL masternodes we can connect to and we haven't asked recently
+            for(int i = 0; setRequested.size() < MNB_RECOVERY_QUORUM_TOTAL && i < (int)vecMasternodeRanks.size(); i++) {
+                // avoid banning
+                if (mWeAskedForMasternodeListEntry.Has(std::make_pair(outpoint, vecMasternodeRanks[i].second.addr)))
+                { 
+                    LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeMan::CheckAndRemove -- Avoiding banning, masternode=%s\n", outpoint.ToStringShort());
+                    continue; 
+                }
+                // didn't ask recently, ok to ask now
+                CService addr = vecMasternodeRanks[i].second.addr;
+                setRequested.insert(addr);
+                listScheduledMnbRequestConnections.push_back(std::make_pair(addr, hash));
+                fAskedForMnbRecovery = true;
+            }
+            if (fAskedForMnbRecovery) {
+                LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeMan::CheckAndRemove -- Recovery initiated, masternode=%s\n", outpoint.ToStringShort());
+                nAskForMnbRecovery--;
+            }
+            // wait for mnb recovery replies for MNB_RECOVERY_WAIT_SECONDS seconds,
+            // allow this mnb to be re-verified again after MNB_RECOVERY_RETRY_SECONDS seconds
+            // if mn is still in MASTERNODE_NEW_START_REQUIRED state.
+            int64_t nWaitUntil = GetTime() + MNB_RECOVERY_WAIT_SECONDS;
+            mMnbRecoveryRequests.Set(hash, nWaitUntil + MNB_RECOVERY_RETRY_SECONDS, std::make_pair(nWaitUntil, setRequested));
+        }
+    }
 
-        // proces replies for MASTERNODE_NEW_START_REQUIRED masternodes
+    // proces replies for MASTERNODE_NEW_START_REQUIRED masternodes
+    std::vector<CMasternodeBroadcast> vecMnbToReprocess;
+    {
+        LOCK(cs);
         LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeMan::CheckAndRemove -- mMnbRecoveryGoodReplies size=%d\n", (int)mMnbRecoveryGoodReplies.size());
         std::map<uint256, std::vector<CMasternodeBroadcast> >::iterator itMnbReplies = mMnbRecoveryGoodReplies.begin();
         while(itMnbReplies != mMnbRecoveryGoodReplies.end()){
-            if (mMnbRecoveryRequests[itMnbReplies->first].first < GetTime()) {
+            const auto* pRequest = mMnbRecoveryRequests.Find(itMnbReplies->first);
+            if (!pRequest || pRequest->first < GetTime()) {
                 // all nodes we asked should have replied now
                 if (itMnbReplies->second.size() >= MNB_RECOVERY_QUORUM_REQUIRED) {
                     // majority of nodes we asked agrees that this mn doesn't require new mnb, reprocess one of new mnbs
                     LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeMan::CheckAndRemove -- reprocessing mnb, masternode=%s\n", itMnbReplies->second[0].outpoint.ToStringShort());
                     // mapSeenMasternodeBroadcast.erase(itMnbReplies->first);
-                    int nDos;
                     itMnbReplies->second[0].fRecovery = true;
-                    CheckMnbAndUpdateMasternodeList(NULL, itMnbReplies->second[0], nDos, connman);
+                    vecMnbToReprocess.push_back(itMnbReplies->second[0]);
                 }
                 LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeMan::CheckAndRemove -- removing mnb recovery reply, masternode=%s, size=%d\n", itMnbReplies->second[0].outpoint.ToStringShort(), (int)itMnbReplies->second.size());
                 mMnbRecoveryGoodReplies.erase(itMnbReplies++);
@@ -276,58 +504,21 @@ void CMasternodeMan::CheckAndRemove(CConnman& connman)
             }
         }
     }
+    // CheckMnbAndUpdateMasternodeList() locks cs_main before cs, so it must be called without cs held
+    for (const auto& mnb : vecMnbToReprocess) {
+        int nDos;
+        CheckMnbAndUpdateMasternodeList(NULL, mnb, nDos, connman);
+    }
+
     {
-        // no need for cm_main below
         LOCK(cs);
 
-        auto itMnbRequest = mMnbRecoveryRequests.begin();
-        while(itMnbRequest != mMnbRecoveryRequests.end()){
-            // Allow this mnb to be re-verified again after MNB_RECOVERY_RETRY_SECONDS seconds
-            // if mn is still in MASTERNODE_NEW_START_REQUIRED state.
-            if (GetTime() - itMnbRequest->second.first > MNB_RECOVERY_RETRY_SECONDS) {
-                mMnbRecoveryRequests.erase(itMnbRequest++);
-            } else {
-                ++itMnbRequest;
-            }
-        }
-
-        // check who's asked for the Masternode list
-        auto it1 = mAskedUsForMasternodeList.begin();
-        while(it1 != mAskedUsForMasternodeList.end()){
-            if ((*it1).second < GetTime()) {
-                mAskedUsForMasternodeList.erase(it1++);
-            } else {
-                ++it1;
-            }
-        }
-
-        // check who we asked for the Masternode list
-        it1 = mWeAskedForMasternodeList.begin();
-        while(it1 != mWeAskedForMasternodeList.end()){
-            if ((*it1).second < GetTime()){
-                mWeAskedForMasternodeList.erase(it1++);
-            } else {
-                ++it1;
-            }
-        }
-
-        // check which Masternodes we've asked for
-        auto it2 = mWeAskedForMasternodeListEntry.begin();
-        while(it2 != mWeAskedForMasternodeListEntry.end()){
-            auto it3 = it2->second.begin();
-            while(it3 != it2->second.end()){
-                if (it3->second < GetTime()){
-                    it2->second.erase(it3++);
-                } else {
-                    ++it3;
-                }
-            }
-            if (it2->second.empty()) {
-                mWeAskedForMasternodeListEntry.erase(it2++);
-            } else {
-                ++it2;
-            }
-        }
+        // drop the requests and the list requests which are due, the rest is not visited
+        int64_t nNow = GetTime();
+        mMnbRecoveryRequests.Expire(nNow);
+        mAskedUsForMasternodeList.Expire(nNow);
+        mWeAskedForMasternodeList.Expire(nNow);
+        mWeAskedForMasternodeListEntry.Expire(nNow);
 
         auto it3 = mWeAskedForVerification.begin();
         while(it3 != mWeAskedForVerification.end()){
@@ -372,48 +563,48 @@ void CMasternodeMan::Clear()
 {
     LOCK(cs);
     mapMasternodes.clear();
-    mAskedUsForMasternodeList.clear();
-    mWeAskedForMasternodeList.clear();
-    mWeAskedForMasternodeListEntry.clear();
+    mapPayeeIndex.clear();
+    mapCollateralKeyIndex.clear();
+    mapMasternodeKeyIndex.clear();
+    mapAddrIndex.clear();
+    setPrimaryQueue.clear();
+    setSecondaryQueue.clear();
+    mapPrimaryQueueKeys.clear();
+    mapSecondaryQueueKeys.clear();
+    ClearCounters();
+    listScoreCache.clear();
+    fListSnapshotDirty = true;
+    mAskedUsForMasternodeList.Clear();
+    mWeAskedForMasternodeList.Clear();
+    mWeAskedForMasternodeListEntry.Clear();
     mapSeenMasternodeBroadcast.clear();
     mapSeenMasternodePing.clear();
     nLastSentinelPingTime = 0;
 }
 
-int CMasternodeMan::CountMasternodes(int nProtocolVersion)
+/// Sum of the counts with a key of at least nMin. Protocol versions and recent activation
+/// heights have few distinct values, so this only visits a handful of entries.
+static int CountFrom(const std::map<int, int>& mapCounts, int nMin)
 {
-    LOCK(cs);
     int nCount = 0;
-    nProtocolVersion = nProtocolVersion == -1 ? mnpayments.GetMinMasternodePaymentsProto() : nProtocolVersion;
-
-    for (const auto& mnpair : mapMasternodes) {
-        if (mnpair.second.nProtocolVersion < nProtocolVersion)
-        { 
-            LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeMan::CountMasternodes -- Skip (Protocol version too low)\n");
-            continue; 
-        }
-        nCount++;
+    for (auto it = mapCounts.lower_bound(nMin); it != mapCounts.end(); ++it) {
+        nCount += it->second;
     }
-
     return nCount;
 }
 
-int CMasternodeMan::CountEnabled(int nProtocolVersion)
+int CMasternodeMan::CountMasternodes(int nProtocolVersion)
 {
     LOCK(cs);
-    int nCount = 0;
     nProtocolVersion = nProtocolVersion == -1 ? mnpayments.GetMinMasternodePaymentsProto() : nProtocolVersion;
+    return CountFrom(mapProtocolCounts, nProtocolVersion);
+}
 
-    for (const auto& mnpair : mapMasternodes) {
-        if (mnpair.second.nProtocolVersion < nProtocolVersion || !mnpair.second.IsEnabled())
-        { 
-            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::CountEnabled -- Skip (Protocol version too low or masternode not enabled)\n");
-            continue; 
-        }
-        nCount++;
-    }
-
-    return nCount;
+int CMasternodeMan::CountEnabled(int nProtocolVersion)
+{
+    LOCK(cs);
+    nProtocolVersion = nProtocolVersion == -1 ? mnpayments.GetMinMasternodePaymentsProto() : nProtocolVersion;
+    return CountFrom(mapEnabledProtocolCounts, nProtocolVersion);
 }
 
 int CMasternodeMan::CountCollateralisedAtHeight(int blockHeight)
@@ -424,24 +615,56 @@ int CMasternodeMan::CountCollateralisedAtHeight(int blockHeight)
 int CMasternodeMan::CountCollateralisedAtHeight(int nProtocolVersion, int blockHeight, bool onlyEnabled)
 {
     LOCK(cs);
-    int nCount = 0;
-    nProtocolVersion = nProtocolVersion == -1 ? mnpayments.GetMinMasternodePaymentsProto() : nProtocolVersion;
+    // nProtocolVersion has never been applied here
+    const std::map<int, int>& mapCounts = onlyEnabled ? mapEnabledActivationHeightCounts : mapActivationHeightCounts;
+    int nTotal = onlyEnabled ? CountFrom(mapEnabledProtocolCounts, std::numeric_limits<int>::min()) : (int)mapCountKeys.size();
+    // count down from the newest activations, which are few at the heights this is asked for
+    return blockHeight == std::numeric_limits<int>::max() ? nTotal : nTotal - CountFrom(mapCounts, blockHeight + 1);
+}
 
-    for (const auto& mnpair : mapMasternodes) {
-        if (mnpair.second.activationBlockHeight > blockHeight)
-        { 
-            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::CountCollateralisedAtHeight -- Skip (Activation block height too high)\n");
-            continue; 
-        }
-        if (onlyEnabled && !mnpair.second.IsEnabled())
-        {
-            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::CountCollateralisedAtHeight -- Skip (Masternode not enabled)\n");
-            continue;
-        }
-        nCount++;
-    }
+void CMasternodeMan::CheckCounters()
+{
+    if (!fSanityCheck) return;
 
-    return nCount;
+    LOCK(cs);
+    LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::CheckCounters -- Checking counters and payment queues for %u masternodes\n", mapMasternodes.size());
+
+    std::map<int, int> mapStateCountsCheck, mapProtocolCountsCheck, mapEnabledProtocolCountsCheck;
+    std::map<int, int> mapActivationHeightCountsCheck, mapEnabledActivationHeightCountsCheck;
+    assert(mapCountKeys.size() == mapMasternodes.size());
+    size_t nPrimaryQueued = 0, nSecondaryQueued = 0;
+    for (const auto& mnpair : mapMasternodes) {
+        const CMasternode& mn = mnpair.second;
+        assert(!IsCountStale(mn));
+        // the payment queues must give the order of a full sort, or payees would differ between nodes
+        bool fPayable = mn.IsValidForPayment() && mn.nProtocolVersion >= mnpayments.GetMinMasternodePaymentsProto();
+        auto itPrimary = mapPrimaryQueueKeys.find(mn.outpoint);
+        assert((itPrimary != mapPrimaryQueueKeys.end()) == (fPayable && mn.activationBlockHeight > 0));
+        if (itPrimary != mapPrimaryQueueKeys.end()) {
+            assert(itPrimary->second == payment_queue_key_t(mn.GetLastPaidBlockPrimary(), mn.activationBlockHeight, mn.outpoint));
+            nPrimaryQueued++;
+        }
+        auto itSecondary = mapSecondaryQueueKeys.find(mn.outpoint);
+        assert((itSecondary != mapSecondaryQueueKeys.end()) == fPayable);
+        if (itSecondary != mapSecondaryQueueKeys.end()) {
+            assert(itSecondary->second == payment_queue_key_t(mn.GetLastPaidBlockSecondary(), mn.activationBlockHeight, mn.outpoint));
+            nSecondaryQueued++;
+        }
+        mapStateCountsCheck[mn.nActiveState]++;
+        mapProtocolCountsCheck[mn.nProtocolVersion]++;
+        mapActivationHeightCountsCheck[mn.activationBlockHeight]++;
+        if (mn.IsEnabled()) {
+            mapEnabledProtocolCountsCheck[mn.nProtocolVersion]++;
+            mapEnabledActivationHeightCountsCheck[mn.activationBlockHeight]++;
+        }
+    }
+    assert(mapStateCounts == mapStateCountsCheck);
+    assert(mapProtocolCounts == mapProtocolCountsCheck);
+    assert(mapEnabledProtocolCounts == mapEnabledProtocolCountsCheck);
+    assert(mapActivationHeightCounts == mapActivationHeightCountsCheck);
+    assert(mapEnabledActivationHeightCounts == mapEnabledActivationHeightCountsCheck);
+    assert(setPrimaryQueue.size() == nPrimaryQueued && mapPrimaryQueueKeys.size() == nPrimaryQueued);
+    assert(setSecondaryQueue.size() == nSecondaryQueued && mapSecondaryQueueKeys.size() == nSecondaryQueued);
 }
 
 /* Only IPv4 masternodes are allowed in 12.1, saving this for later
@@ -468,8 +691,7 @@ void CMasternodeMan::DsegUpdate(CNode* pnode, CConnman& connman)
     CService addrSquashed = CService(pnode->addr, 0);
     if (Params().NetworkIDString() == CBaseChainParams::MAIN) {
         if (!(pnode->addr.IsRFC1918() || pnode->addr.IsLocal())) {
-            auto it = mWeAskedForMasternodeList.find(addrSquashed);
-            if (it != mWeAskedForMasternodeList.end() && GetTime() < (*it).second) {
+            if (mWeAskedForMasternodeList.HasUnexpired(addrSquashed, GetTime())) {
                 LogPrintG(BCLogLevel::LOG_INFO, BCLog::MN, "[Masternodes] CMasternodeMan::DsegUpdate -- we already asked %s for the list; skipping...\n", addrSquashed.ToString());
                 return;
             }
@@ -482,10 +704,17 @@ void CMasternodeMan::DsegUpdate(CNode* pnode, CConnman& connman)
     // } else {
     //     connman.PushMessage(pnode, msgMaker.Make(NetMsgType::DSEG, COutPoint()));
     // }
-    connman.PushMessage(pnode, msgMaker.Make(NetMsgType::DSEG, COutPoint()));
+    if (pnode->nServices & NODE_MNLIST) {
+        // only ask for what we don't have yet, older peers get the usual DSEG
+        CMasternodeListDigest digest;
+        GetListDigest(digest);
+        connman.PushMessage(pnode, msgMaker.Make(NetMsgType::MNLISTDIGEST, digest));
+    } else {
+        connman.PushMessage(pnode, msgMaker.Make(NetMsgType::DSEG, COutPoint()));
+    }
 
     int64_t askAgain = GetTime() + DSEG_UPDATE_SECONDS;
-    mWeAskedForMasternodeList[addrSquashed] = askAgain;
+    mWeAskedForMasternodeList.Set(addrSquashed, askAgain);
 
     LogPrintG(BCLogLevel::LOG_INFO, BCLog::MN, "[Masternodes] CMasternodeMan::DsegUpdate -- asked %s for the list\n", pnode->addr.ToString());
     LogPrintG(BCLogLevel::LOG_INFO, BCLog::MN, "[Masternodes] CMasternodeMan::DsegUpdate -- %s", pnode->addr.ToString());
@@ -525,52 +754,56 @@ bool CMasternodeMan::GetMasternodeInfo(const COutPoint& outpoint, masternode_inf
 bool CMasternodeMan::GetMasternodeInfo(const CPubKey& pubKeyMasternode, masternode_info_t& mnInfoRet)
 {
     LOCK(cs);
-    for (const auto& mnpair : mapMasternodes) {
-        if (mnpair.second.pubKeyMasternode == pubKeyMasternode) {
-            mnInfoRet = mnpair.second.GetInfo();
-            return true;
-        }
+    const CMasternode* pmn = FindIndexed(mapMasternodeKeyIndex, pubKeyMasternode.GetID(),
+            [&pubKeyMasternode](const CMasternode& mn) { return mn.pubKeyMasternode == pubKeyMasternode; });
+    if (!pmn) {
+        return false;
     }
-    return false;
+    mnInfoRet = pmn->GetInfo();
+    return true;
 }
 
 bool CMasternodeMan::GetMasternodeInfo(const CScript& payee, masternode_info_t& mnInfoRet)
 {
+    // only a P2WPKH script of the collateral key can match
+    int nWitnessVersion;
+    std::vector<unsigned char> vchProgram;
+    if (!payee.IsWitnessProgram(nWitnessVersion, vchProgram) || nWitnessVersion != 0 || vchProgram.size() != CKeyID().size()) {
+        return false;
+    }
+
     LOCK(cs);
-    for (const auto& mnpair : mapMasternodes) {
-        CScript scriptCollateralAddress = GetScriptForDestination(WitnessV0KeyHash(mnpair.second.pubKeyCollateralAddress.GetID()));
-        if (scriptCollateralAddress == payee) {
-            mnInfoRet = mnpair.second.GetInfo();
-            return true;
-        }
+    const CMasternode* pmn = FindIndexed(mapCollateralKeyIndex, CKeyID(uint160(vchProgram)),
+            [](const CMasternode& mn) { return true; });
+    if (!pmn) {
+        return false;
     }
-    return false;
+    mnInfoRet = pmn->GetInfo();
+    return true;
 }
 
 bool CMasternodeMan::GetMasternodeInfoFromCollateral(const CScript& payee, masternode_info_t& mnInfoRet)
 {
-    // Already locked?
-    // LOCK(cs);
-    for (const auto& mnpair : mapMasternodes) {
-        CScript scriptCollateralAddress = GetScriptForDestination(CScriptID(GetScriptForDestination(WitnessV0KeyHash(mnpair.second.pubKeyCollateralAddress.GetID()))));
-        if (scriptCollateralAddress == payee) {
-            mnInfoRet = mnpair.second.GetInfo();
-            return true;
-        }
+    LOCK(cs);
+    const CMasternode* pmn = FindIndexed(mapPayeeIndex, payee,
+            [](const CMasternode& mn) { return true; });
+    if (!pmn) {
+        return false;
     }
-    return false;
+    mnInfoRet = pmn->GetInfo();
+    return true;
 }
 
 bool CMasternodeMan::GetMasternodeInfoFromCollateral(const CPubKey& pubKeyCollateralAddress, masternode_info_t& mnInfoRet)
 {
     LOCK(cs);
-    for (const auto& mnpair : mapMasternodes) {
-        if (mnpair.second.pubKeyCollateralAddress == pubKeyCollateralAddress) {
-            mnInfoRet = mnpair.second.GetInfo();
-            return true;
-        }
+    const CMasternode* pmn = FindIndexed(mapCollateralKeyIndex, pubKeyCollateralAddress.GetID(),
+            [&pubKeyCollateralAddress](const CMasternode& mn) { return mn.pubKeyCollateralAddress == pubKeyCollateralAddress; });
+    if (!pmn) {
+        return false;
     }
-    return false;
+    mnInfoRet = pmn->GetInfo();
+    return true;
 }
 
 int CMasternodeMan::GetNodeActivationHeight(const CPubKey& pubKeyCollateralAddress)
@@ -580,8 +813,6 @@ int CMasternodeMan::GetNodeActivationHeight(const CPubKey& pubKeyCollateralAddre
 
 int CMasternodeMan::GetNodeActivationHeight(const CScript& payee) 
 {
-    // Already locked?
-    //LOCK(cs);
     masternode_info_t primaryCheckMnInfo;
     if (GetMasternodeInfoFromCollateral(payee, primaryCheckMnInfo))
     {
@@ -627,6 +858,15 @@ bool CMasternodeMan::GetNextMasternodesInQueueForPayment(bool fFilterSigTime, in
 }
 
 bool CMasternodeMan::GetNextMasternodesInQueueForPayment(int nBlockHeight, bool fFilterSigTime, int& nCountRet, masternode_info_t& mnInfoRet, std::vector<masternode_info_t>& vSecondaryMnInfoRet)
+{
+    // looking up the payees of the next blocks takes the masternode payments locks, which
+    // must not be acquired while holding cs
+    std::set<CScript> setScheduledPayees;
+    mnpayments.GetScheduledPayees(nBlockHeight, setScheduledPayees);
+    return GetNextMasternodesInQueueForPayment(nBlockHeight, fFilterSigTime, setScheduledPayees, nCountRet, mnInfoRet, vSecondaryMnInfoRet);
+}
+
+bool CMasternodeMan::GetNextMasternodesInQueueForPayment(int nBlockHeight, bool fFilterSigTime, const std::set<CScript>& setScheduledPayees, int& nCountRet, masternode_info_t& mnInfoRet, std::vector<masternode_info_t>& vSecondaryMnInfoRet)
 {
     mnInfoRet = masternode_info_t();
     nCountRet = 0;
@@ -640,141 +880,47 @@ bool CMasternodeMan::GetNextMasternodesInQueueForPayment(int nBlockHeight, bool
     // Need LOCK2 here to ensure consistent locking order because the GetBlockHash call below locks cs_main
     LOCK2(cs_main,cs);
 
-    std::vector<std::pair<int, const CMasternode*> > vecMasternodeLastPaid;
-    std::vector<std::pair<int, const CMasternode*> > vecMasternodeLastPaidSecondary;
-
-    /*
-        Make a vector with all of the last paid times
-    */
-
     int nMnCount = CountMasternodes();
-
-    // Primary
-    for (const auto& mnpair : mapMasternodes) {
-        if (!mnpair.second.IsValidForPayment())
-        { 
-            //LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] \n");
-            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::GetNextMasternodesInQueueForPayment primary -- Skip (Not Valid for Payment) \n");
-            continue; 
-        }
-
-        //check protocol version
-        if (mnpair.second.nProtocolVersion < mnpayments.GetMinMasternodePaymentsProto())
-        { 
-            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::GetNextMasternodesInQueueForPayment primary -- Skip (Protocol Version Too Low) \n");
-            continue; 
-        }
-
-        //it's in the list (up to 8 entries ahead of current block to allow propagation) -- so let's skip it
-        if (mnpayments.IsScheduled(mnpair.second, nBlockHeight))
-        { 
-            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::GetNextMasternodesInQueueForPayment primary -- Skip (Scheduled for payment) \n");
-            continue; 
-        }
-
-        //it's too new, wait for a cycle
-        if (fFilterSigTime && mnpair.second.sigTime + (nMnCount*60) > GetAdjustedTime())
-        { 
-            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::GetNextMasternodesInQueueForPayment primary -- Skip (Too new) \n");
-            continue; 
-        }
-
-        //make sure it has at least as many confirmations as there are masternodes
-        if (GetUTXOConfirmations(mnpair.first) < nMnCount)
-        { 
-            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::GetNextMasternodesInQueueForPayment primary -- Skip (Confirmation Count < Masternode Count) \n");
-            continue; 
-        }
-
-        // Make sure that the activation height is set
-        if (mnpair.second.activationBlockHeight <= 0)
-        {
-            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodePayments::FillBlockPayees -- Primary payee activation height <= zero. Eish. \n");
-            continue; 
-        }
-
-        // Make sure the activation height is realistic
-        if (mnpair.second.activationBlockHeight > nBlockHeight)
-        {
-            // Some kind of fair notice of what happened if this fails
-            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodePayments::FillBlockPayees -- Primary payee activation height is in the future... great Scott! \n");
-            continue; 
-        }
-
-        // if (mnpair.second.nBlockLastPaidPrimary == 0)
-        // {
-        //     // This *could* be (but probably isn't) right... if this is is the first payment to this masternode
-        //     int masternodesEnabledBlocks = nBlockHeight - Params().GetConsensus().nMasternodePaymentsStartBlock;
-        //     int primaryPayeeBlockAge = nBlockHeight - mnpair.second.activationBlockHeight;
-        //     bool irrationalPayeeAge = masternodesEnabledBlocks > nMnCount && primaryPayeeBlockAge > nMnCount;
-        //     if (irrationalPayeeAge)
-        //     {
-        //         // This does not make sense, as this masternodes *should* have been paid by now
-        //         LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodePayments::FillBlockPayees -- Primary payee nTimeLastPaidPrimary is irrationally zero \n");
-        //         continue; 
-        //     }
-        // }
-
-        LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::GetNextMasternodesInQueueForPayment primary -- Selected \n");
-        vecMasternodeLastPaid.push_back(std::make_pair(mnpair.second.GetLastPaidBlockPrimary(), &mnpair.second));
-    }
-
-    // Secondaries
-    for (const auto& mnpair : mapMasternodes) {
-        if (!mnpair.second.IsValidForPayment())
-        { 
-            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::GetNextMasternodesInQueueForPayment secondary -- Skip (Not Valid for Payment) \n");
-            continue; 
-        }
-
-        //check protocol version
-        if (mnpair.second.nProtocolVersion < mnpayments.GetMinMasternodePaymentsProto())
-        { 
-            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::GetNextMasternodesInQueueForPayment secondary -- Skip (Protocol Version Too Low) \n");
-            continue; 
-        }
-
-        // it's in the list (up to 8 entries ahead of current block to allow propagation) -- so let's skip it
-        // skip this check for secondaries
-        // if (mnpayments.IsScheduled(mnpair.second, nBlockHeight))
-        // { 
-        //     LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeMan::GetNextMasternodesInQueueForPayment secondary -- Skip (Scheduled for payment) \n");
-        //     continue; 
-        // }
-
-        //it's too new, wait for a cycle
-        if (fFilterSigTime && mnpair.second.sigTime + ((nMnCount/Params().GetConsensus().nMasternodeMaturitySecondariesMaxCount)*60) > GetAdjustedTime())
-        { 
-            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::GetNextMasternodesInQueueForPayment secondary -- Skip (Too new) \n");
-            continue; 
-        }
-
-        //make sure it has at least as many confirmations as there are masternodes
-        if (GetUTXOConfirmations(mnpair.first) < nMnCount)
-        { 
-            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::GetNextMasternodesInQueueForPayment secondary -- Skip (Confirmation Count < Masternode Count) \n");
-            continue; 
-        }
-
-        // Add it to the secondaries list as well, but use the lastpaid secondary as the first term
-        LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::GetNextMasternodesInQueueForPayment secondary -- Selected \n");
-        vecMasternodeLastPaidSecondary.push_back(std::make_pair(mnpair.second.GetLastPaidBlockSecondary(), &mnpair.second));
-    }
-
-    nCountRet = (int)vecMasternodeLastPaid.size();
+    int nMinProtocol = mnpayments.GetMinMasternodePaymentsProto();
+    int nSecondariesToGet = Params().GetConsensus().nMasternodeMaturitySecondariesMaxCount;
+    int64_t nNow = GetAdjustedTime();
+
+    // The queues are kept in the order the candidates used to be sorted in, so walking one gives
+    // the candidates of a full scan in the same order and can stop after the first nMax of them.
+    // The filters are the ones of the full scan, every node must select the same payees.
+    auto walkQueue = [&](const std::set<payment_queue_key_t>& setQueue, bool fPrimary, size_t nMax, int64_t nMinAge) {
+        std::vector<const CMasternode*> vecRet;
+        for (const auto& key : setQueue) {
+            if (vecRet.size() >= nMax) break;
+            const CMasternode* pmn = Find(std::get<2>(key));
+            // the state may have changed since the queue was last refreshed
+            if (!pmn || !pmn->IsValidForPayment() || pmn->nProtocolVersion < nMinProtocol) continue;
+            //it's in the list (up to 8 entries ahead of current block to allow propagation) -- so let's skip it
+            if (fPrimary && setScheduledPayees.count(pmn->payee)) continue;
+            //it's too new, wait for a cycle
+            if (fFilterSigTime && pmn->sigTime + nMinAge > nNow) continue;
+            // Make sure that the activation height is set and realistic
+            if (fPrimary && (pmn->activationBlockHeight <= 0 || pmn->activationBlockHeight > nBlockHeight)) continue;
+            //make sure it has at least as many confirmations as there are masternodes
+            if (GetUTXOConfirmations(pmn->outpoint) < nMnCount) continue;
+            vecRet.push_back(pmn);
+        }
+        return vecRet;
+    };
+
+    // every qualifying primary is counted
+    std::vector<const CMasternode*> vecPrimaries = walkQueue(setPrimaryQueue, true, std::numeric_limits<size_t>::max(), nMnCount*60);
+    nCountRet = (int)vecPrimaries.size();
 
     //when the network is in the process of upgrading, don't penalize nodes that recently restarted
     if (fFilterSigTime && nCountRet < nMnCount/3)
     {
         LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::GetNextMasternodesInQueueForPayment -- Defer (Network upgrade)\n");
-        return GetNextMasternodesInQueueForPayment(nBlockHeight, false, nCountRet, mnInfoRet, vSecondaryMnInfoRet);
+        return GetNextMasternodesInQueueForPayment(nBlockHeight, false, setScheduledPayees, nCountRet, mnInfoRet, vSecondaryMnInfoRet);
     }
 
-    // Sort them low to high
-    // First primaries
-    sort(vecMasternodeLastPaid.begin(), vecMasternodeLastPaid.end(), CompareLastPaidBlock());
-    // then secondaries (the logic remains the same, but the input is different)
-    sort(vecMasternodeLastPaidSecondary.begin(), vecMasternodeLastPaidSecondary.end(), CompareLastPaidBlock());
+    // Only the first secondaries are looked at, one extra in case the primary is among them
+    std::vector<const CMasternode*> vecSecondaries = walkQueue(setSecondaryQueue, false, nSecondariesToGet + 1, (nMnCount/nSecondariesToGet)*60);
 
     // Calculate the primary
     uint256 blockHash;
@@ -790,11 +936,11 @@ bool CMasternodeMan::GetNextMasternodesInQueueForPayment(int nBlockHeight, bool
     int nCountTenth = 0;
     arith_uint256 nHighest = 0;
     const CMasternode *pBestMasternode = NULL;
-    for (const auto& s : vecMasternodeLastPaid) {
-        arith_uint256 nScore = s.second->CalculateScore(blockHash);
+    for (const CMasternode* pmn : vecPrimaries) {
+        arith_uint256 nScore = pmn->CalculateScore(blockHash);
         if (nScore > nHighest){
             nHighest = nScore;
-            pBestMasternode = s.second;
+            pBestMasternode = pmn;
         }
         nCountTenth++;
         if (nCountTenth >= nTenthNetwork) break;
@@ -804,33 +950,19 @@ bool CMasternodeMan::GetNextMasternodesInQueueForPayment(int nBlockHeight, bool
     }
 
     // Now calculate the secondaries
-    int secondariesToGet = Params().GetConsensus().nMasternodeMaturitySecondariesMaxCount;
-    size_t sampleSize = 0;
-    if ((int)vecMasternodeLastPaidSecondary.size() - 1 >= secondariesToGet)
-    {
-        sampleSize = secondariesToGet;
-    }
-    else
-    {
-        sampleSize = vecMasternodeLastPaidSecondary.size() - 1;
-    }
-    // copy sampleSize items to the output
-    // <= to account for potentially skipping the one selected as a primary
-    for(int i=0; i<= (int)sampleSize; ++i){
-        const CMasternode *pBestSecondaryMasternode = vecMasternodeLastPaidSecondary[i].second;
-        if (pBestSecondaryMasternode)
-        {
+    if (!vecSecondaries.empty()) {
+        // the walk stopped early only if there were more than nSecondariesToGet
+        size_t sampleSize = std::min((size_t)nSecondariesToGet, vecSecondaries.size() - 1);
+        // <= to account for potentially skipping the one selected as a primary
+        for (size_t i = 0; i <= sampleSize; ++i) {
             // make sure we do not add the primary to the secondaries list...
-            if (pBestSecondaryMasternode !=  pBestMasternode)
-            {
-                masternode_info_t tempest = pBestSecondaryMasternode->GetInfo();
-                vSecondaryMnInfoRet.push_back(tempest);
+            if (vecSecondaries[i] != pBestMasternode) {
+                vSecondaryMnInfoRet.push_back(vecSecondaries[i]->GetInfo());
+            }
+            if (vSecondaryMnInfoRet.size() == sampleSize) {
+                // do not take more than you need
+                break;
             }
-        } 
-        if (vSecondaryMnInfoRet.size() == sampleSize)
-        {
-            // do not take more than you need
-            break;
         }
     }
 
@@ -895,33 +1027,44 @@ masternode_info_t CMasternodeMan::FindRandomNotInVec(const std::vector<COutPoint
     return masternode_info_t();
 }
 
-bool CMasternodeMan::GetMasternodeScores(const uint256& nBlockHash, CMasternodeMan::score_pair_vec_t& vecMasternodeScoresRet, int nMinProtocol)
+CMasternodeMan::score_table_ptr_t CMasternodeMan::GetScoreTable(const uint256& nBlockHash, int nMinProtocol)
 {
-    vecMasternodeScoresRet.clear();
-
-    if (!masternodeSync.IsMasternodeListSynced())
-    {
-        LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeMan::GetMasternodeScores -- Skip (Masternode list not synced)\n");
-        return false;
-    }
-
     AssertLockHeld(cs);
 
-    if (mapMasternodes.empty())
-    {
-        LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeMan::GetMasternodeScores -- Skip (Masternode list empty)\n");
-        return false;
+    const auto key = std::make_pair(nBlockHash, nMinProtocol);
+    for (auto it = listScoreCache.begin(); it != listScoreCache.end(); ++it) {
+        if (it->first == key) {
+            listScoreCache.splice(listScoreCache.begin(), listScoreCache, it);
+            return it->second;
+        }
     }
 
+    auto table = std::make_shared<score_table_t>();
     // calculate scores
     for (const auto& mnpair : mapMasternodes) {
         if (mnpair.second.nProtocolVersion >= nMinProtocol) {
-            vecMasternodeScoresRet.push_back(std::make_pair(mnpair.second.CalculateScore(nBlockHash), &mnpair.second));
+            table->vecScores.push_back(std::make_pair(mnpair.second.CalculateScore(nBlockHash), &mnpair.second));
         }
     }
 
-    sort(vecMasternodeScoresRet.rbegin(), vecMasternodeScoresRet.rend(), CompareScoreMN());
-    return !vecMasternodeScoresRet.empty();
+    sort(table->vecScores.rbegin(), table->vecScores.rend(), CompareScoreMN());
+
+    int nRank = 0;
+    for (const auto& scorePair : table->vecScores) {
+        table->mapRanks.emplace(scorePair.second->outpoint, ++nRank);
+    }
+
+    listScoreCache.emplace_front(key, table);
+    if (listScoreCache.size() > MAX_SCORE_CACHE_ENTRIES) {
+        listScoreCache.pop_back();
+    }
+    return table;
+}
+
+CMasternodeMan::score_table_ptr_t CMasternodeMan::GetScoreTableForBlock(const uint256& nBlockHash, int nMinProtocol)
+{
+    LOCK(cs);
+    return GetScoreTable(nBlockHash, nMinProtocol);
 }
 
 bool CMasternodeMan::GetMasternodeRank(const COutPoint& outpoint, int& nRankRet, int nBlockHeight, int nMinProtocol)
@@ -943,23 +1086,20 @@ bool CMasternodeMan::GetMasternodeRank(const COutPoint& outpoint, int& nRankRet,
 
     LOCK(cs);
 
-    score_pair_vec_t vecMasternodeScores;
-    if (!GetMasternodeScores(nBlockHash, vecMasternodeScores, nMinProtocol))
+    score_table_ptr_t table = GetScoreTable(nBlockHash, nMinProtocol);
+    if (table->vecScores.empty())
     {
         LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeMan::GetMasternodeRank -- Skip (Unable to get masternode scores)\n");
         return false;
     }
 
-    int nRank = 0;
-    for (const auto& scorePair : vecMasternodeScores) {
-        nRank++;
-        if (scorePair.second->outpoint == outpoint) {
-            nRankRet = nRank;
-            return true;
-        }
+    auto it = table->mapRanks.find(outpoint);
+    if (it == table->mapRanks.end()) {
+        return false;
     }
 
-    return false;
+    nRankRet = it->second;
+    return true;
 }
 
 bool CMasternodeMan::GetMasternodeRanks(CMasternodeMan::rank_pair_vec_t& vecMasternodeRanksRet, int nBlockHeight, int nMinProtocol)
@@ -980,15 +1120,16 @@ bool CMasternodeMan::GetMasternodeRanks(CMasternodeMan::rank_pair_vec_t& vecMast
 
     LOCK(cs);
 
-    score_pair_vec_t vecMasternodeScores;
-    if (!GetMasternodeScores(nBlockHash, vecMasternodeScores, nMinProtocol))
+    score_table_ptr_t table = GetScoreTable(nBlockHash, nMinProtocol);
+    if (table->vecScores.empty())
     {
         LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeMan::GetMasternodeRanks -- Skip (Unable to get masternode scores)\n");
         return false;
     }
 
+    vecMasternodeRanksRet.reserve(table->vecScores.size());
     int nRank = 0;
-    for (const auto& scorePair : vecMasternodeScores) {
+    for (const auto& scorePair : table->vecScores) {
         nRank++;
         vecMasternodeRanksRet.push_back(std::make_pair(nRank, *scorePair.second));
     }
@@ -1113,19 +1254,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, const std::string& strCommand,
             return;
         }
 
-        LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] MNANNOUNCE -- Masternode announce, masternode=%s\n", mnb.outpoint.ToStringShort());
-
-        int nDos = 0;
-
-        if (CheckMnbAndUpdateMasternodeList(pfrom, mnb, nDos, connman)) {
-            // use announced Masternode as a peer
-            std::vector<CAddress> vAddr;
-            vAddr.push_back(CAddress(mnb.addr, NODE_NETWORK));
-            connman.AddNewAddresses(vAddr, pfrom->addr, 2*60*60);
-        } else if (nDos > 0) {
-            LOCK(cs_main);
-            Misbehaving(pfrom->GetId(), nDos);
-        }
+        ProcessAnnounce(pfrom, mnb, connman);
 
         if (fMasternodesAdded) {
             NotifyMasternodeUpdates(connman);
@@ -1144,53 +1273,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, const std::string& strCommand,
             return;
         }
 
-        LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::ProcessMessage (MNPING) -- Masternode ping, masternode=%s\n", mnp.masternodeOutpoint.ToStringShort());
-
-        // Need LOCK2 here to ensure consistent locking order because the CheckAndUpdate call below locks cs_main
-        LOCK2(cs_main, cs);
-
-        if (mapSeenMasternodePing.count(nHash))
-        {
-            LogPrintG(BCLogLevel::LOG_INFO, BCLog::MN, "[Masternodes] CMasternodeMan::ProcessMessage (MNPING) -- Skipped (Seen) \n");
-            return;
-        } //seen
-
-        mapSeenMasternodePing.insert(std::make_pair(nHash, mnp));
-
-        LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] MNPING -- Masternode ping, masternode=%s new\n", mnp.masternodeOutpoint.ToStringShort());
-
-        // see if we have this Masternode
-        CMasternode* pmn = Find(mnp.masternodeOutpoint);
-
-        if (pmn && mnp.fSentinelIsCurrent)
-            UpdateLastSentinelPingTime();
-
-        // too late, new MNANNOUNCE is required
-        if (pmn && pmn->IsNewStartRequired())
-        {
-            LogPrintG(BCLogLevel::LOG_INFO, BCLog::MN, "[Masternodes] CMasternodeMan::ProcessMessage (MNPING) -- Skipped (Too late, new MNANNOUNCE required) \n");
-            return;
-        }
-
-        int nDos = 0;
-        if (mnp.CheckAndUpdate(pmn, false, nDos, connman))
-        {
-            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::ProcessMessage (MNPING) -- Skipped (Updated) \n");
-            return;
-        }
-
-        if (nDos > 0) {
-            // if anything significant failed, mark that node
-            LogPrintG(BCLogLevel::LOG_INFO, BCLog::MN, "[Masternodes] CMasternodeMan::ProcessMessage (MNPING) -- Node is acting suspicious \n");
-            Misbehaving(pfrom->GetId(), nDos);
-        } else if (pmn != NULL) {
-            // nothing significant failed, mn is a known one too
-            return;
-        }
-
-        // something significant is broken or mn is unknown,
-        // we might have to ask for a masternode entry once
-        AskForMN(pfrom, mnp.masternodeOutpoint, connman);
+        ProcessPing(pfrom, mnp, connman);
 
     } else if (strCommand == NetMsgType::DSEG) { //Get Masternode list or specific entry
         // Ignore such requests until we are fully synced.
@@ -1220,6 +1303,64 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, const std::string& strCommand,
             SyncSingle(pfrom, masternodeOutpoint, connman);
         }
 
+    } else if (strCommand == NetMsgType::MNLISTDIGEST) { //Get the Masternode list entries missing from a digest
+        // Same as DSEG, this is a heavy one so it's better to finish sync first.
+        if (!masternodeSync.IsSynced())
+        {
+            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::ProcessMessage (MNLISTDIGEST) -- Skipped (Masternodes not synced) \n");
+            return;
+        }
+
+        CMasternodeListDigest digest;
+        vRecv >> digest;
+        LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] MNLISTDIGEST -- Masternode list, peer has %d entries, peer=%d\n", digest.vecShortIds.size(), pfrom->GetId());
+
+        SyncDigest(pfrom, digest, connman);
+
+    } else if (strCommand == NetMsgType::MNLISTBATCH) { //Masternode list entries we were missing
+
+        CMasternodeListBatch batch;
+        vRecv >> batch;
+
+        if (!masternodeSync.IsBlockchainSynced())
+        {
+            LogPrintG(BCLogLevel::LOG_INFO, BCLog::MN, "[Masternodes] CMasternodeMan::ProcessMessage (MNLISTBATCH) -- Skipped (Blockchain not synced) \n");
+            return;
+        }
+
+        {
+            LOCK(cs);
+            if (!mWeAskedForMasternodeList.HasUnexpired(CService(pfrom->addr, 0), GetTime())) {
+                LogPrintG(BCLogLevel::LOG_INFO, BCLog::MN, "[Masternodes] CMasternodeMan::ProcessMessage (MNLISTBATCH) -- Skipped (Not asked for), peer=%d\n", pfrom->GetId());
+                return;
+            }
+        }
+
+        LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] MNLISTBATCH -- %d Masternode entries, complete=%d, peer=%d\n", batch.vecMnb.size(), batch.fComplete, pfrom->GetId());
+
+        for (auto& mnb : batch.vecMnb) {
+            ProcessAnnounce(pfrom, mnb, connman);
+            if (!mnb.lastPing) continue;
+            // a known broadcast is skipped as seen, its newer ping still has to be applied
+            bool fNewPing;
+            {
+                LOCK(cs);
+                CMasternode* pmn = Find(mnb.outpoint);
+                fNewPing = pmn && pmn->lastPing.GetHash() != mnb.lastPing.GetHash();
+            }
+            if (fNewPing) {
+                ProcessPing(pfrom, mnb.lastPing, connman);
+            }
+        }
+
+        if (fMasternodesAdded) {
+            NotifyMasternodeUpdates(connman);
+        }
+
+        if (batch.fComplete) {
+            masternodeSync.NotifyMasternodeListReceived(pfrom);
+        }
+
     } else if (strCommand == NetMsgType::MNVERIFY) { // Masternode Verify
 
         // Need LOCK2 here to ensure consistent locking order because all functions below call GetBlockHash which locks cs_main
@@ -1252,6 +1393,77 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, const std::string& strCommand,
     }
 }
                      
+void CMasternodeMan::ProcessAnnounce(CNode* pfrom, CMasternodeBroadcast& mnb, CConnman& connman)
+{
+    LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] MNANNOUNCE -- Masternode announce, masternode=%s\n", mnb.outpoint.ToStringShort());
+
+    int nDos = 0;
+
+    if (CheckMnbAndUpdateMasternodeList(pfrom, mnb, nDos, connman)) {
+        // use announced Masternode as a peer
+        std::vector<CAddress> vAddr;
+        vAddr.push_back(CAddress(mnb.addr, NODE_NETWORK));
+        connman.AddNewAddresses(vAddr, pfrom->addr, 2*60*60);
+    } else if (nDos > 0) {
+        LOCK(cs_main);
+        Misbehaving(pfrom->GetId(), nDos);
+    }
+}
+
+void CMasternodeMan::ProcessPing(CNode* pfrom, CMasternodePing& mnp, CConnman& connman)
+{
+    uint256 nHash = mnp.GetHash();
+
+    LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::ProcessMessage (MNPING) -- Masternode ping, masternode=%s\n", mnp.masternodeOutpoint.ToStringShort());
+
+    // Need LOCK2 here to ensure consistent locking order because the CheckAndUpdate call below locks cs_main
+    LOCK2(cs_main, cs);
+
+    if (mapSeenMasternodePing.count(nHash))
+    {
+        LogPrintG(BCLogLevel::LOG_INFO, BCLog::MN, "[Masternodes] CMasternodeMan::ProcessMessage (MNPING) -- Skipped (Seen) \n");
+        return;
+    } //seen
+
+    mapSeenMasternodePing.insert(std::make_pair(nHash, mnp));
+
+    LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] MNPING -- Masternode ping, masternode=%s new\n", mnp.masternodeOutpoint.ToStringShort());
+
+    // see if we have this Masternode
+    CMasternode* pmn = Find(mnp.masternodeOutpoint);
+
+    if (pmn && mnp.fSentinelIsCurrent)
+        UpdateLastSentinelPingTime();
+
+    // too late, new MNANNOUNCE is required
+    if (pmn && pmn->IsNewStartRequired())
+    {
+        LogPrintG(BCLogLevel::LOG_INFO, BCLog::MN, "[Masternodes] CMasternodeMan::ProcessMessage (MNPING) -- Skipped (Too late, new MNANNOUNCE required) \n");
+        return;
+    }
+
+    int nDos = 0;
+    if (mnp.CheckAndUpdate(pmn, false, nDos, connman))
+    {
+        if (pmn) RefreshPaymentQueues(*pmn);
+        LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::ProcessMessage (MNPING) -- Skipped (Updated) \n");
+        return;
+    }
+
+    if (nDos > 0) {
+        // if anything significant failed, mark that node
+        LogPrintG(BCLogLevel::LOG_INFO, BCLog::MN, "[Masternodes] CMasternodeMan::ProcessMessage (MNPING) -- Node is acting suspicious \n");
+        Misbehaving(pfrom->GetId(), nDos);
+    } else if (pmn != NULL) {
+        // nothing significant failed, mn is a known one too
+        return;
+    }
+
+    // something significant is broken or mn is unknown,
+    // we might have to ask for a masternode entry once
+    AskForMN(pfrom, mnp.masternodeOutpoint, connman);
+}
+
 void CMasternodeMan::SyncSingle(CNode* pnode, const COutPoint& outpoint, CConnman& connman)
 {
     // do not provide any data until our node is synced
@@ -1287,22 +1499,7 @@ void CMasternodeMan::SyncAll(CNode* pnode, CConnman& connman)
         return;
     }
 
-    // local network
-    bool isLocal = (pnode->addr.IsRFC1918() || pnode->addr.IsLocal());
-
-    CService addrSquashed = CService(pnode->addr, 0);
-    // should only ask for this once
-    if (!isLocal && Params().NetworkIDString() == CBaseChainParams::MAIN) {
-        LOCK2(cs_main, cs);
-        auto it = mAskedUsForMasternodeList.find(addrSquashed);
-        if (it != mAskedUsForMasternodeList.end() && it->second > GetTime()) {
-            Misbehaving(pnode->GetId(), 34);
-            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::%s -- peer already asked me for the list, peer=%d\n", __func__, pnode->GetId());
-            return;
-        }
-        int64_t askAgain = GetTime() + DSEG_UPDATE_SECONDS;
-        mAskedUsForMasternodeList[addrSquashed] = askAgain;
-    }
+    if (!AllowListRequest(pnode)) return;
 
     int nInvCount = 0;
 
@@ -1329,6 +1526,91 @@ void CMasternodeMan::SyncAll(CNode* pnode, CConnman& connman)
     LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::%s -- Sent %d Masternode invs to peer=%d\n", __func__, nInvCount, pnode->GetId());
 }
 
+void CMasternodeMan::SyncDigest(CNode* pnode, const CMasternodeListDigest& digest, CConnman& connman)
+{
+    // do not provide any data until our node is synced
+    if (!masternodeSync.IsSynced())
+    {
+        LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::SyncDigest -- Skipped (Masternodes not synced) \n");
+        return;
+    }
+
+    if (!AllowListRequest(pnode)) return;
+
+    std::vector<CMasternodeBroadcast> vecMnb;
+    GetListDiff(digest, vecMnb);
+
+    const CNetMsgMaker msgMaker(pnode->GetSendVersion());
+    CMasternodeListBatch batch;
+    size_t nBatchBytes = 0;
+    for (auto& mnb : vecMnb) {
+        size_t nSize = GetSerializeSize(mnb, SER_NETWORK, PROTOCOL_VERSION);
+        if (!batch.vecMnb.empty() && nBatchBytes + nSize > MNLIST_BATCH_MAX_BYTES) {
+            connman.PushMessage(pnode, msgMaker.Make(NetMsgType::MNLISTBATCH, batch));
+            batch.vecMnb.clear();
+            nBatchBytes = 0;
+        }
+        batch.vecMnb.push_back(std::move(mnb));
+        nBatchBytes += nSize;
+    }
+    batch.fComplete = true;
+    connman.PushMessage(pnode, msgMaker.Make(NetMsgType::MNLISTBATCH, batch));
+
+    connman.PushMessage(pnode, msgMaker.Make(NetMsgType::SYNCSTATUSCOUNT, MASTERNODE_SYNC_LIST, (int)vecMnb.size()));
+    LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::%s -- Sent %d of %d Masternode entries to peer=%d, peer had %d\n",
+                __func__, vecMnb.size(), size(), pnode->GetId(), digest.vecShortIds.size());
+}
+
+bool CMasternodeMan::AllowListRequest(CNode* pnode)
+{
+    // local network
+    bool isLocal = (pnode->addr.IsRFC1918() || pnode->addr.IsLocal());
+
+    CService addrSquashed = CService(pnode->addr, 0);
+    // should only ask for this once
+    if (!isLocal && Params().NetworkIDString() == CBaseChainParams::MAIN) {
+        LOCK2(cs_main, cs);
+        if (mAskedUsForMasternodeList.HasUnexpired(addrSquashed, GetTime())) {
+            Misbehaving(pnode->GetId(), 34);
+            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::%s -- peer already asked me for the list, peer=%d\n", __func__, pnode->GetId());
+            return false;
+        }
+        int64_t askAgain = GetTime() + DSEG_UPDATE_SECONDS;
+        mAskedUsForMasternodeList.Set(addrSquashed, askAgain);
+    }
+    return true;
+}
+
+void CMasternodeMan::GetListDigest(CMasternodeListDigest& digestRet)
+{
+    LOCK(cs);
+
+    digestRet.nSalt0 = GetRand(std::numeric_limits<uint64_t>::max());
+    digestRet.nSalt1 = GetRand(std::numeric_limits<uint64_t>::max());
+    digestRet.vecShortIds.clear();
+    digestRet.vecShortIds.reserve(mapMasternodes.size());
+    for (const auto& mnpair : mapMasternodes) {
+        digestRet.vecShortIds.push_back(digestRet.GetShortId(CMasternodeBroadcast(mnpair.second)));
+    }
+}
+
+void CMasternodeMan::GetListDiff(const CMasternodeListDigest& digest, std::vector<CMasternodeBroadcast>& vecMnbRet)
+{
+    std::unordered_set<uint64_t> setKnown(digest.vecShortIds.begin(), digest.vecShortIds.end());
+
+    LOCK(cs);
+
+    vecMnbRet.clear();
+    for (const auto& mnpair : mapMasternodes) {
+        // do not send local network masternode
+        if (mnpair.second.addr.IsRFC1918() || mnpair.second.addr.IsLocal()) continue;
+        // NOTE: send masternode regardless of its current state, the other node will need it to verify old votes.
+        CMasternodeBroadcast mnb(mnpair.second);
+        if (setKnown.count(digest.GetShortId(mnb))) continue;
+        vecMnbRet.push_back(std::move(mnb));
+    }
+}
+
 void CMasternodeMan::PushDsegInvs(CNode* pnode, const CMasternode& mn)
 {
     AssertLockHeld(cs);
@@ -1454,36 +1736,37 @@ void CMasternodeMan::CheckSameAddr()
     }
 
     std::vector<CMasternode*> vBan;
-    std::vector<CMasternode*> vSortedByAddr;
 
     {
         LOCK(cs);
 
-        CMasternode* pprevMasternode = NULL;
-        CMasternode* pverifiedMasternode = NULL;
-
-        for (auto& mnpair : mapMasternodes) {
-            vSortedByAddr.push_back(&mnpair.second);
-        }
-
-        sort(vSortedByAddr.begin(), vSortedByAddr.end(), CompareByAddr());
-
-        for (const auto& pmn : vSortedByAddr) {
-            // check only (pre)enabled masternodes
-            if (!pmn->IsEnabled() && !pmn->IsPreEnabled())
-            { 
-                LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::CheckSameAddr -- Skip (IsEnabled && !IsPreEnabled) \n");
-                continue; 
-            }
-            // initial step
-            if (!pprevMasternode) {
-                pprevMasternode = pmn;
-                pverifiedMasternode = pmn->IsPoSeVerified() ? pmn : NULL;
-                LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::CheckSameAddr -- Skip (Initial Step) \n");
-                continue;
+        // equal addresses are adjacent in mapAddrIndex, only groups of several masternodes need a look
+        auto itGroup = mapAddrIndex.begin();
+        while (itGroup != mapAddrIndex.end()) {
+            auto range = mapAddrIndex.equal_range(itGroup->first);
+            itGroup = range.second;
+            if (std::next(range.first) == range.second) continue;
+
+            std::vector<CMasternode*> vSameAddr;
+            for (auto it = range.first; it != range.second; ++it) {
+                CMasternode* pmn = Find(it->second);
+                // check only (pre)enabled masternodes
+                if (pmn && (pmn->IsEnabled() || pmn->IsPreEnabled())) {
+                    vSameAddr.push_back(pmn);
+                }
             }
-            // second+ step
-            if (pmn->addr == pprevMasternode->addr) {
+            std::sort(vSameAddr.begin(), vSameAddr.end(), [](const CMasternode* a, const CMasternode* b) { return a->outpoint < b->outpoint; });
+
+            CMasternode* pprevMasternode = NULL;
+            CMasternode* pverifiedMasternode = NULL;
+            for (const auto& pmn : vSameAddr) {
+                // initial step
+                if (!pprevMasternode) {
+                    pprevMasternode = pmn;
+                    pverifiedMasternode = pmn->IsPoSeVerified() ? pmn : NULL;
+                    continue;
+                }
+                // second+ step
                 if (pverifiedMasternode) {
                     // another masternode with the same ip is verified, ban this one
                     LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeMan::CheckSameAddr -- Another masternode with the same ip is verified, ban this one \n");
@@ -1495,10 +1778,8 @@ void CMasternodeMan::CheckSameAddr()
                     // and keep a reference to be able to ban following masternodes with the same ip
                     pverifiedMasternode = pmn;
                 }
-            } else {
-                pverifiedMasternode = pmn->IsPoSeVerified() ? pmn : NULL;
+                pprevMasternode = pmn;
             }
-            pprevMasternode = pmn;
         }
     }
 
@@ -1506,6 +1787,7 @@ void CMasternodeMan::CheckSameAddr()
     for (auto& pmn : vBan) {
         LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::CheckSameAddr -- increasing PoSe ban score for masternode %s\n", pmn->outpoint.ToStringShort());
         pmn->IncreasePoSeBanScore();
+        fListSnapshotDirty = true;
     }
 }
 
@@ -1685,6 +1967,7 @@ void CMasternodeMan::ProcessVerifyReply(CNode* pnode, CMasternodeVerification& m
                     prealMasternode = &mnpair.second;
                     if (!mnpair.second.IsPoSeVerified()) {
                         mnpair.second.DecreasePoSeBanScore();
+                        fListSnapshotDirty = true;
                     }
                     netfulfilledman.AddFulfilledRequest(pnode->addr, strprintf("%s", NetMsgType::MNVERIFY)+"-done");
 
@@ -1751,6 +2034,7 @@ void CMasternodeMan::ProcessVerifyReply(CNode* pnode, CMasternodeVerification& m
         // increase ban score for everyone else
         for (const auto& pmn : vpMasternodesToBan) {
             pmn->IncreasePoSeBanScore();
+            fListSnapshotDirty = true;
             LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::ProcessVerifyReply -- increased PoSe ban score for %s addr %s, new score %d\n",
                         prealMasternode->outpoint.ToStringShort(), pnode->addr.ToString(), pmn->nPoSeBanScore);
         }
@@ -1861,6 +2145,7 @@ void CMasternodeMan::ProcessVerifyBroadcast(CNode* pnode, const CMasternodeVerif
 
         if (!pmn1->IsPoSeVerified()) {
             pmn1->DecreasePoSeBanScore();
+            fListSnapshotDirty = true;
         }
         mnv.Relay();
 
@@ -1880,6 +2165,7 @@ void CMasternodeMan::ProcessVerifyBroadcast(CNode* pnode, const CMasternodeVerif
                 continue; 
             }
             mnpair.second.IncreasePoSeBanScore();
+            fListSnapshotDirty = true;
             nCount++;
             LogPrintG(BCLogLevel::LOG_INFO, BCLog::MN, "[Masternodes] CMasternodeMan::ProcessVerifyBroadcast -- increased PoSe ban score for %s addr %s, new score %d\n",
                         mnpair.first.ToStringShort(), mnpair.second.addr.ToString(), mnpair.second.nPoSeBanScore);
@@ -1919,15 +2205,16 @@ bool CMasternodeMan::CheckMnbAndUpdateMasternodeList(CNode* pfrom, CMasternodeBr
             if (GetTime() - mapSeenMasternodeBroadcast[hash].first > Params().GetConsensus().nMasternodeNewStartRequiredSeconds - Params().GetConsensus().nMasternodeMinMnpSeconds * 2) {
                 LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::CheckMnbAndUpdateMasternodeList -- masternode=%s seen update\n", mnb.outpoint.ToStringShort());
                 mapSeenMasternodeBroadcast[hash].first = GetTime();
-                masternodeSync.BumpAssetLastTime("CMasternodeMan::CheckMnbAndUpdateMasternodeList - seen");
+                masternodeSync.BumpAssetLastTime("CMasternodeMan::CheckMnbAndUpdateMasternodeList - seen", MASTERNODE_SYNC_LIST, nullptr);
             }
             // did we ask this node for it?
-            if (pfrom && IsMnbRecoveryRequested(hash) && GetTime() < mMnbRecoveryRequests[hash].first) {
+            auto* pRequest = pfrom ? mMnbRecoveryRequests.Find(hash) : nullptr;
+            if (pRequest && GetTime() < pRequest->first) {
                 LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::CheckMnbAndUpdateMasternodeList -- mnb=%s seen request\n", hash.ToString());
-                if (mMnbRecoveryRequests[hash].second.count(pfrom->addr)) {
+                if (pRequest->second.count(pfrom->addr)) {
                     LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::CheckMnbAndUpdateMasternodeList -- mnb=%s seen request, addr=%s\n", hash.ToString(), pfrom->addr.ToString());
                     // do not allow node to send same mnb multiple times in recovery mode
-                    mMnbRecoveryRequests[hash].second.erase(pfrom->addr);
+                    pRequest->second.erase(pfrom->addr);
                     // does it have newer lastPing?
                     if (mnb.lastPing.sigTime > mapSeenMasternodeBroadcast[hash].second.lastPing.sigTime) {
                         // simulate Check
@@ -1961,6 +2248,7 @@ bool CMasternodeMan::CheckMnbAndUpdateMasternodeList(CNode* pfrom, CMasternodeBr
                 LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::MN, "[Masternodes] CMasternodeMan::CheckMnbAndUpdateMasternodeList -- Update() failed, masternode=%s\n", mnb.outpoint.ToStringShort());
                 return false;
             }
+            RefreshPaymentQueues(*pmn);
             if (hash != mnbOld.GetHash()) {
                 mapSeenMasternodeBroadcast.erase(mnbOld.GetHash());
             }
@@ -1970,7 +2258,7 @@ bool CMasternodeMan::CheckMnbAndUpdateMasternodeList(CNode* pfrom, CMasternodeBr
 
     if (mnb.CheckOutpoint(nDos)) {
         Add(mnb);
-        masternodeSync.BumpAssetLastTime("CMasternodeMan::CheckMnbAndUpdateMasternodeList - new");
+        masternodeSync.BumpAssetLastTime("CMasternodeMan::CheckMnbAndUpdateMasternodeList - new", MASTERNODE_SYNC_LIST, pfrom);
         // if it matches our Masternode privkey...
         if (fMasternodeMode && mnb.pubKeyMasternode == activeMasternode.pubKeyMasternode) {
             mnb.nPoSeBanScore = -Params().GetConsensus().nMasternodePoseBanMaxScore;
@@ -1995,129 +2283,6 @@ bool CMasternodeMan::CheckMnbAndUpdateMasternodeList(CNode* pfrom, CMasternodeBr
     return true;
 }
 
-// This is a simplified version of what is done, when UpdateLastPaid is called for each masternode
-void CMasternodeMan::UpdateLastPaidGlobal(const CBlockIndex* pindex, int nMaxBlocksToScanBack)
-{
-    if (!pindex) return;
-
-    // Make our own list to make lookups easier
-    std::map<CScript, CMasternode> localNodeMap;
-    for (const auto& mnpair : mapMasternodes) {
-        CScript mnpayee = GetScriptForDestination(CScriptID(GetScriptForDestination(WitnessV0KeyHash(mnpair.second.pubKeyCollateralAddress.GetID()))));
-        localNodeMap[mnpayee] = mnpair.second;
-    }
-    
-    const CBlockIndex *pindexActive = chainActive.Tip();
-    assert(pindexActive);
-
-    CDiskBlockPos blockPos = pindexActive->GetBlockPos();
-    int maxSecondaryCount = Params().GetConsensus().nMasternodeMaturitySecondariesMaxCount;
-
-    // Simplified... always go as far back as we can
-    for (int i = 0; i < nMaxBlocksToScanBack; i++) {
-        size_t checkitOut = mnpayments.mapMasternodeBlocksPrimary.count(pindexActive->nHeight);
-        int mnCount = CountMasternodes(-1);
-
-        if ((mnCount > 2 && checkitOut) || (mnCount <= 2))
-        {
-            if (blockPos.IsNull() == true) {
-                return;
-            }
-
-            CBlock block;
-            if (!ReadBlockFromDisk(block, blockPos, Params().GetConsensus()))
-            {
-                continue;
-            }
-
-            // Check that we are not wasting our time with a block that has no MN payments
-            if (block.vtx[0]->vout.size() < 7)
-            {
-                continue;
-            }
-
-            // Explained in the individual masternode run version.
-            int primaryMnPaymentPosition = 6; // starting from 0
-            // Setting this to -1, so the initial increment sets it to 0.
-            int positionTracker = -1;
-            for (const auto& txout : block.vtx[0]->vout)
-            {
-                positionTracker++;
-                if (positionTracker < primaryMnPaymentPosition)
-                {
-                    continue;
-                }
-
-                // If we've made it this far, get some basic info about the tx
-                CScript txPayee = txout.scriptPubKey;
-                int nHeight = pindexActive->nHeight;
-                uint32_t nTime = pindexActive->nTime;
-                // Once we enforce the amount and the primary payee... do this:
-                // CAmount txValue = txout.nValue;
-                // CAmount nMasternodePaymentPrimary = GetMasternodePayments(pindexActive->nHeight, activationBlockHeight, block.vtx[0]->GetValueOut());
-                // double readableMnPayValue = nMasternodePaymentPrimary / COIN;
-                
-                // check if we have this mn... otherwise the rest doesn't make sense
-                auto findIt = localNodeMap.find(txPayee);
-                if (findIt == localNodeMap.end())
-                {
-                    // we don't got this mn... nothing to see here... move along!
-                    continue;
-                }
-
-                if (positionTracker == primaryMnPaymentPosition)
-                {
-                    // this is the spot for the primary payment
-                    // these values were off initially. :(
-                    // But a payment was made...
-                    // The value must be enforced when the dust settles.
-                    // Anyhow...
-
-                    // mark as a primary payment if needed
-                    if (findIt->second.nBlockLastPaidPrimary < nHeight)
-                    {
-                        // set it in the local list
-                        findIt->second.nBlockLastPaidPrimary = nHeight;
-                        findIt->second.nTimeLastPaidPrimary = nTime;
-                        // and in the global list
-                        auto globalListIt = mapMasternodes.find(findIt->second.outpoint);
-                        if (globalListIt != mapMasternodes.end())
-                        {
-                            globalListIt->second.nBlockLastPaidPrimary = nHeight;
-                            globalListIt->second.nTimeLastPaidPrimary = nTime;
-                        }
-                    }
-                }
-                // accounting for 20 secondaries and counting from 0... anything after that cannot be a masternode payment anyway
-                else if (positionTracker > primaryMnPaymentPosition && positionTracker < (primaryMnPaymentPosition + maxSecondaryCount + 1)) 
-                {
-                    // From here on, it is a secondary payment
-                    // mark as a secondary payment if needed
-                    if (findIt->second.nBlockLastPaidSecondary < nHeight)
-                    {
-                        // set it in the local list
-                        findIt->second.nBlockLastPaidSecondary = nHeight;
-                        findIt->second.nTimeLastPaidSecondary = nTime;
-                        // and in the global list
-                        auto globalListIt = mapMasternodes.find(findIt->second.outpoint);
-                        if (globalListIt != mapMasternodes.end())
-                        {
-                            globalListIt->second.nBlockLastPaidSecondary = nHeight;
-                            globalListIt->second.nTimeLastPaidSecondary = nTime;
-                        }
-                    }
-                }
-            }
-        }
-        
-        // Go back to the previous block if we can... let's Rock!
-        if (pindexActive->pprev == nullptr) { assert(pindexActive); break; }
-        pindexActive = pindexActive->pprev;
-    }
-
-
-}
-
 void CMasternodeMan::UpdateLastPaid(const CBlockIndex* pindex, bool lock)
 {
     LOCK(cs);
@@ -2140,40 +2305,14 @@ void CMasternodeMan::UpdateLastPaid(const CBlockIndex* pindex, bool lock)
         return;
     }
 
-    // Actually... go back as far as we can for now
-    int nMaxBlocksToScanBack = 0;
+    LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::UpdateLastPaid -- nCachedBlockHeight=%d\n", nCachedBlockHeight);
 
-    // use lastpaid to limit the number of blocks...
-    if (nUpdateLastPaidBlock == 0)
-    {
-        // it has not run yet...
-        nMaxBlocksToScanBack = mnpayments.GetStorageLimit();
-    }
-    else
-    {
-        // it has run, so we don't need to dive quite as deeply - add an extra block... just in case ;)
-        nMaxBlocksToScanBack = (nCachedBlockHeight - nUpdateLastPaidBlock) + 1;
+    // The payment index is kept up to date by ConnectBlock/DisconnectTip, so this costs
+    // two index lookups per masternode and never reads blocks.
+    for (auto& mnpair : mapMasternodes) {
+        mnpair.second.UpdateLastPaid(pindex);
+        RefreshPaymentQueues(mnpair.second);
     }
-    
-    // static int nLastRunBlockHeight = 0;
-    // Scan at least LAST_PAID_SCAN_BLOCKS but no more than mnpayments.GetStorageLimit()
-    // int nMaxBlocksToScanBack = std::max(LAST_PAID_SCAN_BLOCKS, nCachedBlockHeight - nLastRunBlockHeight);
-    // nMaxBlocksToScanBack = std::min(nMaxBlocksToScanBack, mnpayments.GetStorageLimit());
-
-    LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMan::UpdateLastPaid -- nCachedBlockHeight=%d, nUpdateLastPaidBlock=%d, nMaxBlocksToScanBack=%d\n",
-                            nCachedBlockHeight, nUpdateLastPaidBlock, nMaxBlocksToScanBack);
-
-    // This is fine when you have a 1:1 relationshaip between blocks and masternodes getting paid
-    // but... we have multiple payees per block, so we need to rethink this, so we don't run through
-    // the chain masternodeCount times.
-    // for (auto& mnpair : mapMasternodes) {
-    //     mnpair.second.UpdateLastPaid(pindex, nMaxBlocksToScanBack);
-    // }
-
-    // Should be faster....
-    UpdateLastPaidGlobal(pindex, nMaxBlocksToScanBack);
-
-    nUpdateLastPaidBlock = nCachedBlockHeight;
 }
 
 void CMasternodeMan::UpdateLastSentinelPingTime()
@@ -2212,11 +2351,12 @@ void CMasternodeMan::RemoveGovernanceObject(uint256 nGovernanceObjectHash)
 void CMasternodeMan::CheckMasternode(const CPubKey& pubKeyMasternode, bool fForce)
 {
     LOCK2(cs_main, cs);
-    for (auto& mnpair : mapMasternodes) {
-        if (mnpair.second.pubKeyMasternode == pubKeyMasternode) {
-            mnpair.second.Check(fForce);
-            return;
-        }
+    const CMasternode* pmn = FindIndexed(mapMasternodeKeyIndex, pubKeyMasternode.GetID(),
+            [&pubKeyMasternode](const CMasternode& mn) { return mn.pubKeyMasternode == pubKeyMasternode; });
+    if (pmn) {
+        CMasternode* pmnCheck = Find(pmn->outpoint);
+        pmnCheck->Check(fForce);
+        RefreshPaymentQueues(*pmnCheck);
     }
 }
 
@@ -2236,6 +2376,7 @@ void CMasternodeMan::SetMasternodeLastPing(const COutPoint& outpoint, const CMas
         return;
     }
     pmn->lastPing = mnp;
+    fListSnapshotDirty = true;
     if (mnp.fSentinelIsCurrent) {
         UpdateLastSentinelPingTime();
     }
@@ -2262,6 +2403,56 @@ void CMasternodeMan::UpdatedBlockTip(const CBlockIndex *pindex, bool lock)
     // }
 }
                          
+void CMasternodeMan::BlockConnected(const CBlock& block, const CBlockIndex* pindex)
+{
+    LOCK(cs);
+
+    if (mapMasternodes.empty()) return;
+
+    for (const auto& ptx : block.vtx) {
+        if (!ptx->IsCoinBase()) {
+            for (const auto& txin : ptx->vin) {
+                auto it = mapMasternodes.find(txin.prevout);
+                if (it != mapMasternodes.end()) {
+                    it->second.SetCollateralSpent();
+                    RefreshPaymentQueues(it->second);
+                }
+            }
+        }
+        // a collateral transaction confirmed again after a reorg
+        const uint256& txid = ptx->GetHash();
+        for (auto it = mapMasternodes.lower_bound(COutPoint(txid, 0)); it != mapMasternodes.end() && it->first.hash == txid; ++it) {
+            it->second.SetCollateralUnspent(pindex->nHeight);
+            RefreshPaymentQueues(it->second);
+        }
+    }
+}
+
+void CMasternodeMan::BlockDisconnected(const CBlock& block)
+{
+    LOCK(cs);
+
+    if (mapMasternodes.empty()) return;
+
+    for (auto itTx = block.vtx.rbegin(); itTx != block.vtx.rend(); ++itTx) {
+        const CTransaction& tx = **itTx;
+        // outputs of a disconnected transaction are gone from the UTXO set
+        const uint256& txid = tx.GetHash();
+        for (auto it = mapMasternodes.lower_bound(COutPoint(txid, 0)); it != mapMasternodes.end() && it->first.hash == txid; ++it) {
+            it->second.SetCollateralSpent();
+            RefreshPaymentQueues(it->second);
+        }
+        if (tx.IsCoinBase()) continue;
+        for (const auto& txin : tx.vin) {
+            auto it = mapMasternodes.find(txin.prevout);
+            if (it != mapMasternodes.end()) {
+                it->second.SetCollateralUnspent();
+                RefreshPaymentQueues(it->second);
+            }
+        }
+    }
+}
+
 void CMasternodeMan::WarnMasternodeDaemonUpdates()
 {
     LOCK(cs);
@@ -7,13 +7,87 @@
 #define MASTERNODEMAN_H
 
 #include <masternodes/masternode.h>
+#include <masternodes/timerwheel.h>
+#include <saltedhasher.h>
 #include <sync.h>
 
+#include <atomic>
+#include <list>
+#include <memory>
+#include <tuple>
+#include <unordered_map>
+
 class CMasternodeMan;
+class CBlock;
 class CConnman;
 
 extern CMasternodeMan mnodeman;
 
+/** Salted hasher for the secondary indexes of CMasternodeMan */
+class SaltedMasternodeKeyHasher
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedMasternodeKeyHasher();
+
+    size_t operator()(const CScript& script) const;
+    size_t operator()(const CKeyID& keyID) const;
+    size_t operator()(const CService& addr) const;
+    size_t operator()(const std::pair<COutPoint, CService>& entry) const;
+};
+
+/** Short ids of the masternode list entries a node has, sent to ask a peer for the rest of its list */
+class CMasternodeListDigest
+{
+public:
+    /// Picked by the requester so nobody can make entries collide on purpose
+    uint64_t nSalt0;
+    uint64_t nSalt1;
+    std::vector<uint64_t> vecShortIds;
+
+    CMasternodeListDigest() :
+        nSalt0(0),
+        nSalt1(0),
+        vecShortIds()
+        {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nSalt0);
+        READWRITE(nSalt1);
+        READWRITE(vecShortIds);
+    }
+
+    /// Covers the broadcast and its last ping, so an entry which was pinged since is sent again
+    uint64_t GetShortId(const CMasternodeBroadcast& mnb) const;
+};
+
+/** Masternode list entries missing from a CMasternodeListDigest, the last batch of a reply is marked complete */
+class CMasternodeListBatch
+{
+public:
+    std::vector<CMasternodeBroadcast> vecMnb;
+    bool fComplete;
+
+    CMasternodeListBatch() :
+        vecMnb(),
+        fComplete(false)
+        {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(vecMnb);
+        READWRITE(fComplete);
+    }
+};
+
 class CMasternodeMan
 {
 public:
@@ -21,12 +95,23 @@ public:
     typedef std::vector<score_pair_t> score_pair_vec_t;
     typedef std::pair<int, const CMasternode> rank_pair_t;
     typedef std::vector<rank_pair_t> rank_pair_vec_t;
+    typedef std::shared_ptr<const std::map<COutPoint, CMasternode> > list_snapshot_t;
+
+    /// Masternodes sorted by their score for a block, best first
+    struct score_table_t {
+        score_pair_vec_t vecScores;
+        std::map<COutPoint, int> mapRanks;
+    };
+    typedef std::shared_ptr<const score_table_t> score_table_ptr_t;
 
 private:
     static const std::string SERIALIZATION_VERSION_STRING;
 
     static const int DSEG_UPDATE_SECONDS        = 3 * 60 * 60;
 
+    // list entries are sent in batches of about this size, well below MAX_PROTOCOL_MESSAGE_LENGTH
+    static const size_t MNLIST_BATCH_MAX_BYTES  = 1000 * 1000;
+
     static const int LAST_PAID_SCAN_BLOCKS;
 
     static const int MIN_POSE_PROTO_VERSION     = BLOCKRESTRUCTURE_AND_MASTERNODES;
@@ -40,6 +125,8 @@ private:
     static const int MNB_RECOVERY_WAIT_SECONDS      = 60;
     static const int MNB_RECOVERY_RETRY_SECONDS     = 3 * 60 * 60;
 
+    static const size_t MAX_SCORE_CACHE_ENTRIES     = 16;
+
 
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
@@ -49,18 +136,32 @@ private:
 
     // map to hold all MNs
     std::map<COutPoint, CMasternode> mapMasternodes;
-    // who's asked for the Masternode list and the last time
-    std::map<CService, int64_t> mAskedUsForMasternodeList;
-    // who we asked for the Masternode list and the last time
-    std::map<CService, int64_t> mWeAskedForMasternodeList;
-    // which Masternodes we've asked for
-    std::map<COutPoint, std::map<CService, int64_t> > mWeAskedForMasternodeListEntry;
+
+    // secondary indexes into mapMasternodes, several masternodes may share a key
+    typedef std::unordered_multimap<CScript, COutPoint, SaltedMasternodeKeyHasher> payee_index_t;
+    typedef std::unordered_multimap<CKeyID, COutPoint, SaltedMasternodeKeyHasher> keyid_index_t;
+    typedef std::unordered_multimap<CService, COutPoint, SaltedMasternodeKeyHasher> addr_index_t;
+    payee_index_t mapPayeeIndex;
+    keyid_index_t mapCollateralKeyIndex;
+    keyid_index_t mapMasternodeKeyIndex;
+    addr_index_t mapAddrIndex;
+
+    typedef CTimerWheel<CService, SaltedMasternodeKeyHasher> addr_timer_t;
+    typedef CTimerWheel<std::pair<COutPoint, CService>, SaltedMasternodeKeyHasher> entry_timer_t;
+    typedef CTimerWheel<uint256, SaltedTxidHasher, std::pair<int64_t, std::set<CService> > > recovery_timer_t;
+    // who's asked for the Masternode list and when they may ask again
+    addr_timer_t mAskedUsForMasternodeList;
+    // who we asked for the Masternode list and when we may ask again
+    addr_timer_t mWeAskedForMasternodeList;
+    // which Masternodes we've asked which peers for
+    entry_timer_t mWeAskedForMasternodeListEntry;
 
     // who we asked for the masternode verification
     std::map<CService, CMasternodeVerification> mWeAskedForVerification;
 
-    // these maps are used for masternode recovery from MASTERNODE_NEW_START_REQUIRED state
-    std::map<uint256, std::pair< int64_t, std::set<CService> > > mMnbRecoveryRequests;
+    // these maps are used for masternode recovery from MASTERNODE_NEW_START_REQUIRED state,
+    // requests wait for replies until the first of the pair and are dropped MNB_RECOVERY_RETRY_SECONDS later
+    recovery_timer_t mMnbRecoveryRequests;
     std::map<uint256, std::vector<CMasternodeBroadcast> > mMnbRecoveryGoodReplies;
     std::list< std::pair<CService, uint256> > listScheduledMnbRequestConnections;
     std::map<CService, std::pair<int64_t, std::set<uint256> > > mapPendingMNB;
@@ -76,19 +177,90 @@ private:
     std::vector<uint256> vecDirtyGovernanceObjectHashes;
 
     int64_t nLastSentinelPingTime;
-    int64_t nUpdateLastPaidBlock = 0;
 
     friend class CMasternodeSync;
     /// Find an entry
     CMasternode* Find(const COutPoint& outpoint);
 
-    bool GetMasternodeScores(const uint256& nBlockHash, score_pair_vec_t& vecMasternodeScoresRet, int nMinProtocol = 0);
+    /// Keep the secondary indexes in sync with an entry of mapMasternodes, call Remove before the keys change
+    void AddToIndexes(const CMasternode& mn);
+    void RemoveFromIndexes(const CMasternode& mn);
+    void RebuildIndexes();
+
+    /// Find the entry a full scan of mapMasternodes would have found first among those with this key
+    template <typename Index, typename Predicate>
+    const CMasternode* FindIndexed(const Index& index, const typename Index::key_type& key, Predicate pred) const
+    {
+        AssertLockHeld(cs);
+        const CMasternode* pmnRet = nullptr;
+        auto range = index.equal_range(key);
+        for (auto it = range.first; it != range.second; ++it) {
+            auto itMn = mapMasternodes.find(it->second);
+            if (itMn == mapMasternodes.end() || !pred(itMn->second)) continue;
+            if (!pmnRet || itMn->first < pmnRet->outpoint) {
+                pmnRet = &itMn->second;
+            }
+        }
+        return pmnRet;
+    }
+
+    /// (last paid height, activation height, collateral): the order in which masternodes are due for payment
+    typedef std::tuple<int, int, COutPoint> payment_queue_key_t;
+    /// Masternodes in a state to be paid, maintained with the other indexes and refreshed as they are
+    /// checked and paid. Conditions that depend on the block being paid are checked when walking them.
+    std::set<payment_queue_key_t> setPrimaryQueue;
+    std::set<payment_queue_key_t> setSecondaryQueue;
+    std::map<COutPoint, payment_queue_key_t> mapPrimaryQueueKeys;
+    std::map<COutPoint, payment_queue_key_t> mapSecondaryQueueKeys;
+
+    void RefreshPaymentQueues(const CMasternode& mn);
+
+    /// (state, protocol version, activation height): what an entry adds to the counters below
+    typedef std::tuple<int, int, int> count_key_t;
+    /// Counters behind CountMasternodes, CountEnabled and CountCollateralisedAtHeight. They are
+    /// updated with the payment queues, so every state change that reaches RefreshPaymentQueues.
+    std::map<COutPoint, count_key_t> mapCountKeys;
+    std::map<int, int> mapStateCounts;
+    std::map<int, int> mapProtocolCounts;
+    std::map<int, int> mapEnabledProtocolCounts;
+    std::map<int, int> mapActivationHeightCounts;
+    std::map<int, int> mapEnabledActivationHeightCounts;
+    /// Compare the counters with a full scan after every Check, see -checkmasternodes
+    bool fSanityCheck;
+
+    /// Count the entry as it is now, or take it out of the counters if pmn is null
+    void UpdateCounters(const COutPoint& outpoint, const CMasternode* pmn);
+    void ClearCounters();
+    /// Whether the entry changed since it was last counted
+    bool IsCountStale(const CMasternode& mn) const;
+
+    /// Copy of mapMasternodes for readers, only accessed through std::atomic_load/store
+    list_snapshot_t listSnapshot;
+    /// Set when entries were added, removed or changed in a way readers care about
+    std::atomic<bool> fListSnapshotDirty{true};
+
+    /// Score tables by (block hash, min protocol), most recently used first. Cleared whenever an
+    /// entry is added, removed or re-keyed, which also keeps the CMasternode pointers valid.
+    std::list<std::pair<std::pair<uint256, int>, score_table_ptr_t> > listScoreCache;
+
+    score_table_ptr_t GetScoreTable(const uint256& nBlockHash, int nMinProtocol);
+
+    /// setScheduledPayees is collected before cs is taken, see CMasternodePayments::GetScheduledPayees
+    bool GetNextMasternodesInQueueForPayment(int nBlockHeight, bool fFilterSigTime, const std::set<CScript>& setScheduledPayees, int& nCountRet, masternode_info_t& mnInfoRet, std::vector<masternode_info_t>& vSecondaryMnInfoRet);
     
     void SyncSingle(CNode* pnode, const COutPoint& outpoint, CConnman& connman);
     void SyncAll(CNode* pnode, CConnman& connman);
+    /// Send the entries missing from the peer's digest in MNLISTBATCH messages
+    void SyncDigest(CNode* pnode, const CMasternodeListDigest& digest, CConnman& connman);
+    /// Rate limit full list requests, shared by DSEG and MNLISTDIGEST
+    bool AllowListRequest(CNode* pnode);
 
     void PushDsegInvs(CNode* pnode, const CMasternode& mn);
 
+    /// What MNANNOUNCE and MNPING do with a broadcast or ping, also used for MNLISTBATCH entries
+    void ProcessAnnounce(CNode* pfrom, CMasternodeBroadcast& mnb, CConnman& connman);
+    void ProcessPing(CNode* pfrom, CMasternodePing& mnp, CConnman& connman);
+
 public:
     // Keep track of all broadcasts I've seen
     std::map<uint256, std::pair<int64_t, CMasternodeBroadcast> > mapSeenMasternodeBroadcast;
@@ -114,8 +286,31 @@ public:
         READWRITE(mapMasternodes);
         READWRITE(mAskedUsForMasternodeList);
         READWRITE(mWeAskedForMasternodeList);
-        READWRITE(mWeAskedForMasternodeListEntry);
-        READWRITE(mMnbRecoveryRequests);
+        // the timer wheels are stored in the format of the maps they replaced
+        std::map<COutPoint, std::map<CService, int64_t> > mapAskedForEntry;
+        std::map<uint256, std::pair<int64_t, std::set<CService> > > mapRecoveryRequests;
+        if (!ser_action.ForRead()) {
+            mWeAskedForMasternodeListEntry.ForEach([&](const std::pair<COutPoint, CService>& entry, int64_t nExpire, bool) {
+                mapAskedForEntry[entry.first][entry.second] = nExpire;
+            });
+            mMnbRecoveryRequests.ForEach([&](const uint256& hash, int64_t, const std::pair<int64_t, std::set<CService> >& request) {
+                mapRecoveryRequests[hash] = request;
+            });
+        }
+        READWRITE(mapAskedForEntry);
+        READWRITE(mapRecoveryRequests);
+        if (ser_action.ForRead()) {
+            mWeAskedForMasternodeListEntry.Clear();
+            for (const auto& outpointpair : mapAskedForEntry) {
+                for (const auto& addrpair : outpointpair.second) {
+                    mWeAskedForMasternodeListEntry.Set(std::make_pair(outpointpair.first, addrpair.first), addrpair.second);
+                }
+            }
+            mMnbRecoveryRequests.Clear();
+            for (const auto& requestpair : mapRecoveryRequests) {
+                mMnbRecoveryRequests.Set(requestpair.first, requestpair.second.first + MNB_RECOVERY_RETRY_SECONDS, requestpair.second);
+            }
+        }
         READWRITE(mMnbRecoveryGoodReplies);
         READWRITE(nLastSentinelPingTime);
 
@@ -124,6 +319,9 @@ public:
         if (ser_action.ForRead() && (strVersion != SERIALIZATION_VERSION_STRING)) {
             Clear();
         }
+        if (ser_action.ForRead()) {
+            RebuildIndexes();
+        }
     }
 
     CMasternodeMan();
@@ -162,8 +360,21 @@ public:
     /// Count Masternodes by network type - NET_IPV4, NET_IPV6, NET_TOR
     // int CountByIP(int nNetworkType);
 
+    /// Enable the counter consistency check
+    void SetSanityCheck(bool fSanityCheckIn) { fSanityCheck = fSanityCheckIn; }
+    /// Assert that the counters and payment queues match a full scan of the list
+    void CheckCounters();
+
     void DsegUpdate(CNode* pnode, CConnman& connman);
 
+    /// Short ids of our entries under a fresh salt
+    void GetListDigest(CMasternodeListDigest& digestRet);
+    /// Our entries which are missing from a digest or differ from what it has
+    void GetListDiff(const CMasternodeListDigest& digest, std::vector<CMasternodeBroadcast>& vecMnbRet);
+
+    /// Change the address and masternode key of an entry of the list without breaking the indexes
+    void UpdateIndexedKeys(CMasternode& mn, const CService& addrNew, const CPubKey& pubKeyMasternodeNew);
+
     /// Versions of Find that are safe to use from outside the class
     bool Get(const COutPoint& outpoint, CMasternode& masternodeRet);
     bool Has(const COutPoint& outpoint);
@@ -185,8 +396,13 @@ public:
     /// Find a random entry
     masternode_info_t FindRandomNotInVec(const std::vector<COutPoint> &vecToExclude, int nProtocolVersion = -1);
 
-    std::map<COutPoint, CMasternode> GetFullMasternodeMap() { return mapMasternodes; }
+    /// Immutable copy of the list as of the last PublishListSnapshot(), does not take cs
+    list_snapshot_t GetListSnapshot();
+    /// Replace the snapshot handed out to readers if the list changed since it was taken
+    void PublishListSnapshot();
 
+    /// The cached score table for a block, the CMasternode pointers in it are only valid until the list changes
+    score_table_ptr_t GetScoreTableForBlock(const uint256& nBlockHash, int nMinProtocol);
     bool GetMasternodeRanks(rank_pair_vec_t& vecMasternodeRanksRet, int nBlockHeight = -1, int nMinProtocol = 0);
     bool GetMasternodeRank(const COutPoint &outpoint, int& nRankRet, int nBlockHeight = -1, int nMinProtocol = 0);
 
@@ -211,10 +427,9 @@ public:
 
     /// Perform complete check and only then update masternode list and maps using provided CMasternodeBroadcast
     bool CheckMnbAndUpdateMasternodeList(CNode* pfrom, CMasternodeBroadcast mnb, int& nDos, CConnman& connman);
-    bool IsMnbRecoveryRequested(const uint256& hash) { return mMnbRecoveryRequests.count(hash); }
+    bool IsMnbRecoveryRequested(const uint256& hash) { return mMnbRecoveryRequests.Has(hash); }
 
     void UpdateLastPaid(const CBlockIndex* pindex, bool lock = true);
-    void UpdateLastPaidGlobal(const CBlockIndex* pindex, int nMaxBlocksToScanBack);
 
     void AddDirtyGovernanceObjectHash(const uint256& nHash)
     {
@@ -241,6 +456,11 @@ public:
     void SetMasternodeLastPing(const COutPoint& outpoint, const CMasternodePing& mnp);
 
     void UpdatedBlockTip(const CBlockIndex *pindex, bool lock = true);
+
+    /// Apply collateral spends and confirmations of a newly connected block
+    void BlockConnected(const CBlock& block, const CBlockIndex* pindex);
+    /// Undo BlockConnected for a block that was disconnected in a reorg
+    void BlockDisconnected(const CBlock& block);
     
     void WarnMasternodeDaemonUpdates();
 
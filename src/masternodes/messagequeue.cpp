@@ -0,0 +1,260 @@
+// Copyright (c) 2014-2018 The Machinecoin Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <masternodes/messagequeue.h>
+
+#include <masternodes/governance.h>
+#include <masternodes/governance-vote.h>
+#include <masternodes/masternode.h>
+#include <masternodes/masternode-payments.h>
+#include <masternodes/masternode-sync.h>
+#include <masternodes/masternodeman.h>
+#include <protocol.h>
+#include <util.h>
+#include <utilstrencodings.h>
+#include <validation.h>
+
+#include <functional>
+
+CMasternodeMessageQueue mnmessagequeue;
+
+bool CMasternodeMessageQueue::IsQueuedCommand(const std::string& strCommand)
+{
+    static const std::set<std::string> setCommands = {
+        NetMsgType::MASTERNODEPAYMENTVOTEPRIMARY,
+        NetMsgType::MASTERNODEPAYMENTVOTESECONDARY,
+        NetMsgType::MASTERNODEPAYMENTSYNC,
+        NetMsgType::MNANNOUNCE,
+        NetMsgType::MNPING,
+        NetMsgType::DSEG,
+        NetMsgType::SYNCSTATUSCOUNT,
+        NetMsgType::MNGOVERNANCESYNC,
+        NetMsgType::MNGOVERNANCEOBJECT,
+        NetMsgType::MNGOVERNANCEOBJECTVOTE,
+        NetMsgType::MNVERIFY,
+        NetMsgType::MNLISTDIGEST,
+        NetMsgType::MNLISTBATCH,
+    };
+    return setCommands.count(strCommand) != 0;
+}
+
+void CMasternodeMessageQueue::Parse(entry_t& entry)
+{
+    // work on a copy, ProcessMessage reads the original later
+    CDataStream vRecv(entry.vRecv);
+
+    if (entry.strCommand == NetMsgType::MNANNOUNCE) {
+        CMasternodeBroadcast mnb;
+        vRecv >> mnb;
+        entry.vKeys.emplace_back(mnb.GetSignatureHash(), mnb.vchSig);
+        if (mnb.lastPing) {
+            entry.vKeys.emplace_back(mnb.lastPing.GetSignatureHash(), mnb.lastPing.vchSig);
+        }
+    } else if (entry.strCommand == NetMsgType::MNLISTBATCH) {
+        CMasternodeListBatch batch;
+        vRecv >> batch;
+        for (const auto& mnb : batch.vecMnb) {
+            entry.vKeys.emplace_back(mnb.GetSignatureHash(), mnb.vchSig);
+            if (mnb.lastPing) {
+                entry.vKeys.emplace_back(mnb.lastPing.GetSignatureHash(), mnb.lastPing.vchSig);
+            }
+        }
+    } else if (entry.strCommand == NetMsgType::MNPING) {
+        CMasternodePing mnp;
+        vRecv >> mnp;
+        entry.hashDedup = mnp.GetHash();
+        entry.vKeys.emplace_back(mnp.GetSignatureHash(), mnp.vchSig);
+    } else if (entry.strCommand == NetMsgType::MASTERNODEPAYMENTVOTEPRIMARY || entry.strCommand == NetMsgType::MASTERNODEPAYMENTVOTESECONDARY) {
+        CMasternodePaymentVote vote;
+        vRecv >> vote;
+        entry.hashDedup = vote.GetHash();
+        entry.vKeys.emplace_back(vote.GetSignatureHash(), vote.vchSig);
+    } else if (entry.strCommand == NetMsgType::MNGOVERNANCEOBJECTVOTE) {
+        CGovernanceVote vote;
+        vRecv >> vote;
+        entry.hashDedup = vote.GetHash();
+        entry.vKeys.emplace_back(vote.GetSignatureHash(), vote.GetSignature());
+    } else if (entry.strCommand == NetMsgType::MNVERIFY) {
+        CMasternodeVerification mnv;
+        vRecv >> mnv;
+        uint256 blockHash;
+        if (!mnv.vchSig1.empty() && GetBlockHash(blockHash, mnv.nBlockHeight)) {
+            entry.vKeys.emplace_back(mnv.GetSignatureHash1(blockHash), mnv.vchSig1);
+            if (!mnv.vchSig2.empty()) {
+                entry.vKeys.emplace_back(mnv.GetSignatureHash2(blockHash), mnv.vchSig2);
+            }
+        }
+    }
+}
+
+void CMasternodeMessageQueue::ThreadVerify()
+{
+    while (true) {
+        entry_ptr entry;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condWorker.wait(lock, [this] { return fInterrupt || !dequeVerify.empty(); });
+            if (fInterrupt) return;
+            entry = dequeVerify.front();
+            dequeVerify.pop_front();
+        }
+
+        for (auto& key : entry->vKeys) {
+            key.Recover();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            entry->fVerified = true;
+        }
+        pconnman->WakeMessageHandler();
+    }
+}
+
+void CMasternodeMessageQueue::Apply(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, CConnman& connman)
+{
+    try {
+        mnodeman.ProcessMessage(pfrom, strCommand, vRecv, connman);
+        mnpayments.ProcessMessage(pfrom, strCommand, vRecv, connman);
+        masternodeSync.ProcessMessage(pfrom, strCommand, vRecv);
+        governance.ProcessMessage(pfrom, strCommand, vRecv, connman);
+    } catch (const std::exception& e) {
+        LogPrintG(BCLogLevel::LOG_ERROR, BCLog::MN, "[Masternodes] CMasternodeMessageQueue::Apply -- Exception '%s' caught processing %s from peer=%d\n",
+                    e.what(), SanitizeString(strCommand), pfrom->GetId());
+    }
+}
+
+void CMasternodeMessageQueue::Start(int nThreads, CConnman& connman)
+{
+    if (nThreads <= 0) return;
+
+    pconnman = &connman;
+    fInterrupt = false;
+    for (int i = 0; i < nThreads; i++) {
+        vThreads.emplace_back(&TraceThread<std::function<void()> >, "mnsig", std::function<void()>(std::bind(&CMasternodeMessageQueue::ThreadVerify, this)));
+    }
+    fRunning = true;
+}
+
+void CMasternodeMessageQueue::Interrupt()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        fInterrupt = true;
+    }
+    condWorker.notify_all();
+}
+
+void CMasternodeMessageQueue::Stop()
+{
+    // the message handler thread may still be running, from now on it processes messages itself
+    fRunning = false;
+    Interrupt();
+    for (auto& thread : vThreads) {
+        if (thread.joinable()) thread.join();
+    }
+    vThreads.clear();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& entry : dequeApply) {
+        entry->pnode->Release();
+    }
+    dequeApply.clear();
+    dequeVerify.clear();
+    setInFlight.clear();
+    mapPeerBytes.clear();
+}
+
+bool CMasternodeMessageQueue::HasRoom(const CNode* pfrom)
+{
+    if (!IsRunning()) return true;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (dequeApply.size() >= MAX_QUEUED_APPLY) return false;
+    auto it = mapPeerBytes.find(pfrom->GetId());
+    return it == mapPeerBytes.end() || it->second < MAX_QUEUED_BYTES_PER_PEER;
+}
+
+bool CMasternodeMessageQueue::Push(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv)
+{
+    if (!IsRunning()) return false;
+
+    entry_ptr entry = std::make_shared<entry_t>(pfrom, strCommand, vRecv);
+    try {
+        Parse(*entry);
+    } catch (const std::exception&) {
+        // leave the error to ProcessMessage
+        entry->vKeys.clear();
+        entry->hashDedup.SetNull();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (fInterrupt) return false;
+        if (!entry->hashDedup.IsNull() && !setInFlight.insert(entry->hashDedup).second) {
+            pfrom->setAskFor.erase(entry->hashDedup);
+            LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::MN, "[Masternodes] CMasternodeMessageQueue::Push -- %s %s already queued, peer=%d\n",
+                        strCommand, entry->hashDedup.ToString(), pfrom->GetId());
+            return true;
+        }
+        if (dequeVerify.size() >= MAX_QUEUED_VERIFY) {
+            // workers are behind, ProcessMessage verifies this one on its own
+            entry->vKeys.clear();
+        }
+        entry->fVerified = entry->vKeys.empty();
+        pfrom->AddRef();
+        mapPeerBytes[pfrom->GetId()] += entry->nSize;
+        dequeApply.push_back(entry);
+        if (!entry->fVerified) {
+            dequeVerify.push_back(entry);
+        }
+    }
+    if (!entry->fVerified) {
+        condWorker.notify_one();
+    }
+    return true;
+}
+
+void CMasternodeMessageQueue::ApplyVerified(CConnman& connman)
+{
+    int nApplied = 0;
+    for (; nApplied < MAX_APPLY_PER_CALL; nApplied++) {
+        entry_ptr entry;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (dequeApply.empty() || !dequeApply.front()->fVerified) break;
+            entry = dequeApply.front();
+            dequeApply.pop_front();
+        }
+
+        if (!entry->pnode->fDisconnect) {
+            CRecoveredKeyScope scope(entry->vKeys);
+            Apply(entry->pnode, entry->strCommand, entry->vRecv, connman);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!entry->hashDedup.IsNull()) {
+                setInFlight.erase(entry->hashDedup);
+            }
+            auto it = mapPeerBytes.find(entry->pnode->GetId());
+            it->second -= entry->nSize;
+            if (it->second == 0) {
+                mapPeerBytes.erase(it);
+            }
+        }
+        entry->pnode->Release();
+    }
+
+    // more may be ready and held back messages may fit now, come back after the other peers had their turn
+    if (nApplied > 0) {
+        connman.WakeMessageHandler();
+    }
+}
+
+size_t CMasternodeMessageQueue::size()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return dequeApply.size();
+}
@@ -0,0 +1,116 @@
+// Copyright (c) 2014-2018 The Machinecoin Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MESSAGEQUEUE_H
+#define MESSAGEQUEUE_H
+
+#include <masternodes/messagesigner.h>
+#include <net.h>
+#include <streams.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+class CMasternodeMessageQueue;
+extern CMasternodeMessageQueue mnmessagequeue;
+
+static const int DEFAULT_MASTERNODE_SIG_THREADS = 2;
+static const int MAX_MASTERNODE_SIG_THREADS = 16;
+
+/** Masternode and governance messages waiting for their signatures to be checked.
+ *
+ *  The message handler thread parses each message, drops pings and votes that
+ *  are already on their way and queues the rest. Worker threads recover the
+ *  public keys of the signatures, which is the expensive part of
+ *  CHashSigner::VerifyHash. The message handler thread then hands the messages
+ *  to the usual ProcessMessage functions in the order they arrived, with the
+ *  recovered keys in scope.
+ *
+ *  The queue is bounded, in total and per peer. While it is full, the message
+ *  handler leaves masternode messages in the peer's receive queue and goes on
+ *  with the peer's other messages, the usual receive buffer limits hold the peer
+ *  back. Applying messages wakes the message handler to come back for them.
+ */
+class CMasternodeMessageQueue
+{
+private:
+    struct entry_t {
+        CNode* pnode;
+        std::string strCommand;
+        CDataStream vRecv;
+        /// Hash of a ping or vote, null for messages that are never dropped as duplicates
+        uint256 hashDedup;
+        std::vector<CRecoveredKey> vKeys;
+        bool fVerified;
+        /// Size of the message with its header, ProcessMessage consumes vRecv
+        size_t nSize;
+
+        entry_t(CNode* pnodeIn, const std::string& strCommandIn, const CDataStream& vRecvIn) :
+            pnode(pnodeIn), strCommand(strCommandIn), vRecv(vRecvIn), hashDedup(), vKeys(), fVerified(false), nSize(vRecvIn.size() + CMessageHeader::HEADER_SIZE) {}
+    };
+    typedef std::shared_ptr<entry_t> entry_ptr;
+
+    std::mutex mutex;
+    std::condition_variable condWorker;
+    /// All queued messages in the order they arrived
+    std::deque<entry_ptr> dequeApply;
+    /// Messages waiting for a worker
+    std::deque<entry_ptr> dequeVerify;
+    /// Pings and votes that are queued
+    std::set<uint256> setInFlight;
+    /// Bytes queued per peer
+    std::map<NodeId, size_t> mapPeerBytes;
+    std::vector<std::thread> vThreads;
+    std::atomic<bool> fRunning;
+    bool fInterrupt;
+    CConnman* pconnman;
+
+    /// Parse the message and fill the signatures to recover
+    void Parse(entry_t& entry);
+    void ThreadVerify();
+
+protected:
+    /// Don't apply more than this many messages per call so other messages keep flowing
+    static const int MAX_APPLY_PER_CALL = 100;
+    /// Past this many messages waiting for a worker, signatures are checked by ProcessMessage again
+    static const size_t MAX_QUEUED_VERIFY = 10000;
+    /// Past this many queued messages, new masternode messages wait in the receive queues
+    static const size_t MAX_QUEUED_APPLY = 20000;
+    /// Past this many queued bytes from one peer, its masternode messages wait in its receive queue
+    static const size_t MAX_QUEUED_BYTES_PER_PEER = DEFAULT_MAXRECEIVEBUFFER * 1000;
+
+    /// Hand a message to the masternode, payment, sync and governance managers
+    virtual void Apply(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, CConnman& connman);
+
+public:
+    CMasternodeMessageQueue() : fRunning(false), fInterrupt(false), pconnman(nullptr) {}
+    virtual ~CMasternodeMessageQueue() {}
+
+    /// Masternode, payment and governance messages are the ones which go through the queue
+    static bool IsQueuedCommand(const std::string& strCommand);
+
+    void Start(int nThreads, CConnman& connman);
+    void Interrupt();
+    /// Join the workers and drop queued messages, must happen before the nodes go away
+    void Stop();
+    bool IsRunning() const { return fRunning; }
+
+    /// False if masternode messages from this peer have to wait in its receive queue until the queue has room
+    bool HasRoom(const CNode* pfrom);
+    /// Queue a message, returns false if the queue isn't running and the caller should process it itself
+    bool Push(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv);
+    /// Process verified messages from the front of the queue, on the message handler thread
+    void ApplyVerified(CConnman& connman);
+
+    size_t size();
+};
+
+#endif
@@ -3,12 +3,45 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <base58.h>
+#include <crypto/sha256.h>
 #include <hash.h>
+#include <script/sigcache.h>
 #include <validation.h> // For strMessageMagic
 #include <masternodes/messagesigner.h>
 #include <tinyformat.h>
+#include <util.h>
 #include <utilstrencodings.h>
 
+#include <atomic>
+
+namespace {
+/** Entries are SHA256(nonce || hash || key id || signature) */
+struct MessageSigEntryWriter
+{
+    static void Write(CSHA256& hasher, const uint256 &hash, const CKeyID& keyID, const std::vector<unsigned char>& vchSig)
+    {
+        hasher.Write(hash.begin(), 32).Write(keyID.begin(), keyID.size()).Write(vchSig.data(), vchSig.size());
+    }
+};
+
+/**
+ * Verified masternode message signature cache. The same ping or vote usually
+ * arrives from several peers before the mapSeen* checks see it, and
+ * CMasternode::Check verifies stored signatures again.
+ */
+static CSaltedEntryCache<MessageSigEntryWriter> messageSigCache;
+static std::atomic<uint64_t> nMessageSigCacheHits{0};
+static std::atomic<uint64_t> nMessageSigCacheMisses{0};
+} // namespace
+
+void InitMasternodeSigCache()
+{
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-maxmnsigcachesize", DEFAULT_MAX_MASTERNODE_SIG_CACHE_SIZE)), MAX_MAX_MASTERNODE_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElems = messageSigCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for masternode signature cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+}
+
 bool CMessageSigner::GetKeysFromSecret(const std::string strSecret, CKey& keyRet, CPubKey& pubkeyRet)
 {
     CGenesisSecret vchSecret;
@@ -46,11 +79,23 @@ bool CHashSigner::SignHash(const uint256& hash, const CKey key, std::vector<unsi
 
 bool CHashSigner::VerifyHash(const uint256& hash, const CPubKey pubkey, const std::vector<unsigned char>& vchSig, std::string& strErrorRet)
 {
+    uint256 entry;
+    messageSigCache.ComputeEntry(entry, hash, pubkey.GetID(), vchSig);
+    if (messageSigCache.Get(entry, false)) {
+        ++nMessageSigCacheHits;
+        return true;
+    }
+    ++nMessageSigCacheMisses;
+
     CPubKey pubkeyFromSig;
-    if (!pubkeyFromSig.RecoverCompact(hash, vchSig)) {
+    const CRecoveredKey* precovered = CRecoveredKeyScope::Find(hash, vchSig);
+    if (precovered ? !precovered->fRecovered : !pubkeyFromSig.RecoverCompact(hash, vchSig)) {
         strErrorRet = "Error recovering public key.";
         return false;
     }
+    if (precovered) {
+        pubkeyFromSig = precovered->pubkey;
+    }
 
     if (pubkeyFromSig.GetID() != pubkey.GetID()) {
         strErrorRet = strprintf("Keys don't match: pubkey=%s, pubkeyFromSig=%s, hash=%s, vchSig=%s",
@@ -59,5 +104,34 @@ bool CHashSigner::VerifyHash(const uint256& hash, const CPubKey pubkey, const st
         return false;
     }
 
+    messageSigCache.Set(entry);
     return true;
 }
+
+void CHashSigner::GetCacheStats(uint64_t& nHitsRet, uint64_t& nMissesRet)
+{
+    nHitsRet = nMessageSigCacheHits;
+    nMissesRet = nMessageSigCacheMisses;
+}
+
+static thread_local const std::vector<CRecoveredKey>* g_precovered_keys = nullptr;
+
+CRecoveredKeyScope::CRecoveredKeyScope(const std::vector<CRecoveredKey>& vKeys) :
+    pvKeysPrev(g_precovered_keys)
+{
+    g_precovered_keys = &vKeys;
+}
+
+CRecoveredKeyScope::~CRecoveredKeyScope()
+{
+    g_precovered_keys = pvKeysPrev;
+}
+
+const CRecoveredKey* CRecoveredKeyScope::Find(const uint256& hash, const std::vector<unsigned char>& vchSig)
+{
+    if (!g_precovered_keys) return nullptr;
+    for (const auto& key : *g_precovered_keys) {
+        if (key.hash == hash && key.vchSig == vchSig) return &key;
+    }
+    return nullptr;
+}
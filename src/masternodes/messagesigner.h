@@ -7,6 +7,14 @@
 
 #include <key.h>
 
+#include <stdint.h>
+#include <vector>
+
+/** Default for -maxmnsigcachesize, in MiB */
+static const unsigned int DEFAULT_MAX_MASTERNODE_SIG_CACHE_SIZE = 4;
+/** Maximum -maxmnsigcachesize allowed */
+static const int64_t MAX_MAX_MASTERNODE_SIG_CACHE_SIZE = 1024;
+
 /** Helper class for signing messages and checking their signatures
  */
 class CMessageSigner
@@ -29,6 +37,43 @@ public:
     static bool SignHash(const uint256& hash, const CKey key, std::vector<unsigned char>& vchSigRet);
     /// Verify the hash signature, returns true if succcessful
     static bool VerifyHash(const uint256& hash, const CPubKey pubkey, const std::vector<unsigned char>& vchSig, std::string& strErrorRet);
+    /// Number of VerifyHash calls answered by the verified signature cache and of those that were not
+    static void GetCacheStats(uint64_t& nHitsRet, uint64_t& nMissesRet);
+};
+
+/** Initialize the cache of signatures that passed CHashSigner::VerifyHash */
+void InitMasternodeSigCache();
+
+/** A compact signature and the public key recovered from it ahead of time
+ */
+struct CRecoveredKey
+{
+    uint256 hash;
+    std::vector<unsigned char> vchSig;
+    CPubKey pubkey;
+    bool fRecovered;
+
+    CRecoveredKey(const uint256& hashIn, const std::vector<unsigned char>& vchSigIn) :
+        hash(hashIn), vchSig(vchSigIn), pubkey(), fRecovered(false) {}
+
+    /// Run the expensive part of CHashSigner::VerifyHash
+    void Recover() { fRecovered = pubkey.RecoverCompact(hash, vchSig); }
+};
+
+/** While in scope, CHashSigner::VerifyHash on the same thread takes public keys
+ *  from the given list instead of recovering them again
+ */
+class CRecoveredKeyScope
+{
+private:
+    const std::vector<CRecoveredKey>* pvKeysPrev;
+
+public:
+    explicit CRecoveredKeyScope(const std::vector<CRecoveredKey>& vKeys);
+    ~CRecoveredKeyScope();
+
+    /// Find the recovery for this hash and signature on the current thread, nullptr if there is none
+    static const CRecoveredKey* Find(const uint256& hash, const std::vector<unsigned char>& vchSig);
 };
 
 #endif
\ No newline at end of file
@@ -9,68 +9,67 @@
 
 CNetFulfilledRequestManager netfulfilledman;
 
+uint16_t CNetFulfilledRequestManager::InternRequestType(const std::string& strRequest)
+{
+    AssertLockHeld(cs_mapFulfilledRequests);
+    auto it = mapRequestTypes.find(strRequest);
+    if (it != mapRequestTypes.end()) {
+        return it->second;
+    }
+    uint16_t nType = vecRequestTypes.size();
+    vecRequestTypes.push_back(strRequest);
+    mapRequestTypes.emplace(strRequest, nType);
+    return nType;
+}
+
+bool CNetFulfilledRequestManager::GetRequestKey(const CService& addr, const std::string& strRequest, request_key_t& keyRet)
+{
+    AssertLockHeld(cs_mapFulfilledRequests);
+    auto it = mapRequestTypes.find(strRequest);
+    // a name nobody added a request for yet
+    if (it == mapRequestTypes.end()) return false;
+    keyRet = request_key_t{CService(addr, 0), it->second};
+    return true;
+}
+
 void CNetFulfilledRequestManager::AddFulfilledRequest(const CService& addr, const std::string& strRequest)
 {
     LOCK(cs_mapFulfilledRequests);
     CService addrSquashed = CService(addr, 0);
-    mapFulfilledRequests[addrSquashed][strRequest] = GetTime() + Params().GetConsensus().nFulfilledRequestExpireTime;
+    mapFulfilledRequests.Set(request_key_t{addrSquashed, InternRequestType(strRequest)}, GetTime() + Params().GetConsensus().nFulfilledRequestExpireTime);
 }
 
 bool CNetFulfilledRequestManager::HasFulfilledRequest(const CService& addr, const std::string& strRequest)
 {
     LOCK(cs_mapFulfilledRequests);
-    CService addrSquashed = CService(addr, 0);
-    fulfilledreqmap_t::iterator it = mapFulfilledRequests.find(addrSquashed);
-
-    return  it != mapFulfilledRequests.end() &&
-            it->second.find(strRequest) != it->second.end() &&
-            it->second[strRequest] > GetTime();
+    request_key_t key;
+    return GetRequestKey(addr, strRequest, key) && mapFulfilledRequests.HasUnexpired(key, GetTime());
 }
 
 void CNetFulfilledRequestManager::RemoveFulfilledRequest(const CService& addr, const std::string& strRequest)
 {
     LOCK(cs_mapFulfilledRequests);
-    CService addrSquashed = CService(addr, 0);
-    fulfilledreqmap_t::iterator it = mapFulfilledRequests.find(addrSquashed);
-
-    if (it != mapFulfilledRequests.end()) {
-        it->second.erase(strRequest);
+    request_key_t key;
+    if (GetRequestKey(addr, strRequest, key)) {
+        mapFulfilledRequests.Erase(key);
     }
 }
 
 void CNetFulfilledRequestManager::CheckAndRemove()
 {
     LOCK(cs_mapFulfilledRequests);
-
-    int64_t now = GetTime();
-    fulfilledreqmap_t::iterator it = mapFulfilledRequests.begin();
-
-    while(it != mapFulfilledRequests.end()) {
-        fulfilledreqmapentry_t::iterator it_entry = it->second.begin();
-        while(it_entry != it->second.end()) {
-            if (now > it_entry->second) {
-                it->second.erase(it_entry++);
-            } else {
-                ++it_entry;
-            }
-        }
-        if (it->second.size() == 0) {
-            mapFulfilledRequests.erase(it++);
-        } else {
-            ++it;
-        }
-    }
+    mapFulfilledRequests.Expire(GetTime());
 }
 
 void CNetFulfilledRequestManager::Clear()
 {
     LOCK(cs_mapFulfilledRequests);
-    mapFulfilledRequests.clear();
+    mapFulfilledRequests.Clear();
 }
 
 std::string CNetFulfilledRequestManager::ToString() const
 {
     std::ostringstream info;
-    info << "Nodes with fulfilled requests: " << (int)mapFulfilledRequests.size();
+    info << "Fulfilled requests: " << (int)mapFulfilledRequests.size();
     return info.str();
 }
@@ -6,7 +6,10 @@
 #ifndef NETFULFILLEDMAN_H
 #define NETFULFILLEDMAN_H
 
+#include <hash.h>
+#include <masternodes/timerwheel.h>
 #include <netaddress.h>
+#include <random.h>
 #include <serialize.h>
 #include <sync.h>
 
@@ -21,10 +24,37 @@ private:
     typedef std::map<std::string, int64_t> fulfilledreqmapentry_t;
     typedef std::map<CService, fulfilledreqmapentry_t> fulfilledreqmap_t;
 
-    //keep track of what node has/was asked for and when
-    fulfilledreqmap_t mapFulfilledRequests;
+    // a node and the interned name of a request
+    struct request_key_t {
+        CService addr;
+        uint16_t nType;
+
+        bool operator==(const request_key_t& other) const { return nType == other.nType && addr == other.addr; }
+    };
+
+    class SaltedRequestKeyHasher
+    {
+    private:
+        const uint64_t k0, k1;
+
+    public:
+        SaltedRequestKeyHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+        size_t operator()(const request_key_t& key) const {
+            std::vector<unsigned char> vchKey = key.addr.GetKey();
+            return CSipHasher(k0, k1).Write(vchKey.data(), vchKey.size()).Write(key.nType).Finalize();
+        }
+    };
+
+    //keep track of what node has/was asked for and until when
+    CTimerWheel<request_key_t, SaltedRequestKeyHasher> mapFulfilledRequests;
+    // request names, there are only a handful of them
+    std::vector<std::string> vecRequestTypes;
+    std::map<std::string, uint16_t> mapRequestTypes;
     CCriticalSection cs_mapFulfilledRequests;
-    
+
+    uint16_t InternRequestType(const std::string& strRequest);
+    bool GetRequestKey(const CService& addr, const std::string& strRequest, request_key_t& keyRet);
     void RemoveFulfilledRequest(const CService& addr, const std::string& strRequest);
 
 public:
@@ -35,7 +65,22 @@ public:
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action) {
         LOCK(cs_mapFulfilledRequests);
-        READWRITE(mapFulfilledRequests);
+        // stored by node and request name like before
+        fulfilledreqmap_t mapStored;
+        if (!ser_action.ForRead()) {
+            mapFulfilledRequests.ForEach([&](const request_key_t& key, int64_t nExpire, bool) {
+                mapStored[key.addr][vecRequestTypes[key.nType]] = nExpire;
+            });
+        }
+        READWRITE(mapStored);
+        if (ser_action.ForRead()) {
+            mapFulfilledRequests.Clear();
+            for (const auto& addrpair : mapStored) {
+                for (const auto& requestpair : addrpair.second) {
+                    mapFulfilledRequests.Set(request_key_t{addrpair.first, InternRequestType(requestpair.first)}, requestpair.second);
+                }
+            }
+        }
     }
 
     void AddFulfilledRequest(const CService& addr, const std::string& strRequest);
@@ -0,0 +1,228 @@
+// Copyright (c) 2014-2018 The Machinecoin Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <serialize.h>
+#include <utiltime.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+/** Keys which expire at a given time, each with an optional payload.
+ *
+ *  The keys sit in a hierarchical timing wheel: LEVELS rings of SLOTS buckets,
+ *  every level SLOTS times coarser than the one below. Expire() only visits the
+ *  buckets whose time has come, so it costs what expires rather than what is
+ *  stored. A key due further out waits in a coarse bucket and moves down a level
+ *  when that bucket comes up.
+ *
+ *  Set and Erase don't touch the bucket a key was in, the stale copy is skipped
+ *  when its bucket comes up. Keys set to a time which has passed already wait in
+ *  an extra bucket for the next Expire().
+ */
+template <typename K, typename Hash, typename V = bool>
+class CTimerWheel
+{
+public:
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+    static const int LEVELS = 4;
+
+private:
+    static const uint16_t NO_SLOT = std::numeric_limits<uint16_t>::max();
+    static const uint16_t OVERDUE_SLOT = LEVELS * SLOTS;
+
+    struct entry_t {
+        int64_t nExpire;
+        uint16_t nSlot;
+        V value;
+    };
+
+    std::unordered_map<K, entry_t, Hash> mapEntries;
+    std::vector<K> vecSlots[LEVELS * SLOTS + 1];
+    // every bucket before this second was handled already
+    int64_t nTimeCurrent;
+
+    static int64_t LevelSpan(int nLevel) { return int64_t(1) << (SLOT_BITS * nLevel); }
+
+    uint16_t GetSlot(int64_t nExpire) const
+    {
+        if (nExpire < nTimeCurrent) return OVERDUE_SLOT;
+        int64_t nTime = nExpire;
+        int nLevel = 0;
+        while (nLevel < LEVELS - 1 && nTime - nTimeCurrent >= LevelSpan(nLevel + 1)) {
+            nLevel++;
+        }
+        // beyond the top level the key waits in the furthest bucket and is placed again from there
+        nTime = std::min(nTime, nTimeCurrent + LevelSpan(LEVELS) - 1);
+        return nLevel * SLOTS + ((nTime / LevelSpan(nLevel)) & (SLOTS - 1));
+    }
+
+    void Place(const K& key, entry_t& entry)
+    {
+        uint16_t nSlot = GetSlot(entry.nExpire);
+        if (entry.nSlot == nSlot) return;
+        entry.nSlot = nSlot;
+        vecSlots[nSlot].push_back(key);
+    }
+
+    template <typename Callback>
+    void ProcessSlot(uint16_t nSlot, int64_t nNow, Callback& fnExpired)
+    {
+        std::vector<K> vecKeys;
+        vecKeys.swap(vecSlots[nSlot]);
+        for (const K& key : vecKeys) {
+            auto it = mapEntries.find(key);
+            // erased or moved since
+            if (it == mapEntries.end() || it->second.nSlot != nSlot) continue;
+            it->second.nSlot = NO_SLOT;
+            if (it->second.nExpire < nNow) {
+                fnExpired(it->first, it->second.value);
+                mapEntries.erase(it);
+            } else {
+                Place(it->first, it->second);
+            }
+        }
+    }
+
+    /// Place every key again, after a jump too long to walk through second by second
+    template <typename Callback>
+    void Rebuild(int64_t nNow, Callback& fnExpired)
+    {
+        for (auto& vecKeys : vecSlots) {
+            std::vector<K>().swap(vecKeys);
+        }
+        nTimeCurrent = nNow;
+        auto it = mapEntries.begin();
+        while (it != mapEntries.end()) {
+            it->second.nSlot = NO_SLOT;
+            if (it->second.nExpire < nNow) {
+                fnExpired(it->first, it->second.value);
+                it = mapEntries.erase(it);
+            } else {
+                Place(it->first, it->second);
+                ++it;
+            }
+        }
+    }
+
+public:
+    CTimerWheel() : mapEntries(), nTimeCurrent(GetTime()) {}
+
+    /// Add a key or move it to a new expiry time, the payload is replaced
+    void Set(const K& key, int64_t nExpire, const V& value = V())
+    {
+        auto it = mapEntries.find(key);
+        if (it == mapEntries.end()) {
+            it = mapEntries.emplace(key, entry_t{nExpire, NO_SLOT, value}).first;
+        } else {
+            it->second.nExpire = nExpire;
+            it->second.value = value;
+        }
+        Place(it->first, it->second);
+    }
+
+    bool Erase(const K& key) { return mapEntries.erase(key) != 0; }
+
+    /// The key is there, expired or not
+    bool Has(const K& key) const { return mapEntries.count(key) != 0; }
+
+    /// The key is there and expires after nNow
+    bool HasUnexpired(const K& key, int64_t nNow) const
+    {
+        auto it = mapEntries.find(key);
+        return it != mapEntries.end() && it->second.nExpire > nNow;
+    }
+
+    bool GetExpiry(const K& key, int64_t& nExpireRet) const
+    {
+        auto it = mapEntries.find(key);
+        if (it == mapEntries.end()) return false;
+        nExpireRet = it->second.nExpire;
+        return true;
+    }
+
+    /// The payload of a key, nullptr if it isn't there
+    V* Find(const K& key)
+    {
+        auto it = mapEntries.find(key);
+        return it == mapEntries.end() ? nullptr : &it->second.value;
+    }
+
+    /// Remove every key which expires before nNow, fnExpired(key, value) is called for each
+    template <typename Callback>
+    void Expire(int64_t nNow, Callback fnExpired)
+    {
+        ProcessSlot(OVERDUE_SLOT, nNow, fnExpired);
+        if (nNow - nTimeCurrent > LevelSpan(2)) {
+            Rebuild(nNow, fnExpired);
+            return;
+        }
+        for (; nTimeCurrent < nNow; nTimeCurrent++) {
+            // move the coarser buckets which start now down first, their keys may be due this second
+            for (int nLevel = LEVELS - 1; nLevel > 0; nLevel--) {
+                if (nTimeCurrent % LevelSpan(nLevel) == 0) {
+                    ProcessSlot(nLevel * SLOTS + ((nTimeCurrent / LevelSpan(nLevel)) & (SLOTS - 1)), nNow, fnExpired);
+                }
+            }
+            ProcessSlot(nTimeCurrent & (SLOTS - 1), nNow, fnExpired);
+        }
+    }
+
+    void Expire(int64_t nNow)
+    {
+        Expire(nNow, [](const K&, V&) {});
+    }
+
+    /// Call fn(key, nExpire, value) for every key, in no particular order
+    template <typename Callback>
+    void ForEach(Callback fn) const
+    {
+        for (const auto& entrypair : mapEntries) {
+            fn(entrypair.first, entrypair.second.nExpire, entrypair.second.value);
+        }
+    }
+
+    size_t size() const { return mapEntries.size(); }
+    bool empty() const { return mapEntries.empty(); }
+
+    void Clear()
+    {
+        mapEntries.clear();
+        for (auto& vecKeys : vecSlots) {
+            std::vector<K>().swap(vecKeys);
+        }
+        nTimeCurrent = GetTime();
+    }
+
+    /// Same format as std::map<K, int64_t>, payloads are not stored
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        WriteCompactSize(s, mapEntries.size());
+        for (const auto& entrypair : mapEntries) {
+            s << entrypair.first << entrypair.second.nExpire;
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        Clear();
+        uint64_t nSize = ReadCompactSize(s);
+        for (uint64_t i = 0; i < nSize; i++) {
+            K key;
+            int64_t nExpire;
+            s >> key >> nExpire;
+            Set(key, nExpire);
+        }
+    }
+};
+
+#endif
@@ -38,7 +38,7 @@
 #include <boost/thread.hpp>
 #include <blake2.h>
 #include <crypto/equihash/equihash.h>
-#include <pow/tromp/equi_miner.h>
+#include <pow/tromp/solver.h>
 #include <functional>
 #include <mutex>
 
@@ -715,6 +715,17 @@ void static GenesisMiner(CWallet *pwallet)
     assert(solver == "tromp" || solver == "default");
     LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::POW, "[ProofOfWork] Using Equihash solver \"%s\" with n = %u, k = %u\n", solver, n, k);
 
+    // The tromp solver allocates its bucket heaps once per miner thread and
+    // reuses them for every nonce.
+    std::unique_ptr<CTrompSolver> tromp;
+    if (solver == "tromp")
+    {
+        int nSolverThreads = gArgs.GetArg("-equihashsolverthreads", DEFAULT_EQUIHASH_SOLVER_THREADS);
+        nSolverThreads = std::max(1, std::min(nSolverThreads, MAX_EQUIHASH_SOLVER_THREADS));
+        tromp.reset(new CTrompSolver(nSolverThreads));
+        LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::POW, "[ProofOfWork] Using %d thread(s) per Equihash solve\n", nSolverThreads);
+    }
+
     std::mutex m_cs;
     bool cancelSolver = false;
     // boost::signals2::connection c = uiInterface.NotifyBlockTip.connect(
@@ -815,14 +826,7 @@ void static GenesisMiner(CWallet *pwallet)
             {
                 // Hash state
                 blake2b_state state;
-                if (Params().IsAfterSwitch(pblock->nHeight))
-                {
-                    EhInitialiseState(n, k, state, "GENX_PoW");
-                }
-                else
-                {
-                    EhInitialiseState(n, k, state, "SafeCash");
-                }
+                EhInitialiseState(n, k, state, GetEquihashPersonalization(pblock->nHeight, Params()));
 
                 // I = the block header minus nonce and solution.
                 CEquihashInput I{*pblock};
@@ -885,41 +889,8 @@ void static GenesisMiner(CWallet *pwallet)
                 // TODO: factor this out into a function with the same API for each solver.
                 if (solver == "tromp") 
                 {
-                    // Create solver and initialize it.
-                    equi eq(1);
-                    eq.setstate(&curr_state);
-
-                    // Initialization done, start algo driver.
-                    eq.digit0(0);
-                    eq.xfull = eq.bfull = eq.hfull = 0;
-                    eq.showbsizes(0);
-                    for (u32 r = 1; r < WK; r++) 
-                    {
-                        (r&1) ? eq.digitodd(r, 0) : eq.digiteven(r, 0);
-                        eq.xfull = eq.bfull = eq.hfull = 0;
-                        eq.showbsizes(r);
-                    }
-                    eq.digitK(0);
+                    tromp->Solve(curr_state, validBlock);
                     //ehSolverRuns.increment();
-
-                    // Convert solution indices to byte array (decompress) and pass it to validBlock method.
-                    for (size_t s = 0; s < eq.nsols; s++) 
-                    {
-                        //LogPrint("pow", "Checking solution %d\n", s+1);
-                        std::vector<eh_index> index_vector(PROOFSIZE);
-                        for (size_t i = 0; i < PROOFSIZE; i++) 
-                        {
-                            index_vector[i] = eq.sols[s][i];
-                        }
-                        std::vector<unsigned char> sol_char = GetMinimalFromIndices(index_vector, DIGITBITS);
-
-                        if (validBlock(sol_char)) 
-                        {
-                            // If we find a POW solution, do not try other solutions
-                            // because they become invalid as we created a new block in blockchain.
-                            break;
-                        }
-                    }
                 } 
                 else 
                 {
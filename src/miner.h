@@ -24,6 +24,10 @@ class CWallet;
 namespace Consensus { struct Params; };
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Default number of threads that share one tromp Equihash solve */
+static const int DEFAULT_EQUIHASH_SOLVER_THREADS = 1;
+/** Upper bound on -equihashsolverthreads */
+static const int MAX_EQUIHASH_SOLVER_THREADS = 64;
 
 struct CBlockTemplate
 {
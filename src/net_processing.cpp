@@ -37,6 +37,7 @@
 #include <masternodes/masternode-payments.h>
 #include <masternodes/masternode-sync.h>
 #include <masternodes/masternodeman.h>
+#include <masternodes/messagequeue.h>
 
 #include <boost/thread.hpp>
 
@@ -830,6 +831,10 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, CScheduler &schedu
 }
 
 void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const std::vector<CTransactionRef>& vtxConflicted) {
+    if (!fLiteMode) {
+        mnodeman.BlockConnected(*pblock, pindex);
+    }
+
     LOCK(g_cs_orphans);
 
     std::vector<uint256> vOrphanErase;
@@ -861,6 +866,12 @@ void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pb
     g_last_tip_update = GetTime();
 }
 
+void PeerLogicValidation::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) {
+    if (!fLiteMode) {
+        mnodeman.BlockDisconnected(*pblock);
+    }
+}
+
 // All of the following cache a recent block, and are protected by cs_most_recent_block
 static CCriticalSection cs_most_recent_block;
 static std::shared_ptr<const CBlock> most_recent_block;
@@ -1046,12 +1057,12 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     */
 
     case MSG_MASTERNODE_PAYMENT_VOTE_PRIMARY:
-        return mnpayments.mapMasternodePaymentVotesPrimary.count(inv.hash);
+        return mnpayments.HasPaymentVote(inv.hash);
 
     case MSG_MASTERNODE_PAYMENT_BLOCK_PRIMARY:
         {
             BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
-            return mi != mapBlockIndex.end() && mnpayments.mapMasternodeBlocksPrimary.find(mi->second->nHeight) != mnpayments.mapMasternodeBlocksPrimary.end();
+            return mi != mapBlockIndex.end() && mnpayments.HasBlockPayees(mi->second->nHeight);
         }
 
     case MSG_MASTERNODE_ANNOUNCE:
@@ -1297,30 +1308,27 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
             }
             
             if (!push && inv.type == MSG_MASTERNODE_PAYMENT_VOTE_PRIMARY) {
-                if (mnpayments.HasVerifiedPaymentVote(inv.hash)) {
-                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MASTERNODEPAYMENTVOTEPRIMARY, mnpayments.mapMasternodePaymentVotesPrimary[inv.hash]));
+                CMasternodePaymentVote vote;
+                if (mnpayments.GetVerifiedPaymentVote(inv.hash, vote)) {
+                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MASTERNODEPAYMENTVOTEPRIMARY, vote));
                     push = true;
                 }
             }
 
             if (!push && inv.type == MSG_MASTERNODE_PAYMENT_VOTE_SECONDARY) {
-                if (mnpayments.HasVerifiedPaymentVote(inv.hash)) {
-                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MASTERNODEPAYMENTVOTESECONDARY, mnpayments.mapMasternodePaymentVotesPrimary[inv.hash]));
+                CMasternodePaymentVote vote;
+                if (mnpayments.GetVerifiedPaymentVote(inv.hash, vote)) {
+                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MASTERNODEPAYMENTVOTESECONDARY, vote));
                     push = true;
                 }
             }
 
             if (!push && inv.type == MSG_MASTERNODE_PAYMENT_BLOCK_PRIMARY) {
                 BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
-                LOCK(cs_mapMasternodeBlocks);
-                if (mi != mapBlockIndex.end() && mnpayments.mapMasternodeBlocksPrimary.count(mi->second->nHeight)) {
-                    for (CMasternodePayee& payee : mnpayments.mapMasternodeBlocksPrimary[mi->second->nHeight].vecPayees) {
-                        std::vector<uint256> vecVoteHashes = payee.GetVoteHashes();
-                        for (uint256& hash : vecVoteHashes) {
-                            if (mnpayments.HasVerifiedPaymentVote(hash)) {
-                                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MASTERNODEPAYMENTVOTEPRIMARY, mnpayments.mapMasternodePaymentVotesPrimary[hash]));
-                            }
-                        }
+                std::vector<CMasternodePaymentVote> vecVotes;
+                if (mi != mapBlockIndex.end() && mnpayments.GetBlockPaymentVotes(mi->second->nHeight, vecVotes)) {
+                    for (const auto& vote : vecVotes) {
+                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MASTERNODEPAYMENTVOTEPRIMARY, vote));
                     }
                     push = true;
                 }
@@ -1328,15 +1336,10 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
 
             if (!push && inv.type == MSG_MASTERNODE_PAYMENT_BLOCK_SECONDARY) {
                 BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
-                LOCK(cs_mapMasternodeBlocks);
-                if (mi != mapBlockIndex.end() && mnpayments.mapMasternodeBlocksPrimary.count(mi->second->nHeight)) {
-                    for (CMasternodePayee& payee : mnpayments.mapMasternodeBlocksPrimary[mi->second->nHeight].vecPayees) {
-                        std::vector<uint256> vecVoteHashes = payee.GetVoteHashes();
-                        for (uint256& hash : vecVoteHashes) {
-                            if (mnpayments.HasVerifiedPaymentVote(hash)) {
-                                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MASTERNODEPAYMENTVOTESECONDARY, mnpayments.mapMasternodePaymentVotesPrimary[hash]));
-                            }
-                        }
+                std::vector<CMasternodePaymentVote> vecVotes;
+                if (mi != mapBlockIndex.end() && mnpayments.GetBlockPaymentVotes(mi->second->nHeight, vecVotes)) {
+                    for (const auto& vote : vecVotes) {
+                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MASTERNODEPAYMENTVOTESECONDARY, vote));
                     }
                     push = true;
                 }
@@ -3040,10 +3043,13 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
 
         if (found)
         {
-            mnodeman.ProcessMessage(pfrom, strCommand, vRecv, *connman);
-            mnpayments.ProcessMessage(pfrom, strCommand, vRecv, *connman);
-            masternodeSync.ProcessMessage(pfrom, strCommand, vRecv);
-            governance.ProcessMessage(pfrom, strCommand, vRecv, *connman);
+            // signatures are checked on the worker threads when the queue is running
+            if (!mnmessagequeue.Push(pfrom, strCommand, vRecv)) {
+                mnodeman.ProcessMessage(pfrom, strCommand, vRecv, *connman);
+                mnpayments.ProcessMessage(pfrom, strCommand, vRecv, *connman);
+                masternodeSync.ProcessMessage(pfrom, strCommand, vRecv);
+                governance.ProcessMessage(pfrom, strCommand, vRecv, *connman);
+            }
         }
         else
         {
@@ -3100,6 +3106,9 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     //
     bool fMoreWork = false;
 
+    // masternode messages whose signatures were checked by the worker threads
+    mnmessagequeue.ApplyVerified(*connman);
+
     if (!pfrom->vRecvGetData.empty())
         ProcessGetData(pfrom, chainparams.GetConsensus(), connman, interruptMsgProc);
 
@@ -3116,13 +3125,20 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     std::list<CNetMessage> msgs;
     {
         LOCK(pfrom->cs_vProcessMsg);
-        if (pfrom->vProcessMsg.empty())
+        // Masternode messages wait here while the signature queue is full, the peer's other messages go on
+        auto itMsg = pfrom->vProcessMsg.begin();
+        if (!mnmessagequeue.HasRoom(pfrom)) {
+            while (itMsg != pfrom->vProcessMsg.end() && CMasternodeMessageQueue::IsQueuedCommand(itMsg->hdr.GetCommand()))
+                ++itMsg;
+        }
+        if (itMsg == pfrom->vProcessMsg.end())
             return false;
+        // Held back messages don't count as more work, ApplyVerified wakes us up when there is room
+        fMoreWork = std::next(itMsg) != pfrom->vProcessMsg.end();
         // Just take one message
-        msgs.splice(msgs.begin(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
+        msgs.splice(msgs.begin(), pfrom->vProcessMsg, itMsg);
         pfrom->nProcessQueueSize -= msgs.front().vRecv.size() + CMessageHeader::HEADER_SIZE;
         pfrom->fPauseRecv = pfrom->nProcessQueueSize > connman->GetReceiveFloodSize();
-        fMoreWork = !pfrom->vProcessMsg.empty();
     }
     CNetMessage& msg(msgs.front());
 
@@ -9,12 +9,18 @@
 #include <chain.h>
 #include <chainparams.h>
 #include <crypto/equihash/equihash.h>
+#include <crypto/sha256.h>
 #include <primitives/block.h>
+#include <script/sigcache.h>
 #include <streams.h>
 #include <uint256.h>
 #include <util.h>
 #include <blake2.h>
 
+#include <atomic>
+#include <cstring>
+
+
 // LWMA for BTC clones
 // Copyright (c) 2017-2018 The Bitcoin Gold developers
 // Copyright (c) 2018 Zawy (M.I.T license continued)
@@ -53,6 +59,46 @@ unsigned int LwmaGetNextWorkRequired(const CBlockIndex* pindexLast, const CBlock
     return LwmaCalculateNextWorkRequired(pindexLast, params);
 }
 
+/** Solvetime of block, clamped to +-6T as the LWMA window uses it. */
+static int64_t LwmaSolvetime(const CBlockIndex* block, const CBlockIndex* block_Prev, const Consensus::Params& params)
+{
+    const int64_t T = params.nPowTargetSpacing;
+    const int64_t solvetime = block->GetBlockTime() - block_Prev->GetBlockTime();
+    return std::max(-6*T, std::min(solvetime, 6*T));
+}
+
+/** Target of block, pre-divided by k*N as the LWMA window sums it. */
+static arith_uint256 LwmaScaledTarget(const CBlockIndex* block, const Consensus::Params& params)
+{
+    const int64_t T = params.nPowTargetSpacing;
+    const int64_t N = params.nZawyLwmaAveragingWindow;
+    const int64_t k = N*(N+1)*T/2;
+    arith_uint256 target;
+    target.SetCompact(block->nBits);
+    return target / (k * N); // BTG added the missing N back here.
+}
+
+void LwmaUpdateAccumulators(CBlockIndex* pindex, const Consensus::Params& params)
+{
+    pindex->fHaveLwmaSums = false;
+    if (!pindex->pprev) {
+        if (pindex->nHeight != 0)
+            return;
+        pindex->nLwmaSolvetimeSum = 0;
+        pindex->nLwmaWeightedSolvetimeSum = 0;
+        pindex->nLwmaTargetSum = LwmaScaledTarget(pindex, params);
+    } else {
+        const CBlockIndex* pprev = pindex->pprev;
+        if (!pprev->fHaveLwmaSums)
+            return;
+        const uint64_t solvetime = LwmaSolvetime(pindex, pprev, params);
+        pindex->nLwmaSolvetimeSum = pprev->nLwmaSolvetimeSum + solvetime;
+        pindex->nLwmaWeightedSolvetimeSum = pprev->nLwmaWeightedSolvetimeSum + (uint64_t)pindex->nHeight * solvetime;
+        pindex->nLwmaTargetSum = pprev->nLwmaTargetSum + LwmaScaledTarget(pindex, params);
+    }
+    pindex->fHaveLwmaSums = true;
+}
+
 unsigned int LwmaCalculateNextWorkRequired(const CBlockIndex* pindexLast, const Consensus::Params& params)
 {   
     const int64_t T = params.nPowTargetSpacing;
@@ -63,19 +109,25 @@ unsigned int LwmaCalculateNextWorkRequired(const CBlockIndex* pindexLast, const
     assert(height > N);
 
     arith_uint256 sum_target;
-    int64_t t = 0, j = 0, solvetime;
-
-    // Loop through N most recent blocks. 
-    for (int i = height - N+1; i <= height; i++) {
-        const CBlockIndex* block = pindexLast->GetAncestor(i);
-        const CBlockIndex* block_Prev = block->GetAncestor(i - 1);
-        solvetime = block->GetBlockTime() - block_Prev->GetBlockTime();
-        solvetime = std::max(-6*T, std::min(solvetime, 6*T));
-        j++;
-        t += solvetime * j;  // Weighted solvetime sum.
-        arith_uint256 target;
-        target.SetCompact(block->nBits);
-        sum_target += target / (k * N); // BTG added the missing N back here.
+    int64_t t = 0, j = 0;
+
+    if (pindexLast->fHaveLwmaSums) {
+        // Block i has weight i - (height - N) in the window, so the weighted
+        // solvetime sum follows from the prefix sums at both ends of it.
+        const CBlockIndex* pindexFirst = pindexLast->GetAncestor(height - N);
+        const uint64_t sum = pindexLast->nLwmaSolvetimeSum - pindexFirst->nLwmaSolvetimeSum;
+        const uint64_t weighted = pindexLast->nLwmaWeightedSolvetimeSum - pindexFirst->nLwmaWeightedSolvetimeSum;
+        t = (int64_t)(weighted - (uint64_t)(height - N) * sum);
+        sum_target = pindexLast->nLwmaTargetSum - pindexFirst->nLwmaTargetSum;
+    } else {
+        // Loop through N most recent blocks. 
+        for (int i = height - N+1; i <= height; i++) {
+            const CBlockIndex* block = pindexLast->GetAncestor(i);
+            const CBlockIndex* block_Prev = block->GetAncestor(i - 1);
+            j++;
+            t += LwmaSolvetime(block, block_Prev, params) * j;  // Weighted solvetime sum.
+            sum_target += LwmaScaledTarget(block, params);
+        }
     }
     // Keep t reasonable to >= 1/10 of expected t.
     if (t < k/10 ) 
@@ -116,6 +168,84 @@ bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& param
     return true;
 }
 
+namespace {
+/** Entries are SHA256(nonce || block hash || personalization) */
+struct EquihashEntryWriter
+{
+    static void Write(CSHA256& hasher, const uint256 &hash, const char* personalization)
+    {
+        hasher.Write(hash.begin(), 32).Write((const unsigned char*)personalization, strlen(personalization));
+    }
+};
+
+/**
+ * Verified Equihash solution cache, to avoid running the (expensive) Equihash
+ * verification again for a header that already passed CheckBlockHeader, e.g.
+ * once in AcceptBlockHeader and again in CheckBlock/AcceptBlock/TestBlockValidity.
+ */
+typedef CSaltedEntryCache<EquihashEntryWriter> CEquihashCache;
+
+static CEquihashCache equihashCache;
+
+/**
+ * nHeight is not part of the serialized header, so CheckBlockHeader cannot tell
+ * which personalization a header was mined with. Headers arrive in chain order,
+ * so try the personalization that verified last time first; the other one is
+ * only needed around the switch height.
+ */
+static std::atomic<bool> fLastEquihashWasLegacy(false);
+} // namespace
+
+void InitEquihashCache()
+{
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-maxequihashcachesize", DEFAULT_MAX_EQUIHASH_CACHE_SIZE)), MAX_MAX_EQUIHASH_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElems = equihashCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for Equihash solution cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+}
+
+const char* GetEquihashPersonalization(int nHeight, const CChainParams& params)
+{
+    return params.IsAfterSwitch(nHeight) ? EQUIHASH_PERSONALIZATION_GENX : EQUIHASH_PERSONALIZATION_LEGACY;
+}
+
+bool CheckBlockEquihashSolution(const CBlockHeader *pblock, const uint256& hash, const CChainParams& params)
+{
+    const bool fLegacyFirst = fLastEquihashWasLegacy.load(std::memory_order_relaxed);
+    const char* vPersonalization[2] = {
+        fLegacyFirst ? EQUIHASH_PERSONALIZATION_LEGACY : EQUIHASH_PERSONALIZATION_GENX,
+        fLegacyFirst ? EQUIHASH_PERSONALIZATION_GENX : EQUIHASH_PERSONALIZATION_LEGACY
+    };
+
+    uint256 vEntry[2];
+    for (int i = 0; i < 2; i++) {
+        equihashCache.ComputeEntry(vEntry[i], hash, vPersonalization[i]);
+        if (equihashCache.Get(vEntry[i], false))
+            return true;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (CheckEquihashSolution(pblock, params, vPersonalization[i])) {
+            equihashCache.Set(vEntry[i]);
+            if (i != 0)
+                fLastEquihashWasLegacy.store(!fLegacyFirst, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool IsEquihashSolutionCached(const uint256& hash)
+{
+    for (const char* personalization : {EQUIHASH_PERSONALIZATION_GENX, EQUIHASH_PERSONALIZATION_LEGACY}) {
+        uint256 entry;
+        equihashCache.ComputeEntry(entry, hash, personalization);
+        if (equihashCache.Get(entry, false))
+            return true;
+    }
+    return false;
+}
+
 bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params& params)
 {
     bool fNegative;
@@ -10,6 +10,7 @@
 #include <consensus/params.h>
 
 #include <stdint.h>
+#include <string>
 
 class CBlockHeader;
 class CBlockIndex;
@@ -22,10 +23,42 @@ unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHead
 unsigned int LwmaGetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params&);
 unsigned int LwmaCalculateNextWorkRequired(const CBlockIndex* pindexLast, const Consensus::Params& params);
 
+/**
+ * Extend the LWMA prefix sums of pindex->pprev to pindex, so that
+ * LwmaCalculateNextWorkRequired does not have to walk the averaging window.
+ * Must be called in height order, like the nChainWork update.
+ */
+void LwmaUpdateAccumulators(CBlockIndex* pindex, const Consensus::Params& params);
+
+
+/** Default for -maxequihashcachesize, in MiB */
+static const unsigned int DEFAULT_MAX_EQUIHASH_CACHE_SIZE = 4;
+/** Maximum -maxequihashcachesize allowed */
+static const int64_t MAX_MAX_EQUIHASH_CACHE_SIZE = 1024;
+
+/** Personalization strings accepted for the Equihash solution of a block header */
+static const char* const EQUIHASH_PERSONALIZATION_GENX = "GENX_PoW";
+static const char* const EQUIHASH_PERSONALIZATION_LEGACY = "SafeCash";
+
+/** Return the personalization string miners use for a block at the given height */
+const char* GetEquihashPersonalization(int nHeight, const CChainParams&);
 
 /** Check whether the Equihash solution in a block header is valid */
 bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams&, const std::string personalizationString);
 
+/**
+ * Check the Equihash solution of a block header against every accepted
+ * personalization, consulting the verified-solution cache first. hash must be
+ * pblock->GetHash(); it commits to the whole header including the solution.
+ */
+bool CheckBlockEquihashSolution(const CBlockHeader *pblock, const uint256& hash, const CChainParams&);
+
+/** Return true if the Equihash solution of the header with this hash is in the verified-solution cache */
+bool IsEquihashSolutionCached(const uint256& hash);
+
+/** To be called once in AppInitMain/BasicTestingSetup to initialize the verified-solution cache. */
+void InitEquihashCache();
+
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
 bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params&);
 
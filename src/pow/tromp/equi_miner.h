@@ -19,6 +19,7 @@
 // twice the number of subtrees expected to land there.
 
 #include "pow/tromp/equi.h"
+#include "crypto/equihash/leafhash.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
@@ -224,6 +225,7 @@ struct equi {
     sols   =  (proof *)hta.alloc(MAXSOLS, sizeof(proof));
   }
   ~equi() {
+    pthread_barrier_destroy(&barry);
     hta.dealloctrees();
     free(nslots);
     free(sols);
@@ -237,6 +239,9 @@ struct equi {
 #ifdef EQUIHASH_TROMP_ATOMIC
     return std::atomic_fetch_add_explicit(&nslots[r&1][bucketi], 1U, std::memory_order_relaxed);
 #else
+    // Only pay for a locked add when other workers share the buckets.
+    if (nthreads > 1)
+      return __atomic_fetch_add(&nslots[r&1][bucketi], 1U, __ATOMIC_RELAXED);
     return nslots[r&1][bucketi]++;
 #endif
   }
@@ -285,7 +290,7 @@ struct equi {
 #ifdef EQUIHASH_TROMP_ATOMIC
     u32 soli = std::atomic_fetch_add_explicit(&nsols, 1U, std::memory_order_relaxed);
 #else
-    u32 soli = nsols++;
+    u32 soli = nthreads > 1 ? __atomic_fetch_add(&nsols, 1U, __ATOMIC_RELAXED) : nsols++;
 #endif
     if (soli < MAXSOLS)
       listindices1(WK, t, sols[soli]); // assume WK odd
@@ -434,41 +439,47 @@ struct equi {
   };
 
   void digit0(const u32 id) {
-    uchar hash[HASHOUT];
-    blake2b_state state;
+    static const u32 BATCH = 2 * CEhLeafHasher::MAX_LANES;
+    uchar hashes[BATCH][HASHOUT];
+    u32 blocks[BATCH];
+    const CEhLeafHasher leaves(blake_ctx, HASHOUT);
     htlayout htl(this, 0);
     const u32 hashbytes = hashsize(0);
-    for (u32 block = id; block < NBLOCKS; block += nthreads) {
-      state = blake_ctx;
-      u32 leb = htole32(block);
-      blake2b_update(&state, (uchar *)&leb, sizeof(u32));
-      blake2b_final(&state, hash, HASHOUT);
-      for (u32 i = 0; i<HASHESPERBLAKE; i++) {
-        const uchar *ph = hash + i * WN/8;
+    for (u32 first = id; first < NBLOCKS; first += BATCH * nthreads) {
+      u32 nblocks = 0;
+      for (u32 block = first; block < NBLOCKS && nblocks < BATCH; block += nthreads)
+        blocks[nblocks++] = block;
+      leaves.Hash(blocks, nblocks, hashes[0]);
+      for (u32 b = 0; b < nblocks; b++) {
+        const u32 block = blocks[b];
+        const uchar *hash = hashes[b];
+        for (u32 i = 0; i<HASHESPERBLAKE; i++) {
+          const uchar *ph = hash + i * WN/8;
 #if BUCKBITS == 16 && RESTBITS == 4
-        const u32 bucketid = ((u32)ph[0] << 8) | ph[1];
+          const u32 bucketid = ((u32)ph[0] << 8) | ph[1];
 #elif BUCKBITS == 12 && RESTBITS == 8
-        const u32 bucketid = ((u32)ph[0] << 4) | ph[1] >> 4;
+          const u32 bucketid = ((u32)ph[0] << 4) | ph[1] >> 4;
 #elif BUCKBITS == 11 && RESTBITS == 9
-        const u32 bucketid = ((u32)ph[0] << 3) | ph[1] >> 5;
+          const u32 bucketid = ((u32)ph[0] << 3) | ph[1] >> 5;
 #elif BUCKBITS == 20 && RESTBITS == 4
-        const u32 bucketid = ((((u32)ph[0] << 8) | ph[1]) << 4) | ph[2] >> 4;
+          const u32 bucketid = ((((u32)ph[0] << 8) | ph[1]) << 4) | ph[2] >> 4;
 #elif BUCKBITS == 12 && RESTBITS == 4
-        const u32 bucketid = ((u32)ph[0] << 4) | ph[1] >> 4;
-        const u32 xhash = ph[1] & 0xf;
+          const u32 bucketid = ((u32)ph[0] << 4) | ph[1] >> 4;
+          const u32 xhash = ph[1] & 0xf;
 #elif BUCKBITS == 20 && RESTBITS == 4
-        const u32 bucketid = ((((u32)ph[0] << 8) | ph[1]) << 4) | ph[2] >> 4;
+          const u32 bucketid = ((((u32)ph[0] << 8) | ph[1]) << 4) | ph[2] >> 4;
 #else
 #error not implemented
 #endif
-        const u32 slot = getslot(0, bucketid);
-        if (slot >= NSLOTS) {
-          bfull++;
-          continue;
+          const u32 slot = getslot(0, bucketid);
+          if (slot >= NSLOTS) {
+            bfull++;
+            continue;
+          }
+          slot0 &s = hta.trees0[0][bucketid][slot];
+          s.attr = tree(block * HASHESPERBLAKE + i);
+          memcpy(s.hash->bytes+htl.nextbo, ph+WN/8-hashbytes, hashbytes);
         }
-        slot0 &s = hta.trees0[0][bucketid][slot];
-        s.attr = tree(block * HASHESPERBLAKE + i);
-        memcpy(s.hash->bytes+htl.nextbo, ph+WN/8-hashbytes, hashbytes);
       }
     }
   }
@@ -626,8 +637,6 @@ void *worker(void *vp) {
   thread_ctx *tp = (thread_ctx *)vp;
   equi *eq = tp->eq;
 
-  if (tp->id == 0)
-//    printf("Digit 0\n");
   barrier(&eq->barry);
   eq->digit0(tp->id);
   barrier(&eq->barry);
@@ -637,8 +646,6 @@ void *worker(void *vp) {
   }
   barrier(&eq->barry);
   for (u32 r = 1; r < WK; r++) {
-    if (tp->id == 0)
-//      printf("Digit %d", r);
     barrier(&eq->barry);
     r&1 ? eq->digitodd(r, tp->id) : eq->digiteven(r, tp->id);
     barrier(&eq->barry);
@@ -649,8 +656,6 @@ void *worker(void *vp) {
     }
     barrier(&eq->barry);
   }
-  if (tp->id == 0)
-//    printf("Digit %d\n", WK);
   eq->digitK(tp->id);
   barrier(&eq->barry);
   pthread_exit(NULL);
@@ -0,0 +1,82 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <pow/tromp/solver.h>
+
+#include <crypto/equihash/equihash.h>
+#include <pow/tromp/equi_miner.h>
+
+#include <algorithm>
+
+CTrompSolver::CTrompSolver(unsigned int nThreads) : eq(new equi(std::max(1u, nThreads)))
+{
+}
+
+CTrompSolver::~CTrompSolver()
+{
+}
+
+size_t CTrompSolver::Solve(const blake2b_state& state, const std::function<bool(std::vector<unsigned char>)>& validBlock)
+{
+    eq->setstate(&state);
+
+    if (eq->nthreads == 1)
+    {
+        eq->digit0(0);
+        eq->xfull = eq->bfull = eq->hfull = 0;
+        eq->showbsizes(0);
+        for (u32 r = 1; r < WK; r++)
+        {
+            (r&1) ? eq->digitodd(r, 0) : eq->digiteven(r, 0);
+            eq->xfull = eq->bfull = eq->hfull = 0;
+            eq->showbsizes(r);
+        }
+        eq->digitK(0);
+    }
+    else
+    {
+        std::vector<thread_ctx> workers(eq->nthreads);
+        for (u32 t = 0; t < eq->nthreads; t++)
+        {
+            workers[t].id = t;
+            workers[t].eq = eq.get();
+            // Workers that did start would wait at the barrier forever.
+            const int err = pthread_create(&workers[t].thread, NULL, worker, (void *)&workers[t]);
+            assert(!err);
+        }
+        for (u32 t = 0; t < eq->nthreads; t++)
+        {
+            pthread_join(workers[t].thread, NULL);
+        }
+    }
+
+    // nsols keeps counting candidates past the MAXSOLS that were stored.
+    const size_t nSols = std::min<size_t>(eq->nsols, MAXSOLS);
+    size_t nPassed = 0;
+    for (size_t s = 0; s < nSols; s++)
+    {
+        std::vector<eh_index> index_vector(PROOFSIZE);
+        for (size_t i = 0; i < PROOFSIZE; i++)
+        {
+            index_vector[i] = eq->sols[s][i];
+        }
+        nPassed++;
+        if (validBlock(GetMinimalFromIndices(index_vector, DIGITBITS)))
+        {
+            // Any other solution is for a block that is now stale.
+            break;
+        }
+    }
+    return nPassed;
+}
+
+unsigned int CTrompSolver::Threads() const
+{
+    return eq->nthreads;
+}
+
+size_t CTrompSolver::DynamicMemoryUsage() const
+{
+    return eq->hta.alloced;
+}
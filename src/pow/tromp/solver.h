@@ -0,0 +1,43 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef GENESIS_POW_TROMP_SOLVER_H
+#define GENESIS_POW_TROMP_SOLVER_H
+
+#include <blake2.h>
+
+#include <functional>
+#include <memory>
+#include <stddef.h>
+#include <vector>
+
+struct equi;
+
+/**
+ * A (192,7) tromp Equihash solver that keeps its bucket heaps between solves.
+ * With more than one thread every round is split across that many workers,
+ * which meet at the solver's barrier between rounds.
+ */
+class CTrompSolver
+{
+private:
+    std::unique_ptr<equi> eq;
+
+public:
+    explicit CTrompSolver(unsigned int nThreads);
+    ~CTrompSolver();
+
+    /**
+     * Solve for the given state and pass each solution, in minimal encoding,
+     * to validBlock until it returns true. Returns the number of solutions
+     * that were passed on.
+     */
+    size_t Solve(const blake2b_state& state, const std::function<bool(std::vector<unsigned char>)>& validBlock);
+
+    unsigned int Threads() const;
+    /** Bytes allocated for the heaps, solution slots and bucket counters. */
+    size_t DynamicMemoryUsage() const;
+};
+
+#endif // GENESIS_POW_TROMP_SOLVER_H
@@ -252,6 +252,16 @@ extern const char *MNGOVERNANCESYNC;
 extern const char *MNGOVERNANCEOBJECT;
 extern const char *MNGOVERNANCEOBJECTVOTE;
 extern const char *MNVERIFY;
+/**
+ * Contains a CMasternodeListDigest of the list the sender already has.
+ * Peers with NODE_MNLIST respond with "mnlbatch" messages.
+ */
+extern const char *MNLISTDIGEST;
+/**
+ * Contains a CMasternodeListBatch, masternode list entries missing from a digest.
+ * Sent in response to a "mnldigest" message.
+ */
+extern const char *MNLISTBATCH;
 };
 
 /* Get a vector of all valid message types (see above) */
@@ -278,6 +288,9 @@ enum ServiceFlags : uint64_t {
     // NODE_XTHIN means the node supports Xtreme Thinblocks
     // If this is turned off then the node will not service nor make xthin requests
     NODE_XTHIN = (1 << 4),
+    // NODE_MNLIST means the node answers "mnldigest" requests with the masternode
+    // list entries the requester is missing, see CMasternodeMan::SyncDigest
+    NODE_MNLIST = (1 << 5),
     // NODE_NETWORK_LIMITED means the same as NODE_NETWORK with the limitation of only
     // serving the last 288 (2 day) blocks
     // See BIP159 for details on how this is implemented.
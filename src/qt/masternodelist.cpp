@@ -289,12 +289,12 @@ void MasternodeList::updateNodeList()
     ui->tableWidgetMasternodes->setSortingEnabled(false);
     ui->tableWidgetMasternodes->clearContents();
     ui->tableWidgetMasternodes->setRowCount(0);
-    std::map<COutPoint, CMasternode> mapMasternodes = mnodeman.GetFullMasternodeMap();
+    CMasternodeMan::list_snapshot_t listSnapshot = mnodeman.GetListSnapshot();
     int offsetFromUtc = GetOffsetFromUtc();
 
-    for (const auto& mnpair : mapMasternodes)
+    for (const auto& mnpair : *listSnapshot)
     {
-        CMasternode mn = mnpair.second;
+        const CMasternode& mn = mnpair.second;
         // populate list
         // Address, Protocol, Status, Active Seconds, Last Seen, Pub Key
         QTableWidgetItem *addressItem = new QTableWidgetItem(QString::fromStdString(mn.addr.ToString()));
@@ -921,6 +921,9 @@ UniValue getgovernanceinfo(const JSONRPCRequest& request)
             "  \"lastgovernanceblock\": xxxxx,                (numeric) the block number of the last governance block\n"
             "  \"nextgovernanceblock\": xxxxx,                (numeric) the block number of the next governance block\n"
             "  \"maxgovobjdatasize\": xxxxx,             (numeric) maximum governance object data size in bytes\n"
+            "  \"sigcachehits\": xxxxx,                  (numeric) masternode and governance signatures found in the verified signature cache\n"
+            "  \"sigcachemisses\": xxxxx,                (numeric) masternode and governance signatures that had to be verified\n"
+            "  \"sigcachehitrate\": x.xxxx,              (numeric) share of signature checks answered by the cache\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getgovernanceinfo", "")
@@ -945,6 +948,12 @@ UniValue getgovernanceinfo(const JSONRPCRequest& request)
     obj.push_back(Pair("nextgovernanceblock", nNextGovernanceBlock));
     obj.push_back(Pair("maxgovobjdatasize", MAX_GOVERNANCE_OBJECT_DATA_SIZE));
 
+    uint64_t nSigCacheHits, nSigCacheMisses;
+    CHashSigner::GetCacheStats(nSigCacheHits, nSigCacheMisses);
+    obj.push_back(Pair("sigcachehits", nSigCacheHits));
+    obj.push_back(Pair("sigcachemisses", nSigCacheMisses));
+    obj.push_back(Pair("sigcachehitrate", nSigCacheHits + nSigCacheMisses ? (double)nSigCacheHits / (nSigCacheHits + nSigCacheMisses) : 0.0));
+
     return obj;
 }
 
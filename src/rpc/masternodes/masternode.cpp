@@ -13,6 +13,7 @@
 #include <masternodes/masternode-sync.h>
 #include <masternodes/masternodeconfig.h>
 #include <masternodes/masternodeman.h>
+#include <masternodes/messagesigner.h>
 #include <rpc/server.h>
 #include <util.h>
 #include <utilmoneystr.h>
@@ -177,7 +178,8 @@ UniValue masternode(const JSONRPCRequest& request)
 
         // A local list of masternodes
         CMasternode node;
-        std::map<COutPoint, CMasternode> mapMasternodes = mnodeman.GetFullMasternodeMap();
+        CMasternodeMan::list_snapshot_t listSnapshot = mnodeman.GetListSnapshot();
+        const std::map<COutPoint, CMasternode>& mapMasternodes = *listSnapshot;
         bool fFound = false;
         int nHeight = 0;
 
@@ -638,9 +640,9 @@ UniValue masternodelist(const JSONRPCRequest& request)
             obj.push_back(Pair(strOutpoint, rankpair.first));
         }
     } else {
-        std::map<COutPoint, CMasternode> mapMasternodes = mnodeman.GetFullMasternodeMap();
-        for (const auto& mnpair : mapMasternodes) {
-            CMasternode mn = mnpair.second;
+        CMasternodeMan::list_snapshot_t listSnapshot = mnodeman.GetListSnapshot();
+        for (const auto& mnpair : *listSnapshot) {
+            const CMasternode& mn = mnpair.second;
             std::string strOutpoint = mnpair.first.ToStringShort();
             if (strMode == "activeseconds") {
                 if (strFilter !="" && strOutpoint.find(strFilter) == std::string::npos) continue;
@@ -1073,6 +1075,12 @@ UniValue mnsync(const JSONRPCRequest& request)
         objStatus.push_back(Pair("IsWinnersListSynced", masternodeSync.IsWinnersListSynced()));
         objStatus.push_back(Pair("IsSynced", masternodeSync.IsSynced()));
         objStatus.push_back(Pair("IsFailed", masternodeSync.IsFailed()));
+        objStatus.push_back(Pair("Assets", masternodeSync.GetAssetsStatus()));
+        uint64_t nSigCacheHits, nSigCacheMisses;
+        CHashSigner::GetCacheStats(nSigCacheHits, nSigCacheMisses);
+        objStatus.push_back(Pair("SigCacheHits", nSigCacheHits));
+        objStatus.push_back(Pair("SigCacheMisses", nSigCacheMisses));
+        objStatus.push_back(Pair("SigCacheHitRate", nSigCacheHits + nSigCacheMisses ? (double)nSigCacheHits / (nSigCacheHits + nSigCacheMisses) : 0.0));
         return objStatus;
     }
 
@@ -141,15 +141,7 @@ UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGen
         }
 	// Solve Equihash.
 	blake2b_state eh_state;
-    // EhInitialiseState(n, k, eh_state, Params().IsAfterSwitch(nHeight));
-    if (Params().IsAfterSwitch(nHeight))
-    {
-        EhInitialiseState(n, k, eh_state, "GENX_PoW");
-    }
-    else
-    {
-        EhInitialiseState(n, k, eh_state, "SafeCash");
-    }
+    EhInitialiseState(n, k, eh_state, GetEquihashPersonalization(nHeight, Params()));
 
 	// I = the block header minus nonce and solution.
 	CEquihashInput I{*pblock};
@@ -895,12 +887,12 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     // Debug Masternode primary payments
     // get the masternode list...
     CMasternode mnDebugNode;
-    std::map<COutPoint, CMasternode> mnDebugMapMasternodes;
+    CMasternodeMan::list_snapshot_t mnDebugListSnapshot;
     // The address to pay
     std::string strAddress;
     if (debugMasternodes)
     {
-        mnDebugMapMasternodes = mnodeman.GetFullMasternodeMap();
+        mnDebugListSnapshot = mnodeman.GetListSnapshot();
     }
 
     CAmount masternodeActual = 0;
@@ -928,7 +920,7 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     // genx address
     if (debugMasternodes)
     {
-        for (const auto& mnpair : mnDebugMapMasternodes) {
+        for (const auto& mnpair : *mnDebugListSnapshot) {
             CTxDestination address = CScriptID(GetScriptForDestination(WitnessV0KeyHash(mnpair.second.pubKeyCollateralAddress.GetID())));
             std::string strCompare = EncodeDestination(address);
             if (strCompare == strAddress)
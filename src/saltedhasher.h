@@ -0,0 +1,29 @@
+// Copyright (c) 2009-2010 Satoshi Nakamoto
+// Copyright (c) 2009-2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef GENESIS_SALTEDHASHER_H
+#define GENESIS_SALTEDHASHER_H
+
+#include <hash.h>
+#include <uint256.h>
+
+#include <cstdint>
+
+/** Salted hasher for txids and other uint256 keys of unordered containers */
+class SaltedTxidHasher
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedTxidHasher();
+
+    size_t operator()(const uint256& txid) const {
+        return SipHashUint256(k0, k1, txid);
+    }
+};
+
+#endif // GENESIS_SALTEDHASHER_H
@@ -11,53 +11,22 @@
 #include <uint256.h>
 #include <util.h>
 
-#include <cuckoocache.h>
-#include <boost/thread.hpp>
-
 namespace {
+/** Entries are SHA256(nonce || signature hash || public key || signature) */
+struct SignatureEntryWriter
+{
+    static void Write(CSHA256& hasher, const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey)
+    {
+        hasher.Write(hash.begin(), 32).Write(&pubkey[0], pubkey.size()).Write(&vchSig[0], vchSig.size());
+    }
+};
+
 /**
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
  * twice for every transaction (once when accepted into memory pool, and
  * again when accepted into the block chain)
  */
-class CSignatureCache
-{
-private:
-     //! Entries are SHA256(nonce || signature hash || public key || signature):
-    uint256 nonce;
-    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
-    map_type setValid;
-    boost::shared_mutex cs_sigcache;
-
-public:
-    CSignatureCache()
-    {
-        GetRandBytes(nonce.begin(), 32);
-    }
-
-    void
-    ComputeEntry(uint256& entry, const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey)
-    {
-        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(&pubkey[0], pubkey.size()).Write(&vchSig[0], vchSig.size()).Finalize(entry.begin());
-    }
-
-    bool
-    Get(const uint256& entry, const bool erase)
-    {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-        return setValid.contains(entry, erase);
-    }
-
-    void Set(uint256& entry)
-    {
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-        setValid.insert(entry);
-    }
-    uint32_t setup_bytes(size_t n)
-    {
-        return setValid.setup_bytes(n);
-    }
-};
+typedef CSaltedEntryCache<SignatureEntryWriter> CSignatureCache;
 
 /* In previous versions of this code, signatureCache was a local static variable
  * in CachingTransactionSignatureChecker::VerifySignature.  We initialize
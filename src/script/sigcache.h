@@ -6,10 +6,16 @@
 #ifndef GENESIS_SCRIPT_SIGCACHE_H
 #define GENESIS_SCRIPT_SIGCACHE_H
 
+#include <crypto/sha256.h>
+#include <cuckoocache.h>
+#include <random.h>
 #include <script/interpreter.h>
+#include <uint256.h>
 
 #include <vector>
 
+#include <boost/thread/shared_mutex.hpp>
+
 // DoS prevention: limit cache size to 32MB (over 1000000 entries on 64-bit
 // systems). Due to how we count cache size, actual memory usage is slightly
 // more (~32.25 MB)
@@ -40,6 +46,55 @@ public:
     }
 };
 
+/**
+ * Cache of verified entries, shared by the script signature, Equihash solution
+ * and masternode message signature caches. Entries are
+ * SHA256(nonce || data), EntryWriter::Write adds the data of the cache using
+ * it.
+ */
+template <typename EntryWriter>
+class CSaltedEntryCache
+{
+private:
+    uint256 nonce;
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+    map_type setValid;
+    boost::shared_mutex cs_cache;
+
+public:
+    CSaltedEntryCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    template <typename... Args>
+    void ComputeEntry(uint256& entry, const Args&... args)
+    {
+        CSHA256 hasher;
+        hasher.Write(nonce.begin(), 32);
+        EntryWriter::Write(hasher, args...);
+        hasher.Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry, const bool erase)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_cache);
+        return setValid.contains(entry, erase);
+    }
+
+    void Set(uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_cache);
+        setValid.insert(entry);
+    }
+
+    /** nBytes is unsigned, zero creates the minimum possible cache (2 elements) */
+    uint32_t setup_bytes(size_t nBytes)
+    {
+        return setValid.setup_bytes(nBytes);
+    }
+};
+
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
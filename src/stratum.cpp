@@ -0,0 +1,673 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <stratum.h>
+
+#include <arith_uint256.h>
+#include <base58.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <consensus/merkle.h>
+#include <crypto/common.h>
+#include <masternodes/masternode-sync.h>
+#include <miner.h>
+#include <net.h>
+#include <netbase.h>
+#include <pow.h>
+#include <primitives/block.h>
+#include <random.h>
+#include <script/standard.h>
+#include <streams.h>
+#include <support/events.h>
+#include <sync.h>
+#include <timedata.h>
+#include <txmempool.h>
+#include <univalue.h>
+#include <util.h>
+#include <utilstrencodings.h>
+#include <validation.h>
+#include <validationinterface.h>
+#include <version.h>
+
+#include <atomic>
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+#include <event2/listener.h>
+#include <event2/thread.h>
+#include <event2/util.h>
+
+/** Maximum length of a request line; a submit with a (192,7) solution is about 900 bytes */
+static const size_t MAX_LINE_LENGTH = 16384;
+/** Number of jobs on the current tip that shares are still accepted for */
+static const size_t MAX_STRATUM_JOBS = 16;
+/** Bytes of nNonce assigned by the server to each miner */
+static const size_t STRATUM_NONCE1_SIZE = 4;
+
+/** Error codes from ZIP 301 */
+enum StratumErrorCode {
+    STRATUM_ERROR_OTHER = 20,
+    STRATUM_ERROR_JOB_NOT_FOUND = 21,
+    STRATUM_ERROR_DUPLICATE_SHARE = 22,
+    STRATUM_ERROR_LOW_DIFFICULTY = 23,
+    STRATUM_ERROR_UNAUTHORIZED = 24,
+    STRATUM_ERROR_NOT_SUBSCRIBED = 25,
+};
+
+/** Hex of a 32-bit value in the little-endian byte order of the header. */
+static std::string HexLE32(uint32_t n)
+{
+    unsigned char buf[4];
+    WriteLE32(buf, n);
+    return HexStr(buf, buf + sizeof(buf));
+}
+
+UniValue StratumNotifyParams(const std::string& jobId, const CBlockHeader& header, bool fCleanJobs)
+{
+    UniValue params(UniValue::VARR);
+    params.push_back(jobId);
+    params.push_back(HexLE32(header.nVersion));
+    params.push_back(HexStr(header.hashPrevBlock.begin(), header.hashPrevBlock.end()));
+    params.push_back(HexStr(header.hashMerkleRoot.begin(), header.hashMerkleRoot.end()));
+    params.push_back(HexStr(header.hashReserved.begin(), header.hashReserved.end()));
+    params.push_back(HexLE32(header.nTime));
+    params.push_back(HexLE32(header.nBits));
+    params.push_back(UniValue(fCleanJobs));
+    return params;
+}
+
+bool StratumApplySubmit(CBlockHeader& header, const std::vector<unsigned char>& vchNonce1, const UniValue& params, std::string& strError)
+{
+    // [WORKER_NAME, JOB_ID, TIME, NONCE_2, EQUIHASH_SOLUTION]
+    if (!params.isArray() || params.size() < 5 || !params[2].isStr() || !params[3].isStr() || !params[4].isStr()) {
+        strError = "Malformed submit";
+        return false;
+    }
+
+    const std::string& strTime = params[2].get_str();
+    if (strTime.size() != 8 || !IsHex(strTime)) {
+        strError = "Malformed time";
+        return false;
+    }
+    std::vector<unsigned char> vchTime = ParseHex(strTime);
+
+    const std::string& strNonce2 = params[3].get_str();
+    std::vector<unsigned char> vchNonce2 = ParseHex(strNonce2);
+    if (!IsHex(strNonce2) || vchNonce1.size() + vchNonce2.size() != header.nNonce.size()) {
+        strError = "Malformed nonce";
+        return false;
+    }
+
+    const std::string& strSolution = params[4].get_str();
+    if (!IsHex(strSolution)) {
+        strError = "Malformed solution";
+        return false;
+    }
+    CDataStream ss(ParseHex(strSolution), SER_NETWORK, PROTOCOL_VERSION);
+    std::vector<unsigned char> vchSolution;
+    try {
+        ss >> vchSolution;
+    } catch (const std::exception&) {
+        strError = "Malformed solution";
+        return false;
+    }
+    if (!ss.empty()) {
+        strError = "Malformed solution";
+        return false;
+    }
+
+    header.nTime = ReadLE32(vchTime.data());
+    std::copy(vchNonce1.begin(), vchNonce1.end(), header.nNonce.begin());
+    std::copy(vchNonce2.begin(), vchNonce2.end(), header.nNonce.begin() + vchNonce1.size());
+    header.nSolution.swap(vchSolution);
+    return true;
+}
+
+namespace {
+
+/** A block template handed out to miners. */
+struct StratumJob
+{
+    std::shared_ptr<const CBlock> pblock;
+    //! Target a share must meet to be a block
+    arith_uint256 hashTarget;
+    //! Hashes of the shares already accepted for this job
+    std::set<uint256> setShares;
+};
+
+/** A connected miner. */
+struct StratumClient
+{
+    struct bufferevent* bev;
+    std::string strPeer;
+    std::vector<unsigned char> vchNonce1;
+    std::string strWorker;
+    std::string strTarget;
+    bool fSubscribed;
+    bool fAuthorized;
+
+    StratumClient() : bev(nullptr), fSubscribed(false), fAuthorized(false) {}
+};
+
+/**
+ * Stratum server. Everything but the validation interface callbacks runs on
+ * the server's event loop thread, so no further locking is needed; tip
+ * changes are handed over by activating evTip.
+ */
+class StratumServer : public CValidationInterface
+{
+public:
+    StratumServer(const CScript& scriptPubKeyIn, const arith_uint256& shareTargetIn);
+    ~StratumServer();
+
+    bool Bind(const CService& addrBind);
+    void Loop();
+    void Break();
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
+
+private:
+    raii_event_base base;
+    struct evconnlistener* listener;
+    raii_event evTip;
+    raii_event evRefresh;
+    /** Set by Break(), which may run before Loop() has started dispatching */
+    std::atomic<bool> fBreak;
+
+    CScript scriptPubKey;
+    arith_uint256 shareTarget;
+
+    std::map<struct bufferevent*, std::unique_ptr<StratumClient> > mapClients;
+    uint32_t nNonce1Next;
+
+    std::map<uint64_t, StratumJob> mapJobs;
+    uint64_t nJobNext;
+    uint256 hashJobPrevBlock;
+    unsigned int nTransactionsUpdatedLast;
+    int64_t nJobTime;
+
+    void UpdateJob(bool fCleanJobs);
+    void SendJob(StratumClient& client, uint64_t nJobId, bool fCleanJobs);
+    std::string ShareTarget(const StratumJob& job) const;
+
+    void Send(StratumClient& client, const UniValue& msg);
+    void Reply(StratumClient& client, const UniValue& id, const UniValue& result);
+    void ReplyError(StratumClient& client, const UniValue& id, int code, const std::string& strMessage);
+    void Disconnect(StratumClient& client);
+
+    void HandleLine(StratumClient& client, const std::string& strLine);
+    void HandleSubscribe(StratumClient& client, const UniValue& id, const UniValue& params);
+    void HandleAuthorize(StratumClient& client, const UniValue& id, const UniValue& params);
+    void HandleSubmit(StratumClient& client, const UniValue& id, const UniValue& params);
+
+    /** Libevent handlers: internal */
+    static void acceptcb(struct evconnlistener* listener, evutil_socket_t fd, struct sockaddr* addr, int socklen, void* ctx);
+    static void readcb(struct bufferevent* bev, void* ctx);
+    static void eventcb(struct bufferevent* bev, short what, void* ctx);
+    static void tipcb(evutil_socket_t fd, short what, void* ctx);
+    static void refreshcb(evutil_socket_t fd, short what, void* ctx);
+};
+
+StratumServer::StratumServer(const CScript& scriptPubKeyIn, const arith_uint256& shareTargetIn) :
+    base(obtain_event_base()), listener(nullptr), fBreak(false), scriptPubKey(scriptPubKeyIn), shareTarget(shareTargetIn),
+    nNonce1Next(GetRand(std::numeric_limits<uint32_t>::max())), nJobNext(1), nTransactionsUpdatedLast(0), nJobTime(0)
+{
+    evTip = obtain_event(base.get(), -1, 0, tipcb, this);
+    evRefresh = obtain_event(base.get(), -1, EV_PERSIST, refreshcb, this);
+    struct timeval tv = {1, 0};
+    event_add(evRefresh.get(), &tv);
+}
+
+StratumServer::~StratumServer()
+{
+    for (auto& it : mapClients) {
+        bufferevent_free(it.first);
+    }
+    mapClients.clear();
+    if (listener)
+        evconnlistener_free(listener);
+}
+
+bool StratumServer::Bind(const CService& addrBind)
+{
+    struct sockaddr_storage sockaddr;
+    socklen_t len = sizeof(sockaddr);
+    if (!addrBind.GetSockAddr((struct sockaddr*)&sockaddr, &len))
+        return false;
+    listener = evconnlistener_new_bind(base.get(), acceptcb, this, LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE, -1, (struct sockaddr*)&sockaddr, len);
+    return listener != nullptr;
+}
+
+void StratumServer::Loop()
+{
+    UpdateJob(true);
+    if (!fBreak)
+        event_base_dispatch(base.get());
+}
+
+void StratumServer::Break()
+{
+    fBreak = true;
+    // Unlike event_base_loopbreak, the exit is queued and still ends a dispatch which starts later
+    event_base_loopexit(base.get(), nullptr);
+}
+
+void StratumServer::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+{
+    if (!fInitialDownload)
+        event_active(evTip.get(), 0, 0);
+}
+
+void StratumServer::tipcb(evutil_socket_t fd, short what, void* ctx)
+{
+    StratumServer* self = (StratumServer*)ctx;
+    self->UpdateJob(true);
+}
+
+void StratumServer::refreshcb(evutil_socket_t fd, short what, void* ctx)
+{
+    StratumServer* self = (StratumServer*)ctx;
+    uint256 hashTip;
+    {
+        LOCK(cs_main);
+        hashTip = chainActive.Tip()->GetBlockHash();
+    }
+    // Retry until the node is ready to produce work, pick up tip changes that
+    // raced with the last job, and refresh on mempool changes at a bounded rate.
+    if (self->mapJobs.empty() || hashTip != self->hashJobPrevBlock) {
+        self->UpdateJob(true);
+    } else if (mempool.GetTransactionsUpdated() != self->nTransactionsUpdatedLast && GetTime() - self->nJobTime >= STRATUM_MEMPOOL_REFRESH_INTERVAL) {
+        self->UpdateJob(false);
+    }
+}
+
+void StratumServer::UpdateJob(bool fCleanJobs)
+{
+    const CChainParams& chainparams = Params();
+    if (chainparams.MiningRequiresPeers() && (!g_connman || g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL) == 0))
+        return;
+    if (IsInitialBlockDownload())
+        return;
+    // Masternode and governance payees would be wrong before the sync completes
+    if (!masternodeSync.IsSynced())
+        return;
+
+    unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    try {
+        pblocktemplate = BlockAssembler(chainparams).CreateNewBlock(scriptPubKey);
+    } catch (const std::exception& e) {
+        LogPrintG(BCLogLevel::LOG_ERROR, BCLog::STRATUM, "[Stratum] Failed to create block template: %s\n", e.what());
+        return;
+    }
+    if (!pblocktemplate)
+        return;
+    CBlock& block = pblocktemplate->block;
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+
+    if (block.hashPrevBlock != hashJobPrevBlock)
+        fCleanJobs = true;
+    if (fCleanJobs)
+        mapJobs.clear();
+    while (mapJobs.size() >= MAX_STRATUM_JOBS)
+        mapJobs.erase(mapJobs.begin());
+
+    const uint64_t nJobId = nJobNext++;
+    StratumJob& job = mapJobs[nJobId];
+    job.hashTarget.SetCompact(block.nBits);
+    job.pblock = std::make_shared<const CBlock>(block);
+
+    hashJobPrevBlock = block.hashPrevBlock;
+    nTransactionsUpdatedLast = nTransactionsUpdated;
+    nJobTime = GetTime();
+
+    LogPrintG(BCLogLevel::LOG_INFO, BCLog::STRATUM, "[Stratum] New job %d at height %d with %u transactions for %u miners\n",
+        nJobId, block.nHeight, block.vtx.size(), mapClients.size());
+    for (auto& it : mapClients) {
+        StratumClient& client = *it.second;
+        if (client.fSubscribed && client.fAuthorized)
+            SendJob(client, nJobId, fCleanJobs);
+    }
+}
+
+std::string StratumServer::ShareTarget(const StratumJob& job) const
+{
+    // Shares harder than a block are pointless
+    const arith_uint256 target = std::max(shareTarget, job.hashTarget);
+    return target.GetHex();
+}
+
+void StratumServer::SendJob(StratumClient& client, uint64_t nJobId, bool fCleanJobs)
+{
+    const StratumJob& job = mapJobs.at(nJobId);
+    const std::string strTarget = ShareTarget(job);
+    if (strTarget != client.strTarget) {
+        UniValue params(UniValue::VARR);
+        params.push_back(strTarget);
+        UniValue msg(UniValue::VOBJ);
+        msg.push_back(Pair("id", NullUniValue));
+        msg.push_back(Pair("method", "mining.set_target"));
+        msg.push_back(Pair("params", params));
+        Send(client, msg);
+        client.strTarget = strTarget;
+    }
+
+    UniValue msg(UniValue::VOBJ);
+    msg.push_back(Pair("id", NullUniValue));
+    msg.push_back(Pair("method", "mining.notify"));
+    msg.push_back(Pair("params", StratumNotifyParams(i64tostr(nJobId), *job.pblock, fCleanJobs)));
+    Send(client, msg);
+}
+
+void StratumServer::Send(StratumClient& client, const UniValue& msg)
+{
+    const std::string strMsg = msg.write() + "\n";
+    evbuffer_add(bufferevent_get_output(client.bev), strMsg.data(), strMsg.size());
+}
+
+void StratumServer::Reply(StratumClient& client, const UniValue& id, const UniValue& result)
+{
+    UniValue msg(UniValue::VOBJ);
+    msg.push_back(Pair("id", id));
+    msg.push_back(Pair("result", result));
+    msg.push_back(Pair("error", NullUniValue));
+    Send(client, msg);
+}
+
+void StratumServer::ReplyError(StratumClient& client, const UniValue& id, int code, const std::string& strMessage)
+{
+    UniValue error(UniValue::VARR);
+    error.push_back(code);
+    error.push_back(strMessage);
+    error.push_back(NullUniValue);
+    UniValue msg(UniValue::VOBJ);
+    msg.push_back(Pair("id", id));
+    msg.push_back(Pair("result", NullUniValue));
+    msg.push_back(Pair("error", error));
+    Send(client, msg);
+}
+
+void StratumServer::Disconnect(StratumClient& client)
+{
+    LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::STRATUM, "[Stratum] Disconnecting %s\n", client.strPeer);
+    struct bufferevent* bev = client.bev;
+    mapClients.erase(bev);
+    bufferevent_free(bev);
+}
+
+void StratumServer::acceptcb(struct evconnlistener* listener, evutil_socket_t fd, struct sockaddr* addr, int socklen, void* ctx)
+{
+    StratumServer* self = (StratumServer*)ctx;
+    CService peer;
+    peer.SetSockAddr(addr);
+    if (self->mapClients.size() >= (size_t)MAX_STRATUM_CLIENTS) {
+        LogPrintG(BCLogLevel::LOG_WARNING, BCLog::STRATUM, "[Stratum] Rejecting %s, too many miners connected\n", peer.ToString());
+        evutil_closesocket(fd);
+        return;
+    }
+
+    struct bufferevent* bev = bufferevent_socket_new(self->base.get(), fd, BEV_OPT_CLOSE_ON_FREE);
+    if (!bev) {
+        evutil_closesocket(fd);
+        return;
+    }
+    std::unique_ptr<StratumClient> client(new StratumClient());
+    client->bev = bev;
+    client->strPeer = peer.ToString();
+    const uint32_t nNonce1 = self->nNonce1Next++;
+    client->vchNonce1.resize(STRATUM_NONCE1_SIZE);
+    WriteBE32(client->vchNonce1.data(), nNonce1);
+    self->mapClients[bev] = std::move(client);
+
+    bufferevent_setcb(bev, readcb, nullptr, eventcb, self);
+    bufferevent_enable(bev, EV_READ | EV_WRITE);
+    LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::STRATUM, "[Stratum] Accepted connection from %s\n", peer.ToString());
+}
+
+void StratumServer::readcb(struct bufferevent* bev, void* ctx)
+{
+    StratumServer* self = (StratumServer*)ctx;
+    auto it = self->mapClients.find(bev);
+    if (it == self->mapClients.end())
+        return;
+    StratumClient& client = *it->second;
+
+    struct evbuffer* input = bufferevent_get_input(bev);
+    size_t n_read_out = 0;
+    char* line;
+    //  If there is not a whole line to read, evbuffer_readln returns nullptr
+    while ((line = evbuffer_readln(input, &n_read_out, EVBUFFER_EOL_CRLF)) != nullptr) {
+        std::string s(line, n_read_out);
+        free(line);
+        if (s.size() > MAX_LINE_LENGTH) {
+            self->Disconnect(client);
+            return;
+        }
+        self->HandleLine(client, s);
+    }
+    // Everything left is an incomplete line; protect against memory exhaustion
+    if (evbuffer_get_length(input) > MAX_LINE_LENGTH) {
+        LogPrintG(BCLogLevel::LOG_WARNING, BCLog::STRATUM, "[Stratum] Disconnecting %s because MAX_LINE_LENGTH exceeded\n", client.strPeer);
+        self->Disconnect(client);
+    }
+}
+
+void StratumServer::eventcb(struct bufferevent* bev, short what, void* ctx)
+{
+    StratumServer* self = (StratumServer*)ctx;
+    auto it = self->mapClients.find(bev);
+    if (it == self->mapClients.end())
+        return;
+    if (what & (BEV_EVENT_EOF | BEV_EVENT_ERROR))
+        self->Disconnect(*it->second);
+}
+
+void StratumServer::HandleLine(StratumClient& client, const std::string& strLine)
+{
+    if (strLine.empty())
+        return;
+
+    UniValue request;
+    if (!request.read(strLine) || !request.isObject()) {
+        ReplyError(client, NullUniValue, STRATUM_ERROR_OTHER, "Parse error");
+        return;
+    }
+    const UniValue& id = find_value(request, "id");
+    const UniValue& method = find_value(request, "method");
+    const UniValue& params = find_value(request, "params");
+    if (!method.isStr() || !(params.isArray() || params.isNull())) {
+        ReplyError(client, id, STRATUM_ERROR_OTHER, "Invalid request");
+        return;
+    }
+
+    const std::string& strMethod = method.get_str();
+    const UniValue args = params.isArray() ? params : UniValue(UniValue::VARR);
+    if (strMethod == "mining.subscribe") {
+        HandleSubscribe(client, id, args);
+    } else if (strMethod == "mining.authorize") {
+        HandleAuthorize(client, id, args);
+    } else if (strMethod == "mining.submit") {
+        HandleSubmit(client, id, args);
+    } else if (strMethod == "mining.extranonce.subscribe") {
+        // The nonce prefix of a connection never changes
+        Reply(client, id, false);
+    } else {
+        ReplyError(client, id, STRATUM_ERROR_OTHER, "Method not found");
+    }
+}
+
+void StratumServer::HandleSubscribe(StratumClient& client, const UniValue& id, const UniValue& params)
+{
+    // [MINER_USER_AGENT, SESSION_ID, CONNECT_HOST, CONNECT_PORT] -> [SESSION_ID, NONCE_1]
+    client.fSubscribed = true;
+    UniValue result(UniValue::VARR);
+    result.push_back(NullUniValue);
+    result.push_back(HexStr(client.vchNonce1));
+    Reply(client, id, result);
+    if (client.fAuthorized && !mapJobs.empty())
+        SendJob(client, mapJobs.rbegin()->first, true);
+}
+
+void StratumServer::HandleAuthorize(StratumClient& client, const UniValue& id, const UniValue& params)
+{
+    // [WORKER_NAME, PASSWORD]. Payouts go to -mineraddress, so any worker
+    // name is accepted; it is only used to attribute shares in the log.
+    if (params.size() < 1 || !params[0].isStr()) {
+        ReplyError(client, id, STRATUM_ERROR_OTHER, "Malformed authorize");
+        return;
+    }
+    client.strWorker = params[0].get_str();
+    client.fAuthorized = true;
+    Reply(client, id, true);
+    if (client.fSubscribed && !mapJobs.empty())
+        SendJob(client, mapJobs.rbegin()->first, true);
+}
+
+void StratumServer::HandleSubmit(StratumClient& client, const UniValue& id, const UniValue& params)
+{
+    if (!client.fSubscribed) {
+        ReplyError(client, id, STRATUM_ERROR_NOT_SUBSCRIBED, "Not subscribed");
+        return;
+    }
+    if (!client.fAuthorized) {
+        ReplyError(client, id, STRATUM_ERROR_UNAUTHORIZED, "Unauthorized worker");
+        return;
+    }
+
+    uint64_t nJobId;
+    auto it = mapJobs.end();
+    if (params.size() >= 2 && params[1].isStr() && ParseUInt64(params[1].get_str(), &nJobId))
+        it = mapJobs.find(nJobId);
+    if (it == mapJobs.end()) {
+        ReplyError(client, id, STRATUM_ERROR_JOB_NOT_FOUND, "Job not found");
+        return;
+    }
+    StratumJob& job = it->second;
+
+    CBlockHeader header = job.pblock->GetBlockHeader();
+    std::string strError;
+    if (!StratumApplySubmit(header, client.vchNonce1, params, strError)) {
+        ReplyError(client, id, STRATUM_ERROR_OTHER, strError);
+        return;
+    }
+    if (header.nTime < job.pblock->nTime || header.GetBlockTime() > GetAdjustedTime() + MAX_FUTURE_BLOCK_TIME) {
+        ReplyError(client, id, STRATUM_ERROR_OTHER, "Time out of range");
+        return;
+    }
+
+    // Check the share target before the much more expensive Equihash check
+    const uint256 hash = header.GetHash();
+    const arith_uint256 bnHash = UintToArith256(hash);
+    if (bnHash > std::max(shareTarget, job.hashTarget)) {
+        ReplyError(client, id, STRATUM_ERROR_LOW_DIFFICULTY, "Low difficulty share");
+        return;
+    }
+    if (job.setShares.count(hash)) {
+        ReplyError(client, id, STRATUM_ERROR_DUPLICATE_SHARE, "Duplicate share");
+        return;
+    }
+    header.nHeight = job.pblock->nHeight;
+    if (!CheckEquihashSolution(&header, Params(), GetEquihashPersonalization(header.nHeight, Params()))) {
+        ReplyError(client, id, STRATUM_ERROR_OTHER, "Invalid solution");
+        return;
+    }
+    job.setShares.insert(hash);
+
+    if (bnHash <= job.hashTarget) {
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>(*job.pblock);
+        pblock->nTime = header.nTime;
+        pblock->nNonce = header.nNonce;
+        pblock->nSolution = header.nSolution;
+        LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::STRATUM, "[Stratum] Block %s at height %d found by %s (%s)\n",
+            hash.ToString(), pblock->nHeight, client.strWorker, client.strPeer);
+        bool fNewBlock = false;
+        if (!ProcessNewBlock(Params(), pblock, true, &fNewBlock)) {
+            ReplyError(client, id, STRATUM_ERROR_OTHER, "Block rejected");
+            return;
+        }
+    } else {
+        LogPrintG(BCLogLevel::LOG_DEBUG, BCLog::STRATUM, "[Stratum] Share %s accepted from %s (%s)\n", hash.ToString(), client.strWorker, client.strPeer);
+    }
+    Reply(client, id, true);
+}
+
+std::unique_ptr<StratumServer> g_stratum;
+boost::thread stratumThread;
+
+void StratumThread()
+{
+    g_stratum->Loop();
+}
+
+} // namespace
+
+bool StartStratumServer()
+{
+    assert(!g_stratum);
+    const CChainParams& chainparams = Params();
+
+    CTxDestination dest = DecodeDestination(gArgs.GetArg("-mineraddress", ""));
+    if (!IsValidDestination(dest)) {
+        LogPrintG(BCLogLevel::LOG_ERROR, BCLog::STRATUM, "[Stratum] -stratum requires a valid -mineraddress\n");
+        return false;
+    }
+
+    const int64_t nDifficulty = gArgs.GetArg("-stratumdifficulty", DEFAULT_STRATUM_DIFFICULTY);
+    if (nDifficulty < 1) {
+        LogPrintG(BCLogLevel::LOG_ERROR, BCLog::STRATUM, "[Stratum] Invalid -stratumdifficulty %d\n", nDifficulty);
+        return false;
+    }
+    arith_uint256 shareTarget = UintToArith256(chainparams.GetConsensus().powLimit);
+    shareTarget /= arith_uint256(nDifficulty);
+
+    CService addrBind;
+    const std::string strBind = gArgs.GetArg("-stratumbind", DEFAULT_STRATUM_BIND);
+    if (!Lookup(strBind.c_str(), addrBind, gArgs.GetArg("-stratumport", DEFAULT_STRATUM_PORT), false)) {
+        LogPrintG(BCLogLevel::LOG_ERROR, BCLog::STRATUM, "[Stratum] Invalid -stratumbind address %s\n", strBind);
+        return false;
+    }
+
+#ifdef WIN32
+    evthread_use_windows_threads();
+#else
+    evthread_use_pthreads();
+#endif
+    g_stratum.reset(new StratumServer(GetScriptForDestination(dest), shareTarget));
+    if (!g_stratum->Bind(addrBind)) {
+        LogPrintG(BCLogLevel::LOG_ERROR, BCLog::STRATUM, "[Stratum] Unable to bind to %s\n", addrBind.ToString());
+        g_stratum.reset();
+        return false;
+    }
+    RegisterValidationInterface(g_stratum.get());
+
+    LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::STRATUM, "[Stratum] Listening for miners on %s (share target %s)\n", addrBind.ToString(), shareTarget.GetHex());
+    stratumThread = boost::thread(boost::bind(&TraceThread<void (*)()>, "stratum", &StratumThread));
+    return true;
+}
+
+void InterruptStratumServer()
+{
+    if (g_stratum) {
+        LogPrintG(BCLogLevel::LOG_INFO, BCLog::STRATUM, "[Stratum] Thread interrupt\n");
+        g_stratum->Break();
+    }
+}
+
+void StopStratumServer()
+{
+    if (g_stratum) {
+        UnregisterValidationInterface(g_stratum.get());
+        stratumThread.join();
+        g_stratum.reset();
+    }
+}
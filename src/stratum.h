@@ -0,0 +1,48 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/**
+ * Built-in Stratum work server for Equihash miners (see ZIP 301).
+ */
+#ifndef GENESIS_STRATUM_H
+#define GENESIS_STRATUM_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class CBlockHeader;
+class UniValue;
+
+/** Default for -stratum */
+static const bool DEFAULT_STRATUM_ENABLE = false;
+/** Default for -stratumbind */
+static const char* const DEFAULT_STRATUM_BIND = "127.0.0.1";
+/** Default for -stratumport */
+static const int DEFAULT_STRATUM_PORT = 7235;
+/** Default for -stratumdifficulty; the share target is powLimit divided by this */
+static const int64_t DEFAULT_STRATUM_DIFFICULTY = 1;
+/** Maximum number of concurrently connected miners */
+static const int MAX_STRATUM_CLIENTS = 256;
+/** Minimum age in seconds of a job before mempool changes replace it */
+static const int64_t STRATUM_MEMPOOL_REFRESH_INTERVAL = 5;
+
+/** Start the Stratum server. Returns false if it could not be set up. */
+bool StartStratumServer();
+/** Interrupt the Stratum server event loop */
+void InterruptStratumServer();
+/** Stop the Stratum server and disconnect all miners */
+void StopStratumServer();
+
+/** Encode the params of a mining.notify message announcing header as jobId. */
+UniValue StratumNotifyParams(const std::string& jobId, const CBlockHeader& header, bool fCleanJobs);
+
+/**
+ * Apply the time, nonce and solution of mining.submit params to the header
+ * of the job they refer to. vchNonce1 is the prefix of nNonce assigned to
+ * the miner. Returns false with strError set if the params are malformed.
+ */
+bool StratumApplySubmit(CBlockHeader& header, const std::vector<unsigned char>& vchNonce1, const UniValue& params, std::string& strError);
+
+#endif // GENESIS_STRATUM_H
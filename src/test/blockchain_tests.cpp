@@ -124,3 +124,113 @@ BOOST_AUTO_TEST_CASE(get_difficulty_for_block_index_overrides_tip)
 }
 
 BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_FIXTURE_TEST_SUITE(blockchain_index_tests, TestingSetup)
+
+/* Once a block index entry is on disk its Equihash solution is dropped
+ * from memory and read back from the block tree database on demand.
+ */
+BOOST_AUTO_TEST_CASE(trimmed_solution_is_read_from_disk)
+{
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.nTime = 1269211443;
+    header.nBits = 0x1d00ffff;
+    header.nSolution.assign(400, 0x5a);
+    header.nSolution[0] = 0x01;
+    uint256 hash = header.GetHash();
+
+    CBlockIndex index(header);
+    index.phashBlock = &hash;
+    BOOST_CHECK(index.GetSolution() == header.nSolution);
+
+    std::vector<const CBlockIndex*> blocks(1, &index);
+    BOOST_CHECK(pblocktree->WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*> >(), 0, blocks));
+
+    index.TrimSolution();
+    BOOST_CHECK(index.nSolution.empty());
+    BOOST_CHECK(index.GetSolution() == header.nSolution);
+    BOOST_CHECK(index.GetBlockHeader().GetHash() == hash);
+
+    // Rewriting a trimmed entry must not lose the solution.
+    index.nStatus |= BLOCK_FAILED_VALID;
+    BOOST_CHECK(pblocktree->WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*> >(), 0, blocks));
+    BOOST_CHECK(CDiskBlockIndex(&index).nSolution == header.nSolution);
+    BOOST_CHECK(index.GetBlockHeader().GetHash() == hash);
+
+    // Entries that were never written keep their (possibly empty) solution.
+    CBlockIndex empty;
+    empty.phashBlock = &hash;
+    BOOST_CHECK(empty.GetSolution().empty());
+}
+
+/* The block index is loaded from several key ranges in parallel; every
+ * entry must come back linked to its parent, and an entry stored under the
+ * wrong hash is only accepted when header hashes are trusted.
+ */
+BOOST_AUTO_TEST_CASE(block_index_loads_in_parallel)
+{
+    const Consensus::Params& params = Params().GetConsensus();
+    const int nBlocks = 64;
+
+    std::vector<uint256> hashes(nBlocks);
+    std::vector<CBlockIndex> indexes(nBlocks);
+    std::vector<const CBlockIndex*> blocks;
+    for (int i = 0; i < nBlocks; i++) {
+        CBlockHeader header;
+        header.nVersion = 4;
+        header.hashPrevBlock = i ? hashes[i - 1] : uint256();
+        header.nTime = 1269211443 + i;
+        header.nBits = UintToArith256(params.powLimit).GetCompact();
+        header.nSolution.assign(400, i);
+        while (!CheckProofOfWork(header.GetHash(), header.nBits, params)) {
+            header.nNonce = ArithToUint256(UintToArith256(header.nNonce) + 1);
+        }
+        hashes[i] = header.GetHash();
+        indexes[i] = CBlockIndex(header);
+        indexes[i].phashBlock = &hashes[i];
+        indexes[i].pprev = i ? &indexes[i - 1] : nullptr;
+        indexes[i].nHeight = i;
+        blocks.push_back(&indexes[i]);
+    }
+    BOOST_CHECK(pblocktree->WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*> >(), 0, blocks));
+
+    std::map<uint256, std::unique_ptr<CBlockIndex> > loaded;
+    auto insert = [&loaded](const uint256& hash) -> CBlockIndex* {
+        if (hash.IsNull())
+            return nullptr;
+        std::unique_ptr<CBlockIndex>& entry = loaded[hash];
+        if (!entry) {
+            entry.reset(new CBlockIndex());
+            entry->phashBlock = &loaded.find(hash)->first;
+        }
+        return entry.get();
+    };
+    BOOST_CHECK(pblocktree->LoadBlockIndexGuts(params, insert));
+    for (int i = 0; i < nBlocks; i++) {
+        BOOST_REQUIRE(loaded.count(hashes[i]));
+        const CBlockIndex* pindex = loaded[hashes[i]].get();
+        BOOST_CHECK_EQUAL(pindex->nHeight, i);
+        BOOST_CHECK(pindex->nSolution.empty());
+        BOOST_CHECK(pindex->GetBlockHeader().GetHash() == hashes[i]);
+        if (i)
+            BOOST_CHECK(pindex->pprev == loaded[hashes[i - 1]].get());
+    }
+
+    // Store the last header under a hash that does not match its contents.
+    uint256 fake = uint256S("0000000000000000000000000000000000000000000000000000000000000001");
+    CBlockIndex forged(indexes[nBlocks - 1]);
+    forged.phashBlock = &fake;
+    BOOST_CHECK(pblocktree->WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*> >(), 0, std::vector<const CBlockIndex*>(1, &forged)));
+
+    loaded.clear();
+    BOOST_CHECK(!pblocktree->LoadBlockIndexGuts(params, insert));
+
+    gArgs.ForceSetArg("-trustblockindexhashes", "1");
+    loaded.clear();
+    BOOST_CHECK(pblocktree->LoadBlockIndexGuts(params, insert));
+    BOOST_CHECK(loaded.count(fake));
+    gArgs.ForceSetArg("-trustblockindexhashes", "0");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
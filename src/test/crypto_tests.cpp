@@ -4,6 +4,8 @@
 
 #include <crypto/aes.h>
 #include <crypto/chacha20.h>
+#include <crypto/common.h>
+#include <crypto/equihash/leafhash.h>
 #include <crypto/ripemd160.h>
 #include <crypto/sha1.h>
 #include <crypto/sha256.h>
@@ -524,6 +526,44 @@ BOOST_AUTO_TEST_CASE(chacha20_testvector)
                  "fab78c9");
 }
 
+BOOST_AUTO_TEST_CASE(equihash_leafhash_tests)
+{
+    // The batched leaf hasher must agree with libb2 for every digest length,
+    // message length and batch size, including the ones it has to fall back on.
+    for (int i = 0; i < 200; i++) {
+        blake2b_param P = {};
+        P.digest_length = 1 + InsecureRandRange(BLAKE2B_OUTBYTES);
+        P.fanout = 1;
+        P.depth = 1;
+        memcpy(P.personal, "GENX_PoW", 8);
+        WriteLE32(P.personal + 8, InsecureRand32());
+
+        blake2b_state base;
+        blake2b_init_param(&base, &P);
+        std::vector<unsigned char> header = insecure_rand_ctx.randbytes(InsecureRandRange(400));
+        blake2b_update(&base, header.data(), header.size());
+
+        std::vector<uint32_t> indices(InsecureRandRange(2 * CEhLeafHasher::MAX_LANES + 2));
+        for (uint32_t& index : indices) {
+            index = InsecureRand32();
+        }
+
+        const size_t outlen = P.digest_length;
+        std::vector<unsigned char> expected(indices.size() * outlen);
+        for (size_t j = 0; j < indices.size(); j++) {
+            blake2b_state state = base;
+            unsigned char lei[4];
+            WriteLE32(lei, indices[j]);
+            blake2b_update(&state, lei, sizeof(lei));
+            blake2b_final(&state, expected.data() + j * outlen, outlen);
+        }
+
+        std::vector<unsigned char> result(indices.size() * outlen);
+        CEhLeafHasher(base, outlen).Hash(indices.data(), indices.size(), result.data());
+        BOOST_CHECK(result == expected);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(countbits_tests)
 {
     FastRandomContext ctx;
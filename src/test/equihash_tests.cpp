@@ -47,7 +47,7 @@ void PrintSolutions(std::stringstream &strm, std::set<std::vector<uint32_t>> sol
 void TestEquihashSolvers(unsigned int n, unsigned int k, const std::string &I, const arith_uint256 &nonce, const std::set<std::vector<uint32_t>> &solns) {
     size_t cBitLen { n/(k+1) };
     blake2b_state state;
-    EhInitialiseState(n, k, state);
+    EhInitialiseState(n, k, state, "ZcashPoW");
     uint256 V = ArithToUint256(nonce);
     BOOST_TEST_MESSAGE("Running solver: n = " << n << ", k = " << k << ", I = " << I << ", V = " << V.GetHex());
     blake2b_update(&state, (unsigned char*)&I[0], I.size());
@@ -86,7 +86,7 @@ void TestEquihashSolvers(unsigned int n, unsigned int k, const std::string &I, c
 void TestEquihashValidator(unsigned int n, unsigned int k, const std::string &I, const arith_uint256 &nonce, std::vector<uint32_t> soln, bool expected) {
     size_t cBitLen { n/(k+1) };
     blake2b_state state;
-    EhInitialiseState(n, k, state);
+    EhInitialiseState(n, k, state, "ZcashPoW");
     uint256 V = ArithToUint256(nonce);
     blake2b_update(&state, (unsigned char*)&I[0], I.size());
     blake2b_update(&state, V.begin(), V.size());
@@ -97,6 +97,12 @@ void TestEquihashValidator(unsigned int n, unsigned int k, const std::string &I,
     bool isValid;
     EhIsValidSolution(n, k, state, GetMinimalFromIndices(soln, cBitLen), isValid);
     BOOST_CHECK(isValid == expected);
+    if (n == 96 && k == 5) {
+        // The allocation-free verifier must agree with the generic one
+        std::vector<unsigned char> minimal = GetMinimalFromIndices(soln, cBitLen);
+        bool isValidFixed = EquihashFixedVerifier<96,5>::IsValidSolution(state, minimal.data(), minimal.size());
+        BOOST_CHECK(isValidFixed == expected);
+    }
 }
 
 BOOST_AUTO_TEST_CASE(solver_testvectors) {
@@ -195,4 +201,62 @@ BOOST_AUTO_TEST_CASE(validator_testvectors) {
                 false);
 }
 
+
+BOOST_AUTO_TEST_CASE(validator_192_7) {
+    // Solution for I = {0x00, ..., 0x6b} and an all-zero nonce, found with the tromp solver
+    const std::vector<unsigned char> soln = ParseHex(
+        "01ab4646dfd3666e31d603b8e1068edb4f3ed932b05dc6f1e41bb87a69a0491a29a49c772486c6922d690a4defaa7d9cf585"
+        "031bebe0947fcd514cfdd1d7345ead472642453e321921611304239a55414354b10f1f562125700e8c035e5ab20d17f5a262"
+        "0da1e04226bfc6650c2883f2e278a69a654c267cbd41c693302ae6dbba79539b1e2e5ead9efab7441e34d5ef66dd81f7b92a"
+        "201e8aae486ee1fa08fa001b936aaaad643121d17c9381735d5a4dacd27177323028dbe1eef9e969952771a290a04fcc97dd"
+        "0a0e029ef051989475bdb59381bfba9252cdf3560387d6ba393d95ba6e5e0f5210389f9f3ef466bb9791d97f19d689e75963"
+        "212f5b36c7dd14b910be904423bc1f85634bb5304ea954eded44ec2deffe9de17ca69dc167255dad1dc8bbd2bfa08b82c47a"
+        "0cf3a6d77c5ebee9caffdfc8246e31c52980ea6c6ed3f836972eda23debc63cccfe46ad437e322fdc34a10f60316a381ab52"
+        "260a94386b7899ee8a9ab466b3732f0abce324efae8ed1a8d333a456624b8e8e9908f72b9674250a57daca76567f59871935");
+    unsigned char I[108];
+    for (size_t i = 0; i < sizeof(I); i++)
+        I[i] = i;
+    unsigned char V[32] = {};
+
+    blake2b_state genx, legacy;
+    EhInitialiseState(192, 7, genx, "GENX_PoW");
+    EhInitialiseState(192, 7, legacy, "SafeCash");
+    for (blake2b_state* state : {&genx, &legacy}) {
+        blake2b_update(state, I, sizeof(I));
+        blake2b_update(state, V, sizeof(V));
+    }
+
+    bool isValid;
+    EhIsValidSolution(192, 7, genx, soln, isValid);
+    BOOST_CHECK(isValid);
+    BOOST_CHECK(Eh192_7.IsValidSolution(genx, soln));
+    EhIsValidSolution(192, 7, legacy, soln, isValid);
+    BOOST_CHECK(!isValid);
+
+    // Every mutation must be rejected by both verifiers
+    std::vector<eh_index> indices = GetIndicesFromMinimal(soln, 24);
+    std::vector<std::vector<eh_index>> mutations;
+    mutations.push_back(indices);
+    mutations.back()[0] ^= 1; // change one index
+    mutations.push_back(indices);
+    std::swap(mutations.back()[0], mutations.back()[1]); // reverse the first pair
+    mutations.push_back(indices);
+    std::rotate(mutations.back().begin(), mutations.back().begin() + 64, mutations.back().end()); // swap the halves
+    mutations.push_back(indices);
+    std::sort(mutations.back().begin(), mutations.back().end()); // sort the indices
+    mutations.push_back(indices);
+    mutations.back()[1] = mutations.back()[0]; // duplicate index
+    for (const std::vector<eh_index>& mutation : mutations) {
+        std::vector<unsigned char> minimal = GetMinimalFromIndices(mutation, 24);
+        EhIsValidSolution(192, 7, genx, minimal, isValid);
+        BOOST_CHECK(!isValid);
+        BOOST_CHECK(!Eh192_7.IsValidSolution(genx, minimal));
+    }
+
+    // Wrong length
+    std::vector<unsigned char> truncated(soln.begin(), soln.end() - 1);
+    EhIsValidSolution(192, 7, genx, truncated, isValid);
+    BOOST_CHECK(!isValid);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
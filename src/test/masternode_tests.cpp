@@ -0,0 +1,940 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <fs.h>
+#include <key.h>
+#include <net.h>
+#include <netbase.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <streams.h>
+#include <script/standard.h>
+#include <timedata.h>
+#include <saltedhasher.h>
+#include <txdb.h>
+#include <validation.h>
+#include <masternodes/flat-database.h>
+#include <masternodes/governance-votedb.h>
+#include <masternodes/masternode-payments.h>
+#include <masternodes/masternode-sync.h>
+#include <masternodes/masternodeman.h>
+#include <masternodes/messagequeue.h>
+#include <masternodes/messagesigner.h>
+#include <masternodes/netfulfilledman.h>
+#include <masternodes/timerwheel.h>
+#include <test/test_genesis.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(masternode_tests, TestingSetup)
+
+static CMutableTransaction SpendingTx(const COutPoint& prevout)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1;
+    return tx;
+}
+
+static CBlock BlockWith(const CMutableTransaction& tx)
+{
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.resize(1);
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    block.vtx.push_back(MakeTransactionRef(tx));
+    return block;
+}
+
+static bool IsSpent(const COutPoint& outpoint)
+{
+    CMasternode mn;
+    BOOST_REQUIRE(mnodeman.Get(outpoint, mn));
+    BOOST_CHECK(mn.IsCollateralTracked());
+    return mn.IsOutpointSpent();
+}
+
+/** The payee selection as it was before the payment queues: filter the whole list, then sort */
+static bool LinearScanForPayment(const std::map<COutPoint, CMasternode>& mapMasternodes, int nBlockHeight, bool fFilterSigTime, int& nCountRet, COutPoint& primaryRet, std::vector<COutPoint>& vSecondaryRet)
+{
+    const Consensus::Params& consensus = Params().GetConsensus();
+    const int nMinProtocol = mnpayments.GetMinMasternodePaymentsProto();
+    const int nSecondariesToGet = consensus.nMasternodeMaturitySecondariesMaxCount;
+    int nMnCount = 0;
+    for (const auto& mnpair : mapMasternodes) {
+        if (mnpair.second.nProtocolVersion >= nMinProtocol) nMnCount++;
+    }
+
+    typedef std::pair<int, const CMasternode*> last_paid_t;
+    auto compareLastPaid = [](const last_paid_t& t1, const last_paid_t& t2) {
+        if (t1.first != t2.first) return t1.first < t2.first;
+        if (t1.second->activationBlockHeight != t2.second->activationBlockHeight) return t1.second->activationBlockHeight < t2.second->activationBlockHeight;
+        return t1.second->outpoint < t2.second->outpoint;
+    };
+    std::vector<last_paid_t> vecLastPaid, vecLastPaidSecondary;
+    for (const auto& mnpair : mapMasternodes) {
+        const CMasternode& mn = mnpair.second;
+        if (!mn.IsValidForPayment() || mn.nProtocolVersion < nMinProtocol) continue;
+        if (GetUTXOConfirmations(mn.outpoint) < nMnCount) continue;
+        if (!(fFilterSigTime && mn.sigTime + nMnCount*60 > GetAdjustedTime()) &&
+                mn.activationBlockHeight > 0 && mn.activationBlockHeight <= nBlockHeight) {
+            vecLastPaid.emplace_back(mn.GetLastPaidBlockPrimary(), &mn);
+        }
+        if (!(fFilterSigTime && mn.sigTime + (nMnCount/nSecondariesToGet)*60 > GetAdjustedTime())) {
+            vecLastPaidSecondary.emplace_back(mn.GetLastPaidBlockSecondary(), &mn);
+        }
+    }
+
+    nCountRet = (int)vecLastPaid.size();
+    if (fFilterSigTime && nCountRet < nMnCount/3) {
+        return LinearScanForPayment(mapMasternodes, nBlockHeight, false, nCountRet, primaryRet, vSecondaryRet);
+    }
+    std::sort(vecLastPaid.begin(), vecLastPaid.end(), compareLastPaid);
+    std::sort(vecLastPaidSecondary.begin(), vecLastPaidSecondary.end(), compareLastPaid);
+
+    const uint256 blockHash = chainActive[nBlockHeight - (consensus.nCoinbaseMaturity + 1)]->GetBlockHash();
+    int nCountTenth = 0;
+    arith_uint256 nHighest = 0;
+    const CMasternode* pBestMasternode = nullptr;
+    for (const auto& s : vecLastPaid) {
+        arith_uint256 nScore = s.second->CalculateScore(blockHash);
+        if (nScore > nHighest) {
+            nHighest = nScore;
+            pBestMasternode = s.second;
+        }
+        nCountTenth++;
+        if (nCountTenth >= nMnCount/10) break;
+    }
+    if (pBestMasternode) primaryRet = pBestMasternode->outpoint;
+
+    size_t sampleSize = (int)vecLastPaidSecondary.size() - 1 >= nSecondariesToGet ? nSecondariesToGet : vecLastPaidSecondary.size() - 1;
+    for (int i = 0; i <= (int)sampleSize; ++i) {
+        if (vecLastPaidSecondary[i].second != pBestMasternode) {
+            vSecondaryRet.push_back(vecLastPaidSecondary[i].second->outpoint);
+        }
+        if (vSecondaryRet.size() == sampleSize) break;
+    }
+    return pBestMasternode != nullptr;
+}
+
+BOOST_AUTO_TEST_CASE(collateral_follows_block_notifications)
+{
+    CMutableTransaction funding = SpendingTx(COutPoint(InsecureRand256(), 0));
+    COutPoint collateral(funding.GetHash(), 0);
+    CMasternode mn(CService(), collateral, CPubKey(), CPubKey(), PROTOCOL_VERSION);
+    {
+        // the collateral is not in the UTXO set yet
+        LOCK(cs_main);
+        BOOST_CHECK(mnodeman.Add(mn));
+    }
+    BOOST_CHECK(IsSpent(collateral));
+
+    CBlockIndex index;
+    index.nHeight = 20;
+    CBlock fundingBlock = BlockWith(funding);
+    mnodeman.BlockConnected(fundingBlock, &index);
+    BOOST_CHECK(!IsSpent(collateral));
+    CMasternode mnRet;
+    BOOST_CHECK(mnodeman.Get(collateral, mnRet));
+    BOOST_CHECK_EQUAL(mnRet.GetActivationBlockHeight(), 20);
+
+    // spent and then reorged out again
+    CBlock spendingBlock = BlockWith(SpendingTx(collateral));
+    index.nHeight = 21;
+    mnodeman.BlockConnected(spendingBlock, &index);
+    BOOST_CHECK(IsSpent(collateral));
+    mnodeman.BlockDisconnected(spendingBlock);
+    BOOST_CHECK(!IsSpent(collateral));
+
+    // unrelated blocks do not touch it
+    CBlock otherBlock = BlockWith(SpendingTx(COutPoint(InsecureRand256(), 0)));
+    mnodeman.BlockConnected(otherBlock, &index);
+    BOOST_CHECK(!IsSpent(collateral));
+
+    // disconnecting the collateral transaction removes the collateral
+    mnodeman.BlockDisconnected(fundingBlock);
+    BOOST_CHECK(IsSpent(collateral));
+
+    mnodeman.Clear();
+}
+
+BOOST_AUTO_TEST_CASE(indexes_follow_list_changes)
+{
+    CKey collateralKey, operatorKey;
+    collateralKey.MakeNewKey(true);
+    operatorKey.MakeNewKey(true);
+    const CService addr = LookupNumeric("1.2.3.4", 9999);
+
+    COutPoint collateral(InsecureRand256(), 0);
+    CMasternode mn(addr, collateral, collateralKey.GetPubKey(), operatorKey.GetPubKey(), PROTOCOL_VERSION);
+    BOOST_CHECK(mn.payee == GetMasternodePayeeScript(collateralKey.GetPubKey()));
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(mnodeman.Add(mn));
+    }
+
+    masternode_info_t info;
+    BOOST_CHECK(mnodeman.GetMasternodeInfo(operatorKey.GetPubKey(), info));
+    BOOST_CHECK(info.outpoint == collateral);
+    BOOST_CHECK(mnodeman.GetMasternodeInfoFromCollateral(mn.payee, info));
+    BOOST_CHECK(info.outpoint == collateral);
+    BOOST_CHECK(mnodeman.GetMasternodeInfoFromCollateral(collateralKey.GetPubKey(), info));
+    BOOST_CHECK(mnodeman.GetMasternodeInfo(GetScriptForDestination(WitnessV0KeyHash(collateralKey.GetPubKey().GetID())), info));
+    BOOST_CHECK(info.outpoint == collateral);
+
+    // the indexes are rebuilt when the list is loaded from disk
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << mnodeman;
+    mnodeman.Clear();
+    BOOST_CHECK(!mnodeman.GetMasternodeInfo(operatorKey.GetPubKey(), info));
+    ss >> mnodeman;
+    BOOST_CHECK(mnodeman.GetMasternodeInfo(operatorKey.GetPubKey(), info));
+    BOOST_CHECK(info.addr == addr);
+    BOOST_CHECK(info.payee == mn.payee);
+
+    mnodeman.Clear();
+    BOOST_CHECK(!mnodeman.GetMasternodeInfo(operatorKey.GetPubKey(), info));
+    BOOST_CHECK(!mnodeman.GetMasternodeInfoFromCollateral(mn.payee, info));
+}
+
+BOOST_AUTO_TEST_CASE(cache_round_trip)
+{
+    COutPoint collateral(InsecureRand256(), 0);
+    CMasternode mn(LookupNumeric("1.2.3.4", 9999), collateral, CPubKey(), CPubKey(), PROTOCOL_VERSION);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(mnodeman.Add(mn));
+    }
+
+    CFlatDB<CMasternodeMan> flatdb("mncache.dat", "magicMasternodeCache");
+    BOOST_CHECK(flatdb.Dump(mnodeman));
+    BOOST_CHECK(fs::exists(GetDataDir() / "mncache.dat"));
+    BOOST_CHECK(!fs::exists(GetDataDir() / "mncache.dat.new"));
+    mnodeman.Clear();
+
+    BOOST_CHECK(flatdb.Load(mnodeman));
+    CMasternode mnRet;
+    BOOST_CHECK(mnodeman.Get(collateral, mnRet));
+    // the collateral is looked up again before the entry is used
+    BOOST_CHECK(!mnRet.IsCollateralTracked());
+
+    // a file that is not ours is left alone
+    {
+        CFlatDB<CMasternodeMan> flatdbOther("mncache.dat", "magicSomethingElse");
+        BOOST_CHECK(!flatdbOther.Dump(mnodeman));
+    }
+
+    mnodeman.Clear();
+}
+
+BOOST_AUTO_TEST_CASE(list_snapshot_is_immutable)
+{
+    COutPoint collateral(InsecureRand256(), 0);
+    CMasternode mn(LookupNumeric("1.2.3.4", 9999), collateral, CPubKey(), CPubKey(), PROTOCOL_VERSION);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(mnodeman.Add(mn));
+    }
+    mnodeman.PublishListSnapshot();
+    CMasternodeMan::list_snapshot_t snapshot = mnodeman.GetListSnapshot();
+    BOOST_CHECK_EQUAL(snapshot->size(), 1U);
+    BOOST_CHECK(snapshot->count(collateral));
+
+    // nothing changed, readers keep sharing the same copy
+    mnodeman.PublishListSnapshot();
+    BOOST_CHECK(mnodeman.GetListSnapshot() == snapshot);
+
+    // readers holding the old snapshot are not affected by later changes
+    mnodeman.Clear();
+    BOOST_CHECK_EQUAL(snapshot->size(), 1U);
+    BOOST_CHECK_EQUAL(mnodeman.GetListSnapshot()->size(), 1U);
+    mnodeman.PublishListSnapshot();
+    BOOST_CHECK(mnodeman.GetListSnapshot()->empty());
+    BOOST_CHECK(snapshot->count(collateral));
+}
+
+BOOST_AUTO_TEST_CASE(counters_follow_list_changes)
+{
+    mnodeman.SetSanityCheck(true);
+
+    COutPoint collateral1(InsecureRand256(), 0);
+    COutPoint collateral2(InsecureRand256(), 1);
+    CMasternode mn1(LookupNumeric("1.2.3.4", 9999), collateral1, CPubKey(), CPubKey(), PROTOCOL_VERSION);
+    CMasternode mn2(LookupNumeric("1.2.3.5", 9999), collateral2, CPubKey(), CPubKey(), PROTOCOL_VERSION - 1);
+    mn1.fUnitTest = mn2.fUnitTest = true;
+    mn1.nActiveState = CMasternode::MASTERNODE_ENABLED;
+    mn1.activationBlockHeight = 10;
+    mn2.nActiveState = CMasternode::MASTERNODE_PRE_ENABLED;
+    mn2.activationBlockHeight = 20;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(mnodeman.Add(mn1));
+        BOOST_CHECK(mnodeman.Add(mn2));
+    }
+    mnodeman.CheckCounters();
+
+    BOOST_CHECK_EQUAL(mnodeman.CountMasternodes(0), 2);
+    BOOST_CHECK_EQUAL(mnodeman.CountMasternodes(PROTOCOL_VERSION), 1);
+    BOOST_CHECK_EQUAL(mnodeman.CountEnabled(0), 1);
+    BOOST_CHECK_EQUAL(mnodeman.CountEnabled(PROTOCOL_VERSION + 1), 0);
+    BOOST_CHECK_EQUAL(mnodeman.CountCollateralisedAtHeight(0, 9, false), 0);
+    BOOST_CHECK_EQUAL(mnodeman.CountCollateralisedAtHeight(0, 10, false), 1);
+    BOOST_CHECK_EQUAL(mnodeman.CountCollateralisedAtHeight(0, 20, false), 2);
+    BOOST_CHECK_EQUAL(mnodeman.CountCollateralisedAtHeight(0, 20, true), 1);
+
+    // the counters are rebuilt when the list is loaded from disk
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << mnodeman;
+    mnodeman.Clear();
+    BOOST_CHECK_EQUAL(mnodeman.CountMasternodes(0), 0);
+    BOOST_CHECK_EQUAL(mnodeman.CountCollateralisedAtHeight(0, 20, false), 0);
+    ss >> mnodeman;
+    mnodeman.CheckCounters();
+    BOOST_CHECK_EQUAL(mnodeman.CountMasternodes(0), 2);
+    BOOST_CHECK_EQUAL(mnodeman.CountEnabled(0), 1);
+
+    mnodeman.Clear();
+    mnodeman.CheckCounters();
+    mnodeman.SetSanityCheck(false);
+}
+
+BOOST_AUTO_TEST_CASE(score_cache_follows_list_changes)
+{
+    COutPoint collateral1(InsecureRand256(), 0);
+    COutPoint collateral2(InsecureRand256(), 1);
+    CMasternode mn1(LookupNumeric("1.2.3.4", 9999), collateral1, CPubKey(), CPubKey(), PROTOCOL_VERSION);
+    CMasternode mn2(LookupNumeric("1.2.3.5", 9999), collateral2, CPubKey(), CPubKey(), PROTOCOL_VERSION);
+    mn1.fUnitTest = true;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(mnodeman.Add(mn1));
+    }
+
+    // the same block and protocol give the cached table, another protocol is scored apart
+    const uint256 hashBlock = InsecureRand256();
+    CMasternodeMan::score_table_ptr_t table = mnodeman.GetScoreTableForBlock(hashBlock, 0);
+    BOOST_CHECK_EQUAL(table->vecScores.size(), 1U);
+    BOOST_CHECK(mnodeman.GetScoreTableForBlock(hashBlock, 0) == table);
+    CMasternodeMan::score_table_ptr_t tableProtocol = mnodeman.GetScoreTableForBlock(hashBlock, PROTOCOL_VERSION + 1);
+    BOOST_CHECK(tableProtocol != table);
+    BOOST_CHECK(tableProtocol->vecScores.empty());
+    BOOST_CHECK(mnodeman.GetScoreTableForBlock(hashBlock, PROTOCOL_VERSION + 1) == tableProtocol);
+    BOOST_CHECK(mnodeman.GetScoreTableForBlock(hashBlock, 0) == table);
+
+    // adding an entry drops the cached tables, its collateral isn't in the UTXO set so it's spent
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(mnodeman.Add(mn2));
+    }
+    BOOST_CHECK(IsSpent(collateral2));
+    CMasternodeMan::score_table_ptr_t tablePrev = table;
+    table = mnodeman.GetScoreTableForBlock(hashBlock, 0);
+    BOOST_CHECK(table != tablePrev);
+    BOOST_CHECK_EQUAL(table->vecScores.size(), 2U);
+    BOOST_CHECK(mnodeman.GetScoreTableForBlock(hashBlock, 0) == table);
+
+    // so does re-keying one
+    CMasternode mnRet;
+    BOOST_CHECK(mnodeman.Get(collateral1, mnRet));
+    mnodeman.UpdateIndexedKeys(mnRet, mnRet.addr, mnRet.pubKeyMasternode);
+    tablePrev = table;
+    table = mnodeman.GetScoreTableForBlock(hashBlock, 0);
+    BOOST_CHECK(table != tablePrev);
+    BOOST_CHECK_EQUAL(table->vecScores.size(), 2U);
+
+    // and removing the spent one, which CheckAndRemove only does once the list is synced
+    masternodeSync.Reset();
+    masternodeSync.SwitchToNextAsset(*connman);
+    masternodeSync.SwitchToNextAsset(*connman);
+    masternodeSync.SwitchToNextAsset(*connman);
+    BOOST_CHECK(masternodeSync.IsMasternodeListSynced());
+    mnodeman.CheckAndRemove(*connman);
+    BOOST_CHECK(!mnodeman.Has(collateral2));
+    tablePrev = table;
+    table = mnodeman.GetScoreTableForBlock(hashBlock, 0);
+    BOOST_CHECK(table != tablePrev);
+    BOOST_CHECK_EQUAL(table->vecScores.size(), 1U);
+    BOOST_CHECK(table->vecScores[0].second->outpoint == collateral1);
+
+    masternodeSync.Reset();
+    mnodeman.Clear();
+}
+
+BOOST_AUTO_TEST_CASE(payment_queues_select_like_a_linear_scan)
+{
+    const int64_t nNow = 1500000000;
+    SetMockTime(nNow);
+    mnodeman.SetSanityCheck(true);
+    masternodeSync.Reset();
+    for (int i = 0; i < 4; i++) {
+        masternodeSync.SwitchToNextAsset(*connman);
+    }
+    BOOST_CHECK(masternodeSync.IsWinnersListSynced());
+
+    // a chain for the collateral confirmations and the score block hash
+    const int nChainHeight = 299;
+    const int nBlockHeight = nChainHeight + 1;
+    std::vector<uint256> hashes(nChainHeight + 1);
+    std::vector<CBlockIndex> blocks(nChainHeight + 1);
+    for (int i = 0; i <= nChainHeight; i++) {
+        hashes[i] = InsecureRand256();
+        blocks[i].phashBlock = &hashes[i];
+        blocks[i].nHeight = i;
+        blocks[i].pprev = i == 0 ? nullptr : &blocks[i - 1];
+        blocks[i].BuildSkip();
+    }
+    CBlockIndex* pindexTipPrev;
+    {
+        LOCK(cs_main);
+        pindexTipPrev = chainActive.Tip();
+        chainActive.SetTip(&blocks.back());
+    }
+
+    for (int nRound = 0; nRound < 30; nRound++) {
+        // every third round most of the list restarted recently, which lets the young ones in
+        const int nNewPercent = nRound % 3 == 0 ? 90 : 20;
+        const int nMasternodes = 20 + InsecureRandRange(30);
+        std::vector<COutPoint> vecCollaterals;
+        for (int i = 0; i < nMasternodes; i++) {
+            COutPoint collateral(InsecureRand256(), 0);
+            CMasternode mn(LookupNumeric("1.2.3.4", 9999 + i), collateral, CPubKey(), CPubKey(), PROTOCOL_VERSION);
+            mn.fUnitTest = true;
+            const int nState = InsecureRandRange(20);
+            mn.nActiveState = nState < 16 ? CMasternode::MASTERNODE_ENABLED : nState < 17 ? CMasternode::MASTERNODE_SENTINEL_PING_EXPIRED : CMasternode::MASTERNODE_EXPIRED;
+            if (InsecureRandRange(10) == 0) mn.nProtocolVersion = mnpayments.GetMinMasternodePaymentsProto() - 1;
+            // ties on the last paid height are broken by activation height and collateral
+            mn.nBlockLastPaidPrimary = InsecureRandRange(4) * 50;
+            mn.nBlockLastPaidSecondary = InsecureRandRange(4) * 50;
+            mn.activationBlockHeight = (int)InsecureRandRange(nBlockHeight + 20) - 10;
+            mn.sigTime = (int)InsecureRandRange(100) < nNewPercent ? nNow - InsecureRandRange(nMasternodes * 60) : nNow - 1000000;
+            mn.nCollateralMinConfBlockHash = InsecureRand256();
+            {
+                LOCK(cs_main);
+                // some collaterals are missing or have too few confirmations
+                if (InsecureRandRange(10) != 0) {
+                    pcoinsTip->AddCoin(collateral, Coin(CTxOut(1000 * COIN, CScript()), InsecureRandRange(nChainHeight - 10), false), false);
+                }
+                BOOST_CHECK(mnodeman.Add(mn));
+            }
+            vecCollaterals.push_back(collateral);
+        }
+        mnodeman.CheckCounters();
+        mnodeman.PublishListSnapshot();
+        CMasternodeMan::list_snapshot_t snapshot = mnodeman.GetListSnapshot();
+
+        for (bool fFilterSigTime : {true, false}) {
+            int nCount = -1, nCountExpected = -1;
+            masternode_info_t mnInfo;
+            std::vector<masternode_info_t> vecSecondaries;
+            COutPoint primaryExpected;
+            std::vector<COutPoint> vecSecondariesExpected;
+            bool fFound = mnodeman.GetNextMasternodesInQueueForPayment(nBlockHeight, fFilterSigTime, nCount, mnInfo, vecSecondaries);
+            bool fFoundExpected = LinearScanForPayment(*snapshot, nBlockHeight, fFilterSigTime, nCountExpected, primaryExpected, vecSecondariesExpected);
+            BOOST_CHECK_EQUAL(fFound, fFoundExpected);
+            BOOST_CHECK_EQUAL(nCount, nCountExpected);
+            if (fFound) {
+                BOOST_CHECK(mnInfo.outpoint == primaryExpected);
+            }
+            BOOST_REQUIRE_EQUAL(vecSecondaries.size(), vecSecondariesExpected.size());
+            for (size_t i = 0; i < vecSecondaries.size(); i++) {
+                BOOST_CHECK(vecSecondaries[i].outpoint == vecSecondariesExpected[i]);
+            }
+        }
+
+        mnodeman.Clear();
+        LOCK(cs_main);
+        for (const COutPoint& collateral : vecCollaterals) {
+            pcoinsTip->SpendCoin(collateral);
+        }
+    }
+
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(pindexTipPrev);
+    }
+    masternodeSync.Reset();
+    mnodeman.SetSanityCheck(false);
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(payment_index_follows_the_chain)
+{
+    // a chain of four blocks and a competing block at height 3
+    std::vector<uint256> hashes(5);
+    std::vector<CBlockIndex> blocks(5);
+    for (int i = 0; i < 5; i++) {
+        hashes[i] = InsecureRand256();
+        blocks[i].phashBlock = &hashes[i];
+        blocks[i].nHeight = i < 4 ? i : 3;
+        blocks[i].nTime = 1000 + i;
+        blocks[i].pprev = i == 0 ? nullptr : &blocks[i < 4 ? i - 1 : 2];
+        blocks[i].BuildSkip();
+    }
+    const CBlockIndex* pindexTip = &blocks[3];
+    const CBlockIndex* pindexFork = &blocks[4];
+
+    CScript payee = GetScriptForDestination(CScriptID(CScript() << OP_TRUE));
+    std::vector<std::pair<CScript, bool> > vPrimary{{payee, true}};
+    std::vector<std::pair<CScript, bool> > vSecondary{{payee, false}};
+    BOOST_CHECK(pblocktree->WriteMasternodePayments(1, hashes[1], vPrimary));
+    BOOST_CHECK(pblocktree->WriteMasternodePayments(2, hashes[2], vSecondary));
+    BOOST_CHECK(pblocktree->WriteMasternodePayments(3, hashes[3], vPrimary));
+
+    const CBlockIndex* pindexPaid = nullptr;
+    BOOST_CHECK(pblocktree->ReadLastMasternodePayment(payee, true, pindexTip, pindexPaid));
+    BOOST_CHECK(pindexPaid == &blocks[3]);
+    BOOST_CHECK(pblocktree->ReadLastMasternodePayment(payee, false, pindexTip, pindexPaid));
+    BOOST_CHECK(pindexPaid == &blocks[2]);
+    // payments above the tip are ignored
+    BOOST_CHECK(pblocktree->ReadLastMasternodePayment(payee, true, &blocks[2], pindexPaid));
+    BOOST_CHECK(pindexPaid == &blocks[1]);
+    // and so are payments of blocks that are not in the chain
+    BOOST_CHECK(pblocktree->ReadLastMasternodePayment(payee, true, pindexFork, pindexPaid));
+    BOOST_CHECK(pindexPaid == &blocks[1]);
+    BOOST_CHECK(!pblocktree->ReadLastMasternodePayment(GetScriptForDestination(CScriptID(CScript() << OP_FALSE)), true, pindexTip, pindexPaid));
+
+    BOOST_CHECK(pblocktree->EraseMasternodePayments(3, vPrimary));
+    BOOST_CHECK(pblocktree->ReadLastMasternodePayment(payee, true, pindexTip, pindexPaid));
+    BOOST_CHECK(pindexPaid == &blocks[1]);
+    BOOST_CHECK(pblocktree->EraseMasternodePayments(1, vPrimary));
+    BOOST_CHECK(!pblocktree->ReadLastMasternodePayment(payee, true, pindexTip, pindexPaid));
+    BOOST_CHECK(pblocktree->EraseMasternodePayments(2, vSecondary));
+}
+
+/** Records what the queue applies instead of processing it */
+class CRecordingMessageQueue : public CMasternodeMessageQueue
+{
+public:
+    using CMasternodeMessageQueue::MAX_APPLY_PER_CALL;
+    using CMasternodeMessageQueue::MAX_QUEUED_APPLY;
+    using CMasternodeMessageQueue::MAX_QUEUED_BYTES_PER_PEER;
+
+    std::vector<std::pair<NodeId, std::string> > vecApplied;
+
+protected:
+    void Apply(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, CConnman& connman) override
+    {
+        vecApplied.emplace_back(pfrom->GetId(), vRecv.str());
+    }
+};
+
+BOOST_AUTO_TEST_CASE(verify_hash_uses_recovered_keys)
+{
+    CKey key, keyOther;
+    key.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+    uint256 hash = InsecureRand256();
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(CHashSigner::SignHash(hash, key, vchSig));
+
+    std::string strError;
+    std::vector<CRecoveredKey> vKeys;
+    vKeys.emplace_back(hash, vchSig);
+    vKeys.back().Recover();
+    BOOST_CHECK(vKeys.back().fRecovered);
+    BOOST_CHECK(vKeys.back().pubkey == key.GetPubKey());
+    {
+        CRecoveredKeyScope scope(vKeys);
+        BOOST_CHECK(CHashSigner::VerifyHash(hash, key.GetPubKey(), vchSig, strError));
+        BOOST_CHECK(!CHashSigner::VerifyHash(hash, keyOther.GetPubKey(), vchSig, strError));
+
+        // the recovered key is trusted, so a wrong one shows it's really used
+        vKeys.back().pubkey = keyOther.GetPubKey();
+        BOOST_CHECK(CHashSigner::VerifyHash(hash, keyOther.GetPubKey(), vchSig, strError));
+    }
+    BOOST_CHECK(CRecoveredKeyScope::Find(hash, vchSig) == nullptr);
+    BOOST_CHECK(CHashSigner::VerifyHash(hash, key.GetPubKey(), vchSig, strError));
+}
+
+BOOST_AUTO_TEST_CASE(message_queue_keeps_order_and_caps)
+{
+    CRecordingMessageQueue queue;
+    queue.Start(1, *connman);
+    CAddress addr;
+    CNode node1(1, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", true);
+    CNode node2(2, NODE_NETWORK, 0, INVALID_SOCKET, addr, 1, 1, CAddress(), "", true);
+
+    // a signed ping waits for the worker, the messages behind it wait for the ping
+    CKey key;
+    key.MakeNewKey(true);
+    CMasternodePing mnp;
+    mnp.masternodeOutpoint = COutPoint(InsecureRand256(), 0);
+    mnp.sigTime = GetAdjustedTime();
+    BOOST_CHECK(CHashSigner::SignHash(mnp.GetSignatureHash(), key, mnp.vchSig));
+    std::vector<std::pair<NodeId, std::string> > vecPushed;
+    CDataStream ssPing(SER_NETWORK, PROTOCOL_VERSION);
+    ssPing << mnp;
+    vecPushed.emplace_back(node1.GetId(), ssPing.str());
+    BOOST_CHECK(queue.Push(&node1, NetMsgType::MNPING, ssPing));
+    // the same ping again is dropped
+    BOOST_CHECK(queue.Push(&node2, NetMsgType::MNPING, ssPing));
+    for (int i = 0; i < 150; i++) {
+        CNode& node = i % 2 ? node1 : node2;
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << i;
+        vecPushed.emplace_back(node.GetId(), ss.str());
+        BOOST_CHECK(queue.Push(&node, NetMsgType::DSEG, ss));
+    }
+    BOOST_CHECK_EQUAL(queue.size(), vecPushed.size());
+
+    for (int i = 0; i < 10000 && queue.size() > 0; i++) {
+        size_t nApplied = queue.vecApplied.size();
+        queue.ApplyVerified(*connman);
+        BOOST_CHECK(queue.vecApplied.size() - nApplied <= (size_t)CRecordingMessageQueue::MAX_APPLY_PER_CALL);
+        MilliSleep(1);
+    }
+    BOOST_CHECK(queue.vecApplied == vecPushed);
+
+    // one peer fills its share, the others still have room
+    BOOST_CHECK(CMasternodeMessageQueue::IsQueuedCommand(NetMsgType::DSEG));
+    BOOST_CHECK(!CMasternodeMessageQueue::IsQueuedCommand(NetMsgType::BLOCK));
+    BOOST_CHECK(queue.HasRoom(&node1));
+    std::vector<char> vchLarge(100000);
+    while (queue.HasRoom(&node1)) {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << vchLarge;
+        BOOST_CHECK(queue.Push(&node1, NetMsgType::DSEG, ss));
+        BOOST_REQUIRE(queue.size() <= CRecordingMessageQueue::MAX_QUEUED_BYTES_PER_PEER / vchLarge.size() + 1);
+    }
+    BOOST_CHECK(queue.HasRoom(&node2));
+    queue.ApplyVerified(*connman);
+    BOOST_CHECK_EQUAL(queue.size(), 0U);
+    BOOST_CHECK(queue.HasRoom(&node1));
+
+    // all peers together
+    for (size_t i = 0; i < CRecordingMessageQueue::MAX_QUEUED_APPLY; i++) {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << (int)i;
+        BOOST_CHECK(queue.Push(i % 2 ? &node1 : &node2, NetMsgType::DSEG, ss));
+    }
+    BOOST_CHECK(!queue.HasRoom(&node1));
+    BOOST_CHECK(!queue.HasRoom(&node2));
+    queue.ApplyVerified(*connman);
+    BOOST_CHECK(queue.HasRoom(&node2));
+
+    // Stop drops the rest and lets go of the nodes
+    queue.Stop();
+    BOOST_CHECK_EQUAL(queue.size(), 0U);
+    BOOST_CHECK_EQUAL(node1.GetRefCount(), 0);
+    BOOST_CHECK_EQUAL(node2.GetRefCount(), 0);
+    // the message handler processes everything itself again
+    BOOST_CHECK(queue.HasRoom(&node1));
+    BOOST_CHECK(!queue.Push(&node1, NetMsgType::DSEG, ssPing));
+}
+
+BOOST_AUTO_TEST_CASE(verify_hash_caches_valid_signatures)
+{
+    CKey key, keyOther;
+    key.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+    uint256 hash = InsecureRand256();
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(key.SignCompact(hash, vchSig));
+
+    uint64_t nHits, nMisses, nHitsPrev, nMissesPrev;
+    std::string strError;
+    CHashSigner::GetCacheStats(nHitsPrev, nMissesPrev);
+    BOOST_CHECK(CHashSigner::VerifyHash(hash, key.GetPubKey(), vchSig, strError));
+    BOOST_CHECK(CHashSigner::VerifyHash(hash, key.GetPubKey(), vchSig, strError));
+    CHashSigner::GetCacheStats(nHits, nMisses);
+    BOOST_CHECK_EQUAL(nHits - nHitsPrev, 1U);
+    BOOST_CHECK_EQUAL(nMisses - nMissesPrev, 1U);
+
+    // failures are never cached
+    BOOST_CHECK(!CHashSigner::VerifyHash(hash, keyOther.GetPubKey(), vchSig, strError));
+    BOOST_CHECK(!CHashSigner::VerifyHash(hash, keyOther.GetPubKey(), vchSig, strError));
+    CHashSigner::GetCacheStats(nHits, nMisses);
+    BOOST_CHECK_EQUAL(nHits - nHitsPrev, 1U);
+    BOOST_CHECK_EQUAL(nMisses - nMissesPrev, 3U);
+}
+
+BOOST_AUTO_TEST_CASE(payment_ring_drops_old_heights)
+{
+    CScript payeeA = CScript() << OP_TRUE;
+    CScript payeeB = CScript() << OP_FALSE;
+    CMasternodePaymentRing ring;
+    ring.Reserve(10);
+
+    CMasternodePaymentVote vote1(COutPoint(InsecureRand256(), 0), 100, payeeA, 1);
+    CMasternodePaymentVote vote2(COutPoint(InsecureRand256(), 0), 100, payeeA, 1);
+    CMasternodePaymentVote vote3(COutPoint(InsecureRand256(), 0), 100, payeeB, 1);
+    BOOST_CHECK(ring.AddVote(vote1.GetHash(), vote1, true));
+    BOOST_CHECK(ring.AddVote(vote2.GetHash(), vote2, true));
+    BOOST_CHECK(ring.AddVote(vote3.GetHash(), vote3, true));
+    BOOST_CHECK_EQUAL(ring.GetBlockCount(), 1);
+    BOOST_CHECK_EQUAL(ring.GetVoteCount(), 3);
+    BOOST_REQUIRE(ring.Find(100) != nullptr);
+    BOOST_CHECK_EQUAL(ring.Find(100)->payees.vecPayees.size(), 2U);
+    BOOST_CHECK(ring.Find(100)->payees.HasPayeeWithVotes(payeeA, 2));
+    BOOST_CHECK(!ring.Find(100)->payees.HasPayeeWithVotes(payeeB, 2));
+    BOOST_CHECK(ring.FindVote(vote3.GetHash()) != nullptr);
+
+    // 110 takes the slot of 100, an older height can't take it back
+    CMasternodePaymentVote voteNew(COutPoint(InsecureRand256(), 0), 110, payeeB, 1);
+    BOOST_CHECK(ring.AddVote(voteNew.GetHash(), voteNew, true));
+    BOOST_CHECK(ring.Find(100) == nullptr);
+    BOOST_CHECK(ring.FindVote(vote1.GetHash()) == nullptr);
+    BOOST_CHECK(!ring.AddVote(vote1.GetHash(), vote1, true));
+    BOOST_CHECK_EQUAL(ring.GetBlockCount(), 1);
+    BOOST_CHECK_EQUAL(ring.GetVoteCount(), 1);
+
+    // growing keeps what is stored, the maps on disk round trip
+    CMasternodePaymentVote voteOld(COutPoint(InsecureRand256(), 0), 105, payeeA, 1);
+    BOOST_CHECK(ring.AddVote(voteOld.GetHash(), voteOld, false));
+    ring.Reserve(25);
+    BOOST_CHECK_EQUAL(ring.GetCapacity(), 25U);
+    std::map<uint256, CMasternodePaymentVote> mapVotes;
+    std::map<int, CMasternodeBlockPayees> mapBlocks;
+    ring.ToMaps(mapVotes, mapBlocks);
+    BOOST_CHECK_EQUAL(mapVotes.size(), 2U);
+    BOOST_CHECK_EQUAL(mapBlocks.size(), 1U);
+    CMasternodePaymentRing ringLoaded;
+    ringLoaded.Reserve(25);
+    ringLoaded.FromMaps(mapVotes, mapBlocks);
+    BOOST_CHECK_EQUAL(ringLoaded.GetBlockCount(), 1);
+    BOOST_CHECK_EQUAL(ringLoaded.GetVoteCount(), 2);
+    BOOST_REQUIRE(ringLoaded.Find(110) != nullptr);
+    BOOST_CHECK(ringLoaded.Find(110)->payees.HasPayeeWithVotes(payeeB, 1));
+
+    // pruning drops whole heights
+    BOOST_CHECK_EQUAL(ringLoaded.RemoveBelow(106), 1);
+    BOOST_CHECK(ringLoaded.Find(105) == nullptr);
+    BOOST_CHECK_EQUAL(ringLoaded.GetVoteCount(), 1);
+    BOOST_CHECK_EQUAL(ringLoaded.RemoveBelow(111), 1);
+    BOOST_CHECK_EQUAL(ringLoaded.GetBlockCount(), 0);
+    BOOST_CHECK_EQUAL(ringLoaded.GetVoteCount(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(list_digest_skips_known_entries)
+{
+    CMasternode mn1(LookupNumeric("1.2.3.4", 9999), COutPoint(InsecureRand256(), 0), CPubKey(), CPubKey(), PROTOCOL_VERSION);
+    CMasternode mn2(LookupNumeric("1.2.3.5", 9999), COutPoint(InsecureRand256(), 0), CPubKey(), CPubKey(), PROTOCOL_VERSION);
+    // local network entries are never sent
+    CMasternode mnLocal(LookupNumeric("192.168.1.1", 9999), COutPoint(InsecureRand256(), 0), CPubKey(), CPubKey(), PROTOCOL_VERSION);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(mnodeman.Add(mn1));
+        BOOST_CHECK(mnodeman.Add(mn2));
+        BOOST_CHECK(mnodeman.Add(mnLocal));
+    }
+
+    CMasternodeListDigest digest;
+    mnodeman.GetListDigest(digest);
+    BOOST_CHECK_EQUAL(digest.vecShortIds.size(), 3U);
+
+    std::vector<CMasternodeBroadcast> vecMnb;
+    mnodeman.GetListDiff(digest, vecMnb);
+    BOOST_CHECK(vecMnb.empty());
+
+    mnodeman.GetListDiff(CMasternodeListDigest(), vecMnb);
+    BOOST_CHECK_EQUAL(vecMnb.size(), 2U);
+
+    // a peer which only has an older ping of mn1 gets it again
+    CMasternodeBroadcast mnbOld(mn1);
+    mnbOld.lastPing.sigTime -= 60;
+    CMasternodeListDigest digestOld;
+    digestOld.nSalt0 = 1;
+    digestOld.nSalt1 = 2;
+    digestOld.vecShortIds.push_back(digestOld.GetShortId(mnbOld));
+    digestOld.vecShortIds.push_back(digestOld.GetShortId(CMasternodeBroadcast(mn2)));
+    mnodeman.GetListDiff(digestOld, vecMnb);
+    BOOST_REQUIRE_EQUAL(vecMnb.size(), 1U);
+    BOOST_CHECK(vecMnb[0].outpoint == mn1.outpoint);
+
+    mnodeman.Clear();
+}
+
+BOOST_AUTO_TEST_CASE(sync_asset_tracks_peers)
+{
+    const int64_t nNow = 1000000;
+    CMasternodeSyncAsset asset;
+    BOOST_CHECK(!asset.IsStarted());
+    BOOST_CHECK_EQUAL(asset.GetProgress(), 0);
+    asset.nTimeStarted = nNow;
+    BOOST_CHECK(asset.IsRunning());
+
+    CMasternodeSyncPeer& fast = asset.mapPeers[1] = CMasternodeSyncPeer(nNow);
+    CMasternodeSyncPeer& slow = asset.mapPeers[2] = CMasternodeSyncPeer(nNow);
+    BOOST_CHECK_EQUAL(asset.CountActivePeers(nNow), 2);
+
+    // the fast peer keeps sending, the slow one sends nothing
+    fast.nItems = 40;
+    fast.nTimeLastItem = nNow + MASTERNODE_SYNC_STALL_SECONDS;
+    fast.nExpectedItems = 100;
+    slow.nExpectedItems = 90;
+    asset.nItems = 40;
+    int64_t nLater = nNow + MASTERNODE_SYNC_STALL_SECONDS + 1;
+    BOOST_CHECK(fast.IsActive(nLater));
+    BOOST_CHECK(slow.IsStalled(nLater));
+    BOOST_CHECK_EQUAL(asset.CountActivePeers(nLater), 1);
+    BOOST_CHECK(fast.GetThroughput() > slow.GetThroughput());
+
+    BOOST_CHECK_EQUAL(asset.GetExpectedItems(), 100);
+    BOOST_CHECK_CLOSE(asset.GetProgress(), 0.4, 0.001);
+    // a peer that answered and went quiet is done, not stalled
+    slow.fAnswered = true;
+    BOOST_CHECK(!slow.IsStalled(nLater));
+
+    BOOST_CHECK_EQUAL(asset.CountCompletePeers(), 0);
+    fast.fComplete = true;
+    BOOST_CHECK_EQUAL(asset.CountCompletePeers(), 1);
+
+    asset.nTimeFinished = nLater;
+    BOOST_CHECK(asset.IsFinished());
+    BOOST_CHECK_EQUAL(asset.GetProgress(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(list_replies_count_per_asked_peer)
+{
+    masternodeSync.Reset();
+    masternodeSync.SwitchToNextAsset(*connman);
+    masternodeSync.SwitchToNextAsset(*connman);
+    BOOST_CHECK_EQUAL(masternodeSync.GetAssetID(), MASTERNODE_SYNC_LIST);
+
+    CAddress addrAsked(LookupNumeric("1.2.3.4", 9999), NODE_NONE);
+    CAddress addrOther(LookupNumeric("1.2.3.5", 9999), NODE_NONE);
+    CNode nodeAsked(1, ServiceFlags(NODE_NETWORK | NODE_MNLIST), 0, INVALID_SOCKET, addrAsked, 0, 0, CAddress(), "", false);
+    CNode nodeOther(2, ServiceFlags(NODE_NETWORK | NODE_MNLIST), 0, INVALID_SOCKET, addrOther, 1, 1, CAddress(), "", false);
+    nodeAsked.nVersion = PROTOCOL_VERSION;
+    nodeAsked.SetSendVersion(PROTOCOL_VERSION);
+    nodeAsked.fSuccessfullyConnected = true;
+    CConnmanTest::AddNode(nodeAsked);
+
+    // ProcessTick only does something every MASTERNODE_SYNC_TICK_SECONDS calls
+    for (int i = 0; i < MASTERNODE_SYNC_TICK_SECONDS; i++) {
+        masternodeSync.ProcessTick(*connman);
+    }
+    UniValue objList = find_value(masternodeSync.GetAssetsStatus(), CMasternodeSync::GetAssetName(MASTERNODE_SYNC_LIST));
+    const UniValue& arrPeers = find_value(objList, "Peers");
+    BOOST_REQUIRE_EQUAL(arrPeers.size(), 1U);
+    BOOST_CHECK_EQUAL(find_value(arrPeers[0], "Peer").get_int64(), nodeAsked.GetId());
+
+    // complete lists from a peer which wasn't asked for one don't count
+    for (int i = 0; i < MASTERNODE_SYNC_PEERS_PER_ASSET; i++) {
+        masternodeSync.NotifyMasternodeListReceived(&nodeOther);
+    }
+    // and an asked peer counts once, however many complete lists it sends
+    for (int i = 0; i < MASTERNODE_SYNC_PEERS_PER_ASSET; i++) {
+        masternodeSync.NotifyMasternodeListReceived(&nodeAsked);
+    }
+    for (int i = 0; i < MASTERNODE_SYNC_TICK_SECONDS; i++) {
+        masternodeSync.ProcessTick(*connman);
+    }
+    BOOST_CHECK(!masternodeSync.IsMasternodeListSynced());
+
+    CConnmanTest::ClearNodes();
+    masternodeSync.Reset();
+    netfulfilledman.Clear();
+    mnodeman.Clear();
+}
+
+BOOST_AUTO_TEST_CASE(timer_wheel_expires_due_keys)
+{
+    const int64_t nNow = 1000000;
+    SetMockTime(nNow);
+    CTimerWheel<uint256, SaltedTxidHasher, int> wheel;
+    uint256 hashSoon = InsecureRand256();
+    uint256 hashLater = InsecureRand256();
+    uint256 hashFar = InsecureRand256();
+    uint256 hashErased = InsecureRand256();
+    uint256 hashMoved = InsecureRand256();
+    wheel.Set(hashSoon, nNow + 10, 1);
+    wheel.Set(hashLater, nNow + 100, 2);
+    wheel.Set(hashFar, nNow + 300000, 3);
+    wheel.Set(hashErased, nNow + 10, 4);
+    wheel.Set(hashMoved, nNow + 10, 5);
+    BOOST_CHECK(wheel.Erase(hashErased));
+    wheel.Set(hashMoved, nNow + 200, 6);
+    BOOST_CHECK_EQUAL(wheel.size(), 4U);
+    BOOST_CHECK(wheel.HasUnexpired(hashSoon, nNow + 9));
+    BOOST_CHECK(!wheel.HasUnexpired(hashSoon, nNow + 10));
+
+    std::vector<int> vecExpired;
+    auto fnExpired = [&](const uint256&, int& value) { vecExpired.push_back(value); };
+
+    // a key stays until its time has passed
+    wheel.Expire(nNow + 10, fnExpired);
+    BOOST_CHECK(vecExpired.empty());
+    wheel.Expire(nNow + 11, fnExpired);
+    BOOST_CHECK(vecExpired == std::vector<int>({1}));
+    BOOST_CHECK(!wheel.Has(hashSoon));
+
+    wheel.Expire(nNow + 150, fnExpired);
+    BOOST_CHECK(vecExpired == std::vector<int>({1, 2}));
+    BOOST_REQUIRE(wheel.Find(hashMoved));
+    BOOST_CHECK_EQUAL(*wheel.Find(hashMoved), 6);
+    wheel.Expire(nNow + 250, fnExpired);
+    BOOST_CHECK(vecExpired == std::vector<int>({1, 2, 6}));
+
+    // the far key moves down the levels without expiring early, a long jump gets there too
+    wheel.Expire(nNow + 4000, fnExpired);
+    wheel.Expire(nNow + 300000, fnExpired);
+    BOOST_CHECK(wheel.Has(hashFar));
+    wheel.Expire(nNow + 300001, fnExpired);
+    BOOST_CHECK(vecExpired == std::vector<int>({1, 2, 6, 3}));
+    BOOST_CHECK(wheel.empty());
+
+    // stored like a map of keys to times
+    wheel.Set(hashSoon, nNow + 400000, 7);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << wheel;
+    std::map<uint256, int64_t> mapStored;
+    ss >> mapStored;
+    BOOST_CHECK_EQUAL(mapStored.size(), 1U);
+    BOOST_CHECK_EQUAL(mapStored[hashSoon], nNow + 400000);
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(vote_store_keeps_tallies)
+{
+    CGovernanceVoteStore store;
+    COutPoint outpoint1(InsecureRand256(), 0);
+    COutPoint outpoint2(InsecureRand256(), 1);
+    COutPoint outpoint3(InsecureRand256(), 2);
+    store.Set(outpoint1, VOTE_SIGNAL_FUNDING, vote_instance_t(VOTE_OUTCOME_YES, 10, 10));
+    store.Set(outpoint2, VOTE_SIGNAL_FUNDING, vote_instance_t(VOTE_OUTCOME_YES, 20, 20));
+    store.Set(outpoint3, VOTE_SIGNAL_FUNDING, vote_instance_t(VOTE_OUTCOME_NO, 30, 30));
+    store.Set(outpoint3, VOTE_SIGNAL_DELETE, vote_instance_t(VOTE_OUTCOME_ABSTAIN, 30, 30));
+    BOOST_CHECK_EQUAL(store.size(), 3U);
+    BOOST_CHECK_EQUAL(store.Count(VOTE_SIGNAL_FUNDING, VOTE_OUTCOME_YES), 2);
+    BOOST_CHECK_EQUAL(store.Count(VOTE_SIGNAL_FUNDING, VOTE_OUTCOME_NO), 1);
+    BOOST_CHECK_EQUAL(store.Count(VOTE_SIGNAL_DELETE, VOTE_OUTCOME_ABSTAIN), 1);
+    BOOST_CHECK_EQUAL(store.Count(VOTE_SIGNAL_VALID, VOTE_OUTCOME_YES), 0);
+
+    // a new vote replaces the old one in the tallies
+    store.Set(outpoint1, VOTE_SIGNAL_FUNDING, vote_instance_t(VOTE_OUTCOME_NO, 40, 40));
+    BOOST_CHECK_EQUAL(store.Count(VOTE_SIGNAL_FUNDING, VOTE_OUTCOME_YES), 1);
+    BOOST_CHECK_EQUAL(store.Count(VOTE_SIGNAL_FUNDING, VOTE_OUTCOME_NO), 2);
+    BOOST_CHECK_EQUAL(store.Get(outpoint1, VOTE_SIGNAL_FUNDING).nCreationTime, 40);
+    BOOST_CHECK_EQUAL(store.Get(outpoint1, VOTE_SIGNAL_DELETE).eOutcome, VOTE_OUTCOME_NONE);
+
+    // removing a masternode moves the last one into its place
+    store.Remove(outpoint1);
+    BOOST_CHECK(!store.Has(outpoint1));
+    BOOST_CHECK_EQUAL(store.Count(VOTE_SIGNAL_FUNDING, VOTE_OUTCOME_NO), 1);
+    BOOST_CHECK_EQUAL(store.Get(outpoint3, VOTE_SIGNAL_DELETE).eOutcome, VOTE_OUTCOME_ABSTAIN);
+
+    // stored like the map of vote records it replaced
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << store;
+    std::map<COutPoint, vote_rec_t> mapRecords;
+    ss >> mapRecords;
+    BOOST_CHECK_EQUAL(mapRecords.size(), 2U);
+    BOOST_CHECK_EQUAL(mapRecords[outpoint3].mapInstances.size(), 2U);
+    ss << mapRecords;
+    CGovernanceVoteStore storeLoaded;
+    ss >> storeLoaded;
+    BOOST_CHECK_EQUAL(storeLoaded.Count(VOTE_SIGNAL_FUNDING, VOTE_OUTCOME_YES), 1);
+    BOOST_CHECK_EQUAL(storeLoaded.Count(VOTE_SIGNAL_DELETE, VOTE_OUTCOME_ABSTAIN), 1);
+    BOOST_CHECK_EQUAL(storeLoaded.Get(outpoint2, VOTE_SIGNAL_FUNDING).nTime, 20);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,15 +2,58 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <arith_uint256.h>
 #include <chain.h>
 #include <chainparams.h>
+#include <consensus/validation.h>
+#include <crypto/equihash/equihash.h>
 #include <pow.h>
+#include <primitives/block.h>
 #include <random.h>
+#include <streams.h>
 #include <util.h>
+#include <validation.h>
 #include <test/test_genesis.h>
 
 #include <boost/test/unit_test.hpp>
 
+namespace {
+struct RegTestingSetup : public TestingSetup {
+    RegTestingSetup() : TestingSetup(CBaseChainParams::REGTEST) {}
+};
+
+/** Header on top of prev at the lowest difficulty, with a valid Equihash solution */
+CBlockHeader SolveHeader(const uint256& hashPrev, uint32_t nTime, const CChainParams& params)
+{
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.hashPrevBlock = hashPrev;
+    header.nTime = nTime;
+    header.nBits = UintToArith256(params.GetConsensus().powLimit).GetCompact();
+
+    const unsigned int n = params.EquihashN();
+    const unsigned int k = params.EquihashK();
+    blake2b_state eh_state;
+    EhInitialiseState(n, k, eh_state, GetEquihashPersonalization(1, params));
+    CEquihashInput I{header};
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << I;
+    blake2b_update(&eh_state, (unsigned char*)&ss[0], ss.size());
+
+    std::function<bool(std::vector<unsigned char>)> validBlock = [&header, &params](std::vector<unsigned char> soln) {
+        header.nSolution = soln;
+        return CheckProofOfWork(header.GetHash(), header.nBits, params.GetConsensus());
+    };
+    while (true) {
+        header.nNonce = ArithToUint256(UintToArith256(header.nNonce) + 1);
+        blake2b_state curr_state = eh_state;
+        blake2b_update(&curr_state, header.nNonce.begin(), header.nNonce.size());
+        if (EhBasicSolveUncancellable(n, k, curr_state, validBlock))
+            return header;
+    }
+}
+} // namespace
+
 BOOST_FIXTURE_TEST_SUITE(pow_tests, BasicTestingSetup)
 
 /* Test calculation of next difficulty target with no constraints applying */
@@ -83,4 +126,104 @@ BOOST_AUTO_TEST_CASE(GetBlockProofEquivalentTime_test)
     }
 }
 
+
+BOOST_AUTO_TEST_CASE(equihash_personalization_switch)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    BOOST_CHECK_EQUAL(GetEquihashPersonalization(0, *chainParams), EQUIHASH_PERSONALIZATION_LEGACY);
+    BOOST_CHECK_EQUAL(GetEquihashPersonalization(29999, *chainParams), EQUIHASH_PERSONALIZATION_LEGACY);
+    BOOST_CHECK_EQUAL(GetEquihashPersonalization(30000, *chainParams), EQUIHASH_PERSONALIZATION_GENX);
+}
+
+BOOST_AUTO_TEST_CASE(equihash_cache_rejects_invalid_solution)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    CBlockHeader header;
+    header.nBits = 0x207fffff;
+    header.nSolution.assign(400, 0x5a);
+    const uint256 hash = header.GetHash();
+    // Failures are never cached, so a second attempt must fail as well.
+    BOOST_CHECK(!CheckBlockEquihashSolution(&header, hash, *chainParams));
+    BOOST_CHECK(!CheckBlockEquihashSolution(&header, hash, *chainParams));
+}
+
+/* Checking a batch of headers on the header check threads must leave the
+ * valid solutions cached, and must not let an invalid one through.
+ */
+BOOST_FIXTURE_TEST_CASE(header_batch_check_warms_cache_and_rejects_invalid, RegTestingSetup)
+{
+    const CChainParams& params = Params();
+    const uint256 hashGenesis = params.GetConsensus().hashGenesisBlock;
+    const uint32_t nTime = params.GenesisBlock().nTime;
+
+    const CBlockHeader header1 = SolveHeader(hashGenesis, nTime + 60, params);
+    const CBlockHeader header2 = SolveHeader(header1.GetHash(), nTime + 120, params);
+    BOOST_CHECK(!IsEquihashSolutionCached(header1.GetHash()));
+    BOOST_CHECK(!IsEquihashSolutionCached(header2.GetHash()));
+    BOOST_CHECK(CheckBlockHeadersParallel({header1, header2}, params));
+    BOOST_CHECK(IsEquihashSolutionCached(header1.GetHash()));
+    BOOST_CHECK(IsEquihashSolutionCached(header2.GetHash()));
+
+    CBlockHeader headerBad = SolveHeader(hashGenesis, nTime + 180, params);
+    headerBad.nSolution[headerBad.nSolution.size() / 2] ^= 0x01;
+    const CBlockHeader headerNext = SolveHeader(headerBad.GetHash(), nTime + 240, params);
+    BOOST_CHECK(!CheckBlockHeadersParallel({headerBad, headerNext}, params));
+    BOOST_CHECK(!IsEquihashSolutionCached(headerBad.GetHash()));
+
+    CValidationState state;
+    CBlockHeader first_invalid;
+    BOOST_CHECK(!ProcessNewBlockHeaders({headerBad, headerNext}, state, params, nullptr, &first_invalid));
+    BOOST_CHECK(first_invalid.GetHash() == headerBad.GetHash());
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "invalid-solution");
+    BOOST_CHECK(!IsEquihashSolutionCached(headerBad.GetHash()));
+}
+
+/* The cached LWMA prefix sums must give exactly the same target as the
+ * original loop over the averaging window, at every height of a chain with
+ * erratic (including negative) solvetimes.
+ */
+BOOST_AUTO_TEST_CASE(lwma_incremental_matches_window_loop)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = chainParams->GetConsensus();
+    const int64_t T = params.nPowTargetSpacing;
+    const int nBlocks = 3000;
+
+    std::vector<CBlockIndex> blocks(nBlocks);
+    for (int i = 0; i < nBlocks; i++) {
+        CBlockIndex* pindex = &blocks[i];
+        pindex->pprev = i ? &blocks[i - 1] : nullptr;
+        pindex->nHeight = i;
+        pindex->BuildSkip();
+        if (i == 0) {
+            pindex->nTime = 1269211443;
+        } else if (InsecureRandRange(50) == 0) {
+            pindex->nTime = blocks[i - 1].nTime + 20 * T; // long gap
+        } else {
+            pindex->nTime = blocks[i - 1].nTime + InsecureRandRange(10 * T) - 3 * T;
+        }
+
+        if (i <= params.nZawyLwmaAveragingWindow + 1) {
+            pindex->nBits = UintToArith256(params.powLimit).GetCompact();
+        } else {
+            // Compute the next target both ways from the cached sums of the previous block.
+            const CBlockIndex* pindexLast = &blocks[i - 1];
+            BOOST_REQUIRE(pindexLast->fHaveLwmaSums);
+            unsigned int nIncremental = LwmaCalculateNextWorkRequired(pindexLast, params);
+            blocks[i - 1].fHaveLwmaSums = false;
+            unsigned int nLoop = LwmaCalculateNextWorkRequired(pindexLast, params);
+            blocks[i - 1].fHaveLwmaSums = true;
+            BOOST_CHECK_EQUAL(nIncremental, nLoop);
+            pindex->nBits = InsecureRandRange(20) ? nIncremental : (InsecureRand32() % 0x1000000) | 0x1d000000;
+        }
+        LwmaUpdateAccumulators(pindex, params);
+    }
+
+    // Without a cached predecessor no sums are produced, and the loop is used.
+    CBlockIndex orphan;
+    orphan.nHeight = nBlocks;
+    LwmaUpdateAccumulators(&orphan, params);
+    BOOST_CHECK(!orphan.fHaveLwmaSums);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
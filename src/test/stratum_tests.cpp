@@ -0,0 +1,95 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <stratum.h>
+
+#include <crypto/common.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <test/test_genesis.h>
+#include <univalue.h>
+#include <utilstrencodings.h>
+#include <version.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(stratum_tests, BasicTestingSetup)
+
+static CBlockHeader MakeHeader()
+{
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.hashPrevBlock = uint256S("00000000000000000000000000000000000000000000000000000000000000ff");
+    header.hashMerkleRoot = uint256S("0102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f20");
+    header.nTime = 0x5c000001;
+    header.nBits = 0x1f07ffff;
+    return header;
+}
+
+static UniValue MakeSubmit(const std::string& strTime, const std::string& strNonce2, const std::vector<unsigned char>& vchSolution)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << vchSolution;
+    UniValue params(UniValue::VARR);
+    params.push_back("worker");
+    params.push_back("1");
+    params.push_back(strTime);
+    params.push_back(strNonce2);
+    params.push_back(HexStr(ss.begin(), ss.end()));
+    return params;
+}
+
+BOOST_AUTO_TEST_CASE(notify_encodes_header_fields)
+{
+    const CBlockHeader header = MakeHeader();
+    const UniValue params = StratumNotifyParams("7", header, true);
+    BOOST_REQUIRE_EQUAL(params.size(), 8U);
+    BOOST_CHECK_EQUAL(params[0].get_str(), "7");
+    BOOST_CHECK_EQUAL(params[1].get_str(), "04000000");
+    BOOST_CHECK_EQUAL(params[2].get_str(), "ff00000000000000000000000000000000000000000000000000000000000000");
+    BOOST_CHECK_EQUAL(params[3].get_str(), HexStr(header.hashMerkleRoot.begin(), header.hashMerkleRoot.end()));
+    BOOST_CHECK_EQUAL(params[4].get_str(), std::string(64, '0'));
+    BOOST_CHECK_EQUAL(params[5].get_str(), "0100005c");
+    BOOST_CHECK_EQUAL(params[6].get_str(), "ffff071f");
+    BOOST_CHECK(params[7].get_bool());
+}
+
+BOOST_AUTO_TEST_CASE(submit_reconstructs_header)
+{
+    // The miner's header: the job plus its own time, nonce and solution
+    CBlockHeader expected = MakeHeader();
+    expected.nTime += 30;
+    for (size_t i = 0; i < expected.nNonce.size(); i++) {
+        *(expected.nNonce.begin() + i) = i;
+    }
+    expected.nSolution.assign(400, 0x5a);
+
+    const std::vector<unsigned char> vchNonce1(expected.nNonce.begin(), expected.nNonce.begin() + 4);
+    const std::string strNonce2 = HexStr(expected.nNonce.begin() + 4, expected.nNonce.end());
+    unsigned char time[4];
+    WriteLE32(time, expected.nTime);
+
+    CBlockHeader header = MakeHeader();
+    std::string strError;
+    BOOST_CHECK(StratumApplySubmit(header, vchNonce1, MakeSubmit(HexStr(time, time + 4), strNonce2, expected.nSolution), strError));
+    BOOST_CHECK(header.GetHash() == expected.GetHash());
+
+    // Malformed submissions leave the job header alone
+    const uint256 hashJob = MakeHeader().GetHash();
+    header = MakeHeader();
+    BOOST_CHECK(!StratumApplySubmit(header, vchNonce1, MakeSubmit("0100", strNonce2, expected.nSolution), strError));
+    BOOST_CHECK(!StratumApplySubmit(header, vchNonce1, MakeSubmit(HexStr(time, time + 4), strNonce2 + "00", expected.nSolution), strError));
+    BOOST_CHECK(!StratumApplySubmit(header, vchNonce1, MakeSubmit(HexStr(time, time + 4), "zz" + strNonce2.substr(2), expected.nSolution), strError));
+    UniValue params = MakeSubmit(HexStr(time, time + 4), strNonce2, expected.nSolution);
+    params.setArray();
+    BOOST_CHECK(!StratumApplySubmit(header, vchNonce1, params, strError));
+    params = MakeSubmit(HexStr(time, time + 4), strNonce2, expected.nSolution);
+    UniValue trailing(UniValue::VARR);
+    for (size_t i = 0; i < 4; i++) trailing.push_back(params[i]);
+    trailing.push_back(params[4].get_str() + "00");
+    BOOST_CHECK(!StratumApplySubmit(header, vchNonce1, trailing, strError));
+    BOOST_CHECK(header.GetHash() == hashJob);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
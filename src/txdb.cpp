@@ -16,6 +16,9 @@
 
 #include <stdint.h>
 
+#include <exception>
+#include <thread>
+
 #include <boost/thread.hpp>
 
 static const char DB_COIN = 'C';
@@ -23,6 +26,7 @@ static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_BLOCK_INDEX = 'b';
+static const char DB_MASTERNODE_PAYMENT = 'm';
 
 static const char DB_BEST_BLOCK = 'B';
 static const char DB_HEAD_BLOCKS = 'H';
@@ -52,6 +56,32 @@ struct CoinEntry {
     }
 };
 
+/** Key of a payment to a masternode. The height is stored inverted and big endian, so
+ *  that the latest payment to a payee sorts first. */
+struct MasternodePaymentEntry {
+    char key;
+    char type;
+    CScript* payee;
+    uint32_t nHeight;
+    MasternodePaymentEntry(const CScript* ptr, bool fPrimary, int nHeightIn) : key(DB_MASTERNODE_PAYMENT), type(fPrimary ? 'p' : 's'), payee(const_cast<CScript*>(ptr)), nHeight(nHeightIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        s << key;
+        s << type;
+        s << *payee;
+        ser_writedata32be(s, ~nHeight);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        s >> key;
+        s >> type;
+        s >> *payee;
+        nHeight = ~ser_readdata32be(s);
+    }
+};
+
 }
 
 CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
@@ -236,6 +266,14 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     return WriteBatch(batch, true);
 }
 
+bool CBlockTreeDB::ReadBlockSolution(const uint256 &hash, std::vector<unsigned char> &solution) {
+    CDiskBlockIndex diskindex;
+    if (!Read(std::make_pair(DB_BLOCK_INDEX, hash), diskindex))
+        return false;
+    solution.swap(diskindex.nSolution);
+    return true;
+}
+
 bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
     return Read(std::make_pair(DB_TXINDEX, txid), pos);
 }
@@ -247,6 +285,49 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::WriteMasternodePayments(int nHeight, const uint256 &hashBlock, const std::vector<std::pair<CScript, bool> > &vPayees) {
+    CDBBatch batch(*this);
+    for (const auto& payee : vPayees)
+        batch.Write(MasternodePaymentEntry(&payee.first, payee.second, nHeight), hashBlock);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseMasternodePayments(int nHeight, const std::vector<std::pair<CScript, bool> > &vPayees) {
+    CDBBatch batch(*this);
+    for (const auto& payee : vPayees)
+        batch.Erase(MasternodePaymentEntry(&payee.first, payee.second, nHeight));
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadLastMasternodePayment(const CScript &payee, bool fPrimary, const CBlockIndex *pindexTip, const CBlockIndex *&pindexRet) {
+    if (!pindexTip) return false;
+
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(MasternodePaymentEntry(&payee, fPrimary, pindexTip->nHeight));
+
+    // Entries of blocks that were disconnected without cleaning up (e.g. when replaying
+    // blocks at startup) are skipped by checking the hash against the chain.
+    CScript keyPayee;
+    MasternodePaymentEntry entry(&keyPayee, fPrimary, 0);
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        if (!pcursor->GetKey(entry) || entry.key != DB_MASTERNODE_PAYMENT || entry.type != (fPrimary ? 'p' : 's') || keyPayee != payee) {
+            break;
+        }
+        uint256 hashBlock;
+        if (!pcursor->GetValue(hashBlock)) {
+            return error("%s: failed to read masternode payment", __func__);
+        }
+        const CBlockIndex* pindex = pindexTip->GetAncestor(entry.nHeight);
+        if (pindex && pindex->GetBlockHash() == hashBlock) {
+            pindexRet = pindex;
+            return true;
+        }
+        pcursor->Next();
+    }
+    return false;
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -259,47 +340,105 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+bool CBlockTreeDB::LoadBlockIndexRange(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, std::mutex& cs_insert, std::atomic<bool>& fAbort, unsigned int nBegin, unsigned int nEnd, bool fTrustHashes)
 {
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
-    pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
+    uint256 hashStart;
+    *hashStart.begin() = nBegin;
+    pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, hashStart));
 
-    // Load mapBlockIndex
+    // Load this range of mapBlockIndex
     while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
+        // The workers are not boost threads, so interruption_point() would not see an interrupt.
+        if (fAbort || ShutdownRequested())
+            return false;
         std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->hashReserved   = diskindex.hashReserved;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nSolution      = diskindex.nSolution;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-
-                if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, consensusParams))
-                    return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
-
-                pcursor->Next();
-            } else {
-                return error("%s: failed to read value", __func__);
-            }
-        } else {
+        if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX || *key.second.begin() >= nEnd)
             break;
+
+        CDiskBlockIndex diskindex;
+        if (!pcursor->GetValue(diskindex))
+            return error("%s: failed to read value", __func__);
+
+        // The key is the header hash; recomputing it covers the full header
+        // including its solution and dominates the cost of loading.
+        if (!fTrustHashes && diskindex.GetBlockHash() != key.second)
+            return error("%s: header hash mismatch: %s", __func__, diskindex.ToString());
+        if (!CheckProofOfWork(key.second, diskindex.nBits, consensusParams))
+            return error("%s: CheckProofOfWork failed: %s", __func__, diskindex.ToString());
+
+        // Construct block index object
+        CBlockIndex* pindexNew;
+        {
+            std::lock_guard<std::mutex> lock(cs_insert);
+            pindexNew                 = insertBlockIndex(key.second);
+            pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
         }
+        pindexNew->nHeight        = diskindex.nHeight;
+        pindexNew->nFile          = diskindex.nFile;
+        pindexNew->nDataPos       = diskindex.nDataPos;
+        pindexNew->nUndoPos       = diskindex.nUndoPos;
+        pindexNew->nVersion       = diskindex.nVersion;
+        pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+        pindexNew->hashReserved   = diskindex.hashReserved;
+        pindexNew->nTime          = diskindex.nTime;
+        pindexNew->nBits          = diskindex.nBits;
+        pindexNew->nNonce         = diskindex.nNonce;
+        pindexNew->nStatus        = diskindex.nStatus;
+        pindexNew->nTx            = diskindex.nTx;
+
+        // The solution is only needed to serve headers; leave it on disk.
+        pindexNew->TrimSolution();
+
+        pcursor->Next();
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+{
+    const bool fTrustHashes = gArgs.GetBoolArg("-trustblockindexhashes", DEFAULT_TRUST_BLOCK_INDEX_HASHES);
+    const int nThreads = std::max(1, std::min(GetNumCores(), MAX_BLOCK_INDEX_LOAD_THREADS));
+
+    // Header hashes are uniformly distributed, so splitting the key space on
+    // the first byte of the hash gives every thread a similar share. Each
+    // thread only writes to the entries it owns; mapBlockIndex itself is
+    // guarded by cs_insert.
+    std::mutex cs_insert;
+    std::atomic<bool> fAbort(false);
+    std::vector<std::thread> threads;
+    std::vector<char> vResult(nThreads, false);
+    std::vector<std::exception_ptr> vException(nThreads);
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back([&, i]() {
+            try {
+                vResult[i] = LoadBlockIndexRange(consensusParams, insertBlockIndex, cs_insert, fAbort, 256 * i / nThreads, 256 * (i + 1) / nThreads, fTrustHashes);
+                if (!vResult[i])
+                    fAbort = true;
+            } catch (...) {
+                vException[i] = std::current_exception();
+                fAbort = true;
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    boost::this_thread::interruption_point();
+    if (ShutdownRequested()) {
+        LogPrintG(BCLogLevel::LOG_INFO, BCLog::DB, "[BlockTreeDB] Loading the block index was interrupted\n");
+        return false;
+    }
+
+    for (int i = 0; i < nThreads; i++) {
+        if (vException[i])
+            std::rethrow_exception(vException[i]);
+        if (!vResult[i])
+            return false;
     }
+    LogPrintG(BCLogLevel::LOG_INFO, BCLog::DB, "[BlockTreeDB] Loaded block index with %d threads%s\n", nThreads, fTrustHashes ? " (header hashes trusted)" : "");
 
     return true;
 }
@@ -10,8 +10,10 @@
 #include <dbwrapper.h>
 #include <chain.h>
 
+#include <atomic>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <utility>
 #include <vector>
@@ -26,6 +28,10 @@ static constexpr int MAX_BLOCK_COINSDB_USAGE = 10;
 static const int64_t nDefaultDbCache = 450;
 //! -dbbatchsize default (bytes)
 static const int64_t nDefaultDbBatchSize = 16 << 20;
+//! -trustblockindexhashes default
+static const bool DEFAULT_TRUST_BLOCK_INDEX_HASHES = false;
+//! Max threads used to load the block index at startup
+static const int MAX_BLOCK_INDEX_LOAD_THREADS = 8;
 //! max. -dbcache (MiB)
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache (MiB)
@@ -118,13 +124,24 @@ public:
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &info);
     bool ReadLastBlockFile(int &nFile);
+    bool ReadBlockSolution(const uint256 &hash, std::vector<unsigned char> &solution);
     bool WriteReindexing(bool fReindexing);
     bool ReadReindexing(bool &fReindexing);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &vect);
+    /** Record the masternode payees (payee script, primary or not) in the coinbase of the block at nHeight */
+    bool WriteMasternodePayments(int nHeight, const uint256 &hashBlock, const std::vector<std::pair<CScript, bool> > &vPayees);
+    bool EraseMasternodePayments(int nHeight, const std::vector<std::pair<CScript, bool> > &vPayees);
+    /** Find the most recent block in the chain ending at pindexTip that paid payee */
+    bool ReadLastMasternodePayment(const CScript &payee, bool fPrimary, const CBlockIndex *pindexTip, const CBlockIndex *&pindexRet);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+
+private:
+    //! Load the entries whose hash starts with a byte in [nBegin, nEnd). Gives up when
+    //! another range set fAbort or a shutdown is requested.
+    bool LoadBlockIndexRange(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, std::mutex& cs_insert, std::atomic<bool>& fAbort, unsigned int nBegin, unsigned int nEnd, bool fTrustHashes);
 };
 
 #endif // GENESIS_TXDB_H
@@ -283,6 +283,7 @@ const CLogCategoryDesc LogCategories[] =
     {BCLog::LEVELDB, "leveldb"},
     {BCLog::MN, "masternode"},
     {BCLog::GOV, "governance"},
+    {BCLog::STRATUM, "stratum"},
     {BCLog::BLOCKVALID, "blockvalidation"},
     {BCLog::POW, "pow"},
     {BCLog::ALL, "1"},
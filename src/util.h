@@ -131,6 +131,7 @@ namespace BCLog {
         LEVELDB     = (1 << 20),
         MN          = (1 << 21),
         GOV         = (1 << 22),
+        STRATUM     = (1 << 23),
         BLOCKVALID  = (1 << 29),
         POW         = (1 << 30),
         ALL         = ~(uint32_t)0,
@@ -1840,6 +1840,66 @@ static bool WriteTxIndexDataForBlock(const CBlock& block, CValidationState& stat
     return true;
 }
 
+/** The coinbase outputs that pay masternodes: the primary payee at output 6, followed by the secondaries */
+static void GetMasternodePaymentsForBlock(const CBlock& block, int nHeight, std::vector<std::pair<CScript, bool> >& vPayees)
+{
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    if (nHeight < consensusParams.nMasternodePaymentsStartBlock || block.vtx.empty()) return;
+
+    const int primaryMnPaymentPosition = 6;
+    const std::vector<CTxOut>& vout = block.vtx[0]->vout;
+    const size_t nEnd = std::min(vout.size(), (size_t)(primaryMnPaymentPosition + consensusParams.nMasternodeMaturitySecondariesMaxCount + 1));
+    for (size_t i = primaryMnPaymentPosition; i < nEnd; i++) {
+        vPayees.emplace_back(vout[i].scriptPubKey, i == primaryMnPaymentPosition);
+    }
+}
+
+static bool WriteMasternodePaymentIndexDataForBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex)
+{
+    std::vector<std::pair<CScript, bool> > vPayees;
+    GetMasternodePaymentsForBlock(block, pindex->nHeight, vPayees);
+    if (vPayees.empty()) return true;
+
+    if (!pblocktree->WriteMasternodePayments(pindex->nHeight, pindex->GetBlockHash(), vPayees)) {
+        return AbortNode(state, "Failed to write masternode payment index");
+    }
+
+    return true;
+}
+
+bool BuildMasternodePaymentIndex(const CChainParams& chainparams)
+{
+    bool fBuilt = false;
+    if (pblocktree->ReadFlag("mnpaymentindex", fBuilt) && fBuilt) return true;
+
+    // Datadirs from before the index existed: read the payments of the active chain once
+    std::vector<const CBlockIndex*> vBlocks;
+    {
+        LOCK(cs_main);
+        for (const CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->nHeight >= chainparams.GetConsensus().nMasternodePaymentsStartBlock; pindex = pindex->pprev) {
+            vBlocks.push_back(pindex);
+        }
+    }
+
+    LogPrintf("Building masternode payment index from %u blocks...\n", vBlocks.size());
+    for (const CBlockIndex* pindex : vBlocks) {
+        if (ShutdownRequested()) return false;
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA)) continue;
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus())) {
+            return error("%s: ReadBlockFromDisk() failed at %d, hash=%s", __func__, pindex->nHeight, pindex->GetBlockHash().ToString());
+        }
+        std::vector<std::pair<CScript, bool> > vPayees;
+        GetMasternodePaymentsForBlock(block, pindex->nHeight, vPayees);
+        if (!vPayees.empty() && !pblocktree->WriteMasternodePayments(pindex->nHeight, pindex->GetBlockHash(), vPayees)) {
+            return error("%s: failed to write masternode payment index", __func__);
+        }
+    }
+
+    return pblocktree->WriteFlag("mnpaymentindex", true);
+}
+
 static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
 
 void ThreadScriptCheck() {
@@ -2194,6 +2254,9 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     if (!WriteTxIndexDataForBlock(block, state, pindex))
         return false;
 
+    if (!WriteMasternodePaymentIndexDataForBlock(block, state, pindex))
+        return false;
+
     assert(pindex->phashBlock);
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -2283,15 +2346,16 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
                     vFiles.push_back(std::make_pair(*it, &vinfoBlockFile[*it]));
                     setDirtyFileInfo.erase(it++);
                 }
-                std::vector<const CBlockIndex*> vBlocks;
-                vBlocks.reserve(setDirtyBlockIndex.size());
-                for (std::set<CBlockIndex*>::iterator it = setDirtyBlockIndex.begin(); it != setDirtyBlockIndex.end(); ) {
-                    vBlocks.push_back(*it);
-                    setDirtyBlockIndex.erase(it++);
-                }
+                std::vector<CBlockIndex*> vDirty(setDirtyBlockIndex.begin(), setDirtyBlockIndex.end());
+                setDirtyBlockIndex.clear();
+                std::vector<const CBlockIndex*> vBlocks(vDirty.begin(), vDirty.end());
                 if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
                     return AbortNode(state, "Failed to write to block index database");
                 }
+                // Solutions are now on disk and are read back when a header is served.
+                for (CBlockIndex* pindex : vDirty) {
+                    pindex->TrimSolution();
+                }
             }
             // Finally remove any pruned files
             if (fFlushForPrune)
@@ -2436,6 +2500,13 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
     if (!FlushStateToDisk(chainparams, state, FLUSH_STATE_IF_NEEDED))
         return false;
 
+    {
+        std::vector<std::pair<CScript, bool> > vPayees;
+        GetMasternodePaymentsForBlock(block, pindexDelete->nHeight, vPayees);
+        if (!vPayees.empty() && !pblocktree->EraseMasternodePayments(pindexDelete->nHeight, vPayees))
+            return AbortNode(state, "Failed to erase masternode payment index");
+    }
+
     if (disconnectpool) {
         // Save transactions to re-add to mempool at end of reorg
         for (auto it = block.vtx.rbegin(); it != block.vtx.rend(); ++it) {
@@ -3033,6 +3104,7 @@ CBlockIndex* CChainState::AddToBlockIndex(const CBlockHeader& block)
     }
     pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
+    LwmaUpdateAccumulators(pindexNew, Params().GetConsensus());
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
     if (pindexBestHeader == nullptr || pindexBestHeader->nChainWork < pindexNew->nChainWork)
         pindexBestHeader = pindexNew;
@@ -3181,32 +3253,21 @@ static bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos,
 
 static bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true)
 {
+    if (!fCheckPOW)
+        return true;
+
+    const uint256 hash = block.GetHash();
+
     // Check Equihash solution is valid
-    if (fCheckPOW)
+    if (!CheckBlockEquihashSolution(&block, hash, Params()) && hash != Params().GetConsensus().hashGenesisBlock)
     {
-        if (CheckEquihashSolution(&block, Params(), "GENX_PoW"))
-        {
-            // LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::BLOCKVALID, "[BlockValidation] CheckBlockHeader(): Found solution using GENX_PoW at height: %d\n", block.nHeight);
-        }
-        //else if (IsInitialBlockDownload() && CheckEquihashSolution(&block, Params(), "SafeCash"))
-        else if (CheckEquihashSolution(&block, Params(), "SafeCash"))
-        {
-            // LogPrintG(BCLogLevel::LOG_INFO, BCLog::BLOCKVALID, "[BlockValidation] CheckBlockHeader(): Found solution using SafeCash at height: %d\n", block.nHeight);
-        }
-        else if (block.GetHash() == Params().GetConsensus().hashGenesisBlock)
-        {
-            // LogPrintG(BCLogLevel::LOG_NOTICE, BCLog::BLOCKVALID, "[BlockValidation] Skipping genesis block\n");
-        }
-        else
-        {
-            // Nothing worked... bugger.
-            LogPrintG(BCLogLevel::LOG_ERROR, BCLog::BLOCKVALID, "[BlockValidation] CheckBlockHeader(): Equihash solution invalid at height %d\n", block.nHeight);
-            return state.DoS(100, error("CheckBlockHeader(): Equihash solution invalid"),
-                    REJECT_INVALID, "invalid-solution");
-        }
+        // Nothing worked... bugger.
+        LogPrintG(BCLogLevel::LOG_ERROR, BCLog::BLOCKVALID, "[BlockValidation] CheckBlockHeader(): Equihash solution invalid for block %s\n", hash.ToString());
+        return state.DoS(100, error("CheckBlockHeader(): Equihash solution invalid"),
+                REJECT_INVALID, "invalid-solution");
     }
     // Check proof of work matches claimed amount
-    if (fCheckPOW && !CheckProofOfWork(block.GetHash(), block.nBits, consensusParams))
+    if (!CheckProofOfWork(hash, block.nBits, consensusParams))
         return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
 
     return true;
@@ -3715,10 +3776,59 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
     return true;
 }
 
+bool CHeaderCheck::operator()() {
+    const uint256 hash = pheader->GetHash();
+    return CheckBlockEquihashSolution(pheader, hash, *pparams) &&
+           CheckProofOfWork(hash, pheader->nBits, pparams->GetConsensus());
+}
+
+static CCheckQueue<CHeaderCheck> headercheckqueue(16);
+
+void ThreadHeaderCheck() {
+    RenameThread("genesis-headerch");
+    headercheckqueue.Thread();
+}
+
+/**
+ * Verify the proof of work of a batch of headers on the header check threads
+ * before they are accepted one by one under cs_main. Headers we already know
+ * are skipped. The result only warms the Equihash cache: an invalid header is
+ * still rejected (and its peer punished) by the sequential AcceptBlockHeader.
+ */
+bool CheckBlockHeadersParallel(const std::vector<CBlockHeader>& headers, const CChainParams& chainparams)
+{
+    if (headers.size() < 2 || !nScriptCheckThreads)
+        return true;
+
+    std::vector<CHeaderCheck> vChecks;
+    {
+        LOCK(cs_main);
+        // Nothing to gain if the batch does not connect; AcceptBlockHeader bails out on the first header.
+        if (!mapBlockIndex.count(headers[0].hashPrevBlock))
+            return true;
+        vChecks.reserve(headers.size());
+        for (const CBlockHeader& header : headers) {
+            if (!mapBlockIndex.count(header.GetHash()))
+                vChecks.emplace_back(header, chainparams);
+        }
+    }
+    if (vChecks.size() < 2)
+        return true;
+
+    CCheckQueueControl<CHeaderCheck> control(&headercheckqueue);
+    control.Add(vChecks);
+    if (!control.Wait()) {
+        LogPrintG(BCLogLevel::LOG_INFO, BCLog::BLOCKVALID, "[BlockValidation] %s: batch of %u headers contains an invalid proof of work\n", __func__, headers.size());
+        return false;
+    }
+    return true;
+}
+
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, CBlockHeader *first_invalid)
 {
     if (first_invalid != nullptr) first_invalid->SetNull();
+    CheckBlockHeadersParallel(headers, chainparams);
     {
         LOCK(cs_main);
         for (const CBlockHeader& header : headers) {
@@ -4140,6 +4250,7 @@ bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlo
         CBlockIndex* pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
         pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
+        LwmaUpdateAccumulators(pindex, consensus_params);
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
         if (pindex->nTx > 0) {
@@ -4611,6 +4722,8 @@ bool LoadBlockIndex(const CChainParams& chainparams)
         // Use the provided setting for -txindex in the new database
         fTxIndex = gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX);
         pblocktree->WriteFlag("txindex", fTxIndex);
+        // The masternode payment index is filled in as blocks are connected
+        pblocktree->WriteFlag("mnpaymentindex", true);
     }
     return true;
 }
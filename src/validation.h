@@ -257,6 +257,13 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
  */
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& block, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex=nullptr, CBlockHeader *first_invalid=nullptr);
 
+/**
+ * Verify the proof of work of a batch of new headers on the header check threads,
+ * which warms the Equihash cache for ProcessNewBlockHeaders. Returns false if one
+ * of the checked headers failed. Call without cs_main held.
+ */
+bool CheckBlockHeadersParallel(const std::vector<CBlockHeader>& headers, const CChainParams& chainparams);
+
 /** Check whether enough disk space is available for an incoming block */
 bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
 /** Open a block file (blk?????.dat) */
@@ -276,6 +283,8 @@ bool LoadChainTip(const CChainParams& chainparams);
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the header proof-of-work checking thread */
+void ThreadHeaderCheck();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
@@ -403,6 +412,31 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure representing the proof-of-work verification of one header.
+ * Note that this stores a reference to the header, which must outlive it.
+ * A successful check leaves the solution in the Equihash cache, so the
+ * sequential AcceptBlockHeader pass does not verify it again.
+ */
+class CHeaderCheck
+{
+private:
+    const CBlockHeader *pheader;
+    const CChainParams *pparams;
+
+public:
+    CHeaderCheck(): pheader(nullptr), pparams(nullptr) {}
+    CHeaderCheck(const CBlockHeader& headerIn, const CChainParams& paramsIn) :
+        pheader(&headerIn), pparams(&paramsIn) { }
+
+    bool operator()();
+
+    void swap(CHeaderCheck &check) {
+        std::swap(pheader, check.pheader);
+        std::swap(pparams, check.pparams);
+    }
+};
+
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
 
@@ -422,6 +456,9 @@ bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams,
 /** Check whether witness commitments are required for block. */
 bool IsWitnessEnabled(const CBlockIndex* pindexPrev, const Consensus::Params& params);
 
+/** Fill the masternode payment index from the active chain, unless it is already complete */
+bool BuildMasternodePaymentIndex(const CChainParams& chainparams);
+
 /** When there are blocks in the active chain with missing data, rewind the chainstate and remove them from the block index */
 bool RewindBlockIndex(const CChainParams& params);
 